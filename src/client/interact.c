@@ -96,6 +96,8 @@ const char *get_pkd_ftype_name(pick_ftype pk_fltype)
  *  p_flpkd    - a pointer to the `picked_file` structure containing the initial
  *               directory path and file selection type (source/target).
  *  pf_flselect - a function pointer to the file selection function (local or remote).
+ *  pf_search  - a function pointer to the file search function, called for the input '?pattern';
+ *               NULL if the search isn't available.
  *  hostname   - a string representing the hostname where the file selection is taking place.
  *  path_res   - an allocated character array to store the full path of the selected file.
  *
@@ -145,7 +147,8 @@ const char *get_pkd_ftype_name(pick_ftype pk_fltype)
  * fs_opers.c:select_file()
  */
 char *get_filename_inter(const picked_file *p_flpkd, T_pf_select pf_flselect, 
-                         const char *hostname, char *path_res)
+                         T_pf_search pf_search, T_pf_more pf_more, const char *hostname,
+                         char *path_res)
 {
   LOG(LOG_TYPE_INTR, LOG_LEVEL_DEBUG, "Begin. Request to get %s filename on %s", 
       get_pkd_ftype_name(p_flpkd->pftype), hostname);
@@ -157,6 +160,7 @@ char *get_filename_inter(const picked_file *p_flpkd, T_pf_select pf_flselect,
   int nwrt_fname; // number of characters written to the current path in each iteration
   picked_file flpkd_curr = *p_flpkd; // current picked file object that will be sent to a selection function
   file_err *p_flerr; // pointer to the file & error info struct
+  int rc; // the result of the user input
 
   // Initialization
   // Init the previous path with a root dir as a guaranteed valid path on Unix-like OS
@@ -209,12 +213,21 @@ char *get_filename_inter(const picked_file *p_flpkd, T_pf_select pf_flselect,
     // Print the full (absolute) path and content of the current directory
     printf("\n%s:\n%s\n", p_flerr->file.name, p_flerr->file.cont.t_flcont_val);
 
-    // Print the prompt for user input
-    printf("Select the %s file on %s:\n", get_pkd_ftype_name(flpkd_curr.pftype), hostname);
+    // Print the prompt for user input & get user input of filename,
+    // the next pages of the listing are shown on the input '+'
+    do {
+      printf("Select the %s file on %s%s:\n", get_pkd_ftype_name(flpkd_curr.pftype), hostname,
+             pf_search ? " (type '?text' to search the file names)" : "");
+      rc = input_filename(fname_inp);
+    } while (rc == 0 && pf_more != NULL && strcmp(fname_inp, "+") == 0 && (*pf_more)() == 0);
+    if (rc != 0)
+      continue;
 
-    // Get user input of filename
-    if (input_filename(fname_inp) != 0)
+    // Search the files, the chosen path is processed as the inputted absolute one
+    if (*fname_inp == '?' && pf_search != NULL && (*pf_search)(fname_inp + 1, fname_inp) != 0) {
+      xdr_free((xdrproc_t)xdr_file_err, p_flerr); // the current directory is listed again
       continue;
+    }
 
     // Before changing the current path, save it as the previous valid path
     copy_path(path_curr, path_prev);
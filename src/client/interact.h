@@ -15,6 +15,14 @@ const char *get_pkd_ftype_name(pick_ftype pk_fltype);
 // The function pointer type for the file selection functions
 typedef file_err * (*T_pf_select)(picked_file *);
 
+// The function pointer type for the file search functions: search the files by the pattern
+// and let the user choose one; return 0 and the chosen path, or 1 if nothing is chosen
+typedef int (*T_pf_search)(const char *pattern, char *path_res);
+
+// The function pointer type for the functions showing the next page of the listing: return 0
+// if the page or the end of the listing is shown, 1 on failure
+typedef int (*T_pf_more)(void);
+
 /* Get the filename interactively by traversing directories.
  *
  * This function allows a user to interactively select a file by navigating through directories.
@@ -25,6 +33,10 @@ typedef file_err * (*T_pf_select)(picked_file *);
  *  p_flpkd    - a pointer to the `picked_file` structure containing the initial
  *               directory path and file selection type (source/target).
  *  pf_flselect - a function pointer to the file selection function (local or remote).
+ *  pf_search  - a function pointer to the file search function, called for the input '?pattern';
+ *               NULL if the search isn't available.
+ *  pf_more    - a function pointer to show the next page of the listed directory, called for
+ *               the input '+'; NULL if the listing isn't paginated.
  *  hostname   - a string representing the hostname where the file selection is taking place.
  *  path_res   - an allocated character array to store the full path of the selected file.
  *
@@ -39,6 +51,7 @@ typedef file_err * (*T_pf_select)(picked_file *);
  * 5. Handles errors in file selection.
  */
 char *get_filename_inter(const picked_file *p_flpkd, T_pf_select pf_flselect,
-                         const char *hostname, char *path_res);
+                         T_pf_search pf_search, T_pf_more pf_more, const char *hostname,
+                         char *path_res);
 
 #endif
\ No newline at end of file
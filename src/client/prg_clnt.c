@@ -3,8 +3,17 @@
  * Errors range: 1-5 (reserve 6-10)
  */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h> 
+#include <time.h>
 #include <errno.h>
+#include <netdb.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <pwd.h>
+#include <grp.h>
+#include <zlib.h>
 #include "../common/mem_opers.h"  /* for the memory manipulations */
 #include "../common/fs_opers.h"   /* for working with the File System */
 #include "../common/file_opers.h" /* for the files manipulations */
@@ -30,8 +39,18 @@ enum Action {
   , act_download   = (1 << 3)
   , act_interact   = (1 << 4)
   , act_invalid    = (1 << 5)
+  , act_usage      = (1 << 6)
 };
 
+// The size of the file chunk transferred by one RPC
+enum { SIZE_CHUNK = 1048576 };
+
+// The max number of retries of the chunk request rejected by the busy server
+enum { NUMB_BUSY_RETRIES = 30 };
+
+// The max number of repeats of the directory usage request answered with the partial usage
+enum { NUMB_USAGE_REPEATS = 100 };
+
 // The supported types of help info
 enum Help_types { hlp_short, hlp_full };
 
@@ -52,7 +71,8 @@ static void print_help(const char *this_prg_name, enum Help_types help_type)
   fprintf(stderr, "Usage:\n"
     "%s [-u | -d] [server] [file_src] [file_targ]\n"
     "%s [-u | -d] [server] -i\n"
-    "%s [-h]\n\n", this_prg_name, this_prg_name, this_prg_name); 
+    "%s -s [server] [dir]\n"
+    "%s [-h]\n\n", this_prg_name, this_prg_name, this_prg_name, this_prg_name); 
 
   // Print a part of the full help info
   if (help_type == hlp_full)
@@ -60,10 +80,15 @@ static void print_help(const char *this_prg_name, enum Help_types help_type)
       "Options:\n"
       "-u         action: upload a file to the remote server\n"
       "-d         action: download a file from the remote server\n"
-      "server     a remote server hostname\n"
+      "server     a remote server hostname, or 'hostname:port' to connect to the server\n"
+      "           running on the fixed port without querying rpcbind; an IPv6 address is given\n"
+      "           as is, or as '[address]:port' with the port\n"
       "file_src   a source file name on a client (if upload action) or server (if download action) side\n"
       "file_targ  a target file name on a server (if upload action) or client (if download action) side\n"
       "-i         action: use interactive mode to choose the source and target files\n"
+      "           (type '?text' there to search the remote file names containing 'text')\n"
+      "-s         action: print the disk usage of the directory subtree on the remote server\n"
+      "dir        a directory name on the server (if disk usage action)\n"
       "-h         action: print this help\n"
       "\nExamples:\n"
       "1. Upload the local file /tmp/file to server 'serva' and save it remotely as /tmp/file_upld:\n"
@@ -73,8 +98,12 @@ static void print_help(const char *this_prg_name, enum Help_types help_type)
       "3. Choose the local and remote files in interactive mode and make an Upload to server 'servc':\n"
       "%s -u servc -i\n\n"
       "4. Choose the local and remote files in interactive mode and make an Download from server 'servd':\n"
-      "%s -d servd -i\n"
-      , this_prg_name, this_prg_name, this_prg_name, this_prg_name);
+      "%s -d servd -i\n\n"
+      "5. Download the remote file /tmp/file from server 'serve' listening on the fixed port 20048:\n"
+      "%s -d serve:20048 /tmp/file /tmp/file_down\n\n"
+      "6. Print the size of the remote directory /var/log and number of its files on server 'servf':\n"
+      "%s -s servf /var/log\n"
+      , this_prg_name, this_prg_name, this_prg_name, this_prg_name, this_prg_name, this_prg_name);
     else
       fprintf(stderr, "To see the extended help info use '-h' option.\n");
 }
@@ -95,6 +124,18 @@ static enum Action process_args(int argc, char *argv[])
   if (argc == 2 && strcmp(argv[1], "-h") == 0)
     action = act_help_full;
 
+  // Process the disk usage action arguments
+  if (argc == 4 && strcmp(argv[1], "-s") == 0) {
+    rmt_host = argv[2]; // set the remote host name
+    filename_src = argv[3]; // set the directory name
+    if (filename_src[0] != '/') {
+      fprintf(stderr, "!--Error 6: an invalid directory name has passed for the disk usage.\n"
+        "Please specify the full path for the directory on the remote host.\n\n");
+      return act_invalid;
+    }
+    return act_usage;
+  }
+
   // Process the RPC action arguments
   if ((argc == 4 || argc == 5) && argv[1][0] == '-') {
     switch (argv[1][1]) {
@@ -149,13 +190,73 @@ static enum Action process_args(int argc, char *argv[])
   return action;
 }
 
+/*
+ * Create client "handle" used for calling FLTRPROG directly on the fixed port
+ * without querying rpcbind on the server.
+ * The addresses of the server (IPv4 or IPv6) are tried in turn.
+ * Return NULL if the server name cannot be resolved or connection fails.
+ */
+static CLIENT * create_client_port(const char *hostname, const char *port)
+{
+  struct addrinfo hints, *res, *p_ai;
+  struct netbuf addr;
+  CLIENT *pcl = NULL;
+  int sock;
+
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(hostname, port, &hints, &res) != 0) {
+    fprintf(stderr, "!--Error 7: Cannot resolve the server address: %s\n", rmt_host);
+    return NULL;
+  }
+
+  // The unconnected socket is connected by clnt_vc_create() to the address, without rpcbind
+  for (p_ai = res; p_ai && pcl == NULL; p_ai = p_ai->ai_next) {
+    if ( (sock = socket(p_ai->ai_family, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1 )
+      continue;
+    addr.buf = p_ai->ai_addr;
+    addr.len = addr.maxlen = p_ai->ai_addrlen;
+    if ( (pcl = clnt_vc_create(sock, &addr, FLTRPROG, FLTRVERS, 0, 0)) != NULL )
+      (void)clnt_control(pcl, CLSET_FD_CLOSE, NULL); // the socket is closed by clnt_destroy()
+    else
+      close(sock);
+  }
+  freeaddrinfo(res);
+  return pcl;
+}
+
 /*
  * Create client "handle" used for calling FLTRPROG 
  * on the server designated on the command line.
+ * The server can be specified as 'server:port' or '[address]:port' to connect directly
+ * to the fixed port; the IPv6 address without the port may be given without the brackets.
  */
 static CLIENT * create_client()
 {
-  pclient = clnt_create(rmt_host, FLTRPROG, FLTRVERS, "tcp");
+  char hostname[NI_MAXHOST];
+  const char *p_port = strrchr(rmt_host, ':');
+  const char *p_end = rmt_host[0] == '[' ? strchr(rmt_host, ']') : NULL;
+
+  if (rmt_host[0] == '[' && (p_end == NULL || (p_end[1] != '\0' && p_end[1] != ':'))) {
+    fprintf(stderr, "!--Error 7: Invalid server address, expected '[address]:port': %s\n", rmt_host);
+    exit(2);
+  }
+  if (p_end) { // the IPv6 address in the brackets, the port may follow them
+    snprintf(hostname, sizeof(hostname), "%.*s", (int)(p_end - rmt_host - 1), rmt_host + 1);
+    p_port = p_end[1] == ':' ? p_end + 1 : NULL;
+  }
+  else if (p_port && p_port == strchr(rmt_host, ':')) // the port follows the only colon
+    snprintf(hostname, sizeof(hostname), "%.*s", (int)(p_port - rmt_host), rmt_host);
+  else { // no port, the colons are of the IPv6 address
+    snprintf(hostname, sizeof(hostname), "%s", rmt_host);
+    p_port = NULL;
+  }
+
+  if (p_port)
+    pclient = create_client_port(hostname, p_port + 1);
+  else
+    pclient = clnt_create(hostname, FLTRPROG, FLTRVERS, strchr(hostname, ':') ? "tcp6" : "tcp");
   if (pclient == (CLIENT *)NULL) {
     // Print an error indication why a client handle could not be created.
     // Used when clnt_create() call fails.
@@ -173,116 +274,343 @@ static void process_file_error(err_inf *p_errinf)
   xdr_free((xdrproc_t)xdr_err_inf, p_errinf);
 }
 
-// Upload the File through RPC
-static void file_upload()
+// Abort the transfer: print the RPC failure or the server error, delete the client object and die.
+// p_err_srv - A pointer to the error info returned from the server, NULL if the RPC failed.
+static void abort_transfer(err_inf *p_err_srv)
 {
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: initiate File Upload - local source file:\n  %s", filename_src);
-  file_inf fileinf; // file info object
-  err_inf *p_err_srv = NULL; // result from a server - error info
-
-  // Init the file name & type
-  fileinf.name = fileinf.cont.t_flcont_val = NULL; // init for stable memory allocation
-  if ( reset_file_name_type(&fileinf) != 0 )
-    exit(3);
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "file name & type was init'ed");
-
-  // Set the target file name to the file object
-  strncpy(fileinf.name, filename_trg, LEN_PATH_MAX);
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "target filename was set to:\n  %s", fileinf.name);
-
-  // Get (read) the file content and save it into the file object for transfering
-  if ( read_file_cont(filename_src, &fileinf.cont, &p_err_srv) != 0 ) {
-    LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Error reading the local file:\n  %s", filename_src);
-    process_file_error(p_err_srv);
-    xdr_free((xdrproc_t)xdr_file_inf, &fileinf);
-    exit(4);
-  }
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "file contents was read, before RPC");
-
-  // Make a file upload to a server through RPC
-  p_err_srv = upload_file_1(&fileinf, pclient);
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "RPC operation DONE");
-
-  // Print an error message indicating why an RPC failed.
-  // Used after clnt_call(), that is called here by upload_file_1().
+  int errnum = 5;
   if (p_err_srv == (err_inf *)NULL) {
     LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "RPC failed - NULL returned");
     clnt_perror(pclient, rmt_host);
-    clnt_destroy(pclient);                       // delete the client object
-    xdr_free((xdrproc_t)xdr_file_inf, &fileinf); // free the local file info
-    exit(5);
   }
-
-  // Check an error that may occur on the server
-  if (p_err_srv->num != 0) {
+  else {
     // Error on a server has occurred. Print error message and die.
     LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Server error occurred:\n%s", p_err_srv->err_inf_u.msg);
-    fprintf(stderr, "!--Server error %d: %s\n", 
+    fprintf(stderr, "!--Server error %d: %s\n",
             p_err_srv->num, p_err_srv->err_inf_u.msg);
-    clnt_destroy(pclient);                       // delete the client object
-    xdr_free((xdrproc_t)xdr_file_inf, &fileinf); // free the local file info
+    errnum = p_err_srv->num;
     xdr_free((xdrproc_t)xdr_err_inf, p_err_srv); // free the error info returned from server
-    exit(p_err_srv->num);
   }
+  clnt_destroy(pclient); // delete the client object
+  exit(errnum);
+}
 
-  // Okay, we successfully called the remote procedure.
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "RPC was successful");
+// Wait before the retry of the chunk request rejected by the busy server.
+// Return 1 if the request should be retried, 0 if the error is not ERRNUM_BUSY or
+// the retries are exhausted.
+static int wait_busy_server(const err_inf *p_err_srv, int *p_numb_retries)
+{
+  const char *p_after;
+  int retry_after = 1000; // milliseconds, if the server didn't specify it
+
+  if (p_err_srv == NULL || p_err_srv->num != ERRNUM_BUSY || ++*p_numb_retries > NUMB_BUSY_RETRIES)
+    return 0;
+  if ( (p_after = strstr(p_err_srv->err_inf_u.msg, "retry after ")) != NULL )
+    (void)sscanf(p_after, "retry after %d", &retry_after);
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "server is busy, retry after %d ms", retry_after);
+  usleep(retry_after * 1000);
+  return 1;
+}
+
+// Upload the File through RPC.
+// The file is read & transferred by chunks of SIZE_CHUNK bytes, so neither the Client nor
+// the Server hold the whole file in memory, and the Server can interleave the chunks
+// of different clients fairly.
+static void file_upload()
+{
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: initiate File Upload - local source file:\n  %s", filename_src);
+  chunk_inf chunkinf;         // the uploaded chunk of file
+  err_inf *p_err_srv = NULL;  // result from a server - error info
+  err_inf *p_err_loc = NULL;  // error info of the local file operations
+  FILE *hfile;                // the local file handler
+  struct stat statbuf;        // the local file status
+  int last = 0;               // the end of file flag
+  int numb_retries = 0;       // number of retries of the rejected chunk
 
-  // Free the memory
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG,
-    "before memory freeing: &fileinf=%p, p_err_srv=%p", &fileinf, p_err_srv);
-  xdr_free((xdrproc_t)xdr_file_inf, &fileinf); // free the local file info
-  xdr_free((xdrproc_t)xdr_err_inf, p_err_srv); // free the error info returned from server
+  // Set the target file name to the chunk object
+  memset(&chunkinf, 0, sizeof(chunkinf));
+  chunkinf.name = filename_trg;
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "target filename was set to:\n  %s", chunkinf.name);
+
+  if ( (hfile = open_file(filename_src, "rb", &p_err_loc)) == NULL ) {
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Error opening the local file:\n  %s", filename_src);
+    process_file_error(p_err_loc);
+    exit(4);
+  }
+  // The file size is declared to the server to check its free space by the first chunk
+  if (fstat(fileno(hfile), &statbuf) == 0)
+    chunkinf.size = (uint64_t)statbuf.st_size;
+
+  do {
+    // Get (read) the next chunk of the file, the file is closed on failure
+    if ( read_file_chunk(filename_src, hfile, chunkinf.chunk.offs, SIZE_CHUNK,
+                         &chunkinf.chunk.cont, &last, &p_err_loc) != 0 ) {
+      LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Error reading the local file:\n  %s", filename_src);
+      process_file_error(p_err_loc);
+      free_file_cont(&chunkinf.chunk.cont);
+      exit(4);
+    }
+    chunkinf.chunk.last = last;
+
+    // Make a chunk upload to a server through RPC, retry it while the server is busy
+    while ( (p_err_srv = upload_chunk_1(&chunkinf, pclient)) != NULL &&
+            wait_busy_server(p_err_srv, &numb_retries) )
+      xdr_free((xdrproc_t)xdr_err_inf, p_err_srv);
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "RPC operation DONE, offset %lu", chunkinf.chunk.offs);
+    if (p_err_srv == (err_inf *)NULL || p_err_srv->num != 0) {
+      fclose(hfile);
+      free_file_cont(&chunkinf.chunk.cont);
+      abort_transfer(p_err_srv);
+    }
+
+    chunkinf.chunk.offs += chunkinf.chunk.cont.t_flcont_len;
+    numb_retries = 0;
+    free_file_cont(&chunkinf.chunk.cont);
+    xdr_free((xdrproc_t)xdr_err_inf, p_err_srv); // free the error info returned from server
+  } while (!last);
+
+  // Okay, we successfully called the remote procedures.
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "RPC was successful, uploaded %lu bytes", chunkinf.chunk.offs);
+  if ( close_file(filename_src, hfile, &p_err_loc) != 0 ) {
+    process_file_error(p_err_loc);
+    exit(4);
+  }
   LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Done.");
 }
 
-// Download the File through RPC
-static void file_download()
+// Discard the partially downloaded local file
+static void discard_download(FILE *hfile)
 {
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: initiate File Download - remote source file:\n  %s", filename_src);
+  if (hfile == NULL)
+    return;
+  fclose(hfile);
+  remove(filename_trg);
+}
 
-  // Perform a file download from a server through RPC and return the downloaded
-  // file info & error info object (error info is filled in if an error occurs)
-  file_err *p_flerr_srv = download_file_1((char **)&filename_src, pclient);
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "RPC operation DONE");
+// The path prefix of the files stored compressed on the server, it's requested once per session:
+// NULL - not requested yet, "" - there's none or the server doesn't support the blocks
+static char *zip_prefix_srv = NULL;
 
-  // Print an error message indicating why an RPC failed.
-  // Used after clnt_call(), that is called here by download_file_1().
-  if (p_flerr_srv == (file_err *)NULL) {
-    LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "RPC failed - NULL returned");
-    clnt_perror(pclient, rmt_host);
-    clnt_destroy(pclient); // delete the client object
-    exit(5);
+// Check whether the file can be stored compressed on the server, so it's to be downloaded by blocks.
+// Return 1 if it's under the zip prefix advertised by the server, 0 otherwise.
+static int is_zip_stored(const char *name)
+{
+  t_flname *p_prefix;
+  size_t len;
+
+  if (zip_prefix_srv == NULL) {
+    if ( (p_prefix = zip_prefix_1(NULL, pclient)) == NULL || (zip_prefix_srv = strdup(*p_prefix)) == NULL )
+      zip_prefix_srv = "";
+    if (p_prefix)
+      xdr_free((xdrproc_t)xdr_t_flname, (char *)p_prefix);
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "The prefix of the compressed files: '%s'", zip_prefix_srv);
   }
+  len = strlen(zip_prefix_srv);
+  return len > 0 && strncmp(name, zip_prefix_srv, len) == 0 && name[len] == '/';
+}
 
-  // Check an error that may occur on the server
-  if (p_flerr_srv->err.num != 0) {
-    // Error on a server has occurred. Print error message and die.
-    LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Server error occurred:\n  %s", p_flerr_srv->err.err_inf_u.msg);
-    fprintf(stderr, "!--Server error %d: %s\n", 
-            p_flerr_srv->err.num, p_flerr_srv->err.err_inf_u.msg);
-    clnt_destroy(pclient); // delete the client object
-    xdr_free((xdrproc_t)xdr_file_err, p_flerr_srv); // free file & error info returned from server
-    exit(p_flerr_srv->err.num);
+// Download the File stored compressed on the server through RPC.
+// The blocks are requested by SIZE_CHUNK bytes of the uncompressed content & received as they
+// are stored, the client decompresses them. The local file is created only after the first
+// blocks are successfully received.
+// Return 0 if the file is downloaded, 1 if the server stores it as is or doesn't support
+// the blocks, so it's to be downloaded by chunks.
+static int file_download_blocks()
+{
+  chunk_req chunkreq = { filename_src, 0, SIZE_CHUNK }; // the requested blocks of file
+  block_err *p_blerr_srv;     // result from a server - blocks & error info
+  err_inf *p_err_loc = NULL;  // error info of the local file operations
+  struct rpc_err rpcerr;      // the RPC failure
+  zip_block *p_blk;           // the received block
+  t_flcont flcont = { 0, NULL }; // the decompressed block
+  t_flcont out;               //   & its decompressed content
+  const t_flcont *p_out;      // the saved block
+  uLongf len;                 // the length of the decompressed block
+  FILE *hfile = NULL;         // the local file handler
+  int last;                   // the end of file flag
+  int numb_retries = 0;       // number of retries of the rejected request
+  u_int i;
+
+  do {
+    // Perform a blocks download from a server through RPC, retry it while the server is busy
+    while ( (p_blerr_srv = download_blocks_1(&chunkreq, pclient)) != NULL &&
+            wait_busy_server(&p_blerr_srv->err, &numb_retries) )
+      xdr_free((xdrproc_t)xdr_block_err, p_blerr_srv);
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "RPC operation DONE, offset %lu", chunkreq.offs);
+
+    // The file stored as is & the server without the blocks are known by the first request
+    if (hfile == NULL && p_blerr_srv == NULL) {
+      clnt_geterr(pclient, &rpcerr);
+      if (rpcerr.re_status == RPC_PROCUNAVAIL)
+        return 1;
+    }
+    if (hfile == NULL && p_blerr_srv != NULL && p_blerr_srv->err.num == ERRNUM_PLAIN) {
+      xdr_free((xdrproc_t)xdr_block_err, p_blerr_srv);
+      return 1;
+    }
+    if (p_blerr_srv == (block_err *)NULL || p_blerr_srv->err.num != 0) {
+      discard_download(hfile);
+      free(flcont.t_flcont_val);
+      abort_transfer(p_blerr_srv ? &p_blerr_srv->err : NULL);
+    }
+    if (p_blerr_srv->blks.offs != chunkreq.offs ||
+        (p_blerr_srv->blks.blocks.blocks_len == 0 && !p_blerr_srv->blks.last)) {
+      fprintf(stderr, "!--Error 6: Unexpected blocks at offset %lu of the file: %s\n",
+              chunkreq.offs, filename_src);
+      discard_download(hfile);
+      exit(6);
+    }
+    if (hfile == NULL && (hfile = open_file(filename_trg, "wbx", &p_err_loc)) == NULL) {
+      process_file_error(p_err_loc);
+      exit(6);
+    }
+
+    // Decompress the blocks, the ones stored as is are saved at once
+    for (i = 0; i < p_blerr_srv->blks.blocks.blocks_len; ++i) {
+      p_blk = &p_blerr_srv->blks.blocks.blocks_val[i];
+      p_out = &p_blk->cont;
+      if (p_blk->cont.t_flcont_len != p_blk->size) {
+        if (flcont.t_flcont_len < p_blk->size &&
+            (flcont.t_flcont_val = realloc(flcont.t_flcont_val, p_blk->size)) == NULL) {
+          fprintf(stderr, "!--Error 6: Failed to allocate memory for the block of the file: %s\n", filename_src);
+          discard_download(hfile);
+          exit(6);
+        }
+        if (flcont.t_flcont_len < p_blk->size)
+          flcont.t_flcont_len = p_blk->size;
+        len = p_blk->size;
+        if (uncompress((Bytef *)flcont.t_flcont_val, &len, (const Bytef *)p_blk->cont.t_flcont_val,
+                       p_blk->cont.t_flcont_len) != Z_OK || len != p_blk->size) {
+          fprintf(stderr, "!--Error 6: Failed to decompress the block at offset %lu of the file: %s\n",
+                  chunkreq.offs, filename_src);
+          discard_download(hfile);
+          exit(6);
+        }
+        out.t_flcont_len = p_blk->size;
+        out.t_flcont_val = flcont.t_flcont_val;
+        p_out = &out;
+      }
+      // Save (write) the block to the local file
+      if ( write_file(filename_trg, p_out, hfile, &p_err_loc) != 0 ) {
+        LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Error saving the file:\n  %s", filename_trg);
+        remove(filename_trg); // the file was closed by write_file()
+        process_file_error(p_err_loc);
+        exit(6);
+      }
+      chunkreq.offs += p_blk->size;
+    }
+    numb_retries = 0;
+    last = p_blerr_srv->blks.last;
+    xdr_free((xdrproc_t)xdr_block_err, p_blerr_srv); // free blocks & error info returned from server
+  } while (!last);
+
+  free(flcont.t_flcont_val);
+  if ( close_file(filename_trg, hfile, &p_err_loc) != 0 ) {
+    process_file_error(p_err_loc);
+    exit(6);
   }
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "file contents (%lu bytes) was saved to:\n  %s",
+      chunkreq.offs, filename_trg);
+  return 0;
+}
 
-  // Okay, we successfully called the remote procedure.
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "RPC was successful, downloaded remote file:\n  %s", p_flerr_srv->file.name);
-  
-  // Save (write) the remote file content to a local file
-  err_inf *p_err_tmp = NULL; // a nulled pointer to an error info structure
-  if ( save_file_cont(filename_trg, &p_flerr_srv->file.cont, &p_err_tmp) != 0 ) {
-    LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Error saving the file:\n  %s", filename_trg);
-    process_file_error(p_err_tmp);
-    xdr_free((xdrproc_t)xdr_file_err, p_flerr_srv);
+// Download the File through RPC.
+// The file under the zip prefix of the server is downloaded by its blocks. The others are
+// requested & saved by chunks of SIZE_CHUNK bytes, the local file is created only after
+// the first chunk is successfully received.
+static void file_download()
+{
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: initiate File Download - remote source file:\n  %s", filename_src);
+  chunk_req chunkreq = { filename_src, 0, SIZE_CHUNK }; // the requested chunk of file
+  chunk_err *p_cherr_srv;     // result from a server - chunk & error info
+  err_inf *p_err_loc = NULL;  // error info of the local file operations
+  FILE *hfile = NULL;         // the local file handler
+  int last;                   // the end of file flag
+  int numb_retries = 0;       // number of retries of the rejected chunk
+
+  if (is_zip_stored(filename_src) && file_download_blocks() == 0) {
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Done.");
+    return;
+  }
+  do {
+    // Perform a chunk download from a server through RPC, retry it while the server is busy
+    while ( (p_cherr_srv = download_chunk_1(&chunkreq, pclient)) != NULL &&
+            wait_busy_server(&p_cherr_srv->err, &numb_retries) )
+      xdr_free((xdrproc_t)xdr_chunk_err, p_cherr_srv);
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "RPC operation DONE, offset %lu", chunkreq.offs);
+    if (p_cherr_srv == (chunk_err *)NULL || p_cherr_srv->err.num != 0) {
+      discard_download(hfile);
+      if (p_cherr_srv)
+        free_file_cont(&p_cherr_srv->chunk.cont);
+      abort_transfer(p_cherr_srv ? &p_cherr_srv->err : NULL);
+    }
+
+    // Save (write) the chunk content to a new local file
+    if ( (hfile == NULL && (hfile = open_file(filename_trg, "wbx", &p_err_loc)) == NULL) ||
+         write_file(filename_trg, &p_cherr_srv->chunk.cont, hfile, &p_err_loc) != 0 ) {
+      LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Error saving the file:\n  %s", filename_trg);
+      if (hfile)
+        remove(filename_trg); // the file was closed by write_file()
+      process_file_error(p_err_loc);
+      xdr_free((xdrproc_t)xdr_chunk_err, p_cherr_srv);
+      exit(6);
+    }
+
+    chunkreq.offs += p_cherr_srv->chunk.cont.t_flcont_len;
+    numb_retries = 0;
+    last = p_cherr_srv->chunk.last;
+    xdr_free((xdrproc_t)xdr_chunk_err, p_cherr_srv); // free chunk & error info returned from server
+  } while (!last);
+
+  if ( close_file(filename_trg, hfile, &p_err_loc) != 0 ) {
+    process_file_error(p_err_loc);
     exit(6);
   }
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "file contents was saved to:\n  %s", filename_trg);
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_INFO, "file contents (%lu bytes) was saved to:\n  %s",
+      chunkreq.offs, filename_trg);
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Done.");
+}
 
-  // Free the file & error info returned from server
-  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, 
-    "before memory freeing: file_err=%p, file=%p, err=%p", p_flerr_srv, &p_flerr_srv->file, &p_flerr_srv->err);
-  xdr_free((xdrproc_t)xdr_file_err, p_flerr_srv);
+/*
+ * The Directory Usage section
+ */
+// Get the disk usage of the remote directory subtree through the RPC and print it.
+// The partial usage (the time limit was reached on the server) is requested again,
+// the server continues faster using the directories scanned before.
+static void dir_usage_rmt()
+{
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: get the disk usage of %s", filename_src);
+  usage_err *p_userr;
+  int numb_repeats = 0;
+
+  while (1) {
+    if ( (p_userr = dir_usage_1(&filename_src, pclient)) == NULL ) {
+      LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "RPC failed - NULL returned");
+      clnt_perror(pclient, rmt_host);
+      clnt_destroy(pclient); // delete the client object
+      exit(5);
+    }
+    if (p_userr->err.num != 0) {
+      fprintf(stderr, "!--Server error %d: %s\n", p_userr->err.num, p_userr->err.err_inf_u.msg);
+      xdr_free((xdrproc_t)xdr_usage_err, p_userr);
+      return;
+    }
+    if (p_userr->usage.complete || ++numb_repeats > NUMB_USAGE_REPEATS)
+      break;
+    fprintf(stderr, "... %llu files & %llu directories so far\n",
+            (unsigned long long)p_userr->usage.numb_files, (unsigned long long)p_userr->usage.numb_dirs);
+    xdr_free((xdrproc_t)xdr_usage_err, p_userr);
+  }
+
+  printf("%s%s:\n  size: %llu bytes (%.1f MiB), disk usage: %llu bytes (%.1f MiB)\n"
+         "  files: %llu, directories: %llu\n",
+         p_userr->usage.path, p_userr->usage.complete ? "" : " (partial)",
+         (unsigned long long)p_userr->usage.bytes, p_userr->usage.bytes / 1048576.,
+         (unsigned long long)p_userr->usage.disk_bytes, p_userr->usage.disk_bytes / 1048576.,
+         (unsigned long long)p_userr->usage.numb_files, (unsigned long long)p_userr->usage.numb_dirs);
+  if (p_userr->usage.numb_errors)
+    printf("  %llu entries can't be read\n", (unsigned long long)p_userr->usage.numb_errors);
+  xdr_free((xdrproc_t)xdr_usage_err, p_userr);
   LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Done.");
 }
 
@@ -290,14 +618,214 @@ static void file_download()
  * The Pick File section
  * Error numbers range: ??-??
  */
+// Number of the entries in each page of the remote directory listing
+enum { NUMB_LIST_PAGE = 100 };
+
+// Split the glob pattern off the path if its last component has the wildcards.
+// Return the pattern, or "" if there's no one.
+static char * split_glob(char *path)
+{
+  char *name = strrchr(path, '/');
+  if (name == NULL || strpbrk(name + 1, "*?[") == NULL)
+    return "";
+  *name = '\0';
+  return name + 1;
+}
+
+// Get the name of the user on this host, or the number if it's unknown.
+// The name is kept in the static memory till the next call with another user.
+static const char * user_name(unsigned uid)
+{
+  static unsigned uid_last;
+  static char name[64] = "";
+  struct passwd *p_pw;
+
+  if (*name && uid == uid_last)
+    return name;
+  if ( (p_pw = getpwuid((uid_t)uid)) != NULL )
+    snprintf(name, sizeof(name), "%s", p_pw->pw_name);
+  else
+    snprintf(name, sizeof(name), "%u", uid);
+  uid_last = uid;
+  return name;
+}
+
+// Get the name of the group on this host, or the number if it's unknown.
+// The name is kept in the static memory till the next call with another group.
+static const char * group_name(unsigned gid)
+{
+  static unsigned gid_last;
+  static char name[64] = "";
+  struct group *p_gr;
+
+  if (*name && gid == gid_last)
+    return name;
+  if ( (p_gr = getgrgid((gid_t)gid)) != NULL )
+    snprintf(name, sizeof(name), "%s", p_gr->gr_name);
+  else
+    snprintf(name, sizeof(name), "%u", gid);
+  gid_last = gid;
+  return name;
+}
+
+// Format the page of the remote directory listing as the text like the pick_file() one,
+// the owners are shown by their names on this host.
+// Return the allocated text, or NULL on failure.
+static char * format_page(const list_page *p_page, const char *filter, size_t *p_len)
+{
+  const dir_item *p_item;
+  char strmode[11];
+  char datestring[64];
+  struct tm tm;
+  time_t mtime;
+  int lenmax_uid = 1, lenmax_gid = 1, lenmax_size = 1, len;
+  u_int i;
+  char *text = NULL;
+  FILE *hfile;
+
+  // The owner, group & size are printed in the columns of the max width
+  for (i = 0; i < p_page->items.items_len; ++i) {
+    p_item = &p_page->items.items_val[i];
+    if ( (len = (int)strlen(user_name(p_item->uid))) > lenmax_uid ) lenmax_uid = len;
+    if ( (len = (int)strlen(group_name(p_item->gid))) > lenmax_gid ) lenmax_gid = len;
+    if ( (len = snprintf(NULL, 0, "%llu", (unsigned long long)p_item->size)) > lenmax_size )
+      lenmax_size = len;
+  }
+
+  if ( (hfile = open_memstream(&text, p_len)) == NULL )
+    return NULL;
+  for (i = 0; i < p_page->items.items_len; ++i) {
+    p_item = &p_page->items.items_val[i];
+    if (p_item->type == FTYPE_INV) {
+      fprintf(hfile, "?????????? %s\n", p_item->name);
+      continue;
+    }
+    mtime = (time_t)p_item->mtime;
+    if (localtime_r(&mtime, &tm) == NULL ||
+        strftime(datestring, sizeof(datestring), "%b %d %R %Y", &tm) == 0)
+      datestring[0] = '\0';
+    fprintf(hfile, "%s  %-*s ", str_perm((mode_t)p_item->mode, strmode), lenmax_uid, user_name(p_item->uid));
+    fprintf(hfile, "%-*s %*llu %s %s\n", lenmax_gid, group_name(p_item->gid),
+            lenmax_size, (unsigned long long)p_item->size, datestring, p_item->name);
+  }
+  if (p_page->cursor != 0)
+    fprintf(hfile, "[%llu more entries; type '+' to show the next page]\n",
+            (unsigned long long)(p_page->total - p_page->cursor));
+  if (*filter && p_page->total == 0)
+    fprintf(hfile, "[no entries match '%s']\n", filter);
+  if (fclose(hfile) != 0) {
+    free(text);
+    return NULL;
+  }
+  ++*p_len; // the terminating null
+  return text;
+}
+
+// The remote directory listed last, its next page is requested on demand by list_next_page()
+static struct {
+  char path[LEN_PATH_MAX];    // the listed directory
+  char *filter;               //   & the glob pattern, it points into `path`
+  uint64_t cursor;            // the cursor of the next page, 0 - the listing is complete
+} list_last;
+
+// Make the listing request for the page of the remote directory listed last.
+static list_req list_last_req(void)
+{
+  list_req lsreq;
+  lsreq.path = *list_last.path ? list_last.path : "/";
+  lsreq.filter = list_last.filter;
+  lsreq.cursor = list_last.cursor;
+  lsreq.limit = NUMB_LIST_PAGE;
+  lsreq.sort = ls_sort_name;
+  lsreq.desc = FALSE;
+  return lsreq;
+}
+
+// List the first page of the remote directory through the RPC, the entries are sorted by name
+// and filtered by the glob pattern in the last path component; the next pages are shown on demand.
+// Return the page in the form of the pick_file() result, or NULL if the path isn't a directory
+// or the server doesn't support the listing (then pick_file() is used).
+static file_err * list_first_page(const picked_file *p_flpkd)
+{
+  static file_err flerr_list;   // returned variable, its content is freed by xdr_free()
+  list_req lsreq;
+  list_err *p_lserr;
+  size_t len;
+
+  snprintf(list_last.path, sizeof(list_last.path), "%s", p_flpkd->name);
+  list_last.filter = split_glob(list_last.path);
+  list_last.cursor = 0;
+  lsreq = list_last_req();
+  if ( (p_lserr = list_dir_1(&lsreq, pclient)) == NULL ) {
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "list_dir is not supported by the server");
+    return NULL;
+  }
+  if (p_lserr->err.num != 0) {
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Not listed:\n  %s", p_lserr->err.err_inf_u.msg);
+    xdr_free((xdrproc_t)xdr_list_err, (char *)p_lserr);
+    return NULL;
+  }
+
+  memset(&flerr_list, 0, sizeof(flerr_list));
+  flerr_list.file.type = FTYPE_DIR;
+  flerr_list.file.name = strdup(p_lserr->list.path);
+  flerr_list.file.cont.t_flcont_val = format_page(&p_lserr->list, lsreq.filter, &len);
+  flerr_list.file.cont.t_flcont_len = len;
+  list_last.cursor = p_lserr->list.cursor;
+  xdr_free((xdrproc_t)xdr_list_err, (char *)p_lserr);
+  if (flerr_list.file.name == NULL || flerr_list.file.cont.t_flcont_val == NULL) {
+    xdr_free((xdrproc_t)xdr_file_err, (char *)&flerr_list);
+    return NULL;
+  }
+  return &flerr_list;
+}
+
+// Show the next page of the remote directory listed last, it's called for the input '+'.
+// Return 0 if the input is processed: the page or the end of the listing is shown.
+static int list_next_page(void)
+{
+  list_req lsreq = list_last_req();
+  list_err *p_lserr;
+  char *text;
+  size_t len;
+
+  if (list_last.cursor == 0) {
+    printf("[no more entries]\n");
+    return 0;
+  }
+  if ( (p_lserr = list_dir_1(&lsreq, pclient)) == NULL ) {
+    clnt_perror(pclient, rmt_host);
+    return 1;
+  }
+  if (p_lserr->err.num != 0) {
+    fprintf(stderr, "!--Server error %d: %s\n", p_lserr->err.num, p_lserr->err.err_inf_u.msg);
+    list_last.cursor = 0;
+    xdr_free((xdrproc_t)xdr_list_err, (char *)p_lserr);
+    return 0;
+  }
+  list_last.cursor = p_lserr->list.cursor;
+  if ( (text = format_page(&p_lserr->list, lsreq.filter, &len)) != NULL )
+    printf("%s", text);
+  free(text);
+  xdr_free((xdrproc_t)xdr_list_err, (char *)p_lserr);
+  return 0;
+}
+
 // The main function to Pick (choose) file remotelly through the RPC.
 // Also, this function is a wrapper of the pick_file() RPC function call.
 file_err * file_select_rmt(picked_file *p_flpkd)
 {
   LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: initiate File Selection - init filename:\n  %s", p_flpkd->name);
 
+  // The directory is listed page by page, its first page is shown
+  file_err *p_flerr_srv = list_first_page(p_flpkd);
+  if (p_flerr_srv != NULL) {
+    LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Done, listed directory:\n  %s", p_flerr_srv->file.name);
+    return p_flerr_srv;
+  }
+
   // Choose a file on the server via RPC and return the choosen file info or an error
-  file_err *p_flerr_srv = pick_file_1(p_flpkd, pclient);
+  p_flerr_srv = pick_file_1(p_flpkd, pclient);
   LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "RPC operation DONE");
 
   // Print an error message indicating why an RPC failed.
@@ -324,6 +852,65 @@ file_err * file_select_rmt(picked_file *p_flpkd)
   return p_flerr_srv;
 }
 
+// Number of the found files shown by the search
+enum { NUMB_SEARCH_SHOWN = 20 };
+
+// Search the file names matching the pattern on the server through the RPC and let the user
+// choose one of the found files. Return 0 and the chosen path in `path_res`, or 1 if nothing
+// is chosen.
+static int search_rmt(const char *pattern, char *path_res)
+{
+  char pat[LEN_PATH_MAX];
+  char inp[32];
+  search_req srreq;
+  search_err *p_srerr;
+  found_list *p_found;
+  long numb = 1;
+  char *endp;
+  u_int i;
+
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Begin: search '%s'", pattern);
+  snprintf(pat, sizeof(pat), "%s", pattern); // the pattern can be in `path_res`
+  srreq.pattern = pat;
+  srreq.limit = NUMB_SEARCH_SHOWN;
+  if ( (p_srerr = search_names_1(&srreq, pclient)) == NULL ) {
+    clnt_perror(pclient, rmt_host); // e.g. the server doesn't support the search
+    return 1;
+  }
+  if (p_srerr->err.num != 0) {
+    fprintf(stderr, "!--Server error %d: %s\n", p_srerr->err.num, p_srerr->err.err_inf_u.msg);
+    xdr_free((xdrproc_t)xdr_search_err, p_srerr);
+    return 1;
+  }
+
+  p_found = &p_srerr->found;
+  if (p_found->items.items_len == 0) {
+    printf("No files under %s match '%s'\n", p_found->root, pat);
+    xdr_free((xdrproc_t)xdr_search_err, p_srerr);
+    return 1;
+  }
+  printf("\n%llu files under %s match '%s'%s:\n", (unsigned long long)p_found->total,
+         p_found->root, pat, p_found->total > p_found->items.items_len ? ", the first ones are shown" : "");
+  for (i = 0; i < p_found->items.items_len; ++i)
+    printf("%3u) %s%s\n", i + 1, p_found->items.items_val[i].path,
+           p_found->items.items_val[i].type == FTYPE_DIR ? "/" : "");
+
+  // The only found file is chosen at once
+  if (p_found->items.items_len > 1) {
+    printf("Select the number of the file (ENTER - back to the directory): ");
+    if (fgets(inp, sizeof(inp), stdin) == NULL || *inp == '\n' ||
+        (numb = strtol(inp, &endp, 10)) < 1 || numb > (long)p_found->items.items_len ||
+        (*endp != '\n' && *endp != '\0')) {
+      xdr_free((xdrproc_t)xdr_search_err, p_srerr);
+      return 1;
+    }
+  }
+  copy_path(p_found->items.items_val[numb - 1].path, path_res);
+  xdr_free((xdrproc_t)xdr_search_err, p_srerr);
+  LOG(LOG_TYPE_CLNT, LOG_LEVEL_DEBUG, "Done, chosen file:\n  %s", path_res);
+  return 0;
+}
+
 // Print the confirmation prompt for the RPC operation to transfer the file.
 static void print_confirm_trop_msg(enum Action *act)
 {
@@ -366,10 +953,11 @@ static int get_user_confirm()
 // Get the filename and prompt the user to confirm the selection.
 // Can be used for all types of selection: Source & Target file on Client & Server.
 static char * get_and_confirm_filename(const picked_file *p_flpkd, const char *hostname,
-                                       T_pf_select pf_select, char *selected_filename)
+                                       T_pf_select pf_select, T_pf_search pf_search,
+                                       T_pf_more pf_more, char *selected_filename)
 {
   do {
-    if ( !get_filename_inter(p_flpkd, pf_select, hostname, selected_filename) )
+    if ( !get_filename_inter(p_flpkd, pf_select, pf_search, pf_more, hostname, selected_filename) )
       return NULL;
     printf("'%s'\nDo you really want to select this file? (y/n) [y]: ", selected_filename);
   } while ( get_user_confirm() != 0 );
@@ -386,20 +974,20 @@ static void interact(enum Action *act)
   if (*act & act_upload) {
     // Select a Source file on a local host
     if ( !get_and_confirm_filename(&(picked_file){".", pk_ftype_source}, "localhost",
-                                    select_file, filename_src) ) { return; }
+                                    select_file, NULL, NULL, filename_src) ) { return; }
 
     // Select a Target file on a remote host
     if ( !get_and_confirm_filename(&(picked_file){".", pk_ftype_target}, rmt_host,
-                                    file_select_rmt, filename_trg) ) { return; }
+                                    file_select_rmt, search_rmt, list_next_page, filename_trg) ) { return; }
   }
   else if (*act & act_download) {
     // Select a Source file on a remote host
     if ( !get_and_confirm_filename(&(picked_file){".", pk_ftype_source}, rmt_host,
-                                    file_select_rmt, filename_src) ) { return; }
+                                    file_select_rmt, search_rmt, list_next_page, filename_src) ) { return; }
 
     // Select a Target file on a local host
     if ( !get_and_confirm_filename(&(picked_file){".", pk_ftype_target}, "localhost",
-                                    select_file, filename_trg) ) { return; }
+                                    select_file, NULL, NULL, filename_trg) ) { return; }
   }
 
   // Confirm the RPC action after completing all interactive actions.
@@ -432,6 +1020,10 @@ static void do_RPC_action(enum Action act)
       // download file from the server
       file_download();
       break;
+    case act_usage:
+      // print the disk usage of the directory on the server
+      dir_usage_rmt();
+      break;
     default:
       LOG(LOG_TYPE_CLNT, LOG_LEVEL_ERROR, "Unknown program execution mode");
       fprintf(stderr, "Unknown program execution mode\n");
@@ -1,11 +1,16 @@
 /*
  * file_opers.c: a set of functions to manipulate the file like open, close, read, write a file.
- * Errors range: 11-17 (reserve 18-20)
+ * Errors range: 11-19 (reserve 20)
  */
+#define _GNU_SOURCE // for O_TMPFILE & fallocate()
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <stdlib.h> 
+#include <unistd.h>
+#include <fcntl.h>
 #include <errno.h>
+#include <sys/stat.h>
 
 #include "file_opers.h"
 #include "mem_opers.h"
@@ -37,8 +42,8 @@ extern int errno; // global system error number
  *  Note: The system error (based on `errno`) is included in the message only if
  * `errno` is non-zero at the time the function is called.
  */
-static int process_error(const char *filename, int errnum, 
-                         const char *errmsg_act, err_inf **pp_errinf)
+int process_error(const char *filename, int errnum, 
+                  const char *errmsg_act, err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin error processing");
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_ERROR, "Main error message: %s", errmsg_act);
@@ -138,7 +143,7 @@ static const char *get_error_message(const char *mode) {
  * Return value:
  *  A pointer to a FILE object if successful, or NULL on failure.
  */
-static FILE *open_file(const t_flname flname, const char *mode, err_inf **pp_errinf)
+FILE *open_file(const char *flname, const char *mode, err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
   FILE *hfile = fopen(flname, mode);
@@ -168,7 +173,7 @@ static FILE *open_file(const t_flname flname, const char *mode, err_inf **pp_err
  *  <0 (-1) - on failure. In such cases, the error information is prepared,
  *            and the system error message is stored in pp_errinf.
  */
-static int close_file(const t_flname flname, FILE *hfile, err_inf **pp_errinf)
+int close_file(const char *flname, FILE *hfile, err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
   int rc = fclose(hfile);
@@ -200,7 +205,7 @@ static int close_file(const t_flname flname, FILE *hfile, err_inf **pp_errinf)
  *  2 for read error,
  *  3 for partial read error.
  */
-static int read_file(const t_flname flname, t_flcont *p_flcont, 
+static int read_file(const char *flname, t_flcont *p_flcont, 
                      FILE *hfile, err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
@@ -252,7 +257,7 @@ static int read_file(const t_flname flname, t_flcont *p_flcont,
  *  0 on success,
  *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
  */
-int read_file_cont(const t_flname flname, t_flcont *p_flcont,
+int read_file_cont(const char *flname, t_flcont *p_flcont,
                    err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
@@ -274,6 +279,165 @@ int read_file_cont(const t_flname flname, t_flcont *p_flcont,
   return 0;
 }
 
+/* Read a chunk of the file content into a buffer.
+ *
+ * This function reads up to `size` bytes starting from the `offs` offset of the opened
+ * file into the file content buffer, that should be freed (unallocated) before the call.
+ * The file position is changed only if it differs from the requested offset, so
+ * the sequential reading of chunks doesn't make any seeks.
+ * If any errors occur, it allocates and fills an error information with details
+ * about the failure and close the file handle.
+ *
+ * Parameters:
+ *  flname    - the name of the file to read from.
+ *  hfile     - a pointer to the opened file handle from which to read.
+ *  offs      - the offset of the chunk in the file.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to a structure where the chunk content will be stored.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int read_file_chunk(const char *flname, FILE *hfile, uint64_t offs, size_t size,
+                    t_flcont *p_flcont, int *p_last, err_inf **pp_errinf)
+{
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin, offset: %lu, size: %lu", offs, size);
+  struct stat statbuf;
+  int errnum = 0;
+
+  // Get the file size to determine the chunk size & the end of file
+  if (fstat(fileno(hfile), &statbuf) == -1)
+    errnum = 14;
+  else if (offs > (uint64_t)statbuf.st_size) {
+    errno = 0;
+    errnum = 18;
+  }
+  else if (ftello(hfile) != (off_t)offs && fseeko(hfile, (off_t)offs, SEEK_SET) != 0)
+    errnum = 19;
+  if (errnum) {
+    (void)process_error(flname, errnum, errnum == 14 ? "Failed to read from the file" :
+                        errnum == 18 ? "Invalid offset of the file chunk" :
+                        "Failed to seek in the file", pp_errinf);
+    fclose(hfile);
+    return errnum;
+  }
+
+  // Nothing to read at the end of file
+  if ((uint64_t)statbuf.st_size - offs < size)
+    size = (size_t)((uint64_t)statbuf.st_size - offs);
+  *p_last = (offs + size >= (uint64_t)statbuf.st_size);
+  if (size == 0) {
+    LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done, empty chunk.");
+    return 0;
+  }
+
+  // Allocate the memory to store the chunk content & read it
+  if ( alloc_file_cont(p_flcont, size) == NULL ) {
+    errno = 0; // reset system error remained from the previous error case
+    (void)process_error(flname, 13, "Failed to allocate memory for the content of file", pp_errinf);
+    fclose(hfile);
+    return 13;
+  }
+
+  size_t nch = fread(p_flcont->t_flcont_val, 1, size, hfile);
+  if (ferror(hfile)) {
+    (void)process_error(flname, 14, "Failed to read from the file", pp_errinf);
+    fclose(hfile);
+    return 14;
+  }
+  if (nch < size) {
+    (void)process_error(flname, 15, "Partial reading of the file", pp_errinf);
+    fclose(hfile);
+    return 15;
+  }
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done.");
+  return 0;
+}
+
+/* Read a chunk of the file content into a buffer by the file descriptor.
+ *
+ * This function reads up to `size` bytes starting from the `offs` offset of the file
+ * opened for reading into the file content buffer, that should be freed (unallocated)
+ * before the call. The chunk is read with pread(), so the file position isn't used and
+ * the descriptor can be shared by the readers of different chunks.
+ * If any errors occur, it allocates and fills an error information with details
+ * about the failure; the descriptor is not closed.
+ *
+ * Parameters:
+ *  flname    - the name of the file to read from.
+ *  fd        - the descriptor of the file opened for reading.
+ *  offs      - the offset of the chunk in the file.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to a structure where the chunk content will be stored.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int pread_file_chunk(const char *flname, int fd, uint64_t offs, size_t size,
+                     t_flcont *p_flcont, int *p_last, err_inf **pp_errinf)
+{
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin, offset: %lu, size: %lu", offs, size);
+  struct stat statbuf;
+  size_t nch = 0;
+  ssize_t nrd;
+
+  // Get the file size to determine the chunk size & the end of file
+  if (fstat(fd, &statbuf) == -1) {
+    (void)process_error(flname, 14, "Failed to read from the file", pp_errinf);
+    return 14;
+  }
+  if (offs > (uint64_t)statbuf.st_size) {
+    errno = 0;
+    (void)process_error(flname, 18, "Invalid offset of the file chunk", pp_errinf);
+    return 18;
+  }
+
+  // Nothing to read at the end of file
+  if ((uint64_t)statbuf.st_size - offs < size)
+    size = (size_t)((uint64_t)statbuf.st_size - offs);
+  *p_last = (offs + size >= (uint64_t)statbuf.st_size);
+  if (size == 0) {
+    LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done, empty chunk.");
+    return 0;
+  }
+
+  // Allocate the memory to store the chunk content & read it
+  if ( alloc_file_cont(p_flcont, size) == NULL ) {
+    errno = 0; // reset system error remained from the previous error case
+    (void)process_error(flname, 13, "Failed to allocate memory for the content of file", pp_errinf);
+    return 13;
+  }
+
+  while (nch < size) {
+    if ( (nrd = pread(fd, p_flcont->t_flcont_val + nch, size - nch, (off_t)(offs + nch))) == -1 ) {
+      if (errno == EINTR)
+        continue;
+      (void)process_error(flname, 14, "Failed to read from the file", pp_errinf);
+      return 14;
+    }
+    if (nrd == 0) {
+      errno = 0;
+      (void)process_error(flname, 15, "Partial reading of the file", pp_errinf);
+      return 15;
+    }
+    nch += (size_t)nrd;
+  }
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done.");
+  return 0;
+}
+
 /* Write content to a file.
  *
  * This function writes data from a file content structure to the specified file handle.
@@ -295,8 +459,8 @@ int read_file_cont(const t_flname flname, t_flcont *p_flcont,
  *  2 if a partial write occurs,
  * -1 if an error occurs while preparing error information.
  */
-static int write_file(const t_flname flname, const t_flcont *p_flcont, 
-                      FILE *hfile, err_inf **pp_errinf)
+int write_file(const char *flname, const t_flcont *p_flcont, 
+               FILE *hfile, err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
 
@@ -324,7 +488,8 @@ static int write_file(const t_flname flname, const t_flcont *p_flcont,
 /* Save file content to a new local file.
  *
  * This function creates a new file with the specified name, writes the provided
- * content into it, and then closes the file. Any errors encountered during these
+ * content into it, and then closes the file. The file is written as an anonymous one
+ * and linked under the name when it's complete (see open_new_file()). Any errors encountered during these
  * operations are recorded in the `err_inf` structure.
  *
  * Parameters:
@@ -339,19 +504,43 @@ static int write_file(const t_flname flname, const t_flcont *p_flcont,
  *  0 on success,
  *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
  */
-int save_file_cont(const t_flname flname, const t_flcont *p_flcont,
+int save_file_cont(const char *flname, const t_flcont *p_flcont,
                    err_inf **pp_errinf)
 {
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
   
-  // Open the file
+  // Create the new file, it's visible under its name only when it's written
   FILE *hfile = NULL;    // the file handler
-  if ( (hfile = open_file(flname, "wbx", pp_errinf)) == NULL )
+  int fd, tmp;
+  if ( (fd = open_new_file(flname, p_flcont->t_flcont_len, &tmp, pp_errinf)) == -1 )
+    return (*pp_errinf)->num;
+  if ( (hfile = fdopen(fd, "wb")) == NULL ) {
+    (void)process_error(flname, 11, "Cannot open the file for binary writing", pp_errinf);
+    close(fd);
+    if (!tmp)
+      unlink(flname);
     return (*pp_errinf)->num;
+  }
 
-  // Write a content of the client file to a new file
-  if ( write_file(flname, p_flcont, hfile, pp_errinf) != 0 )
+  // Write a content of the client file to a new file & publish it under its name
+  if ( write_file(flname, p_flcont, hfile, pp_errinf) != 0 ) {
+    if (!tmp)
+      unlink(flname);
+    return (*pp_errinf)->num;
+  }
+  if ( fflush(hfile) != 0 ) {
+    (void)process_error(flname, 16, "Failed to write to the file", pp_errinf);
+    fclose(hfile);
+    if (!tmp)
+      unlink(flname);
     return (*pp_errinf)->num;
+  }
+  if ( publish_new_file(flname, fd, tmp, pp_errinf) != 0 ) {
+    fclose(hfile);
+    if (!tmp)
+      unlink(flname);
+    return (*pp_errinf)->num;
+  }
 
   // Close the file stream
   if ( close_file(flname, hfile, pp_errinf) != 0 )
@@ -360,3 +549,111 @@ int save_file_cont(const t_flname flname, const t_flcont *p_flcont,
   LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done.");
   return 0;
 }
+
+/* Create a new file to be written and published under the name when it's complete.
+ *
+ * This function creates an anonymous file (O_TMPFILE) in the directory of the specified
+ * name and preallocates the declared size for it, keeping the file size zero. If the file
+ * system doesn't support O_TMPFILE, the file of the name is created exclusively.
+ * The preallocation not supported by the file system is skipped.
+ *
+ * Parameters:
+ *  flname    - the name of the new file.
+ *  size      - the declared size of the file, 0 - nothing is preallocated.
+ *  p_tmp     - a pointer to a flag set to 1 if the file is anonymous, 0 if it's created
+ *              under the name.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  The descriptor of the file opened for writing on success,
+ *  -1 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int open_new_file(const char *flname, uint64_t size, int *p_tmp, err_inf **pp_errinf)
+{
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin, size: %lu", size);
+  char dir[LEN_PATH_MAX + 1];
+  const char *p_slash = strrchr(flname, '/');
+  struct stat statbuf;
+  size_t len_dir;
+  int fd;
+
+  // The anonymous file doesn't reserve the name, so the existing name is checked first
+  if (lstat(flname, &statbuf) == 0) {
+    errno = EEXIST;
+    (void)process_error(flname, 11, get_error_message("wbx"), pp_errinf);
+    return -1;
+  }
+
+  // The anonymous file is created in the directory of the name, the root directory keeps its slash
+  if (p_slash == NULL)
+    strcpy(dir, ".");
+  else {
+    len_dir = p_slash == flname ? 1 : (size_t)(p_slash - flname);
+    if (len_dir > LEN_PATH_MAX)
+      len_dir = LEN_PATH_MAX;
+    memcpy(dir, flname, len_dir);
+    dir[len_dir] = '\0';
+  }
+  *p_tmp = 0;
+  if ( (fd = open(dir, O_TMPFILE | O_WRONLY | O_CLOEXEC, 0666)) != -1 )
+    *p_tmp = 1;
+  // The file systems without O_TMPFILE refuse it with one of these errors
+  else if (errno == EOPNOTSUPP || errno == EISDIR || errno == EINVAL)
+    fd = open(flname, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0666);
+  if (fd == -1) {
+    (void)process_error(flname, 11, get_error_message("wbx"), pp_errinf);
+    return -1;
+  }
+
+  // The blocks are allocated at once, the size of the file grows by the writing
+  if (size && fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, (off_t)size) != 0 &&
+      errno != EOPNOTSUPP && errno != ENOSYS) {
+    (void)process_error(flname, 16, "Failed to preallocate the file", pp_errinf);
+    close(fd);
+    if (!*p_tmp)
+      unlink(flname);
+    return -1;
+  }
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done, anonymous: %d.", *p_tmp);
+  return fd;
+}
+
+/* Publish the new file created by open_new_file() under its name.
+ *
+ * This function links the anonymous file under the name through its descriptor in procfs
+ * (linkat() with AT_EMPTY_PATH requires a privilege), it fails if the name exists.
+ * The file blocks preallocated beyond the written data are released by the truncation.
+ *
+ * Parameters:
+ *  flname    - the name of the new file.
+ *  fd        - the descriptor returned by open_new_file().
+ *  tmp       - the flag set by open_new_file().
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int publish_new_file(const char *flname, int fd, int tmp, err_inf **pp_errinf)
+{
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Begin");
+  char path_fd[32];
+  struct stat statbuf;
+
+  // The file smaller than the declared size keeps the preallocated blocks till the truncation
+  if (fstat(fd, &statbuf) == 0 && (uint64_t)statbuf.st_blocks * 512 >
+      ((uint64_t)statbuf.st_size + statbuf.st_blksize - 1) / statbuf.st_blksize * statbuf.st_blksize &&
+      ftruncate(fd, statbuf.st_size) != 0) {
+    (void)process_error(flname, 16, "Failed to write to the file", pp_errinf);
+    return 16;
+  }
+  if (tmp) {
+    snprintf(path_fd, sizeof(path_fd), "/proc/self/fd/%d", fd);
+    if (linkat(AT_FDCWD, path_fd, AT_FDCWD, flname, AT_SYMLINK_FOLLOW) != 0) {
+      (void)process_error(flname, 19, "Failed to publish the written file under its name", pp_errinf);
+      return 19;
+    }
+  }
+  LOG(LOG_TYPE_FLOP, LOG_LEVEL_DEBUG, "Done.");
+  return 0;
+}
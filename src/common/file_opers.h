@@ -2,6 +2,7 @@
 #define _FILE_OPERS_H_
 
 #include <stdio.h>
+#include <stdint.h>
 #include "../rpcgen/fltr.h"
 
 /* Read the file content into a buffer.
@@ -22,13 +23,14 @@
  *  0 on success,
  *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
  */
-int read_file_cont(const t_flname flname, t_flcont *p_flcont, 
+int read_file_cont(const char *flname, t_flcont *p_flcont, 
                    err_inf **pp_errinf);
 
 /* Save file content to a new local file.
  *
  * This function creates a new file with the specified name, writes the provided
- * content into it, and then closes the file. Any errors encountered during these
+ * content into it, and then closes the file. The file is written as an anonymous one
+ * and linked under the name when it's complete (see open_new_file()). Any errors encountered during these
  * operations are recorded in the `err_inf` structure.
  *
  * Parameters:
@@ -43,7 +45,209 @@ int read_file_cont(const t_flname flname, t_flcont *p_flcont,
  *  0 on success,
  *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
  */
-int save_file_cont(const t_flname flname, const t_flcont *p_flcont, 
+int save_file_cont(const char *flname, const t_flcont *p_flcont, 
                    err_inf **pp_errinf);
 
+/* Process error info and format an error message.
+ *
+ * This function processes error information and constructs an error message that
+ * includes details about the failed action, the associated file, and optionally,
+ * system error details if `errno` is non-zero. It ensures the error info structure
+ * is prepared (allocated if needed) and stores the error message in the provided buffer.
+ *
+ * Parameters:
+ *  filename    - the name of the file associated with the error.
+ *  errnum      - the custom error number to be stored in the error info structure.
+ *  errmsg_act  - a brief message describing the failed action.
+ *  p_errinf    - a double pointer to an `err_inf` structure.
+ *                -> If `p_errinf` is `NULL`, no error handling is done, and
+ *                   the function returns an error code.
+ *                -> If `*pp_errinf` is `NULL`, the function attempts to allocate
+ *                   memory for `err_inf` and initialize it.
+ * Return value:
+ *  0 on success,
+ * <0 (-1) on failure (error info could not be processed or allocated).
+ *
+ *  Note: The system error (based on `errno`) is included in the message only if
+ * `errno` is non-zero at the time the function is called.
+ */
+int process_error(const char *filename, int errnum, 
+                  const char *errmsg_act, err_inf **pp_errinf);
+
+/* Open a file and optionally return error information.
+ *
+ * This function attempts to open a file in the specified mode. If the file cannot
+ * be opened, and the error info pointer is provided, it allocates an error structure
+ * and stores detailed error information.
+ * If the passed error info double pointer is NULL, no error details are returned.
+ * If a valid pointer is passed but uninitialized, the function allocates and initializes it.
+ * If no error occurs, the error info pointer (pp_errinf) remains unchanged,
+ * and the memory it points to is not modified. That means it can be safely reused.
+ *
+ * Note: The caller is responsible for freeing the error information structure if
+ * the value passed was NULL and memory was allocated by this function. If a pointer
+ * to a static or automatic instance of err_inf is passed, only the contents are modified,
+ * not the pointer.
+ *
+ * Parameters:
+ *  flname    - the name of the file to open.
+ *  mode      - the mode in which to open the file (e.g., "r", "w").
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  A pointer to a FILE object if successful, or NULL on failure.
+ */
+FILE *open_file(const char *flname, const char *mode, err_inf **pp_errinf);
+
+/* Close the file stream.
+ *
+ * Closes the file stream and handles any errors that may occur during the process.
+ * If an error occurs, this function prepares the error information using the provided
+ * error info pointer (pp_errinf). The system error (errno) is captured and used
+ * to populate the error message.
+ *
+ * Parameters:
+ *  flname    - the name of the file to close.
+ *  hfile     - the file stream to be closed.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0       - if the file is successfully closed,
+ *  <0 (-1) - on failure. In such cases, the error information is prepared,
+ *            and the system error message is stored in pp_errinf.
+ */
+int close_file(const char *flname, FILE *hfile, err_inf **pp_errinf);
+
+/* Read a chunk of the file content into a buffer.
+ *
+ * This function reads up to `size` bytes starting from the `offs` offset of the opened
+ * file into the file content buffer, that should be freed (unallocated) before the call.
+ * The file position is changed only if it differs from the requested offset, so
+ * the sequential reading of chunks doesn't make any seeks.
+ * If any errors occur, it allocates and fills an error information with details
+ * about the failure and close the file handle.
+ *
+ * Parameters:
+ *  flname    - the name of the file to read from.
+ *  hfile     - a pointer to the opened file handle from which to read.
+ *  offs      - the offset of the chunk in the file.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to a structure where the chunk content will be stored.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int read_file_chunk(const char *flname, FILE *hfile, uint64_t offs, size_t size,
+                    t_flcont *p_flcont, int *p_last, err_inf **pp_errinf);
+
+/* Read a chunk of the file content into a buffer by the file descriptor.
+ *
+ * This function reads up to `size` bytes starting from the `offs` offset of the file
+ * opened for reading into the file content buffer, that should be freed (unallocated)
+ * before the call. The chunk is read with pread(), so the file position isn't used and
+ * the descriptor can be shared by the readers of different chunks.
+ * If any errors occur, it allocates and fills an error information with details
+ * about the failure; the descriptor is not closed.
+ *
+ * Parameters:
+ *  flname    - the name of the file to read from.
+ *  fd        - the descriptor of the file opened for reading.
+ *  offs      - the offset of the chunk in the file.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to a structure where the chunk content will be stored.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int pread_file_chunk(const char *flname, int fd, uint64_t offs, size_t size,
+                     t_flcont *p_flcont, int *p_last, err_inf **pp_errinf);
+
+/* Write content to a file.
+ *
+ * This function writes data from a file content structure to the specified file handle.
+ * If any errors occur during the writing process, it allocates and fills an error
+ * information with details about the failure and close the file handle.
+ *
+ * Parameters:
+ *  flname    - the name of the file being written to.
+ *  p_flcont  - a pointer to the file content structure containing the data to be written.
+ *  hfile     - a file handle (FILE*) where the data will be written.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success,
+ *  1 if a write error occurs, 
+ *  2 if a partial write occurs,
+ * -1 if an error occurs while preparing error information.
+ */
+int write_file(const char *flname, const t_flcont *p_flcont, 
+               FILE *hfile, err_inf **pp_errinf);
+
+/* Create a new file to be written and published under the name when it's complete.
+ *
+ * This function creates an anonymous file (O_TMPFILE) in the directory of the specified
+ * name, so the readers never see the incomplete file, and preallocates the declared size
+ * for it, so the file isn't fragmented and the writing doesn't stall on the allocation
+ * of the blocks. The file is written with pwrite() at any offsets, then it's published by
+ * publish_new_file(). If the file system doesn't support O_TMPFILE, the file of the name
+ * itself is created exclusively. The file fails to be created if the name exists already.
+ *
+ * Parameters:
+ *  flname    - the name of the new file.
+ *  size      - the declared size of the file, 0 - nothing is preallocated.
+ *  p_tmp     - a pointer to a flag set to 1 if the file is anonymous, 0 if it's created
+ *              under the name (it's removed by the caller if the writing is abandoned).
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  The descriptor of the file opened for writing on success,
+ *  -1 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int open_new_file(const char *flname, uint64_t size, int *p_tmp, err_inf **pp_errinf);
+
+/* Publish the new file created by open_new_file() under its name.
+ *
+ * The anonymous file is linked under the name atomically, it fails if the name has been
+ * created meanwhile. The blocks preallocated beyond the written data are released.
+ * The descriptor is not closed.
+ *
+ * Parameters:
+ *  flname    - the name of the new file.
+ *  fd        - the descriptor returned by open_new_file().
+ *  tmp       - the flag set by open_new_file().
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int publish_new_file(const char *flname, int fd, int tmp, err_inf **pp_errinf);
+
 #endif
\ No newline at end of file
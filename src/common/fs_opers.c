@@ -1,12 +1,16 @@
 /*
  * fs_opers.c: a set of functions to work with file system.
- * Errors range: 21-28 (reserve 29-30)
+ * Errors range: 21-29 (reserve 30)
  */
+#define _GNU_SOURCE /* for getdents64() */
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <pwd.h>
 #include <grp.h>
 #include <time.h>
@@ -14,6 +18,7 @@
 #include <langinfo.h>
 #include <stdint.h>
 #include <errno.h>
+#include <pthread.h>
 
 #include "fs_opers.h"
 #include "mem_opers.h"
@@ -66,7 +71,7 @@ static char get_file_type_unix(mode_t mode)
  * Return value:
  *  A pointer to the `strmode` character array.
  */
-static char * str_perm(mode_t mode, char *strmode)
+char * str_perm(mode_t mode, char *strmode)
 {
   strmode[0] = get_file_type_unix(mode);
   strmode[1] = (mode & S_IRUSR) ? 'r' : '-';
@@ -201,53 +206,73 @@ int copy_path(const char *path_src, char *path_trg)
   return snprintf(path_trg, LEN_PATH_MAX, "%s", path_src);
 }
 
-/* Get the file status (info).
+// Number of the cached user & group names each, power of 2
+enum { NUMB_ID_NAMES = 256 };
+
+// Time to live of the cached user & group names, and of the unknown ids, seconds
+enum { ID_NAME_TTL = 300, ID_NAME_TTL_NEG = 30 };
+
+// The cached name of the user or group id
+struct id_name {
+  unsigned id;          // the user or group id
+  char *name;           // the name, NULL if the id is unknown
+  time_t tm_expire;     // the entry is valid till this time (CLOCK_MONOTONIC), 0 - unused slot
+};
+
+static struct id_name usr_names[NUMB_ID_NAMES]; // the user names by uid
+static struct id_name grp_names[NUMB_ID_NAMES]; // the group names by gid
+
+/* Get the user or group name of the id from the cache.
  *
- * This function constructs the full path to a specified file and retrieves its
- * status information. If the full path is invalid or if the status retrieval fails,
- * an error message is set.
+ * The cache keeps the names of the recently listed ids, so the listing doesn't make
+ * NSS lookups (which can be network round trips) for each file. The unknown ids are
+ * cached too, for a shorter time.
  *
  * Parameters:
- *  dirname   - The directory name where the file is located.
- *  filename  - The name of the file whose status is to be retrieved.
- *  p_statbuf - A pointer to a stat structure where the file status information will be stored.
- *  errmsg    - A pointer to a string where an error message will be stored in case of failure.
+ *  cache  - the cache of the user or group names.
+ *  id     - the user or group id.
+ *  is_grp - 1 for the group id, 0 for the user id.
  *
  * Return value:
- *  0 on success, >0 on failure.
+ *  The name, or NULL if the id is unknown. The name is valid till the next call.
  */
-static int get_file_stat(const char *dirname, const char *filename, 
-                         struct stat *p_statbuf, char **errmsg)
+static const char *get_id_name(struct id_name *cache, unsigned id, int is_grp)
 {
-  char fullpath[LEN_PATH_MAX];
-
-  // Construct the full path to the needed file
-  // A NULL-character appends to fullpath automatically by snprintf()
-  if ( snprintf(fullpath, LEN_PATH_MAX, "%s/%s", dirname, filename) < 0 ) {
-    LOG(LOG_TYPE_SLCT, LOG_LEVEL_ERROR, 
-        "get_file_stat(): Invalid path to filename:\n  %s/%s", dirname, filename);
-    // allocate memory and put the error message
-    *errmsg = malloc(LEN_ERRMSG_MAX);
-    if (*errmsg)
-      sprintf(*errmsg, "get_file_stat(): Invalid path to filename:\n  %s/%s\n", dirname, filename);
-    return 1;
-  }
+  struct id_name *p_slot = &cache[id & (NUMB_ID_NAMES - 1)];
+  struct timespec tm_now;
+  struct passwd *pwd;
+  struct group *grp;
+  const char *name;
 
-  // Get the file status (info)
-  if (lstat(fullpath, p_statbuf) == -1) {
-    LOG(LOG_TYPE_SLCT, LOG_LEVEL_ERROR,
-        "get_file_stat(): Cannot get the file status for:\n  %s/%s", dirname, filename);
-    // allocate memory and put the error message
-    *errmsg = malloc(LEN_ERRMSG_MAX);
-    if (*errmsg)
-      sprintf(*errmsg, "get_file_stat(): Cannot get the file status for:\n  %s/%s\n%s\n",
-              dirname, filename, strerror(errno));
-    return 2;
-  }
+  clock_gettime(CLOCK_MONOTONIC, &tm_now);
+  if (p_slot->tm_expire > tm_now.tv_sec && p_slot->id == id)
+    return p_slot->name;
 
-  return 0;
+  // Look up the id & replace the slot
+  if (is_grp)
+    name = (grp = getgrgid((gid_t)id)) != NULL ? grp->gr_name : NULL;
+  else
+    name = (pwd = getpwuid((uid_t)id)) != NULL ? pwd->pw_name : NULL;
+  free(p_slot->name);
+  p_slot->id = id;
+  p_slot->name = name ? strdup(name) : NULL;
+  p_slot->tm_expire = tm_now.tv_sec + (p_slot->name ? ID_NAME_TTL : ID_NAME_TTL_NEG);
+  return p_slot->name;
 }
 
+// Size of the buffer for the raw directory entries read by getdents64()
+enum { LEN_DENTS_BUF = 262144 };
+
+// The entries of a large directory are stat'ed in parallel by up to this number of threads,
+// each thread takes the entries by batches
+enum { NUMB_STAT_THREADS_MAX = 8, NUMB_STAT_BATCH = 64 };
+
+// Min number of the entries per stat thread, a smaller directory is stat'ed sequentially
+enum { NUMB_STAT_PER_THREAD = 512 };
+
+// Max length of the date string in the directory listing
+enum { LEN_DATE_MAX = 64 };
+
 // Directory listing settings
 static struct lsdir_setts
 {
@@ -276,160 +301,386 @@ static int numb_digits(long val)
   return numb;
 }
 
-/* Update directory listing settings based on file statistics.
+// The job of the threads getting the file status of the directory entries
+struct stat_job {
+  int fd;                     // the descriptor of the opened directory
+  struct ls_entries *p_ents;  // the entries
+  size_t next;                // index of the next entry to be taken, shared by the threads
+};
+
+/* Grow the array to hold at least `numb` items, its size is doubled.
+ *
+ * Parameters:
+ *  p_arr      - the array, NULL for the first allocation.
+ *  p_numb_max - a pointer to the number of the allocated items, it's updated on success.
+ *  numb       - the needed number of items.
+ *  size_item  - the size of an item.
+ *
+ * Return value:
+ *  The grown array, or NULL on failure (the passed array is kept).
+ */
+static void *grow_array(void *p_arr, size_t *p_numb_max, size_t numb, size_t size_item)
+{
+  size_t numb_max = *p_numb_max ? *p_numb_max : 256;
+  while (numb_max < numb)
+    numb_max *= 2;
+  if ( (p_arr = realloc(p_arr, numb_max * size_item)) != NULL )
+    *p_numb_max = numb_max;
+  return p_arr;
+}
+
+/* Read the names of all the directory entries.
+ *
+ * The raw entries are read by getdents64() into a large buffer, so a huge directory
+ * is read by a few system calls.
+ *
+ * Parameters:
+ *  fd     - the descriptor of the opened directory.
+ *  p_ents - a pointer to the zeroed entries to be filled.
+ *
+ * Return value:
+ *  0 on success, 1 for the memory allocation failure, 2 for the reading error (errno is set).
+ */
+static int read_dir_entries(int fd, struct ls_entries *p_ents)
+{
+  char *buf = malloc(LEN_DENTS_BUF), *p_new;
+  struct dirent64 *p_de;
+  struct ls_entry *p_items;
+  ssize_t nrd, pos;
+  size_t len;
+
+  if (!buf)
+    return 1;
+  while ( (nrd = getdents64(fd, buf, LEN_DENTS_BUF)) > 0 ) {
+    for (pos = 0; pos < nrd; pos += p_de->d_reclen) {
+      p_de = (struct dirent64 *)(buf + pos);
+      len = strlen(p_de->d_name) + 1;
+
+      if (p_ents->numb == p_ents->numb_max) {
+        if ( (p_items = grow_array(p_ents->items, &p_ents->numb_max, p_ents->numb + 1,
+                                   sizeof(struct ls_entry))) == NULL )
+          break;
+        p_ents->items = p_items;
+      }
+      if (p_ents->len_names + len > p_ents->len_names_max) {
+        if ( (p_new = grow_array(p_ents->names, &p_ents->len_names_max,
+                                 p_ents->len_names + len, 1)) == NULL )
+          break;
+        p_ents->names = p_new;
+      }
+      p_ents->items[p_ents->numb++].offs_name = p_ents->len_names;
+      memcpy(p_ents->names + p_ents->len_names, p_de->d_name, len);
+      p_ents->len_names += len;
+    }
+    if (pos < nrd) {
+      free(buf);
+      return 1;
+    }
+  }
+  free(buf);
+  return nrd == -1 ? 2 : 0;
+}
+
+/* Get the file status of the directory entries by batches, until all of them are taken.
+ *
+ * It's run by each stat thread, the entries are taken by the shared counter,
+ * so the results are gathered into the entries array in any order.
+ *
+ * Parameters:
+ *  arg - a pointer to the stat job.
+ *
+ * Return value:
+ *  NULL.
+ */
+static void *stat_entries_batches(void *arg)
+{
+  struct stat_job *p_job = arg;
+  struct ls_entry *p_entry;
+  struct stat statbuf;
+  size_t i, end;
+
+  while ( (i = __atomic_fetch_add(&p_job->next, NUMB_STAT_BATCH, __ATOMIC_RELAXED)) <
+          p_job->p_ents->numb ) {
+    end = i + NUMB_STAT_BATCH < p_job->p_ents->numb ? i + NUMB_STAT_BATCH : p_job->p_ents->numb;
+    for (; i < end; ++i) {
+      p_entry = &p_job->p_ents->items[i];
+      if (fstatat(p_job->fd, p_job->p_ents->names + p_entry->offs_name, &statbuf,
+                  AT_SYMLINK_NOFOLLOW) == -1) {
+        p_entry->err = errno;
+        continue;
+      }
+      p_entry->err = 0;
+      p_entry->mode = statbuf.st_mode;
+      p_entry->uid = statbuf.st_uid;
+      p_entry->gid = statbuf.st_gid;
+      p_entry->size = statbuf.st_size;
+      p_entry->mtime = statbuf.st_mtime;
+      p_entry->mtime_nsec = statbuf.st_mtim.tv_nsec;
+      p_entry->ino = statbuf.st_ino;
+    }
+  }
+  return NULL;
+}
+
+/* Get the file status of all the directory entries.
+ *
+ * Each entry is stat'ed once, relative to the opened directory, so no full path is built.
+ * The entry whose status can't be got keeps the errno.
+ * The entries of a large directory are stat'ed by several threads, so the latencies
+ * of the network file systems and cold disks overlap. If the threads can't be created,
+ * the remaining entries are stat'ed by the calling thread.
+ * The threads are used instead of IORING_OP_STATX of io_ring.c: this file is shared
+ * with the client, which has no ring, and the kernel runs statx of the ring by its own
+ * blocking workers anyway, so the ring would add the submission without more overlap.
+ *
+ * Parameters:
+ *  fd     - the descriptor of the opened directory.
+ *  p_ents - a pointer to the entries read by read_dir_entries().
+ */
+static void stat_dir_entries(int fd, struct ls_entries *p_ents)
+{
+  struct stat_job job = { fd, p_ents, 0 };
+  pthread_t threads[NUMB_STAT_THREADS_MAX - 1];
+  size_t numb_threads = p_ents->numb / NUMB_STAT_PER_THREAD, i, numb_started = 0;
+
+  if (numb_threads > NUMB_STAT_THREADS_MAX)
+    numb_threads = NUMB_STAT_THREADS_MAX;
+
+  // The calling thread is one of the stat threads
+  for (i = 1; i < numb_threads; ++i)
+    if (pthread_create(&threads[numb_started], NULL, stat_entries_batches, &job) == 0)
+      numb_started++;
+  (void)stat_entries_batches(&job);
+  for (i = 0; i < numb_started; ++i)
+    pthread_join(threads[i], NULL);
+  LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, "%lu entries stat'ed by %lu threads",
+      p_ents->numb, numb_started + 1);
+}
+
+/* Scan the directory: read all its entries & get their file status. */
+int scan_dir(const char *dirname, struct ls_entries *p_ents)
+{
+  int fd, rc, err;
+
+  memset(p_ents, 0, sizeof(struct ls_entries));
+  if ( (fd = open(dirname, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 )
+    return 3;
+  if ( (rc = read_dir_entries(fd, p_ents)) == 0 )
+    stat_dir_entries(fd, p_ents);
+  err = errno;
+  close(fd);
+  errno = err; // keep the error of reading
+  return rc;
+}
+
+/* Free the entries of the scanned directory. */
+void free_dir_entries(struct ls_entries *p_ents)
+{
+  free(p_ents->items);
+  free(p_ents->names);
+  memset(p_ents, 0, sizeof(struct ls_entries));
+}
+
+/* Update directory listing settings based on the directory entry.
  *
  * This function updates various settings related to directory listing,
  * such as the number of files, the maximum length of: user (owner) names,
- * group names, file sizes, and also the total filenames length.
- * It uses the file statistics provided by the `struct stat` and name of the file,
- * and updates the settings in the `struct lsdir_setts`.
+ * group names (or their numeric ids if the names are unknown), file sizes,
+ * and also the total filenames length.
  * 
  * Parameters:
- *  p_statbuf - Pointer to a `struct stat` containing file statistics.
- *  filename  - The name of the file for which information is to be gathered.
+ *  p_entry   - Pointer to the directory entry with its file status.
+ *  len_name  - The length of the file name.
  *  p_lsd_set - Pointer to a `struct lsdir_setts` to be updated.
  */
-static void update_lsdir_setts(struct stat *p_statbuf, const char *filename, struct lsdir_setts *p_lsd_set)
+static void update_lsdir_setts(const struct ls_entry *p_entry, size_t len_name,
+                               struct lsdir_setts *p_lsd_set)
 {
-  struct passwd *pwd;
-  struct group *grp;
-  int len = 0;
+  const char *name;
+  int len;
 
-  // Update the number of files
+  // Update the number of files & the total filenames length
   p_lsd_set->numb_files++;
+  p_lsd_set->lensum_names += len_name;
 
-  // Update the max length of the user (owner) name  
-  if ((pwd = getpwuid(p_statbuf->st_uid)) != NULL) {
-    len = strlen(pwd->pw_name);
-    if (len > p_lsd_set->lenmax_usr) {
-      p_lsd_set->lenmax_usr = len;
-      LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG,
-          "Max length of the user name was updated, len_max=%d", p_lsd_set->lenmax_usr);
-    }
-  }
+  // Update the max length of the user (owner) name
+  name = get_id_name(usr_names, p_entry->uid, 0);
+  len = name ? (int)strlen(name) : numb_digits((long)p_entry->uid);
+  if (len > p_lsd_set->lenmax_usr)
+    p_lsd_set->lenmax_usr = len;
 
-  // Update the max length of the group name  
-  if ((grp = getgrgid(p_statbuf->st_gid)) != NULL) {
-    len = strlen(grp->gr_name);
-    if (len > p_lsd_set->lenmax_grp) {
-      p_lsd_set->lenmax_grp = len;
-      LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, 
-          "Max length of the group name was updated, len_max=%d", p_lsd_set->lenmax_grp);
-    }
-  }
+  // Update the max length of the group name
+  name = get_id_name(grp_names, p_entry->gid, 1);
+  len = name ? (int)strlen(name) : numb_digits((long)p_entry->gid);
+  if (len > p_lsd_set->lenmax_grp)
+    p_lsd_set->lenmax_grp = len;
 
   // Update the max file size
-  len = numb_digits(p_statbuf->st_size);
-  if (len > p_lsd_set->lenmax_size) {
+  len = numb_digits((long)p_entry->size);
+  if (len > p_lsd_set->lenmax_size)
     p_lsd_set->lenmax_size = len;
-    LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG,
-        "Max file size was updated, size_max=%d", p_lsd_set->lenmax_size);
+}
+
+/* Put the string into the buffer, padded with spaces up to the width.
+ *
+ * Parameters:
+ *  p_buff - the position in the buffer.
+ *  str    - the string to put.
+ *  len    - the length of the string.
+ *  width  - the min width of the field.
+ *  left   - 1 to justify the string to the left, 0 - to the right.
+ *
+ * Return value:
+ *  The position in the buffer after the field.
+ */
+static char *put_field(char *p_buff, const char *str, size_t len, size_t width, int left)
+{
+  size_t pad = width > len ? width - len : 0;
+  if (!left) {
+    memset(p_buff, ' ', pad);
+    p_buff += pad;
   }
+  memcpy(p_buff, str, len);
+  p_buff += len;
+  if (left) {
+    memset(p_buff, ' ', pad);
+    p_buff += pad;
+  }
+  return p_buff;
+}
 
-  // Update the total filenames length
-  p_lsd_set->lensum_names += strlen(filename);
-  LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG,
-      "Total filenames length is updated, len=%ld", p_lsd_set->lensum_names);
+/* Put the number into the buffer, padded with spaces up to the width. */
+static char *put_numb(char *p_buff, uintmax_t val, size_t width, int left)
+{
+  char digits[24];
+  char *p_dig = digits + sizeof(digits);
+  do {
+    *--p_dig = '0' + val % 10;
+  } while ((val /= 10) > 0);
+  return put_field(p_buff, p_dig, digits + sizeof(digits) - p_dig, width, left);
 }
 
-/* Calculate the total size needed to list the directory content.
- *
- * This function computes the amount of memory required to store the directory content
- * based on the specified settings. The calculation includes space for file permissions,
- * owner, group, size, date, new line characters, and all filenames.
+/* Get the localized date string of the modification time.
  *
- * NOTE. This function should be updated each time the way of listing the directory is updated
- *       in the get_file_info() function.
+ * The entries of a directory are often modified within the same minute,
+ * so the string of the last minute is reused.
  *
  * Parameters:
- *  p_lsd_set - A pointer to the lsdir_setts structure containing settings for listing the directory.
- * 
+ *  mtime - the modification time.
+ *  p_len - a pointer to the length of the string to be set.
+ *
  * Return value:
- *  The total size needed to store the directory content.
+ *  The date string, valid till the next call.
  */
-static size_t calc_dir_cont_size(const struct lsdir_setts *p_lsd_set)
+static const char *get_date_str(time_t mtime, size_t *p_len)
 {
-  return (10                          // space for file permissions
-        + 2 + p_lsd_set->lenmax_usr   // space for file owner
-        + 1 + p_lsd_set->lenmax_grp   // space for file group
-        + 1 + p_lsd_set->lenmax_size  // space for file size
-        + 1 + 17                      // space for file date
-        + 1 + 1)                      // space for new line character after the filename
-        * p_lsd_set->numb_files       // multiply on the files number
-        + p_lsd_set->lensum_names     // space for all filenames
-        + 1;                          // space for trailing NULL character
+  static char datestring[LEN_DATE_MAX];
+  static size_t len = 0;
+  static time_t min_last = -1; // the minute of the date string, -1 - no string
+  struct tm tm;
+
+  if (mtime < 0 || mtime / 60 != min_last) {
+    min_last = mtime < 0 ? -1 : mtime / 60;
+    len = localtime_r(&mtime, &tm) ? strftime(datestring, sizeof(datestring), "%b %d %R %Y", &tm) : 0;
+  }
+  *p_len = len;
+  return datestring;
 }
 
 /* Get file information.
  *
- * This function gathers and formats information about a specified file or directory.
- * It populates the provided buffer with details about the file's permissions, owner,
- * group, size, modification time, and name.
- *
- * The function performs the following steps:
- * 1. Retrieves the file status information from the passed 'stat' struct.
- * 2. Formats and appends to the provided buffer the file's type and permissions,
- *    owner, group, size, modification time, and name.
+ * This function formats information about a directory entry and puts it into the buffer:
+ * the file's type and permissions, owner, group, size, modification time, and name.
+ * The fields are formatted without sprintf().
  *
  * Parameters:
- *   p_statbuf  - Pointer to a `struct stat` that contains the file status information.
- *   filename   - The name of the file for which information is to be gathered.
+ *   p_entry    - Pointer to the directory entry with its file status.
+ *   filename   - The name of the file.
+ *   len_name   - The length of the file name.
  *   p_lsd_set  - Pointer to a `struct lsdir_setts` that contains the directory listing settings.
  *   p_buff     - Pointer to the buffer where the formatted file information will be stored.
  *
  * Return value:
- *   This function does not return a value. The formatted file information is stored in the
- *   buffer pointed to by `p_buff`.
+ *   The position in the buffer after the file information.
  *
  * Notes:
- * - The calc_dir_cont_size() function should be updated each time the way of listing 
- *   the directory is updated in this function.
- * - The `p_buff` buffer is expected to be pre-allocated and large enough to hold the formatted
- *   file information.
- * - The `str_perm` function is assumed to convert the file mode to a string representing the
- *   file's type and permissions.
+ * - The `p_buff` buffer is expected to be large enough to hold the formatted file
+ *   information, see LEN_LINE_MAX().
  * - This function prints the owner and group names if they can be retrieved using `getpwuid()`
- *   and `getgrgid()` respectively; otherwise, it prints the numeric UID and GID.
+ *   and `getgrgid()` respectively (through the cache of get_id_name()); otherwise, it prints
+ *   the numeric UID and GID.
  * - The modification time is printed in the format "%b %d %R %Y", which includes the month, day,
  *   time, and year.
  */
-static void get_file_info(struct stat *p_statbuf, const char *filename, 
-                          const struct lsdir_setts *p_lsd_set, char *p_buff)
+static char *get_file_info(const struct ls_entry *p_entry, const char *filename, size_t len_name,
+                           const struct lsdir_setts *p_lsd_set, char *p_buff)
 {
-  char           strperm[11];
-  struct passwd *pwd;
-  struct group  *grp;
-  struct tm     *tm;
-  char           datestring[32];
+  const char *str;
+  size_t len;
 
   // Print the file type and permissions
-  p_buff += sprintf(p_buff, "%s", str_perm(p_statbuf->st_mode, strperm));
-
-  // Print the file owner's name if it's found using getpwuid()
-  if ((pwd = getpwuid(p_statbuf->st_uid)) != NULL)
-    p_buff += sprintf(p_buff, "  %-*s", p_lsd_set->lenmax_usr, pwd->pw_name);
+  str_perm(p_entry->mode, p_buff);
+  p_buff += 10;
+
+  // Print the file owner's name if it's found, otherwise its id
+  *p_buff++ = ' ';
+  *p_buff++ = ' ';
+  if ((str = get_id_name(usr_names, p_entry->uid, 0)) != NULL)
+    p_buff = put_field(p_buff, str, strlen(str), p_lsd_set->lenmax_usr, 1);
   else
-    p_buff += sprintf(p_buff, "  %-*d", p_lsd_set->lenmax_usr, p_statbuf->st_uid);
+    p_buff = put_numb(p_buff, p_entry->uid, p_lsd_set->lenmax_usr, 1);
 
-  // Print the file group name if it's found using getgrgid()
-  if ((grp = getgrgid(p_statbuf->st_gid)) != NULL)
-    p_buff += sprintf(p_buff, " %-*s", p_lsd_set->lenmax_grp, grp->gr_name);
+  // Print the file group name if it's found, otherwise its id
+  *p_buff++ = ' ';
+  if ((str = get_id_name(grp_names, p_entry->gid, 1)) != NULL)
+    p_buff = put_field(p_buff, str, strlen(str), p_lsd_set->lenmax_grp, 1);
   else
-    p_buff += sprintf(p_buff, " %-*d", p_lsd_set->lenmax_grp, p_statbuf->st_gid);
+    p_buff = put_numb(p_buff, p_entry->gid, p_lsd_set->lenmax_grp, 1);
 
   // Print the file size
-  p_buff += sprintf(p_buff, " %*jd", p_lsd_set->lenmax_size, (intmax_t)p_statbuf->st_size);
+  *p_buff++ = ' ';
+  p_buff = put_numb(p_buff, (uintmax_t)p_entry->size, p_lsd_set->lenmax_size, 0);
 
-  // Get localized date string and print it
+  // Print the localized date string & the file name
   // NOTE: the 'ls' command has 2 different formats for this date&time string:
   // - if a mod.time is less than 1 year then it's used the format with time and without year,
   // - if a mod.time is more than 1 year then it's used the format without time but with year.
-  // difftime() function may be used to determine the right format similar to 'ls'.
-  // Potentially a similar approach can be used in this program, but I have decided 
-  // that printing month, day, time and year is more informative and sufficient.
-  tm = localtime(&p_statbuf->st_mtime);
-  strftime(datestring, sizeof(datestring), "%b %d %R %Y", tm);
-  p_buff += sprintf(p_buff, " %s %s\n", datestring, filename);
+  // Printing month, day, time and year is more informative and sufficient.
+  *p_buff++ = ' ';
+  str = get_date_str(p_entry->mtime, &len);
+  p_buff = put_field(p_buff, str, len, 0, 1);
+  *p_buff++ = ' ';
+  p_buff = put_field(p_buff, filename, len_name, 0, 1);
+  *p_buff++ = '\n';
+  return p_buff;
+}
+
+// The max length of the listing line of the file: the permissions, owner, group, size, date
+// & name fields with the separators, or the error message of the failed file status
+#define LEN_LINE_MAX(p_lsd_set, len_dir, len_name) \
+  (10 + 2 + (p_lsd_set)->lenmax_usr + 1 + (p_lsd_set)->lenmax_grp + 1 + (p_lsd_set)->lenmax_size + \
+   1 + LEN_DATE_MAX + 1 + 1 + (len_dir) + (len_name) + LEN_ERRMSG_MAX)
+
+/* Put the error message of the failed file status into the buffer.
+ *
+ * Return value:
+ *  The position in the buffer after the message.
+ */
+static char *get_file_error(const char *dirname, size_t len_dir, const char *filename,
+                            size_t len_name, int err, char *p_buff)
+{
+  static const char msg[] = "Cannot get the file status for:\n  ";
+  const char *errstr = strerror(err);
+  size_t len = strlen(errstr);
+
+  p_buff = put_field(p_buff, msg, sizeof(msg) - 1, 0, 1);
+  p_buff = put_field(p_buff, dirname, len_dir, 0, 1);
+  *p_buff++ = '/';
+  p_buff = put_field(p_buff, filename, len_name, 0, 1);
+  *p_buff++ = '\n';
+  p_buff = put_field(p_buff, errstr, len < LEN_ERRMSG_MAX ? len : LEN_ERRMSG_MAX - 1, 0, 1);
+  *p_buff++ = '\n';
+  return p_buff;
 }
 
 /* List the directory content into the file content (char array) stored in the file_err instance.
@@ -443,77 +694,138 @@ static void get_file_info(struct stat *p_statbuf, const char *filename,
  * the file_err structure.
  *
  * The function performs the following steps:
- * 1. Opens the specified directory.
- * 2. Iterates through the directory entries to gather settings for flexible listing.
- * 3. Initializes the file content buffer based on the calculated size of the directory content.
- * 4. Iterates through the directory entries again to populate the file content buffer 
- *    with the directory listing.
+ * 1. Reads all the directory entries at once, by large getdents64() calls.
+ * 2. Gets the file status of each entry once, relative to the opened directory.
+ * 3. Calculates the settings for flexible listing over the gathered entries.
+ * 4. Formats the listing into a growable buffer, which becomes the file content.
+ * So the time of listing is linear in the number of the entries.
  *
  * Parameters:
  *  p_flerr - Pointer to an allocated and nulled RPC struct instance to store file & error info.
+ *  pf_scan - the function reading the entries as scan_dir(): scan_dir() or the one of the storage.
  *
  * Return value:
  *  0 on success, >0 on failure.
  */
-static int ls_dir_str(file_err *p_flerr)
+static int ls_dir_str(file_err *p_flerr, int (*pf_scan)(const char *dirname, struct ls_entries *p_ents))
 {
-  DIR                *hdir; // directory handler
-  struct dirent      *de; // directory entry
-  struct stat         statbuf; // struct contains the file status information
+  struct ls_entries   ents; // the directory entries
   struct lsdir_setts  lsdir_set = lsdir_setts_dflt; // the directory listing settings
-  char               *errmsg = NULL;
+  const char         *dirname = p_flerr->file.name, *filename;
+  size_t              len_dir = strlen(dirname), len_name, len_buf = 0, len = 0, i;
+  char               *buf = NULL, *p_new; // the listing buffer
+  int                 rc;
 
-  // Open the passed directory
-  if ( (hdir = opendir(p_flerr->file.name)) == NULL ) {
+  // Read all the entries of the passed directory & get their file status
+  if ( (rc = pf_scan(dirname, &ents)) == 3 ) {
     p_flerr->err.num = 21;
     sprintf(p_flerr->err.err_inf_u.msg, "Error %i: Cannot open directory:\n'%s'\n%s\n",
-            p_flerr->err.num, p_flerr->file.name, strerror(errno));
+            p_flerr->err.num, dirname, strerror(errno));
     return p_flerr->err.num;
   }
+  if (rc == 2) {
+    p_flerr->err.num = 29;
+    sprintf(p_flerr->err.err_inf_u.msg, "Error %i: Cannot read directory:\n'%s'\n%s\n",
+            p_flerr->err.num, dirname, strerror(errno));
+  }
 
-  // Preliminary loop through directory entries to get settings values 
-  // for subsequent flexible listing of the directory content
-  while ( (de = readdir(hdir)) != NULL ) {
-    // Get the file status (info)
-    if ( get_file_stat(p_flerr->file.name, de->d_name, &statbuf, &errmsg) == 0 )
-      update_lsdir_setts(&statbuf, de->d_name, &lsdir_set);
-    else {
-      // NOTE: Decided not to print the error message here, as such error messages will be retrieved
-      // again and placed in the p_flerr->err instance during the next loop through the directories.
-      // printf("%s", errmsg);
-      free(errmsg); // free allocated memory for returned error message
+  // Calculate the settings for flexible listing of the directory content
+  for (i = 0; rc == 0 && i < ents.numb; ++i)
+    if (ents.items[i].err == 0)
+      update_lsdir_setts(&ents.items[i], strlen(ents.names + ents.items[i].offs_name), &lsdir_set);
+
+  // Format the entries into the growable buffer
+  for (i = 0; rc == 0 && i < ents.numb; ++i) {
+    filename = ents.names + ents.items[i].offs_name;
+    len_name = strlen(filename);
+    if (len + LEN_LINE_MAX(&lsdir_set, len_dir, len_name) + 1 > len_buf) {
+      if ( (p_new = grow_array(buf, &len_buf, len + LEN_LINE_MAX(&lsdir_set, len_dir, len_name) + 1,
+                               1)) == NULL ) {
+        rc = 1;
+        break;
+      }
+      buf = p_new;
     }
+    if (ents.items[i].err == 0)
+      len = get_file_info(&ents.items[i], filename, len_name, &lsdir_set, buf + len) - buf;
+    else
+      len = get_file_error(dirname, len_dir, filename, len_name, ents.items[i].err, buf + len) - buf;
   }
+  free_dir_entries(&ents);
 
-  // Init the file content before filling it with directory listing data
-  if ( reset_file_cont(&p_flerr->file.cont, calc_dir_cont_size(&lsdir_set)) != 0 ) {
+  // Pass the buffer to the file content
+  if (rc == 0 && !buf && (buf = malloc(1)) == NULL)
+    rc = 1;
+  if (rc == 1) {
+    free(buf);
     p_flerr->err.num = 22;
     sprintf(p_flerr->err.err_inf_u.msg,
             "Error %i: Failed to init the file content\n", p_flerr->err.num);
     return p_flerr->err.num;
   }
+  if (rc != 0)
+    return p_flerr->err.num;
+  buf[len] = '\0';
+  free_file_cont(&p_flerr->file.cont);
+  p_flerr->file.cont.t_flcont_val = buf;
+  p_flerr->file.cont.t_flcont_len = len + 1;
+  return 0;
+}
+
+// The cache of the directory listings, NULL - no cache
+static const struct ls_dir_cache *p_lsdir_cache = NULL;
+
+/* Set the cache of the directory listings. */
+void set_ls_dir_cache(const struct ls_dir_cache *p_cache)
+{
+  p_lsdir_cache = p_cache;
+}
 
-  // Reset the position of directory stream to the beginning
-  rewinddir(hdir);
-
-  // Loop through directory entries to get entry info with flexible fields width
-  char *p_curr; // pointer to the current position in the dir content buffer
-  while ( (de = readdir(hdir)) != NULL ) {
-    // Calc the current position in buffer where to place the next (in this iteration) portion of data
-    p_curr = p_flerr->file.cont.t_flcont_val + strlen(p_flerr->file.cont.t_flcont_val);
-    
-    // Get the file status (info)
-    if ( get_file_stat(p_flerr->file.name, de->d_name, &statbuf, &errmsg) == 0 )
-      get_file_info(&statbuf, de->d_name, &lsdir_set, p_curr); // get entry info and add it to the buffer
-    else {
-      strcpy(p_curr, errmsg); // copy the error message to the buffer
-      free(errmsg); // free allocated memory
+/* List the directory content using the cache of the directory listings if it's set.
+ *
+ * Parameters:
+ *  p_flerr - Pointer to an allocated and nulled RPC struct instance to store file & error info.
+ *
+ * Return value:
+ *  0 on success, >0 on failure.
+ */
+static int ls_dir_cached(file_err *p_flerr)
+{
+  const char *listing;
+  size_t len;
+
+  if (!p_lsdir_cache)
+    return ls_dir_str(p_flerr, scan_dir);
+
+  // Copy the cached listing into the file content
+  if ( (listing = p_lsdir_cache->get(p_flerr->file.name)) != NULL ) {
+    len = strlen(listing) + 1;
+    if ( reset_file_cont(&p_flerr->file.cont, len) != 0 ) {
+      p_flerr->err.num = 22;
+      sprintf(p_flerr->err.err_inf_u.msg,
+              "Error %i: Failed to init the file content\n", p_flerr->err.num);
+      return p_flerr->err.num;
     }
+    memcpy(p_flerr->file.cont.t_flcont_val, listing, len);
+    LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, "cached listing of: %s", p_flerr->file.name);
+    return 0;
   }
-  closedir(hdir);
+
+  if (ls_dir_str(p_flerr, scan_dir) != 0)
+    return p_flerr->err.num;
+  p_lsdir_cache->put(p_flerr->file.name, p_flerr->file.cont.t_flcont_val);
   return 0;
 }
 
+// The storage of the picked files other than the file system, NULL - none
+static const struct ls_store *p_ls_store = NULL;
+
+/* Set the storage of the picked files other than the file system. */
+void set_ls_store(const struct ls_store *p_store)
+{
+  p_ls_store = p_store;
+}
+
 /* Select a file: determine its type and get its full (absolute) path.
  *
  * This function determines the type of the specified file and converts its
@@ -538,11 +850,14 @@ static int ls_dir_str(file_err *p_flerr)
  *       Any other value from the `filetype` enum indicates a file system-related error.
  * - For source file selection, only regular files can be selected.
  * - For target file selection, only non-existent files are valid.
+ * The file of the storage set by set_ls_store() is looked up first, its path is kept as passed.
  */
 file_err * select_file(picked_file *p_flpicked)
 {
   LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, "Begin, picked file: %s", p_flpicked->name);
   static file_err flerr;
+  struct stat statbuf;
+  int stored = -1; // the result of the lookup in the storage, -1 if the file isn't there
   flerr.file.type = FTYPE_DFL; // reset the file type
   LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, "file_err created, ptr=%p, filetype set to default", &flerr);
 
@@ -565,8 +880,12 @@ file_err * select_file(picked_file *p_flpicked)
   }
   LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, "file_err object has been reset, ptr=%p", &flerr);
 
-  // Determine the file type
-  flerr.file.type = get_file_type(p_flpicked->name);
+  // Determine the file type, the storage other than the file system is looked up first
+  if ( p_ls_store && (stored = p_ls_store->stat(p_flpicked->name, &statbuf)) != -1 )
+    flerr.file.type = stored ? FTYPE_NEX : S_ISDIR(statbuf.st_mode) ? FTYPE_DIR :
+                      S_ISREG(statbuf.st_mode) ? FTYPE_REG : FTYPE_OTH;
+  else
+    flerr.file.type = get_file_type(p_flpicked->name);
   LOG(LOG_TYPE_SLCT, LOG_LEVEL_DEBUG, "file type: %d", (int)flerr.file.type);
 
   // Process the case of non-existent file required for the target file.
@@ -594,9 +913,12 @@ file_err * select_file(picked_file *p_flpicked)
     return &flerr;
   }
 
-  // Convert the passed path into the full (absolute) path - needed to any type of existent file
+  // Convert the passed path into the full (absolute) path - needed to any type of existent file,
+  // the path of the storage is kept as is
   char *errmsg = NULL;
-  if ( !rel_to_full_path(p_flpicked->name, flerr.file.name, &errmsg) ) {
+  if (stored == 0)
+    copy_path(p_flpicked->name, flerr.file.name);
+  else if ( !rel_to_full_path(p_flpicked->name, flerr.file.name, &errmsg) ) {
     flerr.err.num = 25;
     sprintf(flerr.err.err_inf_u.msg, "Error %i: %s\n", flerr.err.num, errmsg);
     free(errmsg); // free allocated memory
@@ -609,7 +931,7 @@ file_err * select_file(picked_file *p_flpicked)
     case FTYPE_DIR: /* directory */
       // Get the directory content and save it to file_err instance
       // If error has occurred it sets to flerr, no need to check the RC
-      (void)ls_dir_str(&flerr);
+      (void)(stored == 0 ? ls_dir_str(&flerr, p_ls_store->scan) : ls_dir_cached(&flerr));
       break;
 
     case FTYPE_REG: /* regular file */
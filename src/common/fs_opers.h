@@ -2,6 +2,9 @@
 #define _FS_OPERS_H_
 
 #include <stdio.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
 
 /*
  * Forward definitions for the types defined in the RPC protocol. The actual types
@@ -36,6 +39,18 @@ enum { ERRNUM_ERRINF_ERR = -1 };
  */
 enum filetype get_file_type(const char *filepath);
 
+/* Convert file permissions from numeric to symbolic form used by the `ls -l` command.
+ *
+ * Parameters:
+ *  mode    - The mode of the file.
+ *  strmode - A pointer to a character array where the symbolic representation 
+ *            will be stored. The array must be at least 11 characters long.
+ * 
+ * Return value:
+ *  A pointer to the `strmode` character array.
+ */
+char * str_perm(mode_t mode, char *strmode);
+
 /* Get the file size in bytes.
  *
  * This function calculates the size of a file by seeking to the end of the file,
@@ -68,6 +83,90 @@ size_t get_file_size(FILE *hfile);
  */
 int copy_path(const char *path_src, char *path_trg);
 
+// The entry of the scanned directory: its name & the file status needed for the listing
+struct ls_entry {
+  size_t offs_name;     // offset of the file name in the names buffer
+  int err;              // errno of the failed stat, 0 on success
+  mode_t mode;          // the file type & permissions
+  uid_t uid;            // the file owner
+  gid_t gid;            // the file group
+  off_t size;           // the file size
+  time_t mtime;         // the modification time
+  long mtime_nsec;      // nanoseconds of the modification time
+  ino_t ino;            // the inode number
+};
+
+// The entries of the scanned directory in the directory order
+struct ls_entries {
+  struct ls_entry *items;   // the entries
+  size_t numb, numb_max;    // number of the entries & of the allocated ones
+  char *names;              // the NULL-terminated file names of the entries
+  size_t len_names, len_names_max; // length of the names & of the allocated buffer
+};
+
+/* Scan the directory: read all its entries & get their file status.
+ *
+ * The entries are read by large getdents64() calls, and each of them is stat'ed once
+ * (in parallel for a large directory). The entries must be freed by free_dir_entries()
+ * in any case.
+ *
+ * Parameters:
+ *  dirname - the path of the directory.
+ *  p_ents  - a pointer to the entries to be filled.
+ *
+ * Return value:
+ *  0 on success, 1 for the memory allocation failure, 2 for the reading error,
+ *  3 if the directory can't be opened (errno is set for the last two).
+ */
+int scan_dir(const char *dirname, struct ls_entries *p_ents);
+
+/* Free the entries of the scanned directory.
+ *
+ * Parameters:
+ *  p_ents - a pointer to the entries filled by scan_dir().
+ */
+void free_dir_entries(struct ls_entries *p_ents);
+
+/*
+ * The cache of the directory listings made by select_file().
+ * The listing is cached by the full path of the directory, as the text sent to the client.
+ */
+struct ls_dir_cache {
+  /* Get the cached listing of the directory, or NULL if it's not cached. On a miss the cache
+   * should start tracking the changes of the directory, as it's going to be listed. */
+  const char * (*get)(const char *dirname);
+  /* Store the listing of the directory that was missed by get() */
+  void (*put)(const char *dirname, const char *listing);
+};
+
+/* Set the cache of the directory listings.
+ *
+ * Without the cache each selection of a directory lists it anew.
+ *
+ * Parameters:
+ *  p_cache - a pointer to the cache functions, it must remain valid; NULL - no cache.
+ */
+void set_ls_dir_cache(const struct ls_dir_cache *p_cache);
+
+/*
+ * The storage of the files picked by select_file() other than the file system, e.g. the backends
+ * & the storage layout of the Server. Its paths are neither resolved nor cached by the listings.
+ */
+struct ls_store {
+  /* Get the status of the file: return 0, 1 if the storage has no such file, -1 if the path
+   * isn't in the storage (it's picked from the file system then) */
+  int (*stat)(const char *name, struct stat *p_stat);
+  /* Scan the directory of the storage as scan_dir() */
+  int (*scan)(const char *dirname, struct ls_entries *p_ents);
+};
+
+/* Set the storage of the picked files other than the file system.
+ *
+ * Parameters:
+ *  p_store - a pointer to the storage functions, it must remain valid; NULL - no storage.
+ */
+void set_ls_store(const struct ls_store *p_store);
+
 /* Select a file: determine its type and get its full (absolute) path.
  *
  * This function determines the type of the specified file and converts its
@@ -92,6 +191,7 @@ int copy_path(const char *path_src, char *path_trg);
  *       Any other value from the `filetype` enum indicates a file system-related error.
  * - For source file selection, only regular files can be selected.
  * - For target file selection, only non-existent files are valid.
+ * The file of the storage set by set_ls_store() is looked up first, its path is kept as passed.
  */
 file_err * select_file(picked_file *p_flpicked);
 
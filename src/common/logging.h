@@ -55,6 +55,111 @@
 #define LOG_TYPE_FLOP 1
 #endif
 
+// Debug messages for the server event loop
+#ifndef LOG_TYPE_LOOP
+#define LOG_TYPE_LOOP 0
+#endif
+
+// Debug messages for the server requests scheduler
+#ifndef LOG_TYPE_SCHD
+#define LOG_TYPE_SCHD 0
+#endif
+
+// Debug messages for the upload sessions
+#ifndef LOG_TYPE_UPLD
+#define LOG_TYPE_UPLD 0
+#endif
+
+// Debug messages for the admission control
+#ifndef LOG_TYPE_ADMT
+#define LOG_TYPE_ADMT 0
+#endif
+
+// Debug messages for the content cache
+#ifndef LOG_TYPE_CACH
+#define LOG_TYPE_CACH 0
+#endif
+
+// Debug messages for the directory listing cache
+#ifndef LOG_TYPE_DIRC
+#define LOG_TYPE_DIRC 0
+#endif
+
+// Debug messages for the requests coalescing
+#ifndef LOG_TYPE_FLGT
+#define LOG_TYPE_FLGT 0
+#endif
+
+// Debug messages for the paginated directory listing
+#ifndef LOG_TYPE_DPAG
+#define LOG_TYPE_DPAG 0
+#endif
+
+// Debug messages for the versioned directory listings
+#ifndef LOG_TYPE_DDLT
+#define LOG_TYPE_DDLT 0
+#endif
+
+// Debug messages for the directory usage
+#ifndef LOG_TYPE_DUSG
+#define LOG_TYPE_DUSG 0
+#endif
+
+// Debug messages for the file name index
+#ifndef LOG_TYPE_NIDX
+#define LOG_TYPE_NIDX 0
+#endif
+
+// Debug messages for the cache of the file descriptors
+#ifndef LOG_TYPE_FDCH
+#define LOG_TYPE_FDCH 0
+#endif
+
+// Debug messages for the read-ahead of the downloaded files
+#ifndef LOG_TYPE_RDAH
+#define LOG_TYPE_RDAH 0
+#endif
+
+// Debug messages for the reading through io_uring
+#ifndef LOG_TYPE_RING
+#define LOG_TYPE_RING 0
+#endif
+
+// Debug messages for the transfers bypassing the page cache
+#ifndef LOG_TYPE_DRIO
+#define LOG_TYPE_DRIO 0
+#endif
+
+// Debug messages for the durability of the uploaded files
+#ifndef LOG_TYPE_DURB
+#define LOG_TYPE_DURB 0
+#endif
+
+// Debug messages for the storage layout over the data directories
+#ifndef LOG_TYPE_DDIR
+#define LOG_TYPE_DDIR 0
+#endif
+
+// Debug messages for the per-device I/O queues
+#ifndef LOG_TYPE_DEVQ
+#define LOG_TYPE_DEVQ 0
+#endif
+
+// Debug messages for the pack store of the small files
+#ifndef LOG_TYPE_PACK
+#define LOG_TYPE_PACK 0
+#endif
+
+// Debug messages for the pluggable storage backends
+#ifndef LOG_TYPE_SBCK
+#define LOG_TYPE_SBCK 0
+#endif
+
+// Debug messages for the compressed-at-rest storage
+#ifndef LOG_TYPE_ZIP
+#define LOG_TYPE_ZIP 0
+#endif
+
 // String representations for log levels
 static const char* log_level_str(int level)
 {
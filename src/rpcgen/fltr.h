@@ -15,6 +15,11 @@ extern "C" {
 
 #define LEN_PATH_MAX 4096
 #define LEN_ERRMSG_MAX 4096
+#define LEN_CHUNK_MAX 4194304
+#define ERRNUM_BUSY 66
+#define ERRNUM_PLAIN 67
+#define LEN_LIST_MAX 10000
+#define LEN_SEARCH_MAX 1000
 
 typedef char *t_flname;
 
@@ -66,6 +71,184 @@ struct file_err {
 };
 typedef struct file_err file_err;
 
+struct chunk_req {
+	t_flname name;
+	u_quad_t offs;
+	u_int size;
+};
+typedef struct chunk_req chunk_req;
+
+struct chunk_cont {
+	u_quad_t offs;
+	t_flcont cont;
+	bool_t last;
+};
+typedef struct chunk_cont chunk_cont;
+
+struct chunk_inf {
+	t_flname name;
+	u_quad_t size;
+	chunk_cont chunk;
+};
+typedef struct chunk_inf chunk_inf;
+
+struct chunk_err {
+	chunk_cont chunk;
+	err_inf err;
+};
+typedef struct chunk_err chunk_err;
+
+enum list_sort {
+	ls_sort_none = 0,
+	ls_sort_name = 1,
+	ls_sort_size = 2,
+	ls_sort_mtime = 3,
+};
+typedef enum list_sort list_sort;
+
+struct list_req {
+	t_flname path;
+	u_quad_t cursor;
+	u_int limit;
+	list_sort sort;
+	bool_t desc;
+	t_flname filter;
+};
+typedef struct list_req list_req;
+
+struct dir_item {
+	t_flname name;
+	filetype type;
+	u_quad_t size;
+	quad_t mtime;
+	u_int mode;
+	u_int uid;
+	u_int gid;
+};
+typedef struct dir_item dir_item;
+
+struct list_page {
+	t_flname path;
+	struct {
+		u_int items_len;
+		dir_item *items_val;
+	} items;
+	u_quad_t total;
+	u_quad_t cursor;
+};
+typedef struct list_page list_page;
+
+struct list_err {
+	list_page list;
+	err_inf err;
+};
+typedef struct list_err list_err;
+
+enum item_change {
+	ch_added = 0,
+	ch_removed = 1,
+	ch_modified = 2,
+};
+typedef enum item_change item_change;
+
+struct delta_req {
+	t_flname path;
+	u_quad_t gen;
+};
+typedef struct delta_req delta_req;
+
+struct delta_item {
+	item_change change;
+	dir_item item;
+};
+typedef struct delta_item delta_item;
+
+struct dir_delta {
+	t_flname path;
+	u_quad_t gen;
+	bool_t full;
+	struct {
+		u_int items_len;
+		delta_item *items_val;
+	} items;
+};
+typedef struct dir_delta dir_delta;
+
+struct delta_err {
+	dir_delta delta;
+	err_inf err;
+};
+typedef struct delta_err delta_err;
+
+struct usage_inf {
+	t_flname path;
+	u_quad_t bytes;
+	u_quad_t disk_bytes;
+	u_quad_t numb_files;
+	u_quad_t numb_dirs;
+	u_quad_t numb_errors;
+	bool_t complete;
+};
+typedef struct usage_inf usage_inf;
+
+struct usage_err {
+	usage_inf usage;
+	err_inf err;
+};
+typedef struct usage_err usage_err;
+
+struct search_req {
+	t_flname pattern;
+	u_int limit;
+};
+typedef struct search_req search_req;
+
+struct found_item {
+	t_flname path;
+	filetype type;
+};
+typedef struct found_item found_item;
+
+struct found_list {
+	t_flname root;
+	struct {
+		u_int items_len;
+		found_item *items_val;
+	} items;
+	u_quad_t total;
+	quad_t built;
+};
+typedef struct found_list found_list;
+
+struct search_err {
+	found_list found;
+	err_inf err;
+};
+typedef struct search_err search_err;
+
+struct zip_block {
+	u_int size;
+	t_flcont cont;
+};
+typedef struct zip_block zip_block;
+
+struct block_cont {
+	u_quad_t offs;
+	u_quad_t total;
+	struct {
+		u_int blocks_len;
+		zip_block *blocks_val;
+	} blocks;
+	bool_t last;
+};
+typedef struct block_cont block_cont;
+
+struct block_err {
+	block_cont blks;
+	err_inf err;
+};
+typedef struct block_err block_err;
+
 #define FLTRPROG 0x20000027
 #define FLTRVERS 1
 
@@ -79,6 +262,30 @@ extern  file_err * download_file_1_svc(t_flname *, struct svc_req *);
 #define pick_file 3
 extern  file_err * pick_file_1(picked_file *, CLIENT *);
 extern  file_err * pick_file_1_svc(picked_file *, struct svc_req *);
+#define upload_chunk 4
+extern  err_inf * upload_chunk_1(chunk_inf *, CLIENT *);
+extern  err_inf * upload_chunk_1_svc(chunk_inf *, struct svc_req *);
+#define download_chunk 5
+extern  chunk_err * download_chunk_1(chunk_req *, CLIENT *);
+extern  chunk_err * download_chunk_1_svc(chunk_req *, struct svc_req *);
+#define list_dir 6
+extern  list_err * list_dir_1(list_req *, CLIENT *);
+extern  list_err * list_dir_1_svc(list_req *, struct svc_req *);
+#define list_delta 7
+extern  delta_err * list_delta_1(delta_req *, CLIENT *);
+extern  delta_err * list_delta_1_svc(delta_req *, struct svc_req *);
+#define dir_usage 8
+extern  usage_err * dir_usage_1(t_flname *, CLIENT *);
+extern  usage_err * dir_usage_1_svc(t_flname *, struct svc_req *);
+#define search_names 9
+extern  search_err * search_names_1(search_req *, CLIENT *);
+extern  search_err * search_names_1_svc(search_req *, struct svc_req *);
+#define download_blocks 10
+extern  block_err * download_blocks_1(chunk_req *, CLIENT *);
+extern  block_err * download_blocks_1_svc(chunk_req *, struct svc_req *);
+#define zip_prefix 11
+extern  t_flname * zip_prefix_1(void *, CLIENT *);
+extern  t_flname * zip_prefix_1_svc(void *, struct svc_req *);
 extern int fltrprog_1_freeresult (SVCXPRT *, xdrproc_t, caddr_t);
 
 #else /* K&R C */
@@ -91,6 +298,30 @@ extern  file_err * download_file_1_svc();
 #define pick_file 3
 extern  file_err * pick_file_1();
 extern  file_err * pick_file_1_svc();
+#define upload_chunk 4
+extern  err_inf * upload_chunk_1();
+extern  err_inf * upload_chunk_1_svc();
+#define download_chunk 5
+extern  chunk_err * download_chunk_1();
+extern  chunk_err * download_chunk_1_svc();
+#define list_dir 6
+extern  list_err * list_dir_1();
+extern  list_err * list_dir_1_svc();
+#define list_delta 7
+extern  delta_err * list_delta_1();
+extern  delta_err * list_delta_1_svc();
+#define dir_usage 8
+extern  usage_err * dir_usage_1();
+extern  usage_err * dir_usage_1_svc();
+#define search_names 9
+extern  search_err * search_names_1();
+extern  search_err * search_names_1_svc();
+#define download_blocks 10
+extern  block_err * download_blocks_1();
+extern  block_err * download_blocks_1_svc();
+#define zip_prefix 11
+extern  t_flname * zip_prefix_1();
+extern  t_flname * zip_prefix_1_svc();
 extern int fltrprog_1_freeresult ();
 #endif /* K&R C */
 
@@ -105,6 +336,29 @@ extern  bool_t xdr_picked_file (XDR *, picked_file*);
 extern  bool_t xdr_file_inf (XDR *, file_inf*);
 extern  bool_t xdr_err_inf (XDR *, err_inf*);
 extern  bool_t xdr_file_err (XDR *, file_err*);
+extern  bool_t xdr_chunk_req (XDR *, chunk_req*);
+extern  bool_t xdr_chunk_cont (XDR *, chunk_cont*);
+extern  bool_t xdr_chunk_inf (XDR *, chunk_inf*);
+extern  bool_t xdr_chunk_err (XDR *, chunk_err*);
+extern  bool_t xdr_list_sort (XDR *, list_sort*);
+extern  bool_t xdr_list_req (XDR *, list_req*);
+extern  bool_t xdr_dir_item (XDR *, dir_item*);
+extern  bool_t xdr_list_page (XDR *, list_page*);
+extern  bool_t xdr_list_err (XDR *, list_err*);
+extern  bool_t xdr_item_change (XDR *, item_change*);
+extern  bool_t xdr_delta_req (XDR *, delta_req*);
+extern  bool_t xdr_delta_item (XDR *, delta_item*);
+extern  bool_t xdr_dir_delta (XDR *, dir_delta*);
+extern  bool_t xdr_delta_err (XDR *, delta_err*);
+extern  bool_t xdr_usage_inf (XDR *, usage_inf*);
+extern  bool_t xdr_usage_err (XDR *, usage_err*);
+extern  bool_t xdr_search_req (XDR *, search_req*);
+extern  bool_t xdr_found_item (XDR *, found_item*);
+extern  bool_t xdr_found_list (XDR *, found_list*);
+extern  bool_t xdr_search_err (XDR *, search_err*);
+extern  bool_t xdr_zip_block (XDR *, zip_block*);
+extern  bool_t xdr_block_cont (XDR *, block_cont*);
+extern  bool_t xdr_block_err (XDR *, block_err*);
 
 #else /* K&R C */
 extern bool_t xdr_t_flname ();
@@ -115,6 +369,29 @@ extern bool_t xdr_picked_file ();
 extern bool_t xdr_file_inf ();
 extern bool_t xdr_err_inf ();
 extern bool_t xdr_file_err ();
+extern bool_t xdr_chunk_req ();
+extern bool_t xdr_chunk_cont ();
+extern bool_t xdr_chunk_inf ();
+extern bool_t xdr_chunk_err ();
+extern bool_t xdr_list_sort ();
+extern bool_t xdr_list_req ();
+extern bool_t xdr_dir_item ();
+extern bool_t xdr_list_page ();
+extern bool_t xdr_list_err ();
+extern bool_t xdr_item_change ();
+extern bool_t xdr_delta_req ();
+extern bool_t xdr_delta_item ();
+extern bool_t xdr_dir_delta ();
+extern bool_t xdr_delta_err ();
+extern bool_t xdr_usage_inf ();
+extern bool_t xdr_usage_err ();
+extern bool_t xdr_search_req ();
+extern bool_t xdr_found_item ();
+extern bool_t xdr_found_list ();
+extern bool_t xdr_search_err ();
+extern bool_t xdr_zip_block ();
+extern bool_t xdr_block_cont ();
+extern bool_t xdr_block_err ();
 
 #endif /* K&R C */
 
@@ -4,6 +4,11 @@
 
 const LEN_PATH_MAX = 4096; /* max length for file names, equal to standard PATH_MAX */
 const LEN_ERRMSG_MAX = 4096; /* max length for error messages */
+const LEN_CHUNK_MAX = 4194304; /* max size of the file chunk transferred by one request */
+const ERRNUM_BUSY = 66; /* the server is busy, the chunk request should be retried later */
+const ERRNUM_PLAIN = 67; /* the file isn't stored compressed, it should be downloaded by chunks */
+const LEN_LIST_MAX = 10000; /* max number of the directory entries returned by one list_dir request */
+const LEN_SEARCH_MAX = 1000; /* max number of the paths returned by one search_names request */
 
 typedef string t_flname<LEN_PATH_MAX>; /* file name type */
 typedef opaque t_flcont<>; /* file content type */
@@ -52,11 +57,181 @@ struct file_err {
   err_inf err; /* error info */
 };
 
+/* The chunk of file requested for Download */
+struct chunk_req {
+  t_flname name;        /* file name */
+  unsigned hyper offs;  /* offset of the chunk in the file */
+  unsigned int size;    /* chunk size, up to LEN_CHUNK_MAX */
+};
+
+/* The chunk content */
+struct chunk_cont {
+  unsigned hyper offs;  /* offset of the chunk in the file */
+  t_flcont cont;        /* chunk content */
+  bool last;            /* the last chunk: the end of file on Download, completion of Upload */
+};
+
+/* The chunk of file to be Uploaded */
+struct chunk_inf {
+  t_flname name;        /* file name */
+  unsigned hyper size;  /* total file size, the free disk space is checked by the first chunk */
+  chunk_cont chunk;     /* chunk content */
+};
+
+/* Chunk & error info */
+struct chunk_err {
+  chunk_cont chunk;     /* chunk content */
+  err_inf err;          /* error info */
+};
+
+/* The sort keys of the directory listing */
+enum list_sort {
+  ls_sort_none,   /* the directory order */
+  ls_sort_name,   /* file name */
+  ls_sort_size,   /* file size */
+  ls_sort_mtime   /* modification time */
+};
+
+/* The request of a page of the directory listing */
+struct list_req {
+  t_flname path;        /* directory path */
+  unsigned hyper cursor; /* position of the page in the sorted & filtered listing, 0 - the first page */
+  unsigned int limit;   /* max number of entries in the page, up to LEN_LIST_MAX */
+  list_sort sort;       /* sort key */
+  bool desc;            /* descending order */
+  t_flname filter;      /* glob pattern of the file names, "" - all the entries */
+};
+
+/* The directory entry */
+struct dir_item {
+  t_flname name;        /* file name */
+  filetype type;        /* file type, FTYPE_INV if the file status can't be got */
+  unsigned hyper size;  /* file size */
+  hyper mtime;          /* modification time, seconds since the Epoch */
+  unsigned int mode;    /* file type & permissions */
+  unsigned int uid;     /* file owner */
+  unsigned int gid;     /* file group */
+};
+
+/* The page of the directory listing */
+struct list_page {
+  t_flname path;        /* full (absolute) path of the directory */
+  dir_item items<LEN_LIST_MAX>; /* the entries */
+  unsigned hyper total; /* number of the entries matching the filter */
+  unsigned hyper cursor; /* cursor of the next page, 0 - no more entries */
+};
+
+/* Listing page & error info */
+struct list_err {
+  list_page list;       /* listing page */
+  err_inf err;          /* error info */
+};
+
+/* The change of the directory entry since the known generation of the listing */
+enum item_change {
+  ch_added,       /* the entry was added */
+  ch_removed,     /* the entry was removed, only its name is set */
+  ch_modified     /* the file status of the entry was changed */
+};
+
+/* The request of the changes of the directory listing */
+struct delta_req {
+  t_flname path;        /* directory path */
+  unsigned hyper gen;   /* generation of the listing known by the client, 0 - none */
+};
+
+/* The changed directory entry */
+struct delta_item {
+  item_change change;   /* kind of the change */
+  dir_item item;        /* the entry */
+};
+
+/* The changes of the directory listing */
+struct dir_delta {
+  t_flname path;        /* full (absolute) path of the directory */
+  unsigned hyper gen;   /* current generation of the listing */
+  bool full;            /* the changes since the known generation are unknown, the whole listing is sent */
+  delta_item items<>;   /* the changed entries, or all the entries (as added) if `full` */
+};
+
+/* Listing changes & error info */
+struct delta_err {
+  dir_delta delta;      /* listing changes */
+  err_inf err;          /* error info */
+};
+
+/* The disk usage of the directory subtree */
+struct usage_inf {
+  t_flname path;              /* full (absolute) path of the directory */
+  unsigned hyper bytes;       /* total size of the files */
+  unsigned hyper disk_bytes;  /* disk space used by the files & directories */
+  unsigned hyper numb_files;  /* number of the files (all the entries except directories) */
+  unsigned hyper numb_dirs;   /* number of the directories, including the passed one */
+  unsigned hyper numb_errors; /* number of the entries that can't be read or stat'ed */
+  bool complete;              /* FALSE if the time limit was reached and the usage is partial;
+                                 the request should be repeated, the scanned directories are cached */
+};
+
+/* Disk usage & error info */
+struct usage_err {
+  usage_inf usage;      /* disk usage */
+  err_inf err;          /* error info */
+};
+
+/* The request of the file name search */
+struct search_req {
+  t_flname pattern;     /* case-insensitive substring of the file names; with '/' - of the paths */
+  unsigned int limit;   /* max number of the found paths, up to LEN_SEARCH_MAX */
+};
+/* The found file */
+struct found_item {
+  t_flname path;        /* full (absolute) path of the file */
+  filetype type;        /* FTYPE_DIR, FTYPE_REG or FTYPE_OTH */
+};
+/* The found files: the names starting with the pattern first, then the others, the shallower first */
+struct found_list {
+  t_flname root;        /* the indexed directory */
+  found_item items<LEN_SEARCH_MAX>; /* the found files */
+  unsigned hyper total; /* number of the files matching the pattern */
+  hyper built;          /* time the index was last changed, seconds since the Epoch */
+};
+/* Found files & error info */
+struct search_err {
+  found_list found;     /* found files */
+  err_inf err;          /* error info */
+};
+/* The block of file stored compressed */
+struct zip_block {
+  unsigned int size;    /* uncompressed size of the block */
+  t_flcont cont;        /* the block compressed by zlib, or the block as is if its length equals the size */
+};
+
+/* The blocks of file as they are stored */
+struct block_cont {
+  unsigned hyper offs;  /* uncompressed offset of the first block in the file */
+  unsigned hyper total; /* uncompressed size of the file */
+  zip_block blocks<>;   /* the consecutive blocks */
+  bool last;            /* the blocks reach the end of file */
+};
+
+/* Blocks & error info */
+struct block_err {
+  block_cont blks;      /* the blocks */
+  err_inf err;          /* error info, ERRNUM_PLAIN if the file isn't stored compressed */
+};
 /* The file transfer program definition */
 program FLTRPROG {
    version FLTRVERS {
      err_inf upload_file(file_inf fileinf) = 1;
      file_err download_file(t_flname filename) = 2;
      file_err pick_file(picked_file filename) = 3;
+     err_inf upload_chunk(chunk_inf chunkinf) = 4;
+     chunk_err download_chunk(chunk_req chunkreq) = 5;
+     list_err list_dir(list_req listreq) = 6;
+     delta_err list_delta(delta_req deltareq) = 7;
+     usage_err dir_usage(t_flname dirname) = 8;
+     search_err search_names(search_req searchreq) = 9;
+     block_err download_blocks(chunk_req chunkreq) = 10;
+     t_flname zip_prefix(void) = 11;
    } = 1;
 } = 0x20000027;
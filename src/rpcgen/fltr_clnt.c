@@ -53,3 +53,123 @@ pick_file_1(picked_file *argp, CLIENT *clnt)
 	}
 	return (&clnt_res);
 }
+
+err_inf *
+upload_chunk_1(chunk_inf *argp, CLIENT *clnt)
+{
+	static err_inf clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, upload_chunk,
+		(xdrproc_t) xdr_chunk_inf, (caddr_t) argp,
+		(xdrproc_t) xdr_err_inf, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+chunk_err *
+download_chunk_1(chunk_req *argp, CLIENT *clnt)
+{
+	static chunk_err clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, download_chunk,
+		(xdrproc_t) xdr_chunk_req, (caddr_t) argp,
+		(xdrproc_t) xdr_chunk_err, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+list_err *
+list_dir_1(list_req *argp, CLIENT *clnt)
+{
+	static list_err clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, list_dir,
+		(xdrproc_t) xdr_list_req, (caddr_t) argp,
+		(xdrproc_t) xdr_list_err, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+delta_err *
+list_delta_1(delta_req *argp, CLIENT *clnt)
+{
+	static delta_err clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, list_delta,
+		(xdrproc_t) xdr_delta_req, (caddr_t) argp,
+		(xdrproc_t) xdr_delta_err, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+usage_err *
+dir_usage_1(t_flname *argp, CLIENT *clnt)
+{
+	static usage_err clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, dir_usage,
+		(xdrproc_t) xdr_t_flname, (caddr_t) argp,
+		(xdrproc_t) xdr_usage_err, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+search_err *
+search_names_1(search_req *argp, CLIENT *clnt)
+{
+	static search_err clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, search_names,
+		(xdrproc_t) xdr_search_req, (caddr_t) argp,
+		(xdrproc_t) xdr_search_err, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+block_err *
+download_blocks_1(chunk_req *argp, CLIENT *clnt)
+{
+	static block_err clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, download_blocks,
+		(xdrproc_t) xdr_chunk_req, (caddr_t) argp,
+		(xdrproc_t) xdr_block_err, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
+
+t_flname *
+zip_prefix_1(void *argp, CLIENT *clnt)
+{
+	static t_flname clnt_res;
+
+	memset((char *)&clnt_res, 0, sizeof(clnt_res));
+	if (clnt_call (clnt, zip_prefix,
+		(xdrproc_t) xdr_void, (caddr_t) argp,
+		(xdrproc_t) xdr_t_flname, (caddr_t) &clnt_res,
+		TIMEOUT) != RPC_SUCCESS) {
+		return (NULL);
+	}
+	return (&clnt_res);
+}
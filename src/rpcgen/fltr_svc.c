@@ -16,13 +16,20 @@
 #define SIG_PF void(*)(int)
 #endif
 
-static void
+void
 fltrprog_1(struct svc_req *rqstp, register SVCXPRT *transp)
 {
 	union {
 		file_inf upload_file_1_arg;
 		t_flname download_file_1_arg;
 		picked_file pick_file_1_arg;
+		chunk_inf upload_chunk_1_arg;
+		chunk_req download_chunk_1_arg;
+		list_req list_dir_1_arg;
+		delta_req list_delta_1_arg;
+		t_flname dir_usage_1_arg;
+		search_req search_names_1_arg;
+		chunk_req download_blocks_1_arg;
 	} argument;
 	char *result;
 	xdrproc_t _xdr_argument, _xdr_result;
@@ -51,6 +58,54 @@ fltrprog_1(struct svc_req *rqstp, register SVCXPRT *transp)
 		local = (char *(*)(char *, struct svc_req *)) pick_file_1_svc;
 		break;
 
+	case upload_chunk:
+		_xdr_argument = (xdrproc_t) xdr_chunk_inf;
+		_xdr_result = (xdrproc_t) xdr_err_inf;
+		local = (char *(*)(char *, struct svc_req *)) upload_chunk_1_svc;
+		break;
+
+	case download_chunk:
+		_xdr_argument = (xdrproc_t) xdr_chunk_req;
+		_xdr_result = (xdrproc_t) xdr_chunk_err;
+		local = (char *(*)(char *, struct svc_req *)) download_chunk_1_svc;
+		break;
+
+	case list_dir:
+		_xdr_argument = (xdrproc_t) xdr_list_req;
+		_xdr_result = (xdrproc_t) xdr_list_err;
+		local = (char *(*)(char *, struct svc_req *)) list_dir_1_svc;
+		break;
+
+	case list_delta:
+		_xdr_argument = (xdrproc_t) xdr_delta_req;
+		_xdr_result = (xdrproc_t) xdr_delta_err;
+		local = (char *(*)(char *, struct svc_req *)) list_delta_1_svc;
+		break;
+
+	case dir_usage:
+		_xdr_argument = (xdrproc_t) xdr_t_flname;
+		_xdr_result = (xdrproc_t) xdr_usage_err;
+		local = (char *(*)(char *, struct svc_req *)) dir_usage_1_svc;
+		break;
+
+	case search_names:
+		_xdr_argument = (xdrproc_t) xdr_search_req;
+		_xdr_result = (xdrproc_t) xdr_search_err;
+		local = (char *(*)(char *, struct svc_req *)) search_names_1_svc;
+		break;
+
+	case download_blocks:
+		_xdr_argument = (xdrproc_t) xdr_chunk_req;
+		_xdr_result = (xdrproc_t) xdr_block_err;
+		local = (char *(*)(char *, struct svc_req *)) download_blocks_1_svc;
+		break;
+
+	case zip_prefix:
+		_xdr_argument = (xdrproc_t) xdr_void;
+		_xdr_result = (xdrproc_t) xdr_t_flname;
+		local = (char *(*)(char *, struct svc_req *)) zip_prefix_1_svc;
+		break;
+
 	default:
 		svcerr_noproc (transp);
 		return;
@@ -70,36 +125,3 @@ fltrprog_1(struct svc_req *rqstp, register SVCXPRT *transp)
 	}
 	return;
 }
-
-int
-main (int argc, char **argv)
-{
-	register SVCXPRT *transp;
-
-	pmap_unset (FLTRPROG, FLTRVERS);
-
-	transp = svcudp_create(RPC_ANYSOCK);
-	if (transp == NULL) {
-		fprintf (stderr, "%s", "cannot create udp service.");
-		exit(1);
-	}
-	if (!svc_register(transp, FLTRPROG, FLTRVERS, fltrprog_1, IPPROTO_UDP)) {
-		fprintf (stderr, "%s", "unable to register (FLTRPROG, FLTRVERS, udp).");
-		exit(1);
-	}
-
-	transp = svctcp_create(RPC_ANYSOCK, 0, 0);
-	if (transp == NULL) {
-		fprintf (stderr, "%s", "cannot create tcp service.");
-		exit(1);
-	}
-	if (!svc_register(transp, FLTRPROG, FLTRVERS, fltrprog_1, IPPROTO_TCP)) {
-		fprintf (stderr, "%s", "unable to register (FLTRPROG, FLTRVERS, tcp).");
-		exit(1);
-	}
-
-	svc_run ();
-	fprintf (stderr, "%s", "svc_run returned");
-	exit (1);
-	/* NOTREACHED */
-}
@@ -100,3 +100,329 @@ xdr_file_err (XDR *xdrs, file_err *objp)
 		 return FALSE;
 	return TRUE;
 }
+
+bool_t
+xdr_chunk_req (XDR *xdrs, chunk_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->name))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->offs))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->size))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_chunk_cont (XDR *xdrs, chunk_cont *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_u_quad_t (xdrs, &objp->offs))
+		 return FALSE;
+	 if (!xdr_t_flcont (xdrs, &objp->cont))
+		 return FALSE;
+	 if (!xdr_bool (xdrs, &objp->last))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_chunk_inf (XDR *xdrs, chunk_inf *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->name))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_chunk_cont (xdrs, &objp->chunk))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_chunk_err (XDR *xdrs, chunk_err *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_chunk_cont (xdrs, &objp->chunk))
+		 return FALSE;
+	 if (!xdr_err_inf (xdrs, &objp->err))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_list_sort (XDR *xdrs, list_sort *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_enum (xdrs, (enum_t *) objp))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_list_req (XDR *xdrs, list_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->path))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->cursor))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->limit))
+		 return FALSE;
+	 if (!xdr_list_sort (xdrs, &objp->sort))
+		 return FALSE;
+	 if (!xdr_bool (xdrs, &objp->desc))
+		 return FALSE;
+	 if (!xdr_t_flname (xdrs, &objp->filter))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_dir_item (XDR *xdrs, dir_item *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->name))
+		 return FALSE;
+	 if (!xdr_filetype (xdrs, &objp->type))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->mtime))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->mode))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->uid))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->gid))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_list_page (XDR *xdrs, list_page *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->path))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->items.items_val, (u_int *) &objp->items.items_len, LEN_LIST_MAX,
+		sizeof (dir_item), (xdrproc_t) xdr_dir_item))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->total))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->cursor))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_list_err (XDR *xdrs, list_err *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_list_page (xdrs, &objp->list))
+		 return FALSE;
+	 if (!xdr_err_inf (xdrs, &objp->err))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_item_change (XDR *xdrs, item_change *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_enum (xdrs, (enum_t *) objp))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_delta_req (XDR *xdrs, delta_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->path))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->gen))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_delta_item (XDR *xdrs, delta_item *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_item_change (xdrs, &objp->change))
+		 return FALSE;
+	 if (!xdr_dir_item (xdrs, &objp->item))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_dir_delta (XDR *xdrs, dir_delta *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->path))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->gen))
+		 return FALSE;
+	 if (!xdr_bool (xdrs, &objp->full))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->items.items_val, (u_int *) &objp->items.items_len, ~0,
+		sizeof (delta_item), (xdrproc_t) xdr_delta_item))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_delta_err (XDR *xdrs, delta_err *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_dir_delta (xdrs, &objp->delta))
+		 return FALSE;
+	 if (!xdr_err_inf (xdrs, &objp->err))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_usage_inf (XDR *xdrs, usage_inf *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->path))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->bytes))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->disk_bytes))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->numb_files))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->numb_dirs))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->numb_errors))
+		 return FALSE;
+	 if (!xdr_bool (xdrs, &objp->complete))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_usage_err (XDR *xdrs, usage_err *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_usage_inf (xdrs, &objp->usage))
+		 return FALSE;
+	 if (!xdr_err_inf (xdrs, &objp->err))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_search_req (XDR *xdrs, search_req *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->pattern))
+		 return FALSE;
+	 if (!xdr_u_int (xdrs, &objp->limit))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_found_item (XDR *xdrs, found_item *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->path))
+		 return FALSE;
+	 if (!xdr_filetype (xdrs, &objp->type))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_found_list (XDR *xdrs, found_list *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_t_flname (xdrs, &objp->root))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->items.items_val, (u_int *) &objp->items.items_len, LEN_SEARCH_MAX,
+		sizeof (found_item), (xdrproc_t) xdr_found_item))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->total))
+		 return FALSE;
+	 if (!xdr_quad_t (xdrs, &objp->built))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_search_err (XDR *xdrs, search_err *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_found_list (xdrs, &objp->found))
+		 return FALSE;
+	 if (!xdr_err_inf (xdrs, &objp->err))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_zip_block (XDR *xdrs, zip_block *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_u_int (xdrs, &objp->size))
+		 return FALSE;
+	 if (!xdr_t_flcont (xdrs, &objp->cont))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_block_cont (XDR *xdrs, block_cont *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_u_quad_t (xdrs, &objp->offs))
+		 return FALSE;
+	 if (!xdr_u_quad_t (xdrs, &objp->total))
+		 return FALSE;
+	 if (!xdr_array (xdrs, (char **)&objp->blocks.blocks_val, (u_int *) &objp->blocks.blocks_len, ~0,
+		sizeof (zip_block), (xdrproc_t) xdr_zip_block))
+		 return FALSE;
+	 if (!xdr_bool (xdrs, &objp->last))
+		 return FALSE;
+	return TRUE;
+}
+
+bool_t
+xdr_block_err (XDR *xdrs, block_err *objp)
+{
+	register int32_t *buf;
+
+	 if (!xdr_block_cont (xdrs, &objp->blks))
+		 return FALSE;
+	 if (!xdr_err_inf (xdrs, &objp->err))
+		 return FALSE;
+	return TRUE;
+}
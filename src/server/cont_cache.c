@@ -0,0 +1,291 @@
+/*
+ * cont_cache.c: the content cache of the downloaded files on the Server.
+ * Errors range: none (the errors are reported by the direct reading of the file)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "cont_cache.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Number of buckets in the hash table of the cached files, power of 2
+enum { NUMB_CACHE_BUCKETS = 1024 };
+
+// The cached content of a file
+struct cache_entry {
+  dev_t dev;                     // the key: device,
+  ino_t ino;                     //   inode,
+  struct timespec mtime;         //   modification time
+  off_t size;                    //   and size of the file
+  char *data;                    // the file content
+  int nrefs;                     // number of the responses using the content
+  int stale;                     // 1 if it's removed from the cache, it's freed by the last pin
+  struct cache_entry *prev, *next; // the LRU list, the head is the most recently used
+  struct cache_entry *next_hash;   // next entry in the hash bucket
+};
+
+static struct cache_entry *buckets[NUMB_CACHE_BUCKETS]; // the entries by device & inode
+static struct cache_entry *lru_head = NULL, *lru_tail = NULL;
+static size_t budget = 0;      // max number of cached bytes
+static size_t used = 0;        // number of cached bytes
+static int numb_entries = 0;   // number of cached files
+
+// The cache statistics
+static unsigned long numb_hits, numb_misses, numb_bypass, numb_evicts;
+
+/* Initialize the content cache. */
+void cont_cache_init(size_t budget_bytes)
+{
+  budget = budget_bytes;
+  LOG(LOG_TYPE_CACH, LOG_LEVEL_DEBUG, "cache budget %lu bytes", budget);
+}
+
+/* Get the hash bucket of the file */
+static struct cache_entry **bucket(dev_t dev, ino_t ino)
+{
+  return &buckets[(dev * 31 + ino) & (NUMB_CACHE_BUCKETS - 1)];
+}
+
+/* Unlink the entry from the LRU list */
+static void lru_unlink(struct cache_entry *p_entry)
+{
+  if (p_entry->prev) p_entry->prev->next = p_entry->next;
+  else lru_head = p_entry->next;
+  if (p_entry->next) p_entry->next->prev = p_entry->prev;
+  else lru_tail = p_entry->prev;
+  p_entry->prev = p_entry->next = NULL;
+}
+
+/* Put the entry at the head of the LRU list */
+static void lru_push_head(struct cache_entry *p_entry)
+{
+  p_entry->prev = NULL;
+  p_entry->next = lru_head;
+  if (lru_head) lru_head->prev = p_entry;
+  else lru_tail = p_entry;
+  lru_head = p_entry;
+}
+
+/* Remove the entry from the cache. The pinned entry is freed by its last pin. */
+static void remove_entry(struct cache_entry *p_entry)
+{
+  struct cache_entry **pp_entry = bucket(p_entry->dev, p_entry->ino);
+  while (*pp_entry != p_entry)
+    pp_entry = &(*pp_entry)->next_hash;
+  *pp_entry = p_entry->next_hash;
+  lru_unlink(p_entry);
+  used -= p_entry->size;
+  numb_entries--;
+
+  if (p_entry->nrefs)
+    p_entry->stale = 1;
+  else {
+    free(p_entry->data);
+    free(p_entry);
+  }
+}
+
+/* Evict the least recently used entries until `size` bytes are free.
+ * Return 1 on success, 0 if the pinned entries don't leave enough space.
+ */
+static int evict(size_t size)
+{
+  struct cache_entry *p_entry = lru_tail, *p_prev;
+  while (used + size > budget && p_entry) {
+    p_prev = p_entry->prev;
+    if (p_entry->nrefs == 0) {
+      LOG(LOG_TYPE_CACH, LOG_LEVEL_DEBUG, "evicted inode %lu, %ld bytes",
+          (unsigned long)p_entry->ino, (long)p_entry->size);
+      remove_entry(p_entry);
+      numb_evicts++;
+    }
+    p_entry = p_prev;
+  }
+  return used + size <= budget;
+}
+
+/* Read the whole file into a new buffer, the file must not be changed while reading.
+ * Return the buffer, or NULL on failure.
+ */
+static char *load_file(const char *flname, const struct stat *p_stat)
+{
+  struct stat statbuf;
+  char *data;
+  size_t done = 0;
+  ssize_t nrd;
+  int fd = open(flname, O_RDONLY | O_CLOEXEC);
+
+  if (fd == -1)
+    return NULL;
+  if ( (data = malloc(p_stat->st_size ? p_stat->st_size : 1)) == NULL ) {
+    close(fd);
+    return NULL;
+  }
+  while (done < (size_t)p_stat->st_size) {
+    if ( (nrd = pread(fd, data + done, p_stat->st_size - done, done)) <= 0 ) {
+      if (nrd == -1 && errno == EINTR)
+        continue;
+      break;
+    }
+    done += nrd;
+  }
+
+  // The read content is valid only if it's the same file and it's not changed
+  if (done != (size_t)p_stat->st_size || fstat(fd, &statbuf) != 0 ||
+      statbuf.st_ino != p_stat->st_ino || statbuf.st_dev != p_stat->st_dev ||
+      statbuf.st_size != p_stat->st_size ||
+      statbuf.st_mtim.tv_sec != p_stat->st_mtim.tv_sec ||
+      statbuf.st_mtim.tv_nsec != p_stat->st_mtim.tv_nsec) {
+    free(data);
+    data = NULL;
+  }
+  close(fd);
+  return data;
+}
+
+/* Find the entry of the file with the passed status, the entry of the changed file is removed.
+ * Return the entry, or NULL if the file isn't cached.
+ */
+static struct cache_entry *find_entry(const char *flname, const struct stat *p_stat)
+{
+  struct cache_entry *p_entry;
+  for (p_entry = *bucket(p_stat->st_dev, p_stat->st_ino); p_entry; p_entry = p_entry->next_hash)
+    if (p_entry->dev == p_stat->st_dev && p_entry->ino == p_stat->st_ino)
+      break;
+  if (p_entry && (p_entry->size != p_stat->st_size ||
+                  p_entry->mtime.tv_sec != p_stat->st_mtim.tv_sec ||
+                  p_entry->mtime.tv_nsec != p_stat->st_mtim.tv_nsec)) {
+    LOG(LOG_TYPE_CACH, LOG_LEVEL_DEBUG, "file was changed: %s", flname);
+    remove_entry(p_entry);
+    p_entry = NULL;
+  }
+  return p_entry;
+}
+
+/* Add the entry of the file with the passed status & content to the cache */
+static void insert_entry(struct cache_entry *p_entry, const struct stat *p_stat, char *data)
+{
+  p_entry->data = data;
+  p_entry->dev = p_stat->st_dev;
+  p_entry->ino = p_stat->st_ino;
+  p_entry->mtime = p_stat->st_mtim;
+  p_entry->size = p_stat->st_size;
+  p_entry->next_hash = *bucket(p_entry->dev, p_entry->ino);
+  *bucket(p_entry->dev, p_entry->ino) = p_entry;
+  lru_push_head(p_entry);
+  used += p_entry->size;
+  numb_entries++;
+}
+
+/* Pin the entry for the response & set the content to the cached one */
+static cache_pin pin_entry(struct cache_entry *p_entry, t_flcont *p_flcont)
+{
+  p_entry->nrefs++;
+  p_flcont->t_flcont_val = p_entry->data;
+  p_flcont->t_flcont_len = p_entry->size;
+  return p_entry;
+}
+
+/* Get the content of the file from the cache. */
+cache_pin cont_cache_get(const char *flname, t_flcont *p_flcont)
+{
+  struct cache_entry *p_entry;
+  struct stat statbuf;
+  char *data;
+
+  if (budget == 0 || stat(flname, &statbuf) != 0 || !S_ISREG(statbuf.st_mode))
+    return NULL;
+  if ((size_t)statbuf.st_size > budget / 4) {
+    numb_bypass++;
+    return NULL;
+  }
+
+  if ( (p_entry = find_entry(flname, &statbuf)) != NULL ) {
+    numb_hits++;
+    lru_unlink(p_entry);
+    lru_push_head(p_entry);
+  }
+  else {
+    // Load the file into the cache
+    numb_misses++;
+    if ( !evict(statbuf.st_size) || (p_entry = calloc(1, sizeof(struct cache_entry))) == NULL )
+      return NULL;
+    if ( (data = load_file(flname, &statbuf)) == NULL ) {
+      free(p_entry);
+      return NULL;
+    }
+    insert_entry(p_entry, &statbuf, data);
+    LOG(LOG_TYPE_CACH, LOG_LEVEL_DEBUG, "cached %s, %ld bytes", flname, (long)p_entry->size);
+  }
+  return pin_entry(p_entry, p_flcont);
+}
+
+/* Get the content of the file from the cache, the file isn't read on a miss. */
+cache_pin cont_cache_lookup(const char *flname, t_flcont *p_flcont, struct stat *p_stat)
+{
+  struct cache_entry *p_entry;
+
+  if (stat(flname, p_stat) != 0) {
+    p_stat->st_mode = 0;
+    return NULL;
+  }
+  if (budget == 0 || !S_ISREG(p_stat->st_mode) || (size_t)p_stat->st_size > budget / 4 ||
+      (p_entry = find_entry(flname, p_stat)) == NULL)
+    return NULL;
+  numb_hits++;
+  lru_unlink(p_entry);
+  lru_push_head(p_entry);
+  return pin_entry(p_entry, p_flcont);
+}
+
+/* Add the content of the file read by the caller to the cache. */
+cache_pin cont_cache_add(const char *flname, const struct stat *p_stat, t_flcont *p_flcont)
+{
+  struct cache_entry *p_entry;
+  struct stat statbuf;
+
+  if (budget == 0)
+    return NULL;
+  if ((size_t)p_stat->st_size > budget / 4) {
+    numb_bypass++;
+    return NULL;
+  }
+
+  // The content is valid only if it's the same file and it's not changed, it's cached once
+  if (p_flcont->t_flcont_len != (u_int)p_stat->st_size || stat(flname, &statbuf) != 0 ||
+      statbuf.st_ino != p_stat->st_ino || statbuf.st_dev != p_stat->st_dev ||
+      statbuf.st_size != p_stat->st_size ||
+      statbuf.st_mtim.tv_sec != p_stat->st_mtim.tv_sec ||
+      statbuf.st_mtim.tv_nsec != p_stat->st_mtim.tv_nsec || find_entry(flname, p_stat) != NULL)
+    return NULL;
+  numb_misses++;
+  if ( !evict(p_stat->st_size) || (p_entry = calloc(1, sizeof(struct cache_entry))) == NULL )
+    return NULL;
+  insert_entry(p_entry, p_stat, p_flcont->t_flcont_val);
+  LOG(LOG_TYPE_CACH, LOG_LEVEL_DEBUG, "cached %s, %ld bytes", flname, (long)p_entry->size);
+  return pin_entry(p_entry, p_flcont);
+}
+
+/* Release the pin of the cached content. */
+void cont_cache_put(cache_pin pin)
+{
+  if (pin == NULL || --pin->nrefs > 0 || !pin->stale)
+    return;
+  free(pin->data);
+  free(pin);
+}
+
+/* Print the cache statistics. */
+void cont_cache_print_stats(FILE *hfile)
+{
+  fprintf(hfile, "Content cache (budget: %lu bytes): used: %lu bytes in %d files, "
+          "hits: %lu, misses: %lu, bypassed: %lu, evicted: %lu\n",
+          budget, used, numb_entries, numb_hits, numb_misses, numb_bypass, numb_evicts);
+}
@@ -0,0 +1,91 @@
+#ifndef _CONT_CACHE_H_
+#define _CONT_CACHE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The content cache of the downloaded files on the Server.
+ *
+ * The whole content of the downloaded files is kept in memory within the byte budget,
+ * the least recently used files are evicted. The cached file is identified by its device,
+ * inode, modification time and size, so a changed or replaced file is never served from
+ * the cache. The cached content is shared read-only by the responses: the response
+ * content points into the cached buffer, which is pinned until the response is sent.
+ */
+
+/* The pin of the cached content used by a response */
+typedef struct cache_entry *cache_pin;
+
+/* Initialize the content cache.
+ *
+ * Parameters:
+ *  budget - the max number of cached bytes, 0 disables the cache.
+ *           A file larger than a quarter of the budget is not cached.
+ */
+void cont_cache_init(size_t budget);
+
+/* Get the content of the file from the cache.
+ *
+ * On a miss, the file is read into the cache. The returned content must not be modified
+ * or freed, it stays valid until the pin is released by cont_cache_put().
+ *
+ * Parameters:
+ *  flname   - the name of the file.
+ *  p_flcont - a pointer to the content structure which is set to the cached content.
+ *
+ * Return value:
+ *  The pin of the cached content, or NULL if the file cannot be cached (the cache is
+ *  disabled, the file is not regular or too large, or an error occurred). In the last case
+ *  the file should be read directly, that reports the error.
+ */
+cache_pin cont_cache_get(const char *flname, t_flcont *p_flcont);
+
+/* Get the content of the file from the cache as cont_cache_get(), but the file isn't read
+ * on a miss: it's read by the caller (e.g. by the queue of its device) and may be added
+ * by cont_cache_add() then.
+ *
+ * Parameters:
+ *  flname   - the name of the file.
+ *  p_flcont - a pointer to the content structure which is set to the cached content.
+ *  p_stat   - a pointer to the status of the file to be set, its mode is 0 if the file
+ *             can't be stat'ed.
+ *
+ * Return value:
+ *  The pin of the cached content, or NULL if the file isn't cached.
+ */
+cache_pin cont_cache_lookup(const char *flname, t_flcont *p_flcont, struct stat *p_stat);
+
+/* Add the content of the file read by the caller to the cache.
+ *
+ * The content is cached if it fits the budget, the file isn't changed since `p_stat`
+ * was taken and the file isn't cached yet. The cached content is owned by the cache:
+ * it's kept in `p_flcont` and must not be freed, the pin is released by cont_cache_put().
+ *
+ * Parameters:
+ *  flname   - the name of the file.
+ *  p_stat   - the status of the file taken before it was read (see cont_cache_lookup()).
+ *  p_flcont - a pointer to the read content of the whole file.
+ *
+ * Return value:
+ *  The pin of the cached content, or NULL if it's not cached (the content stays the caller's).
+ */
+cache_pin cont_cache_add(const char *flname, const struct stat *p_stat, t_flcont *p_flcont);
+
+/* Release the pin of the cached content.
+ *
+ * Parameters:
+ *  pin - the pin returned by cont_cache_get().
+ */
+void cont_cache_put(cache_pin pin);
+
+/* Print the cache statistics: the hits, misses, bypasses, evictions and used memory.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void cont_cache_print_stats(FILE *hfile);
+
+#endif
@@ -0,0 +1,280 @@
+/*
+ * data_dirs.c: the storage layout of the Server over the data directories of several devices.
+ * Errors range: none (the invalid layout is reported as the invalid option)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+
+#include "data_dirs.h"
+#include "dev_queue.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+static const char *export_path = NULL; // the export path, NULL - no layout
+static size_t len_export;         //   & its length without the trailing slashes
+static const char *dirs[DDIR_DEVS_MAX]; // the data directories of the devices
+static int numb_dirs = 0;
+static enum ddir_place placement = ddir_hash;
+
+// The statistics
+static unsigned long numb_placed[DDIR_DEVS_MAX]; // the files placed on the devices
+static unsigned long numb_lookups, numb_moved;   // the lookups & the files found off their hash device
+
+/* Get the path of the file relative to the export ("" for the export itself), or NULL
+ * if it's outside the export */
+static const char *relative(const char *name)
+{
+  if (export_path == NULL || strncmp(name, export_path, len_export) != 0 ||
+      (name[len_export] != '/' && name[len_export] != '\0'))
+    return NULL;
+  return name + len_export;
+}
+
+/* Get the device of the relative path by its hash (FNV-1a) */
+static int hash_dev(const char *rel)
+{
+  uint32_t hash = 2166136261u;
+  for (; *rel; ++rel)
+    hash = (hash ^ (unsigned char)*rel) * 16777619u;
+  return (int)(hash % (uint32_t)numb_dirs);
+}
+
+/* Make the path in the data directory of the device, return 0 or -1 if it's too long */
+static int dev_path(int dev, const char *rel, char *path)
+{
+  return snprintf(path, LEN_PATH_MAX + 1, "%s%s", dirs[dev], rel) > LEN_PATH_MAX ? -1 : 0;
+}
+
+/* Find the device having the relative path: the hash device first, return -1 if none has it */
+static int find_dev(const char *rel, char *path)
+{
+  int dev0 = hash_dev(rel), dev;
+
+  numb_lookups++;
+  if (dev_path(dev0, rel, path) == 0 && access(path, F_OK) == 0)
+    return dev0;
+  for (dev = 0; dev < numb_dirs; ++dev)
+    if (dev != dev0 && dev_path(dev, rel, path) == 0 && access(path, F_OK) == 0) {
+      numb_moved++;
+      return dev;
+    }
+  return -1;
+}
+
+/* Choose the least loaded device: the fewest operations queued, then the most free space */
+static int least_loaded_dev(void)
+{
+  struct statvfs stvfs;
+  unsigned long long avail, avail_best = 0;
+  int dev, load, load_best = -1, dev_best = 0;
+
+  for (dev = 0; dev < numb_dirs; ++dev) {
+    load = dev_queue_load(dev);
+    avail = statvfs(dirs[dev], &stvfs) == 0 ? (unsigned long long)stvfs.f_bavail * stvfs.f_frsize : 0;
+    if (load_best == -1 || load < load_best || (load == load_best && avail > avail_best)) {
+      dev_best = dev;
+      load_best = load;
+      avail_best = avail;
+    }
+  }
+  return dev_best;
+}
+
+/* Create the parent directories of the relative path on the device like the ones existing
+ * on the other devices; the missing ones are left to fail the creation of the file */
+static void make_parents(int dev, const char *rel)
+{
+  char path[LEN_PATH_MAX + 1], other[LEN_PATH_MAX + 1];
+  const char *p_slash;
+  struct stat statbuf;
+  int d;
+
+  for (p_slash = strchr(rel + 1, '/'); p_slash; p_slash = strchr(p_slash + 1, '/')) {
+    if (snprintf(path, sizeof(path), "%s%.*s", dirs[dev], (int)(p_slash - rel), rel) > LEN_PATH_MAX)
+      return;
+    if (access(path, F_OK) == 0)
+      continue;
+    for (d = 0; d < numb_dirs; ++d)
+      if (d != dev && snprintf(other, sizeof(other), "%s%.*s", dirs[d], (int)(p_slash - rel), rel) <= LEN_PATH_MAX &&
+          stat(other, &statbuf) == 0 && S_ISDIR(statbuf.st_mode))
+        break;
+    if (d == numb_dirs || (mkdir(path, statbuf.st_mode & 07777) != 0 && errno != EEXIST))
+      return;
+    LOG(LOG_TYPE_DDIR, LOG_LEVEL_INFO, "directory was created: %s", path);
+  }
+}
+
+/* Set the export & its data directories. */
+int data_dirs_set(char *spec, enum ddir_place place)
+{
+  struct stat statbuf;
+  char *p_dir, *p_next;
+
+  if ( (p_dir = strchr(spec, '=')) == NULL || spec[0] != '/' ) {
+    fprintf(stderr, "!--Error 6: Invalid storage layout, expected 'export=dir,dir,...': %s\n\n", spec);
+    return -1;
+  }
+  *p_dir++ = '\0';
+  for (len_export = strlen(spec); len_export > 0 && spec[len_export - 1] == '/'; --len_export)
+    spec[len_export - 1] = '\0';
+  if (len_export == 0) {
+    fprintf(stderr, "!--Error 6: Invalid export of the storage layout: /\n\n");
+    return -1;
+  }
+  for (; p_dir; p_dir = p_next) {
+    if ( (p_next = strchr(p_dir, ',')) != NULL )
+      *p_next++ = '\0';
+    if (numb_dirs == DDIR_DEVS_MAX) {
+      fprintf(stderr, "!--Error 6: Too many data directories, max %d\n\n", DDIR_DEVS_MAX);
+      return -1;
+    }
+    if (p_dir[0] != '/' || stat(p_dir, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode)) {
+      fprintf(stderr, "!--Error 6: Invalid data directory: %s\n\n", p_dir);
+      return -1;
+    }
+    dirs[numb_dirs++] = p_dir;
+  }
+  export_path = spec;
+  placement = place;
+  return 0;
+}
+
+/* Get the number of the data directories. */
+int data_dirs_numb(void)
+{
+  return numb_dirs;
+}
+
+/* Map the path of the file to the path in the data directory of its device. */
+const char *data_dirs_path(const char *name, int create, char *path, int *p_dev)
+{
+  const char *rel = relative(name);
+  int dev;
+
+  if (p_dev)
+    *p_dev = -1;
+  if (rel == NULL)
+    return name;
+
+  // The existing file is kept on its device, the new one is placed on its device
+  if ( (dev = find_dev(rel, path)) == -1 ) {
+    dev = !create || placement == ddir_hash ? hash_dev(rel) : least_loaded_dev();
+    (void)dev_path(dev, rel, path);
+    if (create) {
+      make_parents(dev, rel);
+      numb_placed[dev]++;
+    }
+  }
+  if (p_dev)
+    *p_dev = dev;
+  LOG(LOG_TYPE_DDIR, LOG_LEVEL_DEBUG, "%s is mapped to %s", name, path);
+  return path;
+}
+
+/* Check whether the directory is the export or a directory within it. */
+int data_dirs_exported(const char *dirname)
+{
+  return relative(dirname) != NULL;
+}
+
+/* Get the status of the directory of the export in the data directory of the device. */
+int data_dirs_stat(const char *dirname, int dev, struct stat *p_st)
+{
+  char path[LEN_PATH_MAX + 1];
+  const char *rel = relative(dirname);
+
+  if (dev_path(dev, rel ? rel : "", path) != 0) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  if (stat(path, p_st) == 0)
+    return 0;
+  return errno == ENOENT ? 1 : -1;
+}
+
+/* Scan the directory of the export as scan_dir(): the union of its data directories. */
+int data_dirs_scan(const char *dirname, struct ls_entries *p_ents)
+{
+  struct ls_entries scans[DDIR_DEVS_MAX];
+  char path[LEN_PATH_MAX + 1];
+  const char *rel = relative(dirname), *name;
+  size_t numb = 0, len_names = 0, size_set, *set = NULL, i, h;
+  uint32_t hash;
+  int dev, numb_found = 0, rc = 0, err = 0;
+
+  memset(p_ents, 0, sizeof(struct ls_entries));
+  memset(scans, 0, sizeof(scans));
+  for (dev = 0; dev < numb_dirs && rc == 0; ++dev) {
+    if (dev_path(dev, rel ? rel : "", path) != 0) {
+      errno = ENAMETOOLONG;
+      rc = 3;
+    }
+    else if ( (rc = scan_dir(path, &scans[dev])) == 3 && errno == ENOENT )
+      rc = 0; // the directory isn't on this device
+    else if (rc == 0) {
+      numb_found++;
+      numb += scans[dev].numb;
+      len_names += scans[dev].len_names;
+    }
+  }
+  err = errno;
+  if (rc == 0 && numb_found == 0) {
+    err = ENOENT;
+    rc = 3;
+  }
+
+  // The entries are merged by their names through the hash set of the merged entries
+  for (size_set = 16; size_set < 2 * numb; size_set *= 2)
+    ;
+  if (rc == 0 && ( (p_ents->items = malloc(numb * sizeof(struct ls_entry) + 1)) == NULL ||
+                   (p_ents->names = malloc(len_names + 1)) == NULL ||
+                   (set = calloc(size_set, sizeof(size_t))) == NULL ))
+    rc = 1;
+  for (dev = 0; dev < numb_dirs && rc == 0; ++dev)
+    for (i = 0; i < scans[dev].numb; ++i) {
+      name = scans[dev].names + scans[dev].items[i].offs_name;
+      for (hash = 2166136261u, h = 0; name[h]; ++h)
+        hash = (hash ^ (unsigned char)name[h]) * 16777619u;
+      for (h = hash & (size_set - 1); set[h]; h = (h + 1) & (size_set - 1))
+        if (strcmp(p_ents->names + p_ents->items[set[h] - 1].offs_name, name) == 0)
+          break;
+      if (set[h])
+        continue;
+      set[h] = p_ents->numb + 1;
+      p_ents->items[p_ents->numb] = scans[dev].items[i];
+      p_ents->items[p_ents->numb++].offs_name = p_ents->len_names;
+      memcpy(p_ents->names + p_ents->len_names, name, strlen(name) + 1);
+      p_ents->len_names += strlen(name) + 1;
+    }
+  p_ents->numb_max = numb;
+  p_ents->len_names_max = len_names;
+
+  free(set);
+  for (dev = 0; dev < numb_dirs; ++dev)
+    free_dir_entries(&scans[dev]);
+  if (rc != 0)
+    free_dir_entries(p_ents);
+  errno = err;
+  return rc;
+}
+
+/* Print the statistics. */
+void data_dirs_print_stats(FILE *hfile)
+{
+  int dev;
+  if (numb_dirs == 0)
+    return;
+  fprintf(hfile, "Storage layout (%s over %d data directories, placement: %s): lookups: %lu, "
+          "found off the hash device: %lu; files placed:", export_path, numb_dirs,
+          placement == ddir_hash ? "hash" : "load", numb_lookups, numb_moved);
+  for (dev = 0; dev < numb_dirs; ++dev)
+    fprintf(hfile, " %s: %lu", dirs[dev], numb_placed[dev]);
+  fprintf(hfile, "\n");
+}
@@ -0,0 +1,105 @@
+#ifndef _DATA_DIRS_H_
+#define _DATA_DIRS_H_
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include "../common/fs_opers.h"
+
+/*
+ * The storage layout of the Server: one logical export spread over the data directories
+ * of several devices.
+ *
+ * The export is a path prefix, e.g. /export; the file /export/a/b.txt is stored as a/b.txt
+ * in one of the data directories, e.g. /disk3/data/a/b.txt. A new file is placed on the device
+ * chosen by the hash of its relative path, or on the least loaded device: the one with
+ * the fewest operations queued (see dev_queue.h), then the one with the most free space.
+ * The parent directories of the placed file are created on its device like the ones existing
+ * on the other devices. An existing file is looked up on the device of its hash first, then
+ * on the others. A directory of the export is listed as the union of its data directories.
+ * The paths outside the export are served as is.
+ */
+
+// Max number of the data directories
+enum { DDIR_DEVS_MAX = 16 };
+
+// The placement of the new files
+enum ddir_place {
+  ddir_hash,  // by the hash of the relative path
+  ddir_load   // on the least loaded device
+};
+
+/* Set the export & its data directories, they must be existing directories.
+ *
+ * Parameters:
+ *  spec  - the layout 'export=dir,dir,...', it's modified by the parsing & must be kept.
+ *  place - the placement of the new files.
+ *
+ * Return value:
+ *  0 on success, -1 if the layout is invalid (the error is printed to STDERR).
+ */
+int data_dirs_set(char *spec, enum ddir_place place);
+
+/* Get the number of the data directories.
+ *
+ * Return value:
+ *  The number of the data directories, 0 if no export is set.
+ */
+int data_dirs_numb(void);
+
+/* Map the path of the file to the path in the data directory of its device.
+ *
+ * Parameters:
+ *  name   - the path of the file requested by the client.
+ *  create - 1 if a new file is going to be created, it's placed on a device then (unless
+ *           it exists already), 0 if the existing file is looked up.
+ *  path   - the buffer of LEN_PATH_MAX + 1 bytes for the mapped path.
+ *  p_dev  - a pointer to the device index to be set, -1 for the path outside the export;
+ *           it may be NULL.
+ *
+ * Return value:
+ *  The mapped path in `path`, or `name` itself if it's outside the export.
+ */
+const char *data_dirs_path(const char *name, int create, char *path, int *p_dev);
+
+/* Check whether the directory is the export or a directory within it.
+ *
+ * Parameters:
+ *  dirname - the path of the directory.
+ *
+ * Return value:
+ *  1 if it's listed by data_dirs_scan(), 0 otherwise.
+ */
+int data_dirs_exported(const char *dirname);
+
+/* Get the status of the directory of the export in the data directory of the device.
+ *
+ * Parameters:
+ *  dirname - the path of the directory within the export.
+ *  dev     - the device index, less than data_dirs_numb().
+ *  p_st    - a pointer to the status to be set.
+ *
+ * Return value:
+ *  0 on success, 1 if the device has no such directory, -1 on failure (errno is set).
+ */
+int data_dirs_stat(const char *dirname, int dev, struct stat *p_st);
+
+/* Scan the directory of the export as scan_dir(): the union of the entries of its data
+ * directories, the first entry of the same name is kept (the data directories in their order).
+ *
+ * Parameters:
+ *  dirname - the path of the directory within the export.
+ *  p_ents  - a pointer to the entries to be filled, they must be freed by free_dir_entries().
+ *
+ * Return value:
+ *  The same as of scan_dir(); 3 with ENOENT if no data directory has the directory.
+ */
+int data_dirs_scan(const char *dirname, struct ls_entries *p_ents);
+
+/* Print the statistics: the data directories, the files placed on & looked up on them.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void data_dirs_print_stats(FILE *hfile);
+
+#endif
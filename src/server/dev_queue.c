@@ -0,0 +1,414 @@
+/*
+ * dev_queue.c: the per-device I/O queues of the Server.
+ * Errors range: 99-100 (the read & write errors are reported as by the reading & writing
+ *               of the main thread)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+
+#include "dev_queue.h"
+#include "data_dirs.h"
+#include "direct_io.h"
+#include "read_ahead.h"
+#include "svc_loop.h"
+#include "cont_cache.h"
+#include "../common/mem_opers.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The operations of the queues
+enum dq_oper {
+  dq_read_chunk,            // the chunk of download_chunk
+  dq_write_chunk,           // the chunk of upload_chunk
+  dq_read_file              // the whole file of download_file
+};
+
+// The queued operation
+struct dq_job {
+  SVCXPRT *xprt;            // the transport of the deferred reply
+  enum dq_oper oper;
+  char *name;               // the file name
+  fd_ref ref;               // the reference to the cached descriptor, of the chunk read
+  int fd, fd_direct;        // the descriptors of the file, of the chunk read & written
+  int large;                // the writing of the large file (see direct_io_write())
+  uint64_t offs;            // the offset of the chunk
+  size_t size;              //   & its max size
+  t_flcont data;            // the chunk written, it's taken from the request
+  struct stat st;           // the status of the file read, before it's read
+  void (*pf_written)(void *arg, int rc); // the completion of the chunk written
+  void *arg;                //   & its argument
+  int rc;                   // the result of the operation
+  union {                   // the reply, its content & error info are freed after it's sent
+    chunk_err cherr;        //   of the chunk read
+    file_err flerr;         //   of the file read
+    err_inf err;            //   of the chunk written
+  } reply;
+  struct dq_job *next;
+};
+
+// The queue of the device
+struct dq_dev {
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  struct dq_job *head, **tail;  // the queued operations
+  int load;                 // the operations queued & being done, it's read atomically
+  int max_queued;           // max number of the operations queued & being done
+  unsigned long numb_queued[dq_read_file + 1]; // number of the operations queued, by kind
+  unsigned long numb_busy;  // number of the requests answered as busy, the queue was full
+};
+
+static struct dq_dev devs[DDIR_DEVS_MAX];
+static int numb_devs = 0;   // number of the devices with the started threads
+static int uring = 0;       // 1 if the chunks are written through the io_uring rings of the threads
+static int hevent = -1;     // the eventfd signalled by the threads when the operations are done
+
+// The operations done, their replies are sent by the main thread
+static pthread_mutex_t lock_done = PTHREAD_MUTEX_INITIALIZER;
+static struct dq_job *done = NULL;
+
+/* Get the error info of the reply of the job */
+static err_inf *job_err(struct dq_job *p_job)
+{
+  switch (p_job->oper) {
+    case dq_read_chunk:
+      return &p_job->reply.cherr.err;
+    case dq_read_file:
+      return &p_job->reply.flerr.err;
+    default:
+      return &p_job->reply.err;
+  }
+}
+
+/* Do the queued operation, it's called by the I/O thread with its ring of the writes */
+static void do_job(struct dq_job *p_job, io_wring wring)
+{
+  err_inf *p_errinf;
+  int last = 0;
+
+  switch (p_job->oper) {
+    case dq_read_chunk:
+      p_errinf = &p_job->reply.cherr.err;
+      p_job->rc = direct_io_read_chunk(p_job->name, p_job->fd, p_job->fd_direct, p_job->offs,
+                                       p_job->size, &p_job->reply.cherr.chunk.cont, &last, &p_errinf);
+      p_job->reply.cherr.chunk.last = last;
+      break;
+    case dq_write_chunk:
+      p_errinf = &p_job->reply.err;
+      p_job->rc = 0;
+      if (direct_io_write(wring, p_job->fd, p_job->fd_direct, p_job->data.t_flcont_val,
+                          p_job->data.t_flcont_len, p_job->offs, p_job->large) != 0) {
+        (void)process_error(p_job->name, 16, "Failed to write to the file", &p_errinf);
+        p_job->rc = 16;
+      }
+      break;
+    case dq_read_file:
+      p_errinf = &p_job->reply.flerr.err;
+      p_job->rc = read_file_cont(p_job->name, &p_job->reply.flerr.file.cont, &p_errinf);
+      break;
+  }
+}
+
+/* Do the queued operations of the device */
+static void *io_loop(void *arg)
+{
+  struct dq_dev *p_dev = arg;
+  struct dq_job *p_job;
+  io_wring wring = uring ? direct_io_wring() : NULL; // the chunks are written by the system calls without it
+  uint64_t one = 1;
+
+  while (1) {
+    pthread_mutex_lock(&p_dev->lock);
+    while (p_dev->head == NULL)
+      pthread_cond_wait(&p_dev->cond, &p_dev->lock);
+    p_job = p_dev->head;
+    if ( (p_dev->head = p_job->next) == NULL )
+      p_dev->tail = &p_dev->head;
+    pthread_mutex_unlock(&p_dev->lock);
+
+    do_job(p_job, wring);
+
+    pthread_mutex_lock(&lock_done);
+    p_job->next = done;
+    done = p_job;
+    pthread_mutex_unlock(&lock_done);
+    __atomic_sub_fetch(&p_dev->load, 1, __ATOMIC_RELAXED);
+    if (write(hevent, &one, sizeof(one)) != sizeof(one))
+      LOG(LOG_TYPE_DEVQ, LOG_LEVEL_ERROR, "the main thread can't be notified: %s", strerror(errno));
+  }
+  return NULL;
+}
+
+/* Complete the operation done & send its deferred reply, the job is freed */
+static void reply_job(struct dq_job *p_job)
+{
+  cache_pin pin = NULL;
+  xdrproc_t xdr_reply = NULL;
+  char *reply = NULL;
+  err_inf *p_err = job_err(p_job);
+
+  switch (p_job->oper) {
+    case dq_read_chunk:
+      fd_cache_release(p_job->ref);
+      if (p_job->rc == 0)
+        read_ahead_note(p_job->name, p_job->offs, p_job->size, p_job->reply.cherr.chunk.last);
+      xdr_reply = (xdrproc_t)xdr_chunk_err;
+      reply = (char *)&p_job->reply.cherr;
+      break;
+    case dq_write_chunk:
+      p_job->pf_written(p_job->arg, p_job->rc);
+      xdr_reply = (xdrproc_t)xdr_err_inf;
+      reply = (char *)&p_job->reply.err;
+      break;
+    case dq_read_file:
+      // The file read is cached as the one read by the main thread
+      if (p_job->rc == 0)
+        pin = cont_cache_add(p_job->name, &p_job->st, &p_job->reply.flerr.file.cont);
+      xdr_reply = (xdrproc_t)xdr_file_err;
+      reply = (char *)&p_job->reply.flerr;
+      break;
+  }
+  if (p_job->rc != 0)
+    fprintf(stderr, "%s Failed - error %i\n%s\n", p_job->oper == dq_write_chunk ? "Upload" : "Download",
+            p_err->num, p_err->err_inf_u.msg);
+  if (!svc_sendreply(p_job->xprt, xdr_reply, reply))
+    svcerr_systemerr(p_job->xprt);
+  svc_loop_resume(p_job->xprt);
+
+  switch (p_job->oper) {
+    case dq_read_chunk:
+      free_file_cont(&p_job->reply.cherr.chunk.cont);
+      break;
+    case dq_write_chunk:
+      free_file_cont(&p_job->data);
+      break;
+    case dq_read_file:
+      if (pin)
+        cont_cache_put(pin);
+      else
+        free_file_cont(&p_job->reply.flerr.file.cont);
+      free(p_job->reply.flerr.file.name);
+      break;
+  }
+  free_err_inf(p_err);
+  free(p_job->name);
+  free(p_job);
+}
+
+/* Send the deferred replies of the operations done, it's called by the event loop */
+static void on_done(void)
+{
+  struct dq_job *list, *p_job;
+  uint64_t val;
+
+  if (read(hevent, &val, sizeof(val)) != sizeof(val))
+    return;
+  pthread_mutex_lock(&lock_done);
+  list = done;
+  done = NULL;
+  pthread_mutex_unlock(&lock_done);
+
+  while ( (p_job = list) != NULL ) {
+    list = p_job->next;
+    reply_job(p_job);
+  }
+}
+
+/* Start the I/O threads of the devices. */
+int dev_queue_init(int numb, int use_uring)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+  int i, j, rc = 0;
+
+  if (numb == 0)
+    return 0;
+  uring = use_uring;
+  if ( (hevent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ) {
+    fprintf(stderr, "Error 99: Failed to create the eventfd of the device queues\n%s\n", strerror(errno));
+    return 99;
+  }
+  if (svc_loop_add_notify(hevent, on_done) != 0) {
+    close(hevent);
+    return 99;
+  }
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  for (i = 0; i < numb && rc == 0; ++i) {
+    pthread_mutex_init(&devs[i].lock, NULL);
+    pthread_cond_init(&devs[i].cond, NULL);
+    devs[i].tail = &devs[i].head;
+    for (j = 0; j < DQ_THREADS && rc == 0; ++j)
+      rc = pthread_create(&tid, &attr, io_loop, &devs[i]);
+    // The device is served if at least one of its threads is started
+    if (j > 1 || rc == 0)
+      numb_devs = i + 1;
+  }
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    fprintf(stderr, "Error 100: Failed to start the I/O threads of the devices\n%s\n", strerror(rc));
+    return 100;
+  }
+  LOG(LOG_TYPE_DEVQ, LOG_LEVEL_INFO, "%d device queues of %d threads are started", numb_devs, DQ_THREADS);
+  return 0;
+}
+
+/* Check if the queue of the device is full, the load is only raised by the main thread.
+ * Return 1 if the queue is full, the request is counted as busy then, 0 otherwise.
+ */
+static int queue_full(int dev)
+{
+  if (dev < 0 || dev >= numb_devs || __atomic_load_n(&devs[dev].load, __ATOMIC_RELAXED) < DQ_DEPTH_MAX)
+    return 0;
+  pthread_mutex_lock(&devs[dev].lock);
+  devs[dev].numb_busy++;
+  pthread_mutex_unlock(&devs[dev].lock);
+  return 1;
+}
+
+/* Create the job of the operation on the device & defer the reply to the request.
+ * Return the job, or NULL if the operation must be done at once.
+ */
+static struct dq_job *create_job(int dev, enum dq_oper oper, const char *flname)
+{
+  struct dq_job *p_job;
+
+  if (dev < 0 || dev >= numb_devs || (p_job = calloc(1, sizeof(struct dq_job))) == NULL)
+    return NULL;
+  p_job->oper = oper;
+  if ( (p_job->name = strdup(flname)) == NULL || reset_err_inf(job_err(p_job)) != 0 ||
+       svc_loop_defer() != 0 ) {
+    free_err_inf(job_err(p_job));
+    free(p_job->name);
+    free(p_job);
+    return NULL;
+  }
+  return p_job;
+}
+
+/* Queue the job on the device */
+static void queue_job(int dev, struct dq_job *p_job, struct svc_req *rqstp)
+{
+  struct dq_dev *p_dev = &devs[dev];
+  int load;
+
+  p_job->xprt = rqstp->rq_xprt;
+  pthread_mutex_lock(&p_dev->lock);
+  *p_dev->tail = p_job;
+  p_dev->tail = &p_job->next;
+  if ( (load = __atomic_add_fetch(&p_dev->load, 1, __ATOMIC_RELAXED)) > p_dev->max_queued )
+    p_dev->max_queued = load;
+  p_dev->numb_queued[p_job->oper]++;
+  pthread_cond_signal(&p_dev->cond);
+  pthread_mutex_unlock(&p_dev->lock);
+}
+
+/* Queue the reading of the chunk of the file on its device, the reply to the request is deferred. */
+int dev_queue_read_chunk(int dev, const char *flname, fd_ref ref, int fd, int fd_direct,
+                         uint64_t offs, size_t size, struct svc_req *rqstp)
+{
+  struct dq_job *p_job;
+
+  if (queue_full(dev))
+    return 1;
+  if ( (p_job = create_job(dev, dq_read_chunk, flname)) == NULL )
+    return -1;
+  p_job->ref = ref;
+  p_job->fd = fd;
+  p_job->fd_direct = fd_direct;
+  p_job->offs = offs;
+  p_job->size = size;
+  p_job->reply.cherr.chunk.offs = offs;
+  queue_job(dev, p_job, rqstp);
+  return 0;
+}
+
+/* Queue the writing of the uploaded chunk on the device of the file, the reply is deferred. */
+int dev_queue_write_chunk(int dev, const char *name, int fd, int fd_direct, int large, t_flcont *p_data,
+                          uint64_t offs, void (*pf_written)(void *arg, int rc), void *arg,
+                          struct svc_req *rqstp)
+{
+  struct dq_job *p_job;
+
+  if (queue_full(dev))
+    return 1;
+  if ( (p_job = create_job(dev, dq_write_chunk, name)) == NULL )
+    return -1;
+  p_job->fd = fd;
+  p_job->fd_direct = fd_direct;
+  p_job->large = large;
+  p_job->offs = offs;
+  p_job->pf_written = pf_written;
+  p_job->arg = arg;
+
+  // The data is taken from the request, it's not freed by the dispatcher then
+  p_job->data = *p_data;
+  p_data->t_flcont_val = NULL;
+  p_data->t_flcont_len = 0;
+  queue_job(dev, p_job, rqstp);
+  return 0;
+}
+
+/* Queue the reading of the whole file on its device, the reply to the request is deferred. */
+int dev_queue_read_file(int dev, const char *name, const char *flname, const struct stat *p_stat,
+                        struct svc_req *rqstp)
+{
+  struct dq_job *p_job;
+  char *name_reply;
+
+  if (queue_full(dev))
+    return 1;
+  if ( (name_reply = strdup(name)) == NULL )
+    return -1;
+  if ( (p_job = create_job(dev, dq_read_file, flname)) == NULL ) {
+    free(name_reply);
+    return -1;
+  }
+  p_job->reply.flerr.file.name = name_reply;
+  p_job->reply.flerr.file.type = FTYPE_DFL;
+  p_job->st = *p_stat;
+  queue_job(dev, p_job, rqstp);
+  return 0;
+}
+
+/* Answer the request to the full queue with ERRNUM_BUSY and the retry-after time. */
+int dev_queue_busy(const char *name, err_inf **pp_errinf)
+{
+  char msg[64];
+  snprintf(msg, sizeof(msg), "The device queue is full, retry after %d ms", DQ_RETRY_AFTER);
+  errno = EBUSY;
+  LOG(LOG_TYPE_DEVQ, LOG_LEVEL_WARN, "%s: %s", msg, name);
+  (void)process_error(name, ERRNUM_BUSY, msg, pp_errinf);
+  return ERRNUM_BUSY;
+}
+
+/* Get the load of the device. */
+int dev_queue_load(int dev)
+{
+  return dev < numb_devs ? __atomic_load_n(&devs[dev].load, __ATOMIC_RELAXED) : 0;
+}
+
+/* Print the statistics. */
+void dev_queue_print_stats(FILE *hfile)
+{
+  int i;
+  if (numb_devs == 0)
+    return;
+  fprintf(hfile, "Device queues (%d threads each):", DQ_THREADS);
+  for (i = 0; i < numb_devs; ++i) {
+    pthread_mutex_lock(&devs[i].lock);
+    fprintf(hfile, "%s %d: chunks read: %lu, written: %lu, files read: %lu, queued now: %d, max queued: %d, "
+            "busy: %lu", i ? ";" : "", i, devs[i].numb_queued[dq_read_chunk], devs[i].numb_queued[dq_write_chunk],
+            devs[i].numb_queued[dq_read_file], devs[i].load, devs[i].max_queued, devs[i].numb_busy);
+    pthread_mutex_unlock(&devs[i].lock);
+  }
+  fprintf(hfile, "\n");
+}
@@ -0,0 +1,146 @@
+#ifndef _DEV_QUEUE_H_
+#define _DEV_QUEUE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <rpc/rpc.h>
+#include "../rpcgen/fltr.h"
+#include "fd_cache.h"
+
+/*
+ * The per-device I/O queues of the Server.
+ *
+ * Each data directory of the storage layout (see data_dirs.h) is a device with its own queue
+ * of the file I/O served by its own DQ_THREADS threads, so a slow or busy disk delays only
+ * the requests of its files, and all the disks work at once. The queued operations are the reads
+ * of the chunks & of the whole files and the writes of the uploaded chunks. The request queued
+ * is not blocking the event loop: its reply is deferred (see svc_loop_defer()) and sent by
+ * the main thread when the operation is done. The cached & read ahead files, the files
+ * of the backends, packed & compressed, the first chunk of an upload (it creates the file)
+ * and its last one (it links the file under its name) don't get to the queues.
+ * The queue of the device holds up to DQ_DEPTH_MAX operations, the data of each of them
+ * is kept till its reply is sent; the request to the full queue is answered with ERRNUM_BUSY
+ * (see dev_queue_busy()) and retried by the client.
+ */
+
+// Number of the I/O threads per device
+enum { DQ_THREADS = 2 };
+
+// Max number of the operations queued & being done by the device
+enum { DQ_DEPTH_MAX = 32 };
+
+// Time in milliseconds after which the request to the full queue should be retried
+enum { DQ_RETRY_AFTER = 50 };
+
+/* Start the I/O threads of the devices.
+ *
+ * Parameters:
+ *  numb_devs - the number of the devices, up to DDIR_DEVS_MAX; 0 - no queues.
+ *  use_uring - 1 if the uploaded chunks are written through the io_uring ring of each thread
+ *              with the registered bounce buffers (see direct_io_wring()).
+ *
+ * Return value:
+ *  0 on success, >0 on failure (the chunks are read by the main thread then).
+ */
+int dev_queue_init(int numb_devs, int use_uring);
+
+/* Queue the reading of the chunk of the file on its device, the reply to the request is deferred.
+ *
+ * The reply is the chunk as of download_chunk, the descriptor reference is released and
+ * the chunk is noted by the read-ahead (see read_ahead_note()) when the chunk is read.
+ *
+ * Parameters:
+ *  dev       - the device index of the file.
+ *  flname    - the name of the file.
+ *  ref       - the reference to the cached descriptor of the file, it's passed to the queue.
+ *  fd        - the descriptor of the file.
+ *  fd_direct - the descriptor of the file opened with O_DIRECT, or -1.
+ *  offs      - the offset of the chunk.
+ *  size      - the max size of the chunk.
+ *  rqstp     - the request of the chunk.
+ *
+ * Return value:
+ *  0 if the chunk is queued (the RPC function returns NULL), -1 if it must be read at once
+ *  (e.g. the reply to a datagram can't be deferred), 1 if the queue is full; the reference
+ *  is kept by the caller if the chunk is not queued.
+ */
+int dev_queue_read_chunk(int dev, const char *flname, fd_ref ref, int fd, int fd_direct,
+                         uint64_t offs, size_t size, struct svc_req *rqstp);
+
+/* Queue the writing of the uploaded chunk on the device of the file, the reply to the request
+ * is deferred.
+ *
+ * The reply is the error info as of upload_chunk, the completion is called by the main thread
+ * when the chunk is written, before the reply is sent.
+ *
+ * Parameters:
+ *  dev        - the device index of the file.
+ *  name       - the name of the file, for the errors.
+ *  fd         - the descriptor of the file, it must stay open till the completion.
+ *  fd_direct  - the descriptor of the file opened with O_DIRECT, or -1.
+ *  large      - 1 if the file is large (see direct_io_write()).
+ *  p_data     - a pointer to the data of the chunk, it's taken from the request if it's queued.
+ *  offs       - the offset of the chunk.
+ *  pf_written - the completion: it's passed `arg` & the result of the writing, 0 or >0.
+ *  arg        - the argument of the completion.
+ *  rqstp      - the request of the chunk.
+ *
+ * Return value:
+ *  0 if the chunk is queued (the RPC function returns NULL), -1 if it must be written at once,
+ *  1 if the queue is full.
+ */
+int dev_queue_write_chunk(int dev, const char *name, int fd, int fd_direct, int large, t_flcont *p_data,
+                          uint64_t offs, void (*pf_written)(void *arg, int rc), void *arg,
+                          struct svc_req *rqstp);
+
+/* Queue the reading of the whole file on its device, the reply to the request is deferred.
+ *
+ * The reply is the file as of download_file, the content is added to the content cache
+ * (see cont_cache_add()) when it's read.
+ *
+ * Parameters:
+ *  dev    - the device index of the file.
+ *  name   - the name of the file requested.
+ *  flname - the path of the file.
+ *  p_stat - the status of the file before it's read (see cont_cache_lookup()).
+ *  rqstp  - the request of the file.
+ *
+ * Return value:
+ *  0 if the file is queued (the RPC function returns NULL), -1 if it must be read at once,
+ *  1 if the queue is full.
+ */
+
+/* Answer the request to the full queue with ERRNUM_BUSY and the retry-after time.
+ *
+ * Parameters:
+ *  name      - the name of the file requested.
+ *  pp_errinf - a pointer to the pointer to the error info to be set.
+ *
+ * Return value:
+ *  ERRNUM_BUSY.
+ */
+int dev_queue_busy(const char *name, err_inf **pp_errinf);
+int dev_queue_read_file(int dev, const char *name, const char *flname, const struct stat *p_stat,
+                        struct svc_req *rqstp);
+
+/* Get the load of the device: the number of the operations queued & being done.
+ *
+ * Parameters:
+ *  dev - the device index.
+ *
+ * Return value:
+ *  The number of the operations.
+ */
+int dev_queue_load(int dev);
+
+/* Print the statistics: the operations queued by each device, its queue now & at most,
+ * the requests answered as busy.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void dev_queue_print_stats(FILE *hfile);
+
+#endif
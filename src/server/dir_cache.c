@@ -0,0 +1,314 @@
+/*
+ * dir_cache.c: the cache of the directory listings on the Server.
+ * Errors range: 71 (reserve 72-75)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "dir_cache.h"
+#include "../rpcgen/fltr.h"
+#include "../common/fs_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Number of buckets in the hash tables of the cached listings, power of 2
+enum { NUMB_DIR_BUCKETS = 1024 };
+
+// The events of the directory entries changing the listing
+#define DIR_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                        IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// The cached listing of a directory
+struct dir_entry {
+  char *path;                   // the full path of the directory
+  char *listing;                // the listing text
+  size_t size;                  // memory used by the entry
+  int wd;                       // the inotify watch of the directory
+  struct stat stat_parent;      // the status of the parent directory at the listing time
+  struct dir_entry *prev, *next; // the LRU list, the head is the most recently used
+  struct dir_entry *next_path;  // next entry in the bucket by path
+  struct dir_entry *next_wd;    // next entry in the bucket by watch
+};
+
+static struct dir_entry *by_path[NUMB_DIR_BUCKETS]; // the entries by the directory path
+static struct dir_entry *by_wd[NUMB_DIR_BUCKETS];   // the entries by the inotify watch
+static struct dir_entry *lru_head = NULL, *lru_tail = NULL;
+static int hinotify = -1;     // the inotify instance
+static size_t budget = 0;     // max number of bytes used by the entries
+static size_t used = 0;       // number of bytes used by the entries
+static int numb_entries = 0;  // number of the cached listings
+
+// The directory being listed after the miss, its changes are watched since the miss
+static struct {
+  char path[LEN_PATH_MAX];
+  int wd;                     // -1 if there is no pending listing
+  int changed;                // 1 if the directory was changed while it was listed
+} pending = { "", -1, 0 };
+
+// The cache statistics
+static unsigned long numb_hits, numb_misses, numb_invals, numb_evicts, numb_overflows;
+
+/* Get the hash of the directory path (FNV-1a) */
+static unsigned hash_path(const char *path)
+{
+  uint32_t hash = 2166136261u;
+  while (*path)
+    hash = (hash ^ (unsigned char)*path++) * 16777619u;
+  return hash & (NUMB_DIR_BUCKETS - 1);
+}
+
+/* Unlink the entry from the LRU list */
+static void lru_unlink(struct dir_entry *p_entry)
+{
+  if (p_entry->prev) p_entry->prev->next = p_entry->next;
+  else lru_head = p_entry->next;
+  if (p_entry->next) p_entry->next->prev = p_entry->prev;
+  else lru_tail = p_entry->prev;
+  p_entry->prev = p_entry->next = NULL;
+}
+
+/* Put the entry at the head of the LRU list */
+static void lru_push_head(struct dir_entry *p_entry)
+{
+  p_entry->prev = NULL;
+  p_entry->next = lru_head;
+  if (lru_head) lru_head->prev = p_entry;
+  else lru_tail = p_entry;
+  lru_head = p_entry;
+}
+
+/* Remove the inotify watch if it's not used by any entry or by the pending listing */
+static void release_watch(int wd)
+{
+  struct dir_entry *p_entry;
+  if (wd == pending.wd)
+    return;
+  for (p_entry = by_wd[wd & (NUMB_DIR_BUCKETS - 1)]; p_entry; p_entry = p_entry->next_wd)
+    if (p_entry->wd == wd)
+      return;
+  (void)inotify_rm_watch(hinotify, wd); // fails if the watch was already removed by the kernel
+}
+
+/* Remove the entry from the cache and free it */
+static void remove_entry(struct dir_entry *p_entry)
+{
+  struct dir_entry **pp_entry = &by_path[hash_path(p_entry->path)];
+  while (*pp_entry != p_entry)
+    pp_entry = &(*pp_entry)->next_path;
+  *pp_entry = p_entry->next_path;
+  pp_entry = &by_wd[p_entry->wd & (NUMB_DIR_BUCKETS - 1)];
+  while (*pp_entry != p_entry)
+    pp_entry = &(*pp_entry)->next_wd;
+  *pp_entry = p_entry->next_wd;
+  lru_unlink(p_entry);
+  used -= p_entry->size;
+  numb_entries--;
+
+  release_watch(p_entry->wd);
+  free(p_entry->path);
+  free(p_entry->listing);
+  free(p_entry);
+}
+
+/* Invalidate the listings of the watched directory, wd -1 invalidates all of them */
+static void invalidate(int wd)
+{
+  struct dir_entry *p_entry, *p_next;
+
+  if (wd == -1 || wd == pending.wd)
+    pending.changed = 1;
+  if (wd == -1) {
+    while (lru_head) {
+      remove_entry(lru_head);
+      numb_invals++;
+    }
+    return;
+  }
+  for (p_entry = by_wd[wd & (NUMB_DIR_BUCKETS - 1)]; p_entry; p_entry = p_next) {
+    p_next = p_entry->next_wd;
+    if (p_entry->wd == wd) {
+      LOG(LOG_TYPE_DIRC, LOG_LEVEL_DEBUG, "invalidated: %s", p_entry->path);
+      remove_entry(p_entry);
+      numb_invals++;
+    }
+  }
+}
+
+/* Read the pending inotify events and invalidate the changed directories */
+static void read_events(void)
+{
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *p_ev;
+  ssize_t len;
+  char *p_buf;
+
+  while ( (len = read(hinotify, buf, sizeof(buf))) > 0 ) {
+    for (p_buf = buf; p_buf < buf + len; p_buf += sizeof(struct inotify_event) + p_ev->len) {
+      p_ev = (const struct inotify_event *)p_buf;
+      if (p_ev->mask & IN_Q_OVERFLOW) {
+        // The events were lost, nothing can be trusted
+        LOG(LOG_TYPE_DIRC, LOG_LEVEL_WARN, "inotify queue overflow, the cache is cleared");
+        numb_overflows++;
+        invalidate(-1);
+      }
+      else
+        invalidate(p_ev->wd);
+    }
+  }
+  if (len == -1 && errno != EAGAIN && errno != EINTR) {
+    LOG(LOG_TYPE_DIRC, LOG_LEVEL_ERROR, "Failed to read inotify events: %s", strerror(errno));
+    invalidate(-1);
+  }
+}
+
+/* Get the status of the parent directory of the passed one */
+static int stat_parent(const char *dirname, struct stat *p_stat)
+{
+  char path[LEN_PATH_MAX + 3];
+  snprintf(path, sizeof(path), "%s/..", dirname);
+  return lstat(path, p_stat);
+}
+
+/* Stop watching the pending listing */
+static void drop_pending(void)
+{
+  int wd = pending.wd;
+  if (wd == -1)
+    return;
+  pending.wd = -1;
+  release_watch(wd);
+}
+
+/* Get the cached listing of the directory. */
+static const char *dir_cache_get(const char *dirname)
+{
+  struct dir_entry *p_entry;
+  struct stat statbuf;
+  int wd;
+
+  read_events();
+  drop_pending();
+
+  for (p_entry = by_path[hash_path(dirname)]; p_entry; p_entry = p_entry->next_path)
+    if (strcmp(p_entry->path, dirname) == 0)
+      break;
+
+  // The entry '..' is valid while the parent directory is not changed
+  if (p_entry && (stat_parent(dirname, &statbuf) != 0 ||
+                  statbuf.st_ino != p_entry->stat_parent.st_ino ||
+                  statbuf.st_dev != p_entry->stat_parent.st_dev ||
+                  statbuf.st_ctim.tv_sec != p_entry->stat_parent.st_ctim.tv_sec ||
+                  statbuf.st_ctim.tv_nsec != p_entry->stat_parent.st_ctim.tv_nsec)) {
+    LOG(LOG_TYPE_DIRC, LOG_LEVEL_DEBUG, "parent was changed: %s", dirname);
+    remove_entry(p_entry);
+    numb_invals++;
+    p_entry = NULL;
+  }
+
+  if (p_entry) {
+    numb_hits++;
+    lru_unlink(p_entry);
+    lru_push_head(p_entry);
+    return p_entry->listing;
+  }
+
+  // Watch the directory before it's listed, so its changes while listing are not missed
+  numb_misses++;
+  if ( (wd = inotify_add_watch(hinotify, dirname, DIR_WATCH_MASK)) == -1 ) {
+    LOG(LOG_TYPE_DIRC, LOG_LEVEL_WARN, "Failed to watch %s: %s", dirname, strerror(errno));
+    return NULL;
+  }
+  snprintf(pending.path, LEN_PATH_MAX, "%s", dirname);
+  pending.wd = wd;
+  pending.changed = 0;
+  return NULL;
+}
+
+/* Store the listing of the directory missed by dir_cache_get(). */
+static void dir_cache_put(const char *dirname, const char *listing)
+{
+  struct dir_entry *p_entry;
+  size_t size, len_path = strlen(dirname) + 1, len_list = strlen(listing) + 1;
+  unsigned hash;
+
+  read_events();
+  if (pending.wd == -1 || pending.changed || strcmp(pending.path, dirname) != 0) {
+    drop_pending();
+    return;
+  }
+
+  // Too large listing is not cached, the least recently used listings are evicted
+  size = sizeof(struct dir_entry) + len_path + len_list;
+  if (size > budget / 4) {
+    drop_pending();
+    return;
+  }
+  while (used + size > budget && lru_tail) {
+    remove_entry(lru_tail);
+    numb_evicts++;
+  }
+
+  if ( (p_entry = calloc(1, sizeof(struct dir_entry))) == NULL ||
+       (p_entry->path = malloc(len_path)) == NULL ||
+       (p_entry->listing = malloc(len_list)) == NULL ||
+       stat_parent(dirname, &p_entry->stat_parent) != 0 ) {
+    if (p_entry) {
+      free(p_entry->path);
+      free(p_entry->listing);
+      free(p_entry);
+    }
+    drop_pending();
+    return;
+  }
+  memcpy(p_entry->path, dirname, len_path);
+  memcpy(p_entry->listing, listing, len_list);
+  p_entry->size = size;
+  p_entry->wd = pending.wd;
+  pending.wd = -1; // the watch is passed to the entry
+
+  hash = hash_path(dirname);
+  p_entry->next_path = by_path[hash];
+  by_path[hash] = p_entry;
+  p_entry->next_wd = by_wd[p_entry->wd & (NUMB_DIR_BUCKETS - 1)];
+  by_wd[p_entry->wd & (NUMB_DIR_BUCKETS - 1)] = p_entry;
+  lru_push_head(p_entry);
+  used += size;
+  numb_entries++;
+  LOG(LOG_TYPE_DIRC, LOG_LEVEL_DEBUG, "cached listing of %s, %lu bytes", dirname, size);
+}
+
+// The cache functions used by select_file()
+static const struct ls_dir_cache dir_cache = { dir_cache_get, dir_cache_put };
+
+/* Initialize the cache of the directory listings and set it for select_file(). */
+int dir_cache_init(size_t budget_bytes)
+{
+  budget = budget_bytes;
+  if (budget == 0)
+    return 0;
+  if ( (hinotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1 ) {
+    fprintf(stderr, "Error 71: Failed to init inotify, the directory listings are not cached\n%s\n",
+            strerror(errno));
+    budget = 0;
+    return 71;
+  }
+  set_ls_dir_cache(&dir_cache);
+  return 0;
+}
+
+/* Print the cache statistics. */
+void dir_cache_print_stats(FILE *hfile)
+{
+  fprintf(hfile, "Directory listing cache (budget: %lu bytes): used: %lu bytes in %d listings, "
+          "hits: %lu, misses: %lu, invalidated: %lu, evicted: %lu, event overflows: %lu\n",
+          budget, used, numb_entries, numb_hits, numb_misses, numb_invals, numb_evicts,
+          numb_overflows);
+}
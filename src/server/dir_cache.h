@@ -0,0 +1,36 @@
+#ifndef _DIR_CACHE_H_
+#define _DIR_CACHE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+
+/*
+ * The cache of the directory listings on the Server.
+ *
+ * The listings made by pick_file are kept by the full path of the directory within
+ * the memory budget, the least recently used ones are evicted. The cached directory is
+ * watched by inotify: any creation, deletion, move, attributes or content change of its
+ * entries invalidates the listing. The pending events are read before each lookup, so
+ * a stale listing is never returned. The entry '..' of the listing is checked by its
+ * change time, as the changes of the parent directory are not watched.
+ */
+
+/* Initialize the cache of the directory listings and set it for select_file().
+ *
+ * Parameters:
+ *  budget - the max number of bytes used by the cached listings, 0 disables the cache.
+ *           A listing larger than a quarter of the budget is not cached.
+ *
+ * Return value:
+ *  0 on success, >0 if inotify can't be initialized (the cache is disabled).
+ */
+int dir_cache_init(size_t budget);
+
+/* Print the cache statistics: the hits, misses, invalidations, evictions and used memory.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void dir_cache_print_stats(FILE *hfile);
+
+#endif
@@ -0,0 +1,475 @@
+/*
+ * dir_delta.c: the versioned directory listings on the Server.
+ * Errors range: 81-84 (reserve 85)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#include "dir_delta.h"
+#include "../rpcgen/fltr.h"
+#include "../common/fs_opers.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Max number of the tracked directories
+enum { NUMB_DELTA_DIRS = 64 };
+
+// Max number of the entries of all the tracked directories, the least recently used
+// directories are evicted above it
+enum { NUMB_DELTA_ENTRIES = 1 << 20 };
+
+// Min number of the kept tombstones, more of them are kept for a larger directory
+enum { NUMB_TOMBS_MIN = 1024 };
+
+// The events of the directory entries changing the listing
+#define DELTA_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                          IN_MODIFY | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// The generations of the listed entry
+struct ent_gens {
+  uint32_t added;             // when the entry was added
+  uint32_t changed;           // when the entry was added or its file status was changed
+};
+
+// The removed entry
+struct tomb {
+  char *name;                 // the file name
+  uint32_t gen;               // when the entry was removed
+};
+
+// The tracked directory with its last listing
+struct delta_dir {
+  char *path;                 // the full path of the directory, NULL - the slot is free
+  int wd;                     // the inotify watch of the directory, -1 if it's not watched
+  int dirty;                  // 1 if the directory was changed since the last scan
+  unsigned long last_used;    // the LRU stamp
+  uint32_t gen;               // the generation of the last change
+  uint32_t gen_floor;         // the oldest generation the changes are known since
+  struct ls_entries ents;     // the entries of the last scan
+  size_t *order;              // the indexes of the entries sorted by name
+  struct ent_gens *gens;      // the generations of the entries
+  struct tomb *tombs;         // the removed entries
+  size_t numb_tombs, numb_tombs_max;
+};
+
+static struct delta_dir dirs[NUMB_DELTA_DIRS];
+static int hinotify = -1;           // the inotify instance
+static uint32_t instance;           // the high half of the generations of this process
+static uint32_t counter = 0;        // the last generation of all the directories
+static unsigned long numb_uses = 0; // the LRU clock
+static size_t numb_entries = 0;     // number of the entries of all the tracked directories
+
+static char path[PATH_MAX];         // the full path of the requested directory
+static delta_item *items = NULL;    // the changed entries, their names point into `dirs`
+static size_t numb_items_max = 0;
+
+// The entries being sorted
+static const struct ls_entries *p_sort_ents;
+
+// The statistics
+static unsigned long numb_deltas, numb_fulls, numb_scans, numb_scans_saved, numb_evicts;
+
+/* Compare the entries by name for qsort() */
+static int cmp_names(const void *p1, const void *p2)
+{
+  return strcmp(p_sort_ents->names + p_sort_ents->items[*(const size_t *)p1].offs_name,
+                p_sort_ents->names + p_sort_ents->items[*(const size_t *)p2].offs_name);
+}
+
+/* Get the name of the entry by its position in the sorted order */
+static const char *name_at(const struct delta_dir *p_dir, size_t pos)
+{
+  return p_dir->ents.names + p_dir->ents.items[p_dir->order[pos]].offs_name;
+}
+
+/* Check if the file status of the entry was changed */
+static int is_changed(const struct ls_entry *p_old, const struct ls_entry *p_new)
+{
+  return p_old->err != p_new->err || p_old->mode != p_new->mode || p_old->uid != p_new->uid ||
+         p_old->gid != p_new->gid || p_old->size != p_new->size || p_old->mtime != p_new->mtime ||
+         p_old->mtime_nsec != p_new->mtime_nsec || p_old->ino != p_new->ino;
+}
+
+/* Free the tombstones of the directory */
+static void free_tombs(struct delta_dir *p_dir)
+{
+  size_t i;
+  for (i = 0; i < p_dir->numb_tombs; ++i)
+    free(p_dir->tombs[i].name);
+  p_dir->numb_tombs = 0;
+}
+
+/* Stop tracking the directory */
+static void untrack(struct delta_dir *p_dir)
+{
+  if (p_dir->wd != -1)
+    (void)inotify_rm_watch(hinotify, p_dir->wd); // fails if the watch was already removed
+  numb_entries -= p_dir->ents.numb;
+  free_dir_entries(&p_dir->ents);
+  free_tombs(p_dir);
+  free(p_dir->tombs);
+  free(p_dir->order);
+  free(p_dir->gens);
+  free(p_dir->path);
+  memset(p_dir, 0, sizeof(struct delta_dir));
+  p_dir->wd = -1;
+}
+
+/* Read the pending inotify events and mark the changed directories */
+static void read_events(void)
+{
+  char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  const struct inotify_event *p_ev;
+  ssize_t len;
+  char *p_buf;
+  int i;
+
+  if (hinotify == -1)
+    return;
+  while ( (len = read(hinotify, buf, sizeof(buf))) > 0 ) {
+    for (p_buf = buf; p_buf < buf + len; p_buf += sizeof(struct inotify_event) + p_ev->len) {
+      p_ev = (const struct inotify_event *)p_buf;
+      for (i = 0; i < NUMB_DELTA_DIRS; ++i) {
+        if (!dirs[i].path || (dirs[i].wd != p_ev->wd && !(p_ev->mask & IN_Q_OVERFLOW)))
+          continue;
+        dirs[i].dirty = 1;
+        if (p_ev->mask & IN_IGNORED)
+          dirs[i].wd = -1; // the directory was removed, the kernel has removed the watch
+      }
+    }
+  }
+  if (len == -1 && errno != EAGAIN && errno != EINTR) {
+    LOG(LOG_TYPE_DDLT, LOG_LEVEL_ERROR, "Failed to read inotify events: %s", strerror(errno));
+    for (i = 0; i < NUMB_DELTA_DIRS; ++i)
+      dirs[i].dirty = 1;
+  }
+}
+
+/* Get the tracked directory, or start tracking it in the free or least recently used slot */
+static struct delta_dir *get_dir(const char *dirname)
+{
+  struct delta_dir *p_dir = &dirs[0];
+  int i;
+
+  for (i = 0; i < NUMB_DELTA_DIRS; ++i) {
+    if (dirs[i].path && strcmp(dirs[i].path, dirname) == 0) {
+      dirs[i].last_used = ++numb_uses;
+      return &dirs[i];
+    }
+    if (!dirs[i].path || (p_dir->path && dirs[i].last_used < p_dir->last_used))
+      p_dir = &dirs[i];
+  }
+  if (p_dir->path) {
+    LOG(LOG_TYPE_DDLT, LOG_LEVEL_DEBUG, "evicted: %s", p_dir->path);
+    untrack(p_dir);
+    numb_evicts++;
+  }
+  if ( (p_dir->path = strdup(dirname)) == NULL )
+    return NULL;
+  // Watch the directory before it's scanned, so its changes while scanning are not missed
+  if ( hinotify != -1 &&
+       (p_dir->wd = inotify_add_watch(hinotify, dirname, DELTA_WATCH_MASK)) == -1 )
+    LOG(LOG_TYPE_DDLT, LOG_LEVEL_WARN, "Failed to watch %s: %s", dirname, strerror(errno));
+  p_dir->dirty = 1;
+  p_dir->last_used = ++numb_uses;
+  return p_dir;
+}
+
+/* Evict the least recently used directories other than the passed one while the entries
+ * of all the directories are too many */
+static void evict_entries(const struct delta_dir *p_keep)
+{
+  struct delta_dir *p_dir;
+  int i;
+
+  while (numb_entries > NUMB_DELTA_ENTRIES) {
+    p_dir = NULL;
+    for (i = 0; i < NUMB_DELTA_DIRS; ++i)
+      if (dirs[i].path && &dirs[i] != p_keep && (!p_dir || dirs[i].last_used < p_dir->last_used))
+        p_dir = &dirs[i];
+    if (!p_dir)
+      return;
+    untrack(p_dir);
+    numb_evicts++;
+  }
+}
+
+/* Add the tombstone of the removed entry. Return 0 on success, 1 on failure. */
+static int add_tomb(struct delta_dir *p_dir, const char *name, uint32_t gen)
+{
+  struct tomb *tombs;
+  size_t numb_max;
+
+  if (p_dir->numb_tombs == p_dir->numb_tombs_max) {
+    numb_max = p_dir->numb_tombs_max ? 2 * p_dir->numb_tombs_max : 64;
+    if ( (tombs = realloc(p_dir->tombs, numb_max * sizeof(struct tomb))) == NULL )
+      return 1;
+    p_dir->tombs = tombs;
+    p_dir->numb_tombs_max = numb_max;
+  }
+  if ( (p_dir->tombs[p_dir->numb_tombs].name = strdup(name)) == NULL )
+    return 1;
+  p_dir->tombs[p_dir->numb_tombs++].gen = gen;
+  return 0;
+}
+
+/* Scan the directory again and compare the new entries with the kept ones.
+ * The changed entries get the next generation. Return 0 on success, >0 on failure. */
+static int rescan(struct delta_dir *p_dir, err_inf **pp_errinf)
+{
+  struct ls_entries ents;
+  struct ent_gens *gens = NULL;
+  size_t *order = NULL;
+  size_t i_old = 0, i_new = 0, i;
+  uint32_t gen_next = counter + 1;
+  int rc, cmp, changed = 0, failed = 0;
+
+  p_dir->dirty = 0; // the changes while scanning mark the directory again
+  numb_scans++;
+  errno = 0;
+  if ( (rc = scan_dir(p_dir->path, &ents)) != 0 ) {
+    free_dir_entries(&ents);
+    if (rc == 1) {
+      (void)process_error(p_dir->path, 83, "Failed to allocate memory for the directory listing",
+                          pp_errinf);
+      return 83;
+    }
+    (void)process_error(p_dir->path, 84, rc == 2 ? "Failed to read the directory" :
+                        "Failed to open the directory", pp_errinf);
+    untrack(p_dir);
+    return 84;
+  }
+  if ( (order = malloc((ents.numb + 1) * sizeof(size_t))) == NULL ||
+       (gens = malloc((ents.numb + 1) * sizeof(struct ent_gens))) == NULL ) {
+    free(order);
+    free_dir_entries(&ents);
+    (void)process_error(p_dir->path, 83, "Failed to allocate memory for the directory listing",
+                        pp_errinf);
+    p_dir->dirty = 1;
+    return 83;
+  }
+  for (i = 0; i < ents.numb; ++i)
+    order[i] = i;
+  p_sort_ents = &ents;
+  qsort(order, ents.numb, sizeof(size_t), cmp_names);
+
+  // Merge the old & new entries sorted by name
+  while (i_old < p_dir->ents.numb || i_new < ents.numb) {
+    if (i_old == p_dir->ents.numb)
+      cmp = 1;
+    else if (i_new == ents.numb)
+      cmp = -1;
+    else
+      cmp = strcmp(name_at(p_dir, i_old), ents.names + ents.items[order[i_new]].offs_name);
+
+    if (cmp < 0) {
+      // The entry was removed
+      failed |= add_tomb(p_dir, name_at(p_dir, i_old), gen_next);
+      changed = 1;
+      i_old++;
+    }
+    else if (cmp > 0) {
+      // The entry was added
+      gens[order[i_new]].added = gens[order[i_new]].changed = gen_next;
+      changed = 1;
+      i_new++;
+    }
+    else {
+      gens[order[i_new]] = p_dir->gens[p_dir->order[i_old]];
+      if ( is_changed(&p_dir->ents.items[p_dir->order[i_old]], &ents.items[order[i_new]]) ) {
+        gens[order[i_new]].changed = gen_next;
+        changed = 1;
+      }
+      i_old++;
+      i_new++;
+    }
+  }
+
+  numb_entries += ents.numb;
+  numb_entries -= p_dir->ents.numb;
+  free_dir_entries(&p_dir->ents);
+  free(p_dir->order);
+  free(p_dir->gens);
+  p_dir->ents = ents;
+  p_dir->order = order;
+  p_dir->gens = gens;
+
+  if (p_dir->gen == 0) {
+    // The first scan: the changes are known since it
+    counter = p_dir->gen = p_dir->gen_floor = gen_next;
+    free_tombs(p_dir);
+  }
+  else if (changed) {
+    counter = p_dir->gen = gen_next;
+    LOG(LOG_TYPE_DDLT, LOG_LEVEL_DEBUG, "changed: %s, generation %u", p_dir->path, gen_next);
+  }
+
+  // Too many tombstones are dropped, the older generations get the whole listing then
+  if (failed || p_dir->numb_tombs > (ents.numb > NUMB_TOMBS_MIN ? ents.numb : NUMB_TOMBS_MIN)) {
+    free_tombs(p_dir);
+    p_dir->gen_floor = p_dir->gen;
+  }
+  evict_entries(p_dir);
+  return 0;
+}
+
+/* Check if the name is listed in the directory */
+static int is_listed(const struct delta_dir *p_dir, const char *name)
+{
+  size_t lo = 0, hi = p_dir->ents.numb, mid;
+  int cmp;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if ( (cmp = strcmp(name_at(p_dir, mid), name)) == 0 )
+      return 1;
+    if (cmp < 0) lo = mid + 1;
+    else hi = mid;
+  }
+  return 0;
+}
+
+/* Get the type of the listed entry */
+static filetype get_item_type(const struct ls_entry *p_ent)
+{
+  if (p_ent->err)
+    return FTYPE_INV;
+  if (S_ISDIR(p_ent->mode))
+    return FTYPE_DIR;
+  if (S_ISREG(p_ent->mode))
+    return FTYPE_REG;
+  return FTYPE_OTH;
+}
+
+/* Put the changed entry into the items */
+static void put_item(size_t pos, item_change change, const char *name, const struct ls_entry *p_ent)
+{
+  dir_item *p_item = &items[pos].item;
+  items[pos].change = change;
+  memset(p_item, 0, sizeof(dir_item));
+  p_item->name = (char *)name;
+  p_item->type = FTYPE_NEX;
+  if (!p_ent)
+    return;
+  p_item->type = get_item_type(p_ent);
+  p_item->size = p_ent->size;
+  p_item->mtime = p_ent->mtime;
+  p_item->mode = p_ent->mode;
+  p_item->uid = p_ent->uid;
+  p_item->gid = p_ent->gid;
+}
+
+/* Initialize the tracking of the directory changes. */
+int dir_delta_init(void)
+{
+  struct timespec tm;
+  int i;
+
+  for (i = 0; i < NUMB_DELTA_DIRS; ++i)
+    dirs[i].wd = -1;
+  clock_gettime(CLOCK_REALTIME, &tm);
+  instance = (uint32_t)getpid() * 2654435761u ^ (uint32_t)tm.tv_sec ^ (uint32_t)tm.tv_nsec;
+  if (instance == 0)
+    instance = 1;
+  if ( (hinotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1 ) {
+    fprintf(stderr, "Error 81: Failed to init inotify, the directories are scanned by each "
+            "listing changes request\n%s\n", strerror(errno));
+    return 81;
+  }
+  return 0;
+}
+
+/* Make the changes of the directory listing since the passed generation. */
+int dir_delta_make(const delta_req *p_req, dir_delta *p_delta, err_inf **pp_errinf)
+{
+  struct delta_dir *p_dir;
+  uint32_t gen = (uint32_t)p_req->gen;
+  size_t numb = 0, numb_max, i;
+  const struct ls_entry *p_ent;
+  const struct ent_gens *p_gens;
+  int full, rc;
+
+  LOG(LOG_TYPE_DDLT, LOG_LEVEL_DEBUG, "changes of %s since %llx",
+      p_req->path, (unsigned long long)p_req->gen);
+
+  path[0] = '\0';
+  p_delta->path = path;
+  p_delta->gen = 0;
+  p_delta->full = FALSE;
+  p_delta->items.items_len = 0;
+  p_delta->items.items_val = items;
+
+  errno = 0;
+  if (realpath(p_req->path, path) == NULL) {
+    path[0] = '\0';
+    (void)process_error(p_req->path, 82, "Failed to resolve the directory path", pp_errinf);
+    return 82;
+  }
+
+  // The directory is scanned only if it was changed since the last scan
+  read_events();
+  if ( (p_dir = get_dir(path)) == NULL ) {
+    (void)process_error(path, 83, "Failed to allocate memory for the directory listing",
+                        pp_errinf);
+    return 83;
+  }
+  if (p_dir->dirty || p_dir->wd == -1) {
+    if ( (rc = rescan(p_dir, pp_errinf)) != 0 )
+      return rc;
+  }
+  else
+    numb_scans_saved++;
+
+  // The passed generation must be of this process and not older than the kept changes
+  full = (uint32_t)(p_req->gen >> 32) != instance || gen < p_dir->gen_floor || gen > p_dir->gen;
+  numb_max = p_dir->ents.numb + (full ? 0 : p_dir->numb_tombs);
+  if (numb_max > numb_items_max) {
+    delta_item *p_new = realloc(items, numb_max * sizeof(delta_item));
+    if (!p_new) {
+      (void)process_error(path, 83, "Failed to allocate memory for the directory listing",
+                          pp_errinf);
+      return 83;
+    }
+    items = p_new;
+    numb_items_max = numb_max;
+  }
+
+  for (i = 0; i < p_dir->ents.numb; ++i) {
+    p_ent = &p_dir->ents.items[p_dir->order[i]];
+    p_gens = &p_dir->gens[p_dir->order[i]];
+    if (full || p_gens->changed > gen)
+      put_item(numb++, full || p_gens->added > gen ? ch_added : ch_modified,
+               name_at(p_dir, i), p_ent);
+  }
+  // The name removed & added again is reported as added
+  for (i = 0; !full && i < p_dir->numb_tombs; ++i)
+    if (p_dir->tombs[i].gen > gen && !is_listed(p_dir, p_dir->tombs[i].name))
+      put_item(numb++, ch_removed, p_dir->tombs[i].name, NULL);
+
+  if (full) numb_fulls++;
+  else numb_deltas++;
+  p_delta->gen = (uint64_t)instance << 32 | p_dir->gen;
+  p_delta->full = full ? TRUE : FALSE;
+  p_delta->items.items_val = items;
+  p_delta->items.items_len = numb;
+  LOG(LOG_TYPE_DDLT, LOG_LEVEL_DEBUG, "%lu %s of %s, generation %u",
+      numb, full ? "entries" : "changes", path, p_dir->gen);
+  return 0;
+}
+
+/* Print the statistics. */
+void dir_delta_print_stats(FILE *hfile)
+{
+  fprintf(hfile, "Listing changes: %lu entries in tracked directories, changes sent: %lu, "
+          "whole listings sent: %lu, scans: %lu, scans saved: %lu, evicted: %lu\n",
+          numb_entries, numb_deltas, numb_fulls, numb_scans, numb_scans_saved, numb_evicts);
+}
@@ -0,0 +1,56 @@
+#ifndef _DIR_DELTA_H_
+#define _DIR_DELTA_H_
+
+#include <stdio.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The versioned directory listings on the Server (list_delta).
+ *
+ * The last listing of each of the recently requested directories is kept with
+ * the generation of every entry: when it was added and last modified. The removed
+ * entries are kept as tombstones with the generation of their removal. A client passing
+ * the generation it knows gets only the entries added, modified & removed since then.
+ *
+ * The directory is watched by inotify, it's scanned again only after its entries were
+ * changed, so polling an unchanged directory costs no scan. The new scan is compared
+ * with the kept listing by the file status of the entries, so a lost event only delays
+ * the change till the next one. The changes inside the subdirectories (e.g. their
+ * modification time) are seen as soon as the directory itself is changed or scanned.
+ *
+ * The generations are unique to the Server process: a generation of another process
+ * (e.g. of another worker or before the restart), of an evicted directory or older than
+ * the kept tombstones is answered with the whole listing.
+ */
+
+/* Initialize the tracking of the directory changes.
+ *
+ * Return value:
+ *  0 on success, >0 if inotify can't be initialized (each request scans the directory).
+ */
+int dir_delta_init(void);
+
+/* Make the changes of the directory listing since the passed generation.
+ *
+ * The changes are kept in the static memory of this module, they remain valid until
+ * the next call.
+ *
+ * Parameters:
+ *  p_req     - the request: the directory path & the generation known by the client.
+ *  p_delta   - a pointer to the changes to be set.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int dir_delta_make(const delta_req *p_req, dir_delta *p_delta, err_inf **pp_errinf);
+
+/* Print the statistics: the requests answered with the changes & with the whole listings,
+ * the scans of the changed directories and the scans saved by the unchanged ones.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void dir_delta_print_stats(FILE *hfile);
+
+#endif
@@ -0,0 +1,308 @@
+/*
+ * dir_page.c: the paginated directory listing on the Server.
+ * Errors range: 76-78 (reserve 79-80)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <time.h>
+#include <fnmatch.h>
+#include <sys/stat.h>
+
+#include "dir_page.h"
+#include "data_dirs.h"
+#include "pack_store.h"
+#include "store_back.h"
+#include "../rpcgen/fltr.h"
+#include "../common/fs_opers.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+static char path[PATH_MAX];         // the full path of the listed directory
+static struct ls_entries ents;      // the entries of the listed directory
+static size_t *matched = NULL;      // the indexes of the entries matched the filter
+static size_t numb_matched = 0, numb_matched_max = 0;
+static size_t numb_sorted = 0;      // number of the first matched entries in the sorted order
+static dir_item *items = NULL;      // the page items, their names point into `ents`
+static size_t numb_items_max = 0;
+
+// The order of the entries being sorted
+static list_sort sort_key;
+static int sort_desc;
+
+// The request the entries are kept for, the next pages of the listing are made of them
+static struct {
+  char path[LEN_PATH_MAX + 1];      // the requested path of the directory
+  char filter[LEN_PATH_MAX + 1];    //   & the glob pattern
+  list_sort sort;
+  int desc;
+  int exported;                     // 1 if it's the directory of the storage layout
+  uint64_t stamp;                   // the stamp of the directory at the scan, 0 - nothing is kept
+} kept;
+
+// The statistics of the worker
+static unsigned long numb_scans, numb_reuses;
+
+/* Compare the entries by the sort key, the names are compared if the keys are equal */
+static int cmp_entries(size_t i1, size_t i2)
+{
+  const struct ls_entry *p_ent1 = &ents.items[i1], *p_ent2 = &ents.items[i2];
+  int cmp = 0;
+
+  if (sort_key == ls_sort_size)
+    cmp = (p_ent1->size > p_ent2->size) - (p_ent1->size < p_ent2->size);
+  else if (sort_key == ls_sort_mtime)
+    cmp = (p_ent1->mtime > p_ent2->mtime) - (p_ent1->mtime < p_ent2->mtime);
+  if (cmp == 0)
+    cmp = strcmp(ents.names + p_ent1->offs_name, ents.names + p_ent2->offs_name);
+  return sort_desc ? -cmp : cmp;
+}
+
+/* Compare the entries for qsort() */
+static int cmp_qsort(const void *p1, const void *p2)
+{
+  return cmp_entries(*(const size_t *)p1, *(const size_t *)p2);
+}
+
+/* Restore the max-heap order of the entries below the passed position */
+static void sift_down(size_t *heap, size_t numb, size_t pos)
+{
+  size_t child, tmp;
+  while ( (child = 2 * pos + 1) < numb ) {
+    if (child + 1 < numb && cmp_entries(heap[child + 1], heap[child]) > 0)
+      child++;
+    if (cmp_entries(heap[child], heap[pos]) <= 0)
+      break;
+    tmp = heap[pos]; heap[pos] = heap[child]; heap[child] = tmp;
+    pos = child;
+  }
+}
+
+/* Put the first `numb_top` entries in the sorted order to the beginning of the array.
+ * If they are few, the max-heap of them is kept while the rest entries are passed,
+ * the entries out of the heap are swapped to the rest ones.
+ * Return the number of the sorted entries at the beginning of the array. */
+static size_t sort_top(size_t *idxs, size_t numb, size_t numb_top)
+{
+  size_t i, tmp;
+  if (numb_top == 0)
+    return 0;
+  if (numb_top < numb / 4) {
+    for (i = numb_top / 2; i-- > 0; )
+      sift_down(idxs, numb_top, i);
+    for (i = numb_top; i < numb; ++i)
+      if (cmp_entries(idxs[i], idxs[0]) < 0) {
+        tmp = idxs[0]; idxs[0] = idxs[i]; idxs[i] = tmp;
+        sift_down(idxs, numb_top, 0);
+      }
+    numb = numb_top;
+  }
+  qsort(idxs, numb, sizeof(size_t), cmp_qsort);
+  return numb;
+}
+
+/* Get the type of the listed entry */
+static filetype get_item_type(const struct ls_entry *p_ent)
+{
+  if (p_ent->err)
+    return FTYPE_INV;
+  if (S_ISDIR(p_ent->mode))
+    return FTYPE_DIR;
+  if (S_ISREG(p_ent->mode))
+    return FTYPE_REG;
+  return FTYPE_OTH;
+}
+
+/* Grow the array to keep the passed number of elements */
+static int grow(void **p_arr, size_t *p_numb_max, size_t numb, size_t size_elem)
+{
+  void *arr;
+  if (numb <= *p_numb_max)
+    return 0;
+  if ( (arr = realloc(*p_arr, numb * size_elem)) == NULL )
+    return 1;
+  *p_arr = arr;
+  *p_numb_max = numb;
+  return 0;
+}
+
+/* Get the stamp of the directory changed by any creation, removal or renaming of its entries:
+ * the modification time of the directory (of each of its data directories in the storage layout)
+ * and the generation of the packed files. The directory modified in the last seconds isn't
+ * stamped, as its next change may keep the same coarse time.
+ * Return the stamp, 0 if the directory can't be stamped (its entries aren't kept then). */
+static uint64_t stamp_dir(const char *dirname, int exported)
+{
+  struct stat st;
+  uint64_t stamp = 14695981039346656037ull;
+  time_t now = time(NULL);
+  int numb = exported ? data_dirs_numb() : 1, dev, rc;
+
+  for (dev = 0; dev < numb; ++dev) {
+    if ( (rc = exported ? data_dirs_stat(dirname, dev, &st) : stat(dirname, &st)) == -1 )
+      return 0;
+    if (rc == 1)
+      continue;
+    if (st.st_mtim.tv_sec >= now - 1)
+      return 0;
+    stamp = (stamp ^ (uint64_t)st.st_mtim.tv_sec) * 1099511628211ull;
+    stamp = (stamp ^ (uint64_t)st.st_mtim.tv_nsec) * 1099511628211ull;
+  }
+  stamp = (stamp ^ pack_store_gen()) * 1099511628211ull;
+  return stamp ? stamp : 1;
+}
+
+/* Check whether the kept entries are of the request & the directory wasn't changed since its scan */
+static int is_kept(const list_req *p_req, const char *filter)
+{
+  return kept.stamp != 0 && p_req->cursor > 0 && strcmp(kept.path, p_req->path) == 0 &&
+         strcmp(kept.filter, filter) == 0 && kept.sort == p_req->sort && kept.desc == p_req->desc &&
+         stamp_dir(path, kept.exported) == kept.stamp;
+}
+
+/* Scan the directory, select the entries matching the glob pattern of the names & keep them
+ * for the next pages of the request. Return 0 on success, >0 on failure. */
+static int scan_entries(const list_req *p_req, const char *filter, err_inf **pp_errinf)
+{
+  uint64_t stamp = 0;
+  size_t i;
+  int rc, exported = 0;
+
+  // The entries of the previous listing are released
+  free_dir_entries(&ents);
+  path[0] = '\0';
+  kept.stamp = 0;
+  numb_matched = numb_sorted = 0;
+  numb_scans++;
+
+  // The directory under a backend mount is listed by the backend, the directory of the storage
+  // layout is the union of its data directories; they're not resolved. The directory is stamped
+  // before the scan, so the changes made while it's scanned are seen by the next pages.
+  errno = 0;
+  if ( (rc = store_back_list(p_req->path, &ents)) != -1 )
+    snprintf(path, sizeof(path), "%s", p_req->path);
+  else if (data_dirs_exported(p_req->path)) {
+    snprintf(path, sizeof(path), "%s", p_req->path);
+    exported = 1;
+    stamp = stamp_dir(path, 1);
+    rc = data_dirs_scan(path, &ents);
+  }
+  else if (realpath(p_req->path, path) == NULL) {
+    path[0] = '\0';
+    (void)process_error(p_req->path, 76, "Failed to resolve the directory path", pp_errinf);
+    return 76;
+  }
+  else {
+    stamp = stamp_dir(path, 0);
+    rc = scan_dir(path, &ents);
+  }
+  // The packed files of the directory are listed with its files
+  if (rc == 0)
+    rc = pack_store_scan(path, &ents);
+  if (rc != 0) {
+    if (rc == 1) {
+      (void)process_error(path, 77, "Failed to allocate memory for the directory listing",
+                          pp_errinf);
+      return 77;
+    }
+    (void)process_error(path, 78, rc == 2 ? "Failed to read the directory" :
+                        "Failed to open the directory", pp_errinf);
+    return 78;
+  }
+
+  // Select the entries matching the glob pattern of the names
+  errno = 0;
+  if ( grow((void **)&matched, &numb_matched_max, ents.numb, sizeof(size_t)) != 0 ) {
+    (void)process_error(path, 77, "Failed to allocate memory for the directory listing",
+                        pp_errinf);
+    return 77;
+  }
+  for (i = 0; i < ents.numb; ++i)
+    if (filter[0] == '\0' ||
+        fnmatch(filter, ents.names + ents.items[i].offs_name, FNM_PERIOD) == 0)
+      matched[numb_matched++] = i;
+
+  // The entries are kept for the next pages, unless the request doesn't fit
+  if (snprintf(kept.path, sizeof(kept.path), "%s", p_req->path) < (int)sizeof(kept.path) &&
+      snprintf(kept.filter, sizeof(kept.filter), "%s", filter) < (int)sizeof(kept.filter)) {
+    kept.sort = p_req->sort;
+    kept.desc = p_req->desc;
+    kept.exported = exported;
+    kept.stamp = stamp;
+  }
+  return 0;
+}
+
+/* Make the page of the directory listing. */
+int dir_page_make(const list_req *p_req, list_page *p_page, err_inf **pp_errinf)
+{
+  const char *filter = p_req->filter ? p_req->filter : "";
+  size_t first, last, limit, i;
+  const struct ls_entry *p_ent;
+  int rc;
+
+  LOG(LOG_TYPE_DPAG, LOG_LEVEL_DEBUG, "list %s, cursor %llu, limit %u, filter '%s'",
+      p_req->path, (unsigned long long)p_req->cursor, p_req->limit, filter);
+
+  p_page->path = path;
+  p_page->items.items_len = 0;
+  p_page->items.items_val = items;
+  p_page->total = 0;
+  p_page->cursor = 0;
+
+  // The next page of the listing is made of the kept entries, the first one is always scanned
+  if ( is_kept(p_req, filter) ) {
+    numb_reuses++;
+    LOG(LOG_TYPE_DPAG, LOG_LEVEL_DEBUG, "the kept entries are listed: %s", path);
+  }
+  else if ( (rc = scan_entries(p_req, filter, pp_errinf)) != 0 )
+    return rc;
+
+  // The cursor is the offset of the page in the sorted listing
+  limit = p_req->limit < LEN_LIST_MAX ? p_req->limit : LEN_LIST_MAX;
+  first = p_req->cursor < numb_matched ? (size_t)p_req->cursor : numb_matched;
+  last = numb_matched - first > limit ? first + limit : numb_matched;
+
+  // Only the entries up to the page end are sorted, the ones sorted for the previous pages
+  // are kept in their order
+  if (p_req->sort != ls_sort_none && last > numb_sorted) {
+    sort_key = p_req->sort;
+    sort_desc = p_req->desc;
+    numb_sorted += sort_top(matched + numb_sorted, numb_matched - numb_sorted, last - numb_sorted);
+  }
+
+  if ( grow((void **)&items, &numb_items_max, last - first, sizeof(dir_item)) != 0 ) {
+    (void)process_error(path, 77, "Failed to allocate memory for the directory listing",
+                        pp_errinf);
+    return 77;
+  }
+  for (i = first; i < last; ++i) {
+    p_ent = &ents.items[matched[i]];
+    items[i - first].name = ents.names + p_ent->offs_name;
+    items[i - first].type = get_item_type(p_ent);
+    items[i - first].size = p_ent->size;
+    items[i - first].mtime = p_ent->mtime;
+    items[i - first].mode = p_ent->mode;
+    items[i - first].uid = p_ent->uid;
+    items[i - first].gid = p_ent->gid;
+  }
+  p_page->items.items_val = items;
+  p_page->items.items_len = last - first;
+  p_page->total = numb_matched;
+  p_page->cursor = last < numb_matched ? last : 0;
+
+  LOG(LOG_TYPE_DPAG, LOG_LEVEL_DEBUG, "listed %lu of %lu entries", last - first, numb_matched);
+  return 0;
+}
+
+/* Print the statistics. */
+void dir_page_print_stats(FILE *hfile)
+{
+  fprintf(hfile, "Directory pages: directories scanned: %lu, pages made of the kept entries: %lu\n",
+          numb_scans, numb_reuses);
+}
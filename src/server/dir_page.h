@@ -0,0 +1,44 @@
+#ifndef _DIR_PAGE_H_
+#define _DIR_PAGE_H_
+
+#include <stdio.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The paginated directory listing on the Server (list_dir).
+ *
+ * The directory entries are filtered by the glob pattern of their names and sorted
+ * on the Server, only the requested page is returned. If the page is near the beginning
+ * of a large listing, only the entries up to the page end are selected & sorted (top-K),
+ * instead of sorting the whole listing.
+ *
+ * The scanned, filtered & sorted entries are kept for the next pages of the same request
+ * (path, filter & sort), so the page at the cursor isn't made by scanning the directory
+ * again. The kept entries are dropped when the directory stamp changes: the modification
+ * time of the directory or of its data directories & the number of the packed files.
+ * The first page is always scanned; the listings of the backend mounts aren't kept.
+ */
+
+/* Make the page of the directory listing.
+ *
+ * The page (the directory path & entries) is kept in the static memory of this module,
+ * it remains valid until the next call.
+ *
+ * Parameters:
+ *  p_req     - the listing request: the directory path, cursor, limit, sort key & filter.
+ *  p_page    - a pointer to the page to be set.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int dir_page_make(const list_req *p_req, list_page *p_page, err_inf **pp_errinf);
+
+/* Print the statistics: the directories scanned & the pages made of the kept entries.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void dir_page_print_stats(FILE *hfile);
+
+#endif
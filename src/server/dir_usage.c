@@ -0,0 +1,661 @@
+/*
+ * dir_usage.c: the disk usage of the directory subtrees on the Server.
+ * Errors range: 86-89 (reserve 90)
+ */
+#define _GNU_SOURCE // for getdents64()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "dir_usage.h"
+#include "svc_loop.h"
+#include "../rpcgen/fltr.h"
+#include "../common/mem_opers.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Number of the threads walking the subtree, including the calling one
+enum { NUMB_DU_THREADS = 8 };
+
+// Size of the buffer for reading the directory entries, per thread
+enum { LEN_DU_DENTS_BUF = 65536 };
+
+// Number of buckets in the hash table of the cached directories, power of 2
+enum { NUMB_USAGE_BUCKETS = 65536 };
+
+// The directory to be scanned
+struct du_node {
+  struct du_node *parent;     // the parent directory, NULL for the passed one
+  int fd;                     // the opened directory, -1 till it's opened
+  int numb_unopened;          // number of the queued subdirectories not opened yet, +1 while scanning
+  char name[];                // the name in the parent directory, or the full path
+};
+
+// The directories queued by a thread, the thread takes the newest ones, the others steal the oldest
+struct du_deque {
+  pthread_mutex_t lock;
+  struct du_node **nodes;     // the ring buffer
+  size_t head, numb, numb_max;
+};
+
+// The walk of the subtree
+struct du_walk {
+  struct du_deque deques[NUMB_DU_THREADS];
+  long numb_pending;          // number of the directories queued or being scanned
+  int stopped;                // 1 if the time limit was reached
+  int err_root;               // errno of opening the passed directory
+  struct timespec tm_deadline;
+  uint64_t bytes, disk_bytes, numb_files, numb_dirs, numb_errors; // the usage
+};
+
+// The walking thread
+struct du_thread {
+  struct du_walk *p_walk;
+  int idx;                    // index of the thread & its deque
+  char *buf;                  // the buffer for reading the directory entries
+  char *subdirs;              // the names of the subdirectories of the scanned directory
+  size_t len_subdirs_max;
+};
+
+// The cached usage of the directory: its files & the names of its subdirectories
+struct usage_entry {
+  dev_t dev;
+  ino_t ino;
+  struct timespec mtime, ctime; // the directory times at the scan
+  time_t tm_cached;           // time of the scan
+  uint64_t bytes, disk_bytes, numb_files, numb_errors; // the usage of the files
+  size_t len_subdirs;         // length of the subdirectory names
+  size_t size;                // memory used by the entry
+  struct usage_entry *next;   // next entry in the bucket
+  char subdirs[];             // NUL-terminated names of the subdirectories
+};
+
+static struct usage_entry *buckets[NUMB_USAGE_BUCKETS];
+static pthread_mutex_t lock_cache = PTHREAD_MUTEX_INITIALIZER;
+static size_t budget = 0;     // max number of bytes used by the entries
+static size_t used = 0;       // number of bytes used by the entries
+static unsigned long numb_entries = 0; // number of the cached directories
+static time_t tm_swept = 0;   // time of the last sweep of the expired entries
+
+// The statistics
+static unsigned long numb_requests, numb_partial, numb_scanned, numb_hits;
+
+// The queued request of the usage, its reply is deferred
+struct du_job {
+  SVCXPRT *xprt;              // the transport of the deferred reply
+  char *dirname;              // the requested directory
+  char *path;                 // the copy of the resolved path in the reply
+  usage_err reply;            // the reply, its error info is freed after it's sent
+  struct du_job *next;
+};
+
+// The requests queued to the walking thread & the ones done, their replies are sent by the main thread
+static pthread_mutex_t lock_jobs = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_jobs = PTHREAD_COND_INITIALIZER;
+static struct du_job *queued = NULL, **queued_tail = &queued, *done = NULL;
+static int hevent = -1;       // the eventfd signalled by the thread when a request is done, -1 - no thread
+
+/* Get the hash of the directory by its device & inode */
+static unsigned hash_dir(dev_t dev, ino_t ino)
+{
+  uint64_t hash = ((uint64_t)ino ^ ((uint64_t)dev << 32)) * 0x9E3779B97F4A7C15ull;
+  return (unsigned)(hash >> 32) & (NUMB_USAGE_BUCKETS - 1);
+}
+
+/* Check if the cached entry is valid for the directory with the passed status */
+static int is_valid(const struct usage_entry *p_entry, const struct stat *p_st, time_t now)
+{
+  return p_entry->mtime.tv_sec == p_st->st_mtim.tv_sec &&
+         p_entry->mtime.tv_nsec == p_st->st_mtim.tv_nsec &&
+         p_entry->ctime.tv_sec == p_st->st_ctim.tv_sec &&
+         p_entry->ctime.tv_nsec == p_st->st_ctim.tv_nsec &&
+         now - p_entry->tm_cached < DU_CACHE_TTL;
+}
+
+/* Remove the entry following the passed link from the cache, the cache must be locked */
+static void remove_entry(struct usage_entry **pp_entry)
+{
+  struct usage_entry *p_entry = *pp_entry;
+  *pp_entry = p_entry->next;
+  used -= p_entry->size;
+  numb_entries--;
+  free(p_entry);
+}
+
+/* Remove the expired entries from the cache, the cache must be locked */
+static void sweep_expired(time_t now)
+{
+  struct usage_entry **pp_entry;
+  int i;
+
+  if (now == tm_swept)
+    return;
+  tm_swept = now;
+  for (i = 0; i < NUMB_USAGE_BUCKETS; ++i)
+    for (pp_entry = &buckets[i]; *pp_entry; )
+      if (now - (*pp_entry)->tm_cached >= DU_CACHE_TTL)
+        remove_entry(pp_entry);
+      else
+        pp_entry = &(*pp_entry)->next;
+}
+
+/* Get the cached usage of the directory, the subdirectory names are copied to the thread.
+ * Return 1 if the usage is cached, 0 otherwise. */
+static int cache_get(struct du_thread *p_thr, const struct stat *p_st, struct usage_entry *p_usage)
+{
+  struct usage_entry *p_entry;
+  char *subdirs;
+  int found = 0;
+
+  if (budget == 0)
+    return 0;
+  pthread_mutex_lock(&lock_cache);
+  for (p_entry = buckets[hash_dir(p_st->st_dev, p_st->st_ino)]; p_entry; p_entry = p_entry->next)
+    if (p_entry->dev == p_st->st_dev && p_entry->ino == p_st->st_ino)
+      break;
+  if (p_entry && is_valid(p_entry, p_st, time(NULL))) {
+    if (p_entry->len_subdirs > p_thr->len_subdirs_max) {
+      if ( (subdirs = realloc(p_thr->subdirs, p_entry->len_subdirs)) != NULL ) {
+        p_thr->subdirs = subdirs;
+        p_thr->len_subdirs_max = p_entry->len_subdirs;
+      }
+    }
+    if (p_entry->len_subdirs <= p_thr->len_subdirs_max) {
+      memcpy(p_thr->subdirs, p_entry->subdirs, p_entry->len_subdirs);
+      *p_usage = *p_entry;
+      found = 1;
+    }
+  }
+  pthread_mutex_unlock(&lock_cache);
+  return found;
+}
+
+/* Store the usage of the scanned directory */
+static void cache_put(const struct du_thread *p_thr, const struct stat *p_st,
+                      const struct usage_entry *p_usage)
+{
+  struct usage_entry *p_entry, **pp_entry;
+  size_t size = sizeof(struct usage_entry) + p_usage->len_subdirs;
+  time_t now = time(NULL);
+  unsigned hash = hash_dir(p_st->st_dev, p_st->st_ino);
+
+  if (budget == 0 || size > budget / 16)
+    return;
+  pthread_mutex_lock(&lock_cache);
+  for (pp_entry = &buckets[hash]; *pp_entry; pp_entry = &(*pp_entry)->next)
+    if ((*pp_entry)->dev == p_st->st_dev && (*pp_entry)->ino == p_st->st_ino) {
+      remove_entry(pp_entry);
+      break;
+    }
+  if (used + size > budget)
+    sweep_expired(now);
+  if (used + size <= budget && (p_entry = malloc(size)) != NULL) {
+    *p_entry = *p_usage;
+    p_entry->dev = p_st->st_dev;
+    p_entry->ino = p_st->st_ino;
+    p_entry->mtime = p_st->st_mtim;
+    p_entry->ctime = p_st->st_ctim;
+    p_entry->tm_cached = now;
+    p_entry->size = size;
+    memcpy(p_entry->subdirs, p_thr->subdirs, p_usage->len_subdirs);
+    p_entry->next = buckets[hash];
+    buckets[hash] = p_entry;
+    used += size;
+    numb_entries++;
+  }
+  pthread_mutex_unlock(&lock_cache);
+}
+
+/* Put the directory to the newest end of the deque. Return 0 on success, 1 on failure. */
+static int deque_push(struct du_deque *p_dq, struct du_node *p_node)
+{
+  struct du_node **nodes;
+  size_t numb_max, i;
+  int rc = 0;
+
+  pthread_mutex_lock(&p_dq->lock);
+  if (p_dq->numb == p_dq->numb_max) {
+    numb_max = p_dq->numb_max ? 2 * p_dq->numb_max : 256;
+    if ( (nodes = malloc(numb_max * sizeof(struct du_node *))) == NULL )
+      rc = 1;
+    else {
+      for (i = 0; i < p_dq->numb; ++i)
+        nodes[i] = p_dq->nodes[(p_dq->head + i) % p_dq->numb_max];
+      free(p_dq->nodes);
+      p_dq->nodes = nodes;
+      p_dq->numb_max = numb_max;
+      p_dq->head = 0;
+    }
+  }
+  if (rc == 0)
+    p_dq->nodes[(p_dq->head + p_dq->numb++) % p_dq->numb_max] = p_node;
+  pthread_mutex_unlock(&p_dq->lock);
+  return rc;
+}
+
+/* Take the directory from the newest end of the deque, or from the oldest one if it's stolen */
+static struct du_node *deque_take(struct du_deque *p_dq, int is_steal)
+{
+  struct du_node *p_node = NULL;
+
+  pthread_mutex_lock(&p_dq->lock);
+  if (p_dq->numb > 0) {
+    if (is_steal) {
+      p_node = p_dq->nodes[p_dq->head];
+      p_dq->head = (p_dq->head + 1) % p_dq->numb_max;
+    }
+    else
+      p_node = p_dq->nodes[(p_dq->head + p_dq->numb - 1) % p_dq->numb_max];
+    p_dq->numb--;
+  }
+  pthread_mutex_unlock(&p_dq->lock);
+  return p_node;
+}
+
+/* Release the directory by its opened subdirectory or at the end of its scan:
+ * it's closed & freed when all its subdirectories are opened */
+static void release_node(struct du_node *p_node)
+{
+  if (p_node && __atomic_sub_fetch(&p_node->numb_unopened, 1, __ATOMIC_ACQ_REL) == 0) {
+    close(p_node->fd);
+    free(p_node);
+  }
+}
+
+/* Read the entries of the opened directory: get the usage of its files and collect
+ * the names of its subdirectories */
+static void read_usage(struct du_thread *p_thr, int fd, struct usage_entry *p_usage)
+{
+  struct dirent64 *p_de;
+  struct stat statbuf;
+  ssize_t nrd, pos;
+  size_t len;
+  char *subdirs;
+  int is_dir;
+
+  memset(p_usage, 0, sizeof(struct usage_entry));
+  while ( (nrd = getdents64(fd, p_thr->buf, LEN_DU_DENTS_BUF)) > 0 ) {
+    for (pos = 0; pos < nrd; pos += p_de->d_reclen) {
+      p_de = (struct dirent64 *)(p_thr->buf + pos);
+      if (p_de->d_name[0] == '.' && (p_de->d_name[1] == '\0' ||
+                                    (p_de->d_name[1] == '.' && p_de->d_name[2] == '\0')))
+        continue;
+
+      is_dir = p_de->d_type == DT_DIR;
+      if (p_de->d_type != DT_DIR) {
+        // The file system doesn't provide the type, or it's a file: its status is needed
+        if (fstatat(fd, p_de->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == -1) {
+          p_usage->numb_errors++;
+          continue;
+        }
+        is_dir = S_ISDIR(statbuf.st_mode);
+      }
+      if (!is_dir) {
+        p_usage->numb_files++;
+        p_usage->bytes += statbuf.st_size;
+        p_usage->disk_bytes += (uint64_t)statbuf.st_blocks * 512;
+        continue;
+      }
+
+      len = strlen(p_de->d_name) + 1;
+      if (p_usage->len_subdirs + len > p_thr->len_subdirs_max) {
+        if ( (subdirs = realloc(p_thr->subdirs, 2 * (p_usage->len_subdirs + len))) == NULL ) {
+          p_usage->numb_errors++;
+          continue;
+        }
+        p_thr->subdirs = subdirs;
+        p_thr->len_subdirs_max = 2 * (p_usage->len_subdirs + len);
+      }
+      memcpy(p_thr->subdirs + p_usage->len_subdirs, p_de->d_name, len);
+      p_usage->len_subdirs += len;
+    }
+  }
+  if (nrd == -1)
+    p_usage->numb_errors++;
+}
+
+/* Scan the directory: add its usage & queue its subdirectories */
+static void scan_node(struct du_thread *p_thr, struct du_node *p_node)
+{
+  struct du_walk *p_walk = p_thr->p_walk;
+  struct du_node *p_sub;
+  struct usage_entry usage;
+  struct stat statbuf;
+  size_t pos, len;
+  int fd;
+
+  fd = p_node->parent ?
+       openat(p_node->parent->fd, p_node->name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC) :
+       open(p_node->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd == -1 && !p_node->parent)
+    p_walk->err_root = errno;
+  release_node(p_node->parent);
+  if (fd == -1 || fstat(fd, &statbuf) == -1) {
+    if (fd != -1)
+      close(fd);
+    __atomic_add_fetch(&p_walk->numb_errors, 1, __ATOMIC_RELAXED);
+    free(p_node);
+    return;
+  }
+  p_node->fd = fd;
+  p_node->numb_unopened = 1;
+
+  // The unchanged directory isn't read again
+  if (cache_get(p_thr, &statbuf, &usage))
+    __atomic_add_fetch(&numb_hits, 1, __ATOMIC_RELAXED);
+  else {
+    read_usage(p_thr, fd, &usage);
+    if (usage.numb_errors == 0)
+      cache_put(p_thr, &statbuf, &usage);
+    __atomic_add_fetch(&numb_scanned, 1, __ATOMIC_RELAXED);
+  }
+
+  __atomic_add_fetch(&p_walk->numb_dirs, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&p_walk->disk_bytes,
+                     usage.disk_bytes + (uint64_t)statbuf.st_blocks * 512, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&p_walk->bytes, usage.bytes, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&p_walk->numb_files, usage.numb_files, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&p_walk->numb_errors, usage.numb_errors, __ATOMIC_RELAXED);
+
+  // Queue the subdirectories, they're opened relative to this directory
+  for (pos = 0; pos < usage.len_subdirs; pos += len) {
+    len = strlen(p_thr->subdirs + pos) + 1;
+    if ( (p_sub = malloc(sizeof(struct du_node) + len)) == NULL ) {
+      __atomic_add_fetch(&p_walk->numb_errors, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+    p_sub->parent = p_node;
+    p_sub->fd = -1;
+    memcpy(p_sub->name, p_thr->subdirs + pos, len);
+    __atomic_add_fetch(&p_node->numb_unopened, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&p_walk->numb_pending, 1, __ATOMIC_RELAXED);
+    if (deque_push(&p_walk->deques[p_thr->idx], p_sub) != 0) {
+      __atomic_add_fetch(&p_walk->numb_errors, 1, __ATOMIC_RELAXED);
+      __atomic_sub_fetch(&p_walk->numb_pending, 1, __ATOMIC_RELAXED);
+      release_node(p_node);
+      free(p_sub);
+    }
+  }
+  release_node(p_node);
+}
+
+/* Check if the time limit of the walk is reached */
+static int is_late(const struct du_walk *p_walk)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec > p_walk->tm_deadline.tv_sec ||
+         (now.tv_sec == p_walk->tm_deadline.tv_sec && now.tv_nsec >= p_walk->tm_deadline.tv_nsec);
+}
+
+/* Walk the subtree: scan the directories of the own deque, steal the others' ones when it's
+ * empty, until all the directories are scanned. The directories are dropped after the time limit. */
+static void *walk_subtree(void *arg)
+{
+  struct du_thread *p_thr = arg;
+  struct du_walk *p_walk = p_thr->p_walk;
+  const struct timespec tm_idle = { 0, 50000 };
+  struct du_node *p_node;
+  int i;
+
+  while (1) {
+    p_node = deque_take(&p_walk->deques[p_thr->idx], 0);
+    for (i = 1; !p_node && i < NUMB_DU_THREADS; ++i)
+      p_node = deque_take(&p_walk->deques[(p_thr->idx + i) % NUMB_DU_THREADS], 1);
+    if (!p_node) {
+      if (__atomic_load_n(&p_walk->numb_pending, __ATOMIC_ACQUIRE) == 0)
+        break;
+      nanosleep(&tm_idle, NULL); // the other threads are scanning, their subdirectories will come
+      continue;
+    }
+
+    // The passed directory is scanned in any case, so each request makes progress
+    if (p_node->parent && !__atomic_load_n(&p_walk->stopped, __ATOMIC_RELAXED) && is_late(p_walk))
+      __atomic_store_n(&p_walk->stopped, 1, __ATOMIC_RELAXED);
+    if (p_node->parent && __atomic_load_n(&p_walk->stopped, __ATOMIC_RELAXED)) {
+      release_node(p_node->parent);
+      free(p_node);
+    }
+    else
+      scan_node(p_thr, p_node);
+    __atomic_sub_fetch(&p_walk->numb_pending, 1, __ATOMIC_ACQ_REL);
+  }
+  return NULL;
+}
+
+/* Make the usage of the queued requests one by one */
+static void *usage_loop(void *)
+{
+  struct du_job *p_job;
+  err_inf *p_errinf;
+  uint64_t one = 1;
+
+  while (1) {
+    pthread_mutex_lock(&lock_jobs);
+    while (queued == NULL)
+      pthread_cond_wait(&cond_jobs, &lock_jobs);
+    p_job = queued;
+    if ( (queued = p_job->next) == NULL )
+      queued_tail = &queued;
+    pthread_mutex_unlock(&lock_jobs);
+
+    // The path is kept by this module till the next request, it's copied for the reply
+    p_errinf = &p_job->reply.err;
+    (void)dir_usage_make(p_job->dirname, &p_job->reply.usage, &p_errinf);
+    if ( (p_job->path = strdup(p_job->reply.usage.path)) != NULL )
+      p_job->reply.usage.path = p_job->path;
+    else
+      p_job->reply.usage.path = "";
+
+    pthread_mutex_lock(&lock_jobs);
+    p_job->next = done;
+    done = p_job;
+    pthread_mutex_unlock(&lock_jobs);
+    if (write(hevent, &one, sizeof(one)) != sizeof(one))
+      LOG(LOG_TYPE_DUSG, LOG_LEVEL_ERROR, "the main thread can't be notified: %s", strerror(errno));
+  }
+  return NULL;
+}
+
+/* Send the deferred replies of the requests done, it's called by the event loop */
+static void on_done(void)
+{
+  struct du_job *list, *p_job;
+  uint64_t val;
+
+  if (read(hevent, &val, sizeof(val)) != sizeof(val))
+    return;
+  pthread_mutex_lock(&lock_jobs);
+  list = done;
+  done = NULL;
+  pthread_mutex_unlock(&lock_jobs);
+
+  while ( (p_job = list) != NULL ) {
+    list = p_job->next;
+    if (p_job->reply.err.num != 0)
+      fprintf(stderr, "Usage Failed - error %i\n%s\n", p_job->reply.err.num, p_job->reply.err.err_inf_u.msg);
+    if (!svc_sendreply(p_job->xprt, (xdrproc_t)xdr_usage_err, (char *)&p_job->reply))
+      svcerr_systemerr(p_job->xprt);
+    svc_loop_resume(p_job->xprt);
+    free_err_inf(&p_job->reply.err);
+    free(p_job->path);
+    free(p_job->dirname);
+    free(p_job);
+  }
+}
+
+/* Initialize the cache of the directory usage, start the walking thread. */
+int dir_usage_init(size_t budget_bytes)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+  int fd, rc;
+
+  budget = budget_bytes;
+  if ( (fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ) {
+    fprintf(stderr, "Error 89: Failed to create the eventfd of the directory usage\n%s\n", strerror(errno));
+    return 89;
+  }
+  if (svc_loop_add_notify(fd, on_done) != 0) {
+    close(fd);
+    return 89;
+  }
+  hevent = fd;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&tid, &attr, usage_loop, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    fprintf(stderr, "Error 89: Failed to start the thread of the directory usage\n%s\n", strerror(rc));
+    hevent = -1; // the descriptor stays in the event loop, it's never signalled
+    return 89;
+  }
+  return 0;
+}
+
+/* Queue the request of the usage of the directory subtree, the reply to it is deferred. */
+int dir_usage_queue(const char *dirname, struct svc_req *rqstp)
+{
+  struct du_job *p_job;
+
+  if (hevent == -1 || (p_job = calloc(1, sizeof(struct du_job))) == NULL)
+    return -1;
+  if ( (p_job->dirname = strdup(dirname)) == NULL || reset_err_inf(&p_job->reply.err) != 0 ||
+       svc_loop_defer() != 0 ) {
+    free_err_inf(&p_job->reply.err);
+    free(p_job->dirname);
+    free(p_job);
+    return -1;
+  }
+  p_job->xprt = rqstp->rq_xprt;
+
+  pthread_mutex_lock(&lock_jobs);
+  *queued_tail = p_job;
+  queued_tail = &p_job->next;
+  pthread_cond_signal(&cond_jobs);
+  pthread_mutex_unlock(&lock_jobs);
+  return 0;
+}
+
+/* Get the disk usage of the directory subtree. */
+int dir_usage_make(const char *dirname, usage_inf *p_usage, err_inf **pp_errinf)
+{
+  static char path[PATH_MAX]; // the full path of the directory
+  static struct du_walk walk;
+  struct du_thread threads[NUMB_DU_THREADS];
+  pthread_t tids[NUMB_DU_THREADS];
+  struct du_node *p_root;
+  int i, numb_started = 0, rc = 0;
+
+  LOG(LOG_TYPE_DUSG, LOG_LEVEL_DEBUG, "usage of %s", dirname);
+  memset(p_usage, 0, sizeof(usage_inf));
+  path[0] = '\0';
+  p_usage->path = path;
+  pthread_mutex_lock(&lock_cache);
+  numb_requests++;
+  pthread_mutex_unlock(&lock_cache);
+
+  errno = 0;
+  if (realpath(dirname, path) == NULL) {
+    path[0] = '\0';
+    (void)process_error(dirname, 86, "Failed to resolve the directory path", pp_errinf);
+    return 86;
+  }
+  if ( (p_root = malloc(sizeof(struct du_node) + strlen(path) + 1)) == NULL ) {
+    (void)process_error(path, 87, "Failed to allocate memory for the directory usage", pp_errinf);
+    return 87;
+  }
+  p_root->parent = NULL;
+  p_root->fd = -1;
+  strcpy(p_root->name, path);
+
+  memset(&walk, 0, sizeof(walk));
+  for (i = 0; i < NUMB_DU_THREADS; ++i)
+    pthread_mutex_init(&walk.deques[i].lock, NULL);
+  clock_gettime(CLOCK_MONOTONIC, &walk.tm_deadline);
+  walk.tm_deadline.tv_sec += DU_TIME_MAX;
+  walk.numb_pending = 1;
+  if (deque_push(&walk.deques[0], p_root) != 0) {
+    free(p_root);
+    errno = ENOMEM;
+    (void)process_error(path, 87, "Failed to allocate memory for the directory usage", pp_errinf);
+    rc = 87;
+  }
+
+  // The calling thread walks the subtree too, the others are optional
+  for (i = 0; rc == 0 && i < NUMB_DU_THREADS; ++i) {
+    threads[i].p_walk = &walk;
+    threads[i].idx = i;
+    threads[i].subdirs = NULL;
+    threads[i].len_subdirs_max = 0;
+    if ( (threads[i].buf = malloc(LEN_DU_DENTS_BUF)) == NULL && i == 0 ) {
+      free(deque_take(&walk.deques[0], 0));
+      (void)process_error(path, 87, "Failed to allocate memory for the directory usage", pp_errinf);
+      rc = 87;
+    }
+    else if (i > 0 && threads[i].buf &&
+             pthread_create(&tids[numb_started++], NULL, walk_subtree, &threads[i]) != 0) {
+      numb_started--;
+      free(threads[i].buf);
+      threads[i].buf = NULL;
+    }
+  }
+  if (rc == 0) {
+    walk_subtree(&threads[0]);
+    for (i = 0; i < numb_started; ++i)
+      pthread_join(tids[i], NULL);
+    for (i = 0; i < NUMB_DU_THREADS; ++i) {
+      free(threads[i].buf);
+      free(threads[i].subdirs);
+    }
+  }
+  for (i = 0; i < NUMB_DU_THREADS; ++i) {
+    free(walk.deques[i].nodes);
+    pthread_mutex_destroy(&walk.deques[i].lock);
+  }
+  if (rc != 0)
+    return rc;
+
+  if (walk.numb_dirs == 0) {
+    errno = walk.err_root;
+    (void)process_error(path, 88, "Failed to open the directory", pp_errinf);
+    return 88;
+  }
+  p_usage->bytes = walk.bytes;
+  p_usage->disk_bytes = walk.disk_bytes;
+  p_usage->numb_files = walk.numb_files;
+  p_usage->numb_dirs = walk.numb_dirs;
+  p_usage->numb_errors = walk.numb_errors;
+  p_usage->complete = walk.stopped ? FALSE : TRUE;
+  if (walk.stopped) {
+    pthread_mutex_lock(&lock_cache);
+    numb_partial++;
+    pthread_mutex_unlock(&lock_cache);
+  }
+  LOG(LOG_TYPE_DUSG, LOG_LEVEL_DEBUG, "%s: %llu bytes in %llu files & %llu dirs%s", path,
+      (unsigned long long)walk.bytes, (unsigned long long)walk.numb_files,
+      (unsigned long long)walk.numb_dirs, walk.stopped ? ", partial" : "");
+  return 0;
+}
+
+/* Print the statistics. */
+void dir_usage_print_stats(FILE *hfile)
+{
+  pthread_mutex_lock(&lock_cache);
+  fprintf(hfile, "Directory usage (cache budget: %lu bytes): requests: %lu, partial: %lu, "
+          "directories scanned: %lu, cached: %lu; used: %lu bytes in %lu directories\n",
+          budget, numb_requests, numb_partial, numb_scanned, numb_hits, used, numb_entries);
+  pthread_mutex_unlock(&lock_cache);
+}
@@ -0,0 +1,82 @@
+#ifndef _DIR_USAGE_H_
+#define _DIR_USAGE_H_
+
+#include <stdio.h>
+#include <rpc/rpc.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The disk usage of the directory subtrees on the Server (dir_usage).
+ *
+ * The subtree is walked by a pool of threads: each thread takes the directories from its own
+ * deque and steals the oldest ones (the largest subtrees, as a rule) from the other threads
+ * when its deque is empty. The directories are opened relative to their parent directory
+ * and the entries are stat'ed relative to the opened directory, so no full path is built.
+ * The symbolic links are not followed.
+ *
+ * The usage of each scanned directory (its files & the names of its subdirectories) is cached
+ * by its device & inode, and is valid while the modification & change time of the directory
+ * are the same, but not longer than DU_CACHE_TTL seconds, as the size of the files can be
+ * changed without changing the directory. So a repeated request reads only the subdirectories
+ * of the unchanged directories.
+ *
+ * The walk is stopped after DU_TIME_MAX seconds; the partial usage is returned then, and
+ * the repeated request continues faster using the cached directories.
+ *
+ * The requests are queued to a background thread making their walks one by one, so the event
+ * loop isn't blocked by them: the reply is deferred (see svc_loop_defer()) and sent by the main
+ * thread when the walk is done.
+ */
+
+// Max time of one request in seconds
+enum { DU_TIME_MAX = 5 };
+
+// Max time of keeping the usage of the unchanged directory in seconds
+enum { DU_CACHE_TTL = 300 };
+
+/* Initialize the cache of the directory usage, start the thread making the queued requests.
+ *
+ * Parameters:
+ *  budget - the max number of bytes used by the cached usage of the directories,
+ *           0 disables the cache.
+ *
+ * Return value:
+ *  0 on success, >0 if the thread isn't started (the usage is made by the main thread then).
+ */
+int dir_usage_init(size_t budget);
+
+/* Queue the request of the usage of the directory subtree, the reply to it is deferred.
+ *
+ * The reply is the usage as of dir_usage_make(), it's sent when the walk is done.
+ *
+ * Parameters:
+ *  dirname - the directory path.
+ *  rqstp   - the request of the usage.
+ *
+ * Return value:
+ *  0 if the request is queued (the RPC function returns NULL), -1 if the usage must be made
+ *  at once (e.g. the reply to a datagram can't be deferred).
+ */
+int dir_usage_queue(const char *dirname, struct svc_req *rqstp);
+
+/* Get the disk usage of the directory subtree.
+ *
+ * Parameters:
+ *  dirname   - the directory path.
+ *  p_usage   - a pointer to the usage info to be set, its path is kept in the static memory
+ *              of this module till the next call.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int dir_usage_make(const char *dirname, usage_inf *p_usage, err_inf **pp_errinf);
+
+/* Print the statistics: the scanned & cached directories and the memory used by the cache.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void dir_usage_print_stats(FILE *hfile);
+
+#endif
@@ -0,0 +1,293 @@
+/*
+ * direct_io.c: the transfers of the large files bypassing the page cache on the Server.
+ * Errors range: none (the errors are reported as by pread_file_chunk())
+ */
+#define _GNU_SOURCE // for O_DIRECT & sync_file_range()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "direct_io.h"
+#include "../common/file_opers.h"
+#include "../common/mem_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Size of the bounce buffer: the max chunk & its unaligned head and tail
+#define DIO_BUF_SIZE (LEN_CHUNK_MAX + 2 * DIO_ALIGN)
+
+static uint64_t threshold = 0; // the min size of the file transferred bypassing the page cache
+
+// The pool of the bounce buffers, they're allocated on the first use
+static pthread_mutex_t lock_pool = PTHREAD_MUTEX_INITIALIZER;
+static char *pool[DIO_POOL_BUFS];
+static int pool_busy[DIO_POOL_BUFS];
+
+// The statistics, they're updated atomically
+static unsigned long numb_reads, numb_writes, numb_bounced, numb_dropped;
+
+/* Count the event */
+static void count(unsigned long *p_numb)
+{
+  __atomic_add_fetch(p_numb, 1, __ATOMIC_RELAXED);
+}
+
+/* Get the bounce buffer from the pool, return NULL if all of them are busy */
+static char *pool_get(void)
+{
+  char *buf = NULL;
+  int i;
+
+  pthread_mutex_lock(&lock_pool);
+  for (i = 0; i < DIO_POOL_BUFS && pool_busy[i]; ++i)
+    ;
+  if (i < DIO_POOL_BUFS &&
+      (pool[i] || posix_memalign((void **)&pool[i], DIO_ALIGN, DIO_BUF_SIZE) == 0)) {
+    pool_busy[i] = 1;
+    buf = pool[i];
+  }
+  pthread_mutex_unlock(&lock_pool);
+  return buf;
+}
+
+/* Put the bounce buffer back to the pool */
+static void pool_put(char *buf)
+{
+  int i;
+  pthread_mutex_lock(&lock_pool);
+  for (i = 0; i < DIO_POOL_BUFS; ++i)
+    if (pool[i] == buf)
+      pool_busy[i] = 0;
+  pthread_mutex_unlock(&lock_pool);
+}
+
+/* Write the whole buffer at the offset of the file */
+static int write_all(int fd, const char *buf, size_t size, uint64_t offs)
+{
+  ssize_t nwrt;
+  while (size) {
+    if ( (nwrt = pwrite(fd, buf, size, (off_t)offs)) == -1 ) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    buf += nwrt;
+    size -= nwrt;
+    offs += nwrt;
+  }
+  return 0;
+}
+
+/* Write the whole buffer at the offset of the file through the ring, or by the system calls
+ * if there's no ring or it fails (the failed I/O fails again then) */
+static int write_ring(io_wring wring, int fd, const char *buf, size_t size, uint64_t offs)
+{
+  if (wring && io_ring_write(wring, fd, buf, size, offs) == 0)
+    return 0;
+  return write_all(fd, buf, size, offs);
+}
+
+/* Set the threshold of the file size to transfer the file bypassing the page cache. */
+void direct_io_init(uint64_t thresh)
+{
+  threshold = thresh;
+}
+
+/* Check whether the file of the size is transferred bypassing the page cache. */
+int direct_io_wanted(uint64_t size_file)
+{
+  return threshold && size_file >= threshold;
+}
+
+/* Open the second descriptor of the file with O_DIRECT. */
+int direct_io_open(int fd, int flags)
+{
+  char path[32];
+  int fd_direct;
+
+  if (!threshold)
+    return -1;
+  // The descriptor is reopened through procfs, so it's the same file even if its path is replaced
+  snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+  if ( (fd_direct = open(path, flags | O_DIRECT | O_CLOEXEC)) == -1 )
+    LOG(LOG_TYPE_DRIO, LOG_LEVEL_DEBUG, "O_DIRECT isn't supported: %s", strerror(errno));
+  return fd_direct;
+}
+
+/* Allocate the content aligned for O_DIRECT. */
+int direct_io_alloc(t_flcont *p_flcont, size_t size)
+{
+  void *buf;
+  if (posix_memalign(&buf, DIO_ALIGN, (size + DIO_ALIGN - 1) & ~(size_t)(DIO_ALIGN - 1)) != 0)
+    return -1;
+  p_flcont->t_flcont_val = buf;
+  p_flcont->t_flcont_len = size;
+  return 0;
+}
+
+/* Drop the clean pages of the range of the file from the page cache. */
+void direct_io_drop(int fd, uint64_t offs, size_t size)
+{
+  if (posix_fadvise(fd, (off_t)offs, (off_t)size, POSIX_FADV_DONTNEED) == 0)
+    count(&numb_dropped);
+}
+
+/* Read the chunk through the page cache and drop it from there */
+static int read_dropped(const char *flname, int fd, uint64_t offs, size_t size,
+                        t_flcont *p_flcont, int *p_last, err_inf **pp_errinf)
+{
+  int rc = pread_file_chunk(flname, fd, offs, size, p_flcont, p_last, pp_errinf);
+  if (rc == 0)
+    direct_io_drop(fd, offs, p_flcont->t_flcont_len);
+  return rc;
+}
+
+/* Read the file chunk as pread_file_chunk(), bypassing the page cache if the file is large. */
+int direct_io_read_chunk(const char *flname, int fd, int fd_direct, uint64_t offs, size_t size,
+                         t_flcont *p_flcont, int *p_last, err_inf **pp_errinf)
+{
+  struct stat statbuf;
+  uint64_t start;
+  size_t len, need, nch = 0;
+  ssize_t nrd;
+  char *buf, *bounce = NULL;
+
+  if (!threshold)
+    return pread_file_chunk(flname, fd, offs, size, p_flcont, p_last, pp_errinf);
+  if (fstat(fd, &statbuf) == -1) {
+    (void)process_error(flname, 14, "Failed to read from the file", pp_errinf);
+    return 14;
+  }
+  if (!direct_io_wanted((uint64_t)statbuf.st_size) || offs >= (uint64_t)statbuf.st_size)
+    return pread_file_chunk(flname, fd, offs, size, p_flcont, p_last, pp_errinf);
+  if (fd_direct == -1)
+    return read_dropped(flname, fd, offs, size, p_flcont, p_last, pp_errinf);
+
+  if ((uint64_t)statbuf.st_size - offs < size)
+    size = (size_t)((uint64_t)statbuf.st_size - offs);
+  *p_last = (offs + size >= (uint64_t)statbuf.st_size);
+
+  // The aligned range covering the chunk is read, the unaligned chunk is cut from the bounce buffer
+  start = offs & ~(uint64_t)(DIO_ALIGN - 1);
+  need = (size_t)(offs - start) + size;
+  len = (need + DIO_ALIGN - 1) & ~(size_t)(DIO_ALIGN - 1);
+  if (start == offs) {
+    if (direct_io_alloc(p_flcont, size) != 0) {
+      errno = 0;
+      (void)process_error(flname, 13, "Failed to allocate memory for the content of file", pp_errinf);
+      return 13;
+    }
+    buf = p_flcont->t_flcont_val;
+  }
+  else if (len > DIO_BUF_SIZE || (bounce = pool_get()) == NULL)
+    return read_dropped(flname, fd, offs, size, p_flcont, p_last, pp_errinf);
+  else
+    buf = bounce;
+
+  while (nch < need) {
+    if ( (nrd = pread(fd_direct, buf + nch, len - nch, (off_t)(start + nch))) == -1 ) {
+      if (errno == EINTR)
+        continue;
+      if (bounce)
+        pool_put(bounce);
+      else
+        free_file_cont(p_flcont);
+      // The file system may refuse O_DIRECT for the file, it's read through the page cache then
+      if (errno == EINVAL && nch == 0)
+        return read_dropped(flname, fd, offs, size, p_flcont, p_last, pp_errinf);
+      (void)process_error(flname, 14, "Failed to read from the file", pp_errinf);
+      return 14;
+    }
+    if (nrd == 0) {
+      if (bounce)
+        pool_put(bounce);
+      errno = 0;
+      (void)process_error(flname, 15, "Partial reading of the file", pp_errinf);
+      return 15;
+    }
+    nch += (size_t)nrd;
+  }
+  count(&numb_reads);
+
+  if (bounce) {
+    count(&numb_bounced);
+    if (alloc_file_cont(p_flcont, size) != NULL)
+      memcpy(p_flcont->t_flcont_val, bounce + (offs - start), size);
+    pool_put(bounce);
+    if (p_flcont->t_flcont_val == NULL) {
+      errno = 0;
+      (void)process_error(flname, 13, "Failed to allocate memory for the content of file", pp_errinf);
+      return 13;
+    }
+  }
+  return 0;
+}
+
+/* Set up the io_uring ring of the writes of the calling thread. */
+io_wring direct_io_wring(void)
+{
+  int i, numb = 0;
+
+  // The buffers are allocated at once to be registered, they're registered only all together
+  pthread_mutex_lock(&lock_pool);
+  for (i = 0; i < DIO_POOL_BUFS; ++i)
+    if (pool[i] || posix_memalign((void **)&pool[i], DIO_ALIGN, DIO_BUF_SIZE) == 0)
+      numb++;
+  pthread_mutex_unlock(&lock_pool);
+  return io_ring_wring_open(pool, numb == DIO_POOL_BUFS ? numb : 0, DIO_BUF_SIZE);
+}
+
+/* Write the whole buffer at the offset of the file, bypassing the page cache if `fd_direct` is passed. */
+int direct_io_write(io_wring wring, int fd, int fd_direct, const char *buf, size_t size, uint64_t offs,
+                    int large)
+{
+  size_t len = size & ~(size_t)(DIO_ALIGN - 1); // the aligned head of the chunk
+  char *bounce;
+  int rc;
+
+  // The unaligned chunk & the unaligned tail of the chunk are written through the page cache
+  if (fd_direct != -1 && len && offs % DIO_ALIGN == 0 && len <= DIO_BUF_SIZE &&
+      (bounce = pool_get()) != NULL) {
+    memcpy(bounce, buf, len);
+    rc = write_ring(wring, fd_direct, bounce, len, offs);
+    pool_put(bounce);
+    if (rc == 0) {
+      count(&numb_writes);
+      count(&numb_bounced);
+      buf += len;
+      size -= len;
+      offs += len;
+    }
+    else if (errno != EINVAL)
+      return -1;
+  }
+  if (size == 0)
+    return 0;
+  if (write_ring(wring, fd, buf, size, offs) != 0)
+    return -1;
+
+  // The dirty pages aren't dropped: the writeback of the chunk is started, the previous chunk
+  // is written back by the next chunk usually
+  if (large && fd_direct == -1) {
+    (void)sync_file_range(fd, (off_t)offs, (off_t)size, SYNC_FILE_RANGE_WRITE);
+    direct_io_drop(fd, offs >= size ? offs - size : 0, offs >= size ? size : (size_t)offs);
+  }
+  return 0;
+}
+
+/* Print the statistics. */
+void direct_io_print_stats(FILE *hfile)
+{
+  if (!threshold)
+    return;
+  fprintf(hfile, "Direct I/O (files from %lu bytes): chunks read: %lu, written: %lu, bounced: %lu, "
+          "dropped from the page cache: %lu\n", (unsigned long)threshold,
+          __atomic_load_n(&numb_reads, __ATOMIC_RELAXED), __atomic_load_n(&numb_writes, __ATOMIC_RELAXED),
+          __atomic_load_n(&numb_bounced, __ATOMIC_RELAXED), __atomic_load_n(&numb_dropped, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,134 @@
+#ifndef _DIRECT_IO_H_
+#define _DIRECT_IO_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../rpcgen/fltr.h"
+#include "io_ring.h"
+
+/*
+ * The transfers of the large files bypassing the page cache on the Server.
+ *
+ * The chunks of the files of at least the threshold size are read and written through
+ * a second descriptor of the file opened with O_DIRECT, so a large cold transfer doesn't
+ * evict the hot files from the page cache. O_DIRECT requires the offset, the size & the buffer
+ * aligned to DIO_ALIGN: the aligned chunk is read into the aligned content directly,
+ * the unaligned one is read & written through an aligned bounce buffer of the pool, the unaligned
+ * tail of an upload is written through the usual descriptor. Where O_DIRECT isn't supported
+ * (e.g. tmpfs), the chunks are transferred through the page cache and dropped from it
+ * by posix_fadvise(POSIX_FADV_DONTNEED). The functions are thread-safe.
+ * The uploaded chunks may be written through the io_uring ring of the writing thread
+ * (see direct_io_wring()), the bounce buffers are registered in the ring then.
+ */
+
+// Alignment of the offsets, sizes & buffers of O_DIRECT
+enum { DIO_ALIGN = 4096 };
+
+// Number of the bounce buffers of LEN_CHUNK_MAX bytes (plus the alignment)
+enum { DIO_POOL_BUFS = 8 };
+
+/* Set the threshold of the file size to transfer the file bypassing the page cache.
+ *
+ * Parameters:
+ *  threshold - the min file size, 0 - the files are always transferred through the page cache.
+ */
+void direct_io_init(uint64_t threshold);
+
+/* Check whether the file of the size is transferred bypassing the page cache.
+ *
+ * Parameters:
+ *  size_file - the file size.
+ *
+ * Return value:
+ *  1 if it's transferred bypassing the page cache, 0 otherwise.
+ */
+int direct_io_wanted(uint64_t size_file);
+
+/* Open the second descriptor of the file with O_DIRECT.
+ *
+ * Parameters:
+ *  fd    - the descriptor of the file.
+ *  flags - the access mode: O_RDONLY or O_WRONLY.
+ *
+ * Return value:
+ *  The new descriptor, or -1 if the transfers bypassing the page cache are off or O_DIRECT
+ *  isn't supported by the file system.
+ */
+int direct_io_open(int fd, int flags);
+
+/* Allocate the content aligned for O_DIRECT, its buffer is rounded up to DIO_ALIGN.
+ *
+ * Parameters:
+ *  p_flcont - a pointer to the content, it must be empty.
+ *  size     - the size of the content.
+ *
+ * Return value:
+ *  0 on success, -1 on failure of the allocation.
+ */
+int direct_io_alloc(t_flcont *p_flcont, size_t size);
+
+/* Drop the clean pages of the range of the file from the page cache.
+ *
+ * Parameters:
+ *  fd   - the descriptor of the file.
+ *  offs - the offset of the range.
+ *  size - the size of the range.
+ */
+void direct_io_drop(int fd, uint64_t offs, size_t size);
+
+/* Read the file chunk as pread_file_chunk(), bypassing the page cache if the file is large.
+ *
+ * Parameters:
+ *  flname    - the name of the file.
+ *  fd        - the descriptor of the file.
+ *  fd_direct - the descriptor of the file opened with O_DIRECT, or -1.
+ *  offs      - the offset of the chunk.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to the content to be set, it must be empty.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int direct_io_read_chunk(const char *flname, int fd, int fd_direct, uint64_t offs, size_t size,
+                         t_flcont *p_flcont, int *p_last, err_inf **pp_errinf);
+
+/* Set up the io_uring ring of the writes of the calling thread, the bounce buffers of the pool
+ * are allocated & registered in it.
+ *
+ * Return value:
+ *  The ring, or NULL if io_uring isn't available.
+ */
+io_wring direct_io_wring(void);
+
+/* Write the whole buffer at the offset of the file, bypassing the page cache if `fd_direct`
+ * is passed.
+ *
+ * Parameters:
+ *  wring     - the ring of the writes of the calling thread (see direct_io_wring()), or NULL;
+ *              the file is written by the system calls if the ring fails.
+ *  fd        - the descriptor of the file.
+ *  fd_direct - the descriptor of the file opened with O_DIRECT, or -1.
+ *  buf       - the buffer to write.
+ *  size      - the size of the buffer.
+ *  offs      - the offset in the file.
+ *  large     - 1 if the file is large: if `fd_direct` isn't passed, the writeback of the chunk
+ *              is started and the previous chunk is dropped from the page cache.
+ *
+ * Return value:
+ *  0 on success, -1 on failure (errno is set).
+ */
+int direct_io_write(io_wring wring, int fd, int fd_direct, const char *buf, size_t size, uint64_t offs,
+                    int large);
+
+/* Print the statistics: the threshold, the chunks read & written with O_DIRECT, through
+ * the bounce buffers & dropped from the page cache.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void direct_io_print_stats(FILE *hfile);
+
+#endif
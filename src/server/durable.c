@@ -0,0 +1,292 @@
+/*
+ * durable.c: the durability of the uploaded files on the Server.
+ * Errors range: 96-97 (reserve 98)
+ */
+#define _GNU_SOURCE // for syncfs()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+
+#include "durable.h"
+#include "svc_loop.h"
+#include "../common/file_opers.h"
+#include "../common/fs_opers.h"
+#include "../common/mem_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Max number of the file systems flushed by one batch, the files of other ones are flushed each
+enum { DUR_DEVS_MAX = 16 };
+
+// The upload waiting for the group commit
+struct dur_entry {
+  char *name;               // the uploaded file
+  SVCXPRT *xprt;            // the transport of the deferred reply
+  int err;                  // the errno of the flush, 0 on success
+  struct dur_entry *next;
+};
+
+static enum dur_mode mode = dur_none;
+static int window_ms = DUR_WINDOW_DEF;
+static int hevent = -1;     // the eventfd signalled by the thread when a batch is flushed
+
+// The waiting & flushed uploads shared with the thread of the group commit
+static pthread_mutex_t lock_dur = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_waiting = PTHREAD_COND_INITIALIZER;
+static struct dur_entry *waiting = NULL, **waiting_tail = &waiting;
+static struct dur_entry *flushed = NULL;
+
+// The statistics, the flushed files & the flushes are counted atomically
+static unsigned long numb_files, numb_flushes, numb_batches, max_batch;
+
+/* Flush the file data & its directory entry, return 0 or errno */
+static int flush_file(const char *flname)
+{
+  char dir[LEN_PATH_MAX + 1];
+  const char *p_slash = strrchr(flname, '/');
+  size_t len_dir;
+  int fd, err = 0;
+
+  if ( (fd = open(flname, O_RDONLY | O_CLOEXEC)) == -1 )
+    return errno;
+  if (fdatasync(fd) != 0)
+    err = errno;
+  close(fd);
+
+  // The directory entry of the new file is flushed by the directory
+  if (p_slash == NULL)
+    strcpy(dir, ".");
+  else {
+    len_dir = p_slash == flname ? 1 : (size_t)(p_slash - flname);
+    if (len_dir > LEN_PATH_MAX)
+      len_dir = LEN_PATH_MAX;
+    memcpy(dir, flname, len_dir);
+    dir[len_dir] = '\0';
+  }
+  if (err == 0 && (fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) != -1) {
+    if (fsync(fd) != 0)
+      err = errno;
+    close(fd);
+  }
+  __atomic_add_fetch(&numb_flushes, 1, __ATOMIC_RELAXED);
+  return err;
+}
+
+/* Flush the batch: each file system once, the entries get the results */
+static void flush_batch(struct dur_entry *batch)
+{
+  struct {
+    dev_t dev;
+    int fd;
+    int err;
+  } devs[DUR_DEVS_MAX];
+  struct dur_entry *p_entry;
+  struct stat statbuf;
+  int numb_devs = 0, i, fd;
+
+  // A descriptor of each file system is kept, the file systems are flushed after that
+  for (p_entry = batch; p_entry; p_entry = p_entry->next) {
+    if ( (fd = open(p_entry->name, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &statbuf) != 0 ) {
+      p_entry->err = errno;
+      if (fd != -1)
+        close(fd);
+      continue;
+    }
+    for (i = 0; i < numb_devs && devs[i].dev != statbuf.st_dev; ++i)
+      ;
+    if (i < numb_devs)
+      close(fd);
+    else if (numb_devs < DUR_DEVS_MAX) {
+      devs[numb_devs].dev = statbuf.st_dev;
+      devs[numb_devs++].fd = fd;
+    }
+    else {
+      close(fd);
+      // -1 marks the file flushed already
+      p_entry->err = flush_file(p_entry->name);
+      p_entry->err = p_entry->err ? p_entry->err : -1;
+    }
+  }
+  for (i = 0; i < numb_devs; ++i) {
+    devs[i].err = syncfs(devs[i].fd) == 0 ? 0 : errno;
+    close(devs[i].fd);
+    __atomic_add_fetch(&numb_flushes, 1, __ATOMIC_RELAXED);
+  }
+
+  // The results of the file systems are passed to their files
+  for (p_entry = batch; p_entry; p_entry = p_entry->next) {
+    if (p_entry->err == -1)
+      p_entry->err = 0;
+    else if (p_entry->err == 0 && stat(p_entry->name, &statbuf) == 0) {
+      for (i = 0; i < numb_devs && devs[i].dev != statbuf.st_dev; ++i)
+        ;
+      p_entry->err = i < numb_devs ? devs[i].err : 0;
+    }
+  }
+}
+
+/* Flush the waiting uploads by batches */
+static void *commit_loop(void *arg)
+{
+  struct timespec window = { window_ms / 1000, (window_ms % 1000) * 1000000L };
+  struct dur_entry *batch, *p_entry;
+  unsigned long size_batch;
+  uint64_t one = 1;
+
+  (void)arg;
+  while (1) {
+    pthread_mutex_lock(&lock_dur);
+    while (waiting == NULL)
+      pthread_cond_wait(&cond_waiting, &lock_dur);
+    pthread_mutex_unlock(&lock_dur);
+
+    // The uploads completed within the window join the batch
+    nanosleep(&window, NULL);
+    pthread_mutex_lock(&lock_dur);
+    batch = waiting;
+    waiting = NULL;
+    waiting_tail = &waiting;
+    pthread_mutex_unlock(&lock_dur);
+
+    flush_batch(batch);
+
+    pthread_mutex_lock(&lock_dur);
+    for (size_batch = 1, p_entry = batch; p_entry->next; p_entry = p_entry->next)
+      size_batch++;
+    p_entry->next = flushed;
+    flushed = batch;
+    __atomic_add_fetch(&numb_files, size_batch, __ATOMIC_RELAXED);
+    numb_batches++;
+    if (size_batch > max_batch)
+      max_batch = size_batch;
+    pthread_mutex_unlock(&lock_dur);
+    if (write(hevent, &one, sizeof(one)) != sizeof(one))
+      LOG(LOG_TYPE_DURB, LOG_LEVEL_ERROR, "the main thread can't be notified: %s", strerror(errno));
+  }
+  return NULL;
+}
+
+/* Send the deferred replies to the flushed uploads, it's called by the event loop */
+static void on_flushed(void)
+{
+  static err_inf ret_err; // the reply, as the returned variables of the RPC functions
+  static err_inf *p_ret_err = &ret_err;
+  struct dur_entry *list, *p_entry;
+  uint64_t val;
+
+  if (read(hevent, &val, sizeof(val)) != sizeof(val))
+    return;
+  pthread_mutex_lock(&lock_dur);
+  list = flushed;
+  flushed = NULL;
+  pthread_mutex_unlock(&lock_dur);
+
+  while ( (p_entry = list) != NULL ) {
+    list = p_entry->next;
+    if (reset_err_inf(p_ret_err) != 0) {
+      ret_err.num = ERRNUM_ERRINF_ERR;
+      ret_err.err_inf_u.msg = "Failed to init the error info\n";
+    }
+    else if (p_entry->err) {
+      errno = p_entry->err;
+      (void)process_error(p_entry->name, 96, "Failed to flush the file to the disk", &p_ret_err);
+      LOG(LOG_TYPE_DURB, LOG_LEVEL_ERROR, "%s", ret_err.err_inf_u.msg);
+    }
+    if (!svc_sendreply(p_entry->xprt, (xdrproc_t)xdr_err_inf, (char *)p_ret_err))
+      svcerr_systemerr(p_entry->xprt);
+    svc_loop_resume(p_entry->xprt);
+    free(p_entry->name);
+    free(p_entry);
+  }
+}
+
+/* Set the durability mode, start the thread of the group commit. */
+int durable_init(enum dur_mode mode_set, int window)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+  int rc;
+
+  mode = mode_set;
+  window_ms = window;
+  if (mode != dur_group)
+    return 0;
+
+  if ( (hevent = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1 ) {
+    fprintf(stderr, "Error 97: Failed to create the eventfd of the group commit\n%s\n", strerror(errno));
+    mode = dur_file;
+    return 97;
+  }
+  if (svc_loop_add_notify(hevent, on_flushed) != 0) {
+    close(hevent);
+    mode = dur_file;
+    return 97;
+  }
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&tid, &attr, commit_loop, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    fprintf(stderr, "Error 97: Failed to start the thread of the group commit\n%s\n", strerror(rc));
+    mode = dur_file;
+    return 97;
+  }
+  return 0;
+}
+
+/* Make the completed upload durable before it's acknowledged. */
+int durable_commit(const char *flname, struct svc_req *rqstp, err_inf **pp_errinf)
+{
+  struct dur_entry *p_entry;
+  int err;
+
+  if (mode == dur_none)
+    return 0;
+
+  // The reply is deferred till the group commit, the datagram one can't be deferred
+  if (mode == dur_group && (p_entry = calloc(1, sizeof(struct dur_entry))) != NULL) {
+    if ( (p_entry->name = strdup(flname)) != NULL && svc_loop_defer() == 0 ) {
+      p_entry->xprt = rqstp->rq_xprt;
+      pthread_mutex_lock(&lock_dur);
+      *waiting_tail = p_entry;
+      waiting_tail = &p_entry->next;
+      pthread_cond_signal(&cond_waiting);
+      pthread_mutex_unlock(&lock_dur);
+      return -1;
+    }
+    free(p_entry->name);
+    free(p_entry);
+  }
+
+  if ( (err = flush_file(flname)) != 0 ) {
+    errno = err;
+    (void)process_error(flname, 96, "Failed to flush the file to the disk", pp_errinf);
+    return 96;
+  }
+  __atomic_add_fetch(&numb_files, 1, __ATOMIC_RELAXED);
+  return 0;
+}
+
+/* Print the statistics. */
+void durable_print_stats(FILE *hfile)
+{
+  static const char *mode_names[] = { "none", "file", "group" };
+  pthread_mutex_lock(&lock_dur);
+  fprintf(hfile, "Durability (%s", mode_names[mode]);
+  if (mode == dur_group)
+    fprintf(hfile, ", window: %d ms", window_ms);
+  fprintf(hfile, "): files flushed: %lu, disk flushes: %lu", numb_files, numb_flushes);
+  if (mode == dur_group)
+    fprintf(hfile, ", batches: %lu, max batch: %lu", numb_batches, max_batch);
+  fprintf(hfile, "\n");
+  pthread_mutex_unlock(&lock_dur);
+}
@@ -0,0 +1,65 @@
+#ifndef _DURABLE_H_
+#define _DURABLE_H_
+
+#include <stdio.h>
+#include <rpc/rpc.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The durability of the uploaded files on the Server.
+ *
+ * The completed Upload is acknowledged according to the durability mode:
+ *  dur_none  - at once, the file may be lost on a power failure;
+ *  dur_file  - after the file data & its directory entry are flushed to the disk
+ *              (fdatasync() of the file & fsync() of the directory), one flush per file;
+ *  dur_group - the group commit: the completed uploads wait for the batch window,
+ *              then a background thread flushes each file system of the batch once by
+ *              syncfs() and all the waiting uploads are acknowledged together,
+ *              so the small files don't pay a disk flush each.
+ * The waiting upload doesn't block the Server: its reply is deferred (see svc_loop_defer()).
+ * The uploads over UDP can't be deferred, they're flushed as in dur_file mode.
+ */
+
+// The durability modes
+enum dur_mode {
+  dur_none,
+  dur_file,
+  dur_group
+};
+
+// Default batch window of the group commit, milliseconds
+enum { DUR_WINDOW_DEF = 5 };
+
+/* Set the durability mode, start the thread of the group commit.
+ *
+ * Parameters:
+ *  mode      - the durability mode.
+ *  window_ms - the batch window of the group commit, milliseconds.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (the uploads are flushed one by one then).
+ */
+int durable_init(enum dur_mode mode, int window_ms);
+
+/* Make the completed upload durable before it's acknowledged.
+ *
+ * Parameters:
+ *  flname    - the name of the uploaded file, it's published already.
+ *  rqstp     - the request of the upload.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 if the upload is acknowledged at once, -1 if the reply is deferred (the RPC function
+ *  returns NULL, the reply is sent after the group commit),
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int durable_commit(const char *flname, struct svc_req *rqstp, err_inf **pp_errinf);
+
+/* Print the statistics: the mode, the flushed files, the flushes & batches of the group commit.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void durable_print_stats(FILE *hfile);
+
+#endif
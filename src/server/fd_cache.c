@@ -0,0 +1,226 @@
+/*
+ * fd_cache.c: the cache of the open file descriptors of the downloaded files on the Server.
+ * Errors range: none (the errors are reported as by open_file())
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "fd_cache.h"
+#include "direct_io.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Number of buckets in the hash table of the cached descriptors, power of 2
+enum { NUMB_FD_BUCKETS = 1024 };
+
+// The cached descriptor
+struct fd_entry {
+  char *name;                    // the key: path
+  dev_t dev;                     //   and device
+  ino_t ino;                     //   & inode of the file
+  int fd;                        // the descriptor opened for reading
+  int fd_direct;                 //   & with O_DIRECT, -1 - not supported, -2 - not opened yet
+  int nrefs;                     // number of the requests using the descriptor
+  int stale;                     // 1 if it's removed from the cache, it's closed by the last reference
+  time_t tm_used;                // time of the last use
+  time_t tm_checked;             // time of the last check of the path
+  struct fd_entry *prev, *next;  // the LRU list, the head is the most recently used
+  struct fd_entry *next_hash;    // next entry in the hash bucket
+};
+
+static struct fd_entry *buckets[NUMB_FD_BUCKETS]; // the entries by path
+static struct fd_entry *lru_head = NULL, *lru_tail = NULL;
+static int numb_entries = 0;   // number of the cached descriptors
+static time_t tm_swept = 0;    // time of the last closing of the idle descriptors
+
+// The cache statistics
+static unsigned long numb_hits, numb_opens, numb_replaced, numb_evicts;
+
+/* Get the hash bucket of the path */
+static struct fd_entry **bucket(const char *name)
+{
+  unsigned hash = 2166136261u;
+  while (*name)
+    hash = (hash ^ (unsigned char)*name++) * 16777619u;
+  return &buckets[hash & (NUMB_FD_BUCKETS - 1)];
+}
+
+/* Unlink the entry from the LRU list */
+static void lru_unlink(struct fd_entry *p_entry)
+{
+  if (p_entry->prev) p_entry->prev->next = p_entry->next;
+  else lru_head = p_entry->next;
+  if (p_entry->next) p_entry->next->prev = p_entry->prev;
+  else lru_tail = p_entry->prev;
+  p_entry->prev = p_entry->next = NULL;
+}
+
+/* Put the entry at the head of the LRU list */
+static void lru_push_head(struct fd_entry *p_entry)
+{
+  p_entry->prev = NULL;
+  p_entry->next = lru_head;
+  if (lru_head) lru_head->prev = p_entry;
+  else lru_tail = p_entry;
+  lru_head = p_entry;
+}
+
+/* Close the descriptor & free the entry */
+static void free_entry(struct fd_entry *p_entry)
+{
+  close(p_entry->fd);
+  if (p_entry->fd_direct >= 0)
+    close(p_entry->fd_direct);
+  free(p_entry->name);
+  free(p_entry);
+}
+
+/* Remove the entry from the cache. The referenced entry is closed by its last reference. */
+static void remove_entry(struct fd_entry *p_entry)
+{
+  struct fd_entry **pp_entry = bucket(p_entry->name);
+  while (*pp_entry != p_entry)
+    pp_entry = &(*pp_entry)->next_hash;
+  *pp_entry = p_entry->next_hash;
+  lru_unlink(p_entry);
+  numb_entries--;
+
+  if (p_entry->nrefs)
+    p_entry->stale = 1;
+  else
+    free_entry(p_entry);
+}
+
+/* Close the idle descriptors, and the least recently used ones to free a place for a new one */
+static void evict(time_t now)
+{
+  struct fd_entry *p_entry = lru_tail, *p_prev;
+  while (p_entry) {
+    p_prev = p_entry->prev;
+    if (numb_entries < NUMB_FD_CACHE && now - p_entry->tm_used <= FD_CACHE_IDLE)
+      break;
+    if (p_entry->nrefs == 0) {
+      LOG(LOG_TYPE_FDCH, LOG_LEVEL_DEBUG, "closed %s", p_entry->name);
+      remove_entry(p_entry);
+      numb_evicts++;
+    }
+    p_entry = p_prev;
+  }
+}
+
+/* Find the cached descriptor of the path */
+static struct fd_entry *find_entry(const char *name)
+{
+  struct fd_entry *p_entry;
+  for (p_entry = *bucket(name); p_entry; p_entry = p_entry->next_hash)
+    if (strcmp(p_entry->name, name) == 0)
+      return p_entry;
+  return NULL;
+}
+
+/* Get the descriptor of the file opened for reading from the cache, or open it. */
+fd_ref fd_cache_get(const char *flname, int *p_fd, err_inf **pp_errinf)
+{
+  struct fd_entry *p_entry = find_entry(flname);
+  struct stat statbuf;
+  time_t now = time(NULL);
+  int fd;
+
+  if (now != tm_swept) {
+    tm_swept = now;
+    evict(now);
+  }
+
+  // The path is checked again only after a while, it may point to another file by now
+  if (p_entry && now - p_entry->tm_checked >= FD_CACHE_RECHECK) {
+    if (stat(flname, &statbuf) == 0 &&
+        statbuf.st_dev == p_entry->dev && statbuf.st_ino == p_entry->ino)
+      p_entry->tm_checked = now;
+    else {
+      LOG(LOG_TYPE_FDCH, LOG_LEVEL_DEBUG, "replaced or removed %s", flname);
+      remove_entry(p_entry);
+      p_entry = NULL;
+      numb_replaced++;
+    }
+  }
+  if (p_entry) {
+    numb_hits++;
+    lru_unlink(p_entry);
+    lru_push_head(p_entry);
+    p_entry->tm_used = now;
+    p_entry->nrefs++;
+    *p_fd = p_entry->fd;
+    return p_entry;
+  }
+
+  if ( (fd = open(flname, O_RDONLY | O_CLOEXEC)) == -1 ) {
+    (void)process_error(flname, 11, "Cannot open the file for binary reading", pp_errinf);
+    return NULL;
+  }
+  numb_opens++;
+  if (numb_entries >= NUMB_FD_CACHE)
+    evict(now);
+
+  if ( (p_entry = calloc(1, sizeof(struct fd_entry))) == NULL ) {
+    close(fd);
+    errno = 0;
+    (void)process_error(flname, 13, "Failed to allocate memory for the content of file", pp_errinf);
+    return NULL;
+  }
+  p_entry->fd = fd;
+  p_entry->fd_direct = -2;
+  p_entry->nrefs = 1;
+  p_entry->tm_used = p_entry->tm_checked = now;
+
+  // The descriptor isn't cached if its key can't be kept, it's closed by the release
+  if ( (p_entry->name = strdup(flname)) == NULL || fstat(fd, &statbuf) != 0 )
+    p_entry->stale = 1;
+  else {
+    p_entry->dev = statbuf.st_dev;
+    p_entry->ino = statbuf.st_ino;
+    p_entry->next_hash = *bucket(flname);
+    *bucket(flname) = p_entry;
+    lru_push_head(p_entry);
+    numb_entries++;
+  }
+  *p_fd = fd;
+  return p_entry;
+}
+
+/* Release the reference to the cached descriptor. */
+void fd_cache_release(fd_ref ref)
+{
+  if (ref && --ref->nrefs == 0 && ref->stale)
+    free_entry(ref);
+}
+
+/* Get the descriptor of the referenced file opened with O_DIRECT. */
+int fd_cache_direct(fd_ref ref)
+{
+  if (ref->fd_direct == -2)
+    ref->fd_direct = direct_io_open(ref->fd, O_RDONLY);
+  return ref->fd_direct;
+}
+
+/* Forget the cached descriptor of the file. */
+void fd_cache_forget(const char *flname)
+{
+  struct fd_entry *p_entry = find_entry(flname);
+  if (p_entry)
+    remove_entry(p_entry);
+}
+
+/* Print the statistics. */
+void fd_cache_print_stats(FILE *hfile)
+{
+  fprintf(hfile, "Descriptor cache: %d open, hits: %lu, opens: %lu, replaced files: %lu, closed: %lu\n",
+          numb_entries, numb_hits, numb_opens, numb_replaced, numb_evicts);
+}
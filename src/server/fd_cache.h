@@ -0,0 +1,78 @@
+#ifndef _FD_CACHE_H_
+#define _FD_CACHE_H_
+
+#include <stdio.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The cache of the open file descriptors of the downloaded files on the Server.
+ *
+ * The chunks of a file are read with pread() from one shared descriptor, so the chunk
+ * requests of the same file, interleaved or concurrent, need no open, close or seek.
+ * The descriptor is keyed by the path and the device & inode of the file: the path is
+ * checked again at most once per FD_CACHE_RECHECK seconds, a replaced or removed file
+ * gets a new descriptor. The descriptor in use is counted by references, the one not used
+ * for FD_CACHE_IDLE seconds is closed; the least recently used ones are closed when
+ * NUMB_FD_CACHE descriptors are open.
+ */
+
+// Max number of the cached descriptors
+enum { NUMB_FD_CACHE = 256 };
+
+// Max idle time of the cached descriptor, seconds
+enum { FD_CACHE_IDLE = 10 };
+
+// Period of checking the path of the cached descriptor, seconds
+enum { FD_CACHE_RECHECK = 1 };
+
+/* The reference to the cached descriptor */
+typedef struct fd_entry *fd_ref;
+
+/* Get the descriptor of the file opened for reading from the cache, or open it.
+ *
+ * Parameters:
+ *  flname    - the name of the file.
+ *  p_fd      - a pointer to the descriptor to be set, it must not be closed or seeked.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  The reference to the descriptor, it must be released by fd_cache_release(),
+ *  or NULL on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+fd_ref fd_cache_get(const char *flname, int *p_fd, err_inf **pp_errinf);
+
+/* Release the reference to the cached descriptor.
+ *
+ * Parameters:
+ *  ref - the reference returned by fd_cache_get().
+ */
+void fd_cache_release(fd_ref ref);
+
+/* Get the descriptor of the referenced file opened with O_DIRECT, it's opened on the first call
+ * and cached with the file descriptor.
+ *
+ * Parameters:
+ *  ref - the reference returned by fd_cache_get().
+ *
+ * Return value:
+ *  The descriptor, it must not be closed, or -1 if the file isn't read bypassing the page cache
+ *  (see direct_io_open()).
+ */
+int fd_cache_direct(fd_ref ref);
+
+/* Forget the cached descriptor of the file, e.g. when the file is created or removed
+ * by the Server. It's closed as soon as it's not referenced.
+ *
+ * Parameters:
+ *  flname - the name of the file.
+ */
+void fd_cache_forget(const char *flname);
+
+/* Print the statistics: the hits, opens, rechecks found the file replaced & evictions.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void fd_cache_print_stats(FILE *hfile);
+
+#endif
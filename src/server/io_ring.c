@@ -0,0 +1,347 @@
+/*
+ * io_ring.c: the asynchronous reading & the writing of the files on the Server through io_uring.
+ * Errors range: none (the failed reads & writes are reported by their results)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "io_ring.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The ring shared with the kernel
+struct ring {
+  int fd;                        // the ring, -1 if it's not set up
+  unsigned sq_entries;           // number of the entries of the submission queue
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array; // the submission queue shared with the kernel
+  unsigned *cq_head, *cq_tail, *cq_mask;            //   & the completion one
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+};
+
+// The ring of the writes of one thread
+struct io_wring {
+  struct ring ring;
+  char **bufs;                   // the registered buffers, NULL if they're not registered
+  int numb_bufs;
+  size_t size_buf;               //   & their size
+};
+
+static struct ring rd = { .fd = -1 }; // the ring of the reads
+static unsigned numb_queued = 0; // number of the reads queued and not submitted yet
+static int numb_flight = 0;      // number of the reads submitted and not completed yet
+
+// The registered descriptors, -1 - free entry; the table isn't registered if fixed_files is 0
+static int files[IO_RING_FILES];
+static int fixed_files = 0;
+
+// The statistics, the ones of the writes are updated atomically
+static unsigned long numb_reads, numb_fixed, max_flight;
+static int numb_files;
+static unsigned long numb_writes, numb_writes_fixed, numb_wrings;
+
+/* Set up the ring */
+static int ring_setup(unsigned entries, struct io_uring_params *p_params)
+{
+  return (int)syscall(__NR_io_uring_setup, entries, p_params);
+}
+
+/* Submit the queued requests & wait for the completions */
+static int ring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+  return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+/* Register the resources of the ring */
+static int ring_register(int fd, unsigned opcode, void *arg, unsigned nr_args)
+{
+  return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/* Set up the ring of `entries` entries & map its queues.
+ * Return 0 on success, -1 on failure (errno is set).
+ */
+static int ring_open(struct ring *p_ring, unsigned entries)
+{
+  struct io_uring_params params;
+  size_t size_sq, size_cq;
+  char *p_sq, *p_cq;
+  int err;
+
+  memset(&params, 0, sizeof(params));
+  if ( (p_ring->fd = ring_setup(entries, &params)) == -1 )
+    return -1;
+
+  // Map the queues shared with the kernel, they're mapped at once by the recent kernels
+  size_sq = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  size_cq = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  if ((params.features & IORING_FEAT_SINGLE_MMAP) && size_cq > size_sq)
+    size_sq = size_cq;
+  p_sq = mmap(NULL, size_sq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, p_ring->fd, IORING_OFF_SQ_RING);
+  p_cq = (params.features & IORING_FEAT_SINGLE_MMAP) ? p_sq :
+         mmap(NULL, size_cq, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, p_ring->fd, IORING_OFF_CQ_RING);
+  p_ring->sqes = mmap(NULL, params.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, p_ring->fd, IORING_OFF_SQES);
+  if (p_sq == MAP_FAILED || p_cq == MAP_FAILED || p_ring->sqes == MAP_FAILED) {
+    err = errno;
+    close(p_ring->fd); // the mappings are kept, the ring isn't used
+    p_ring->fd = -1;
+    errno = err;
+    return -1;
+  }
+  p_ring->sq_entries = params.sq_entries;
+  p_ring->sq_head = (unsigned *)(p_sq + params.sq_off.head);
+  p_ring->sq_tail = (unsigned *)(p_sq + params.sq_off.tail);
+  p_ring->sq_mask = (unsigned *)(p_sq + params.sq_off.ring_mask);
+  p_ring->sq_array = (unsigned *)(p_sq + params.sq_off.array);
+  p_ring->cq_head = (unsigned *)(p_cq + params.cq_off.head);
+  p_ring->cq_tail = (unsigned *)(p_cq + params.cq_off.tail);
+  p_ring->cq_mask = (unsigned *)(p_cq + params.cq_off.ring_mask);
+  p_ring->cqes = (struct io_uring_cqe *)(p_cq + params.cq_off.cqes);
+  return 0;
+}
+
+/* Get the free submission entry of the ring, it's zeroed.
+ * Return the entry, or NULL if the submission queue is full.
+ */
+static struct io_uring_sqe *ring_get_sqe(struct ring *p_ring)
+{
+  unsigned tail = *p_ring->sq_tail;
+  struct io_uring_sqe *p_sqe;
+
+  // The submitted entries are consumed by the kernel, it moves the head
+  if (tail - __atomic_load_n(p_ring->sq_head, __ATOMIC_ACQUIRE) >= p_ring->sq_entries)
+    return NULL;
+  p_sqe = &p_ring->sqes[tail & *p_ring->sq_mask];
+  memset(p_sqe, 0, sizeof(*p_sqe));
+  return p_sqe;
+}
+
+/* Queue the entry got by ring_get_sqe() */
+static void ring_push_sqe(struct ring *p_ring)
+{
+  unsigned tail = *p_ring->sq_tail, idx = tail & *p_ring->sq_mask;
+  p_ring->sq_array[idx] = idx;
+  __atomic_store_n(p_ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/* Set up the ring & its table of the registered descriptors. */
+int io_ring_init(void)
+{
+  int i;
+
+  if (ring_open(&rd, IO_RING_DEPTH) != 0) {
+    fprintf(stderr, "Failed to set up io_uring, the files are read synchronously\n%s\n", strerror(errno));
+    return 1;
+  }
+
+  // The table of the registered descriptors is sparse, the descriptors are set by the updates
+  for (i = 0; i < IO_RING_FILES; ++i)
+    files[i] = -1;
+  if (ring_register(rd.fd, IORING_REGISTER_FILES, files, IO_RING_FILES) == 0)
+    fixed_files = 1;
+  else
+    LOG(LOG_TYPE_RING, LOG_LEVEL_WARN, "the descriptors can't be registered: %s", strerror(errno));
+  LOG(LOG_TYPE_RING, LOG_LEVEL_INFO, "io_uring of %u entries is set up", rd.sq_entries);
+  return 0;
+}
+
+/* Register the descriptor in the ring. */
+int io_ring_add_file(int fd)
+{
+  struct io_uring_files_update upd;
+  int idx;
+
+  if (!fixed_files)
+    return -1;
+  for (idx = 0; idx < IO_RING_FILES && files[idx] != -1; ++idx)
+    ;
+  if (idx == IO_RING_FILES)
+    return -1;
+
+  memset(&upd, 0, sizeof(upd));
+  upd.offset = (unsigned)idx;
+  upd.fds = (uint64_t)(uintptr_t)&fd;
+  if (ring_register(rd.fd, IORING_REGISTER_FILES_UPDATE, &upd, 1) != 1) {
+    LOG(LOG_TYPE_RING, LOG_LEVEL_WARN, "the descriptor can't be registered: %s", strerror(errno));
+    return -1;
+  }
+  files[idx] = fd;
+  numb_files++;
+  return idx;
+}
+
+/* Remove the registered descriptor from the ring. */
+void io_ring_remove_file(int idx)
+{
+  struct io_uring_files_update upd;
+  int fd = -1;
+
+  if (idx < 0 || idx >= IO_RING_FILES || files[idx] == -1)
+    return;
+  memset(&upd, 0, sizeof(upd));
+  upd.offset = (unsigned)idx;
+  upd.fds = (uint64_t)(uintptr_t)&fd;
+  if (ring_register(rd.fd, IORING_REGISTER_FILES_UPDATE, &upd, 1) != 1) {
+    LOG(LOG_TYPE_RING, LOG_LEVEL_WARN, "the descriptor can't be removed: %s", strerror(errno));
+    return; // the entry isn't reused
+  }
+  files[idx] = -1;
+  numb_files--;
+}
+
+/* Queue the reading of the file. */
+int io_ring_read(int file, int fixed, void *buf, size_t size, uint64_t offs, void *data)
+{
+  struct io_uring_sqe *p_sqe;
+
+  if (numb_flight + numb_queued >= IO_RING_DEPTH || (p_sqe = ring_get_sqe(&rd)) == NULL)
+    return -1;
+  p_sqe->opcode = IORING_OP_READ;
+  p_sqe->fd = file;
+  p_sqe->flags = fixed ? IOSQE_FIXED_FILE : 0;
+  p_sqe->addr = (uint64_t)(uintptr_t)buf;
+  p_sqe->len = (unsigned)size;
+  p_sqe->off = offs;
+  p_sqe->user_data = (uint64_t)(uintptr_t)data;
+  ring_push_sqe(&rd);
+  numb_queued++;
+  numb_reads++;
+  numb_fixed += fixed;
+  return 0;
+}
+
+/* Submit the queued reads and wait for the completion of at least one read in flight. */
+int io_ring_wait(void *datas[], int results[], int max)
+{
+  unsigned head, tail;
+  int rc, n = 0;
+
+  // The completions are waited for only if there's any read in flight
+  while ( (rc = ring_enter(rd.fd, numb_queued, numb_flight + numb_queued ? 1 : 0, IORING_ENTER_GETEVENTS)) == -1 ) {
+    if (errno != EINTR)
+      return -1;
+  }
+  numb_queued -= (unsigned)rc;
+  numb_flight += rc;
+  if ((unsigned long)numb_flight > max_flight)
+    max_flight = (unsigned long)numb_flight;
+
+  head = *rd.cq_head;
+  tail = __atomic_load_n(rd.cq_tail, __ATOMIC_ACQUIRE);
+  while (head != tail && n < max) {
+    struct io_uring_cqe *p_cqe = &rd.cqes[head & *rd.cq_mask];
+    datas[n] = (void *)(uintptr_t)p_cqe->user_data;
+    results[n++] = p_cqe->res;
+    head++;
+  }
+  __atomic_store_n(rd.cq_head, head, __ATOMIC_RELEASE);
+  numb_flight -= n;
+  return n;
+}
+
+/* Set up the ring of the writes of the calling thread with the registered buffers. */
+io_wring io_ring_wring_open(char *bufs[], int numb_bufs, size_t size_buf)
+{
+  struct io_wring *p_wring;
+  struct iovec iovs[numb_bufs > 0 ? numb_bufs : 1];
+  int i;
+
+  if ( (p_wring = calloc(1, sizeof(struct io_wring))) == NULL )
+    return NULL;
+  if (ring_open(&p_wring->ring, IO_WRING_DEPTH) != 0) {
+    LOG(LOG_TYPE_RING, LOG_LEVEL_WARN, "the ring of the writes can't be set up: %s", strerror(errno));
+    free(p_wring);
+    return NULL;
+  }
+
+  // The buffers are pinned in the kernel once, the writes from them aren't mapping the pages
+  for (i = 0; i < numb_bufs; ++i) {
+    iovs[i].iov_base = bufs[i];
+    iovs[i].iov_len = size_buf;
+  }
+  if (numb_bufs > 0 && ring_register(p_wring->ring.fd, IORING_REGISTER_BUFFERS, iovs, (unsigned)numb_bufs) == 0) {
+    p_wring->bufs = bufs;
+    p_wring->numb_bufs = numb_bufs;
+    p_wring->size_buf = size_buf;
+  }
+  else if (numb_bufs > 0)
+    LOG(LOG_TYPE_RING, LOG_LEVEL_WARN, "the buffers of the writes can't be registered: %s", strerror(errno));
+  __atomic_add_fetch(&numb_wrings, 1, __ATOMIC_RELAXED);
+  return p_wring;
+}
+
+/* Write the whole buffer at the offset of the file through the ring of the writes. */
+int io_ring_write(io_wring wring, int fd, const char *buf, size_t size, uint64_t offs)
+{
+  struct ring *p_ring = &wring->ring;
+  struct io_uring_sqe *p_sqe;
+  struct io_uring_cqe *p_cqe;
+  unsigned head;
+  int i, res;
+
+  while (size) {
+    if ( (p_sqe = ring_get_sqe(p_ring)) == NULL ) {
+      errno = EBUSY;
+      return -1;
+    }
+
+    // The registered buffer is written by its index
+    for (i = 0; i < wring->numb_bufs && (buf < wring->bufs[i] || buf + size > wring->bufs[i] + wring->size_buf); ++i)
+      ;
+    p_sqe->opcode = i < wring->numb_bufs ? IORING_OP_WRITE_FIXED : IORING_OP_WRITE;
+    p_sqe->buf_index = i < wring->numb_bufs ? (uint16_t)i : 0;
+    p_sqe->fd = fd;
+    p_sqe->addr = (uint64_t)(uintptr_t)buf;
+    p_sqe->len = (unsigned)size;
+    p_sqe->off = offs;
+    ring_push_sqe(p_ring);
+    __atomic_add_fetch(&numb_writes, 1, __ATOMIC_RELAXED);
+    if (i < wring->numb_bufs)
+      __atomic_add_fetch(&numb_writes_fixed, 1, __ATOMIC_RELAXED);
+
+    // The only write in flight is waited for
+    while (ring_enter(p_ring->fd, 1, 1, IORING_ENTER_GETEVENTS) == -1) {
+      if (errno != EINTR)
+        return -1;
+    }
+    head = *p_ring->cq_head;
+    if (head == __atomic_load_n(p_ring->cq_tail, __ATOMIC_ACQUIRE)) {
+      errno = EIO;
+      return -1;
+    }
+    p_cqe = &p_ring->cqes[head & *p_ring->cq_mask];
+    res = p_cqe->res;
+    __atomic_store_n(p_ring->cq_head, head + 1, __ATOMIC_RELEASE);
+    if (res == -EINTR || res == -EAGAIN)
+      continue;
+    if (res <= 0) {
+      errno = res ? -res : EIO;
+      return -1;
+    }
+    buf += res;
+    size -= (size_t)res;
+    offs += (uint64_t)res;
+  }
+  return 0;
+}
+
+/* Print the statistics. */
+void io_ring_print_stats(FILE *hfile)
+{
+  if (rd.fd != -1)
+    fprintf(hfile, "io_uring (depth: %d): registered files: %d, reads submitted: %lu (fixed files: %lu), "
+            "max in flight: %lu\n", IO_RING_DEPTH, numb_files, numb_reads, numb_fixed, max_flight);
+  if (__atomic_load_n(&numb_wrings, __ATOMIC_RELAXED))
+    fprintf(hfile, "io_uring writes: rings: %lu, writes submitted: %lu (fixed buffers: %lu)\n",
+            __atomic_load_n(&numb_wrings, __ATOMIC_RELAXED), __atomic_load_n(&numb_writes, __ATOMIC_RELAXED),
+            __atomic_load_n(&numb_writes_fixed, __ATOMIC_RELAXED));
+}
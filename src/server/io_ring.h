@@ -0,0 +1,124 @@
+#ifndef _IO_RING_H_
+#define _IO_RING_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * The asynchronous reading & the writing of the files on the Server through io_uring.
+ *
+ * The ring of the reads is used by one thread: the reads are queued by io_ring_read() and submitted
+ * together by io_ring_wait(), which returns their completions, so up to IO_RING_DEPTH reads
+ * of many files are handled by the disk at once. The descriptors of the files read often
+ * are registered in the ring (the fixed files) by io_ring_add_file(), that saves the lookup
+ * of the descriptor on each read; the registration is done by any thread.
+ *
+ * The rings of the writes are used by the I/O threads of the devices, one ring per thread
+ * (see io_ring_wring_open()). The buffers passed to the ring are registered in it (the fixed
+ * buffers), so the writes from them (IORING_OP_WRITE_FIXED) don't map their pages each time;
+ * the other buffers are written by IORING_OP_WRITE.
+ * The rings are set up by the system calls, the kernel must support io_uring (Linux 5.6+).
+ */
+
+// Max number of the reads in flight
+enum { IO_RING_DEPTH = 64 };
+
+// Number of the registered descriptors
+enum { IO_RING_FILES = 64 };
+
+// Number of the entries of the ring of the writes, one write is in flight
+enum { IO_WRING_DEPTH = 4 };
+
+// The ring of the writes of one thread
+typedef struct io_wring *io_wring;
+
+/* Set up the ring & its table of the registered descriptors.
+ *
+ * Return value:
+ *  0 on success, >0 if io_uring isn't available (the error is printed).
+ */
+int io_ring_init(void);
+
+/* Register the descriptor in the ring.
+ *
+ * Parameters:
+ *  fd - the descriptor opened for reading, it must not be closed till io_ring_remove_file().
+ *
+ * Return value:
+ *  The index of the registered descriptor, or -1 if it can't be registered (the descriptor
+ *  itself should be passed to io_ring_read() then).
+ */
+int io_ring_add_file(int fd);
+
+/* Remove the registered descriptor from the ring, its reads must be completed.
+ *
+ * Parameters:
+ *  idx - the index returned by io_ring_add_file().
+ */
+void io_ring_remove_file(int idx);
+
+/* Queue the reading of the file, it's submitted by io_ring_wait().
+ *
+ * Parameters:
+ *  file  - the index of the registered descriptor, or the descriptor itself.
+ *  fixed - 1 if `file` is the index of the registered descriptor.
+ *  buf   - the buffer to read into.
+ *  size  - the number of the bytes to read.
+ *  offs  - the offset in the file.
+ *  data  - the data returned with the completion.
+ *
+ * Return value:
+ *  0 on success, -1 if IO_RING_DEPTH reads are queued already.
+ */
+int io_ring_read(int file, int fixed, void *buf, size_t size, uint64_t offs, void *data);
+
+/* Submit the queued reads and wait for the completion of at least one read in flight.
+ *
+ * Parameters:
+ *  datas   - the array to store the data of the completed reads.
+ *  results - the array to store the results: the number of the read bytes or -errno.
+ *  max     - the size of the arrays.
+ *
+ * Return value:
+ *  The number of the completed reads, or -1 on failure of the ring (errno is set).
+ */
+int io_ring_wait(void *datas[], int results[], int max);
+
+/* Set up the ring of the writes of the calling thread with the registered buffers.
+ *
+ * Parameters:
+ *  bufs      - the buffers to be registered, the array & the buffers must be kept.
+ *  numb_bufs - the number of the buffers, 0 - no registered buffers.
+ *  size_buf  - the size of each buffer.
+ *
+ * Return value:
+ *  The ring, or NULL if io_uring isn't available (the files are written synchronously then).
+ *  The ring is set up without the buffers if they can't be registered.
+ */
+io_wring io_ring_wring_open(char *bufs[], int numb_bufs, size_t size_buf);
+
+/* Write the whole buffer at the offset of the file through the ring of the writes,
+ * the calling thread waits for the completion.
+ *
+ * Parameters:
+ *  wring - the ring of the calling thread.
+ *  fd    - the descriptor of the file.
+ *  buf   - the buffer to write, the one within a registered buffer is written as the fixed one.
+ *  size  - the size of the buffer.
+ *  offs  - the offset in the file.
+ *
+ * Return value:
+ *  0 on success, -1 on failure (errno is set).
+ */
+int io_ring_write(io_wring wring, int fd, const char *buf, size_t size, uint64_t offs);
+
+/* Print the statistics: the registered descriptors, the reads submitted & the max in flight,
+ * the rings of the writes & the writes submitted.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void io_ring_print_stats(FILE *hfile);
+
+#endif
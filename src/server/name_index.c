@@ -0,0 +1,780 @@
+/*
+ * name_index.c: the persistent index of the file names on the Server.
+ * Errors range: 91-94 (reserve 95)
+ */
+#define _GNU_SOURCE // for strcasestr() & qsort_r()
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <time.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+
+#include "name_index.h"
+#include "../rpcgen/fltr.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+#define IDX_NONE UINT32_MAX
+#define ALIGN8(len) (((len) + 7) & ~(uint64_t)7)
+
+// The identifier & version of the index file format
+static const char idx_magic[8] = { 'F', 'L', 'T', 'R', 'I', 'D', 'X', '1' };
+
+// The header of the index file, followed by the sections: the indexed directory (NUL-terminated),
+// the entries, the directories, the trigrams, the posting lists & the names; each section
+// starts at the offset aligned to 8 bytes
+struct idx_header {
+  char magic[8];
+  uint32_t numb_ents, numb_dirs, numb_grams, numb_posts;
+  uint32_t len_names;         // length of the NUL-terminated names
+  uint32_t len_root;          // length of the indexed directory path
+  int64_t built;              // time the index was written
+};
+
+// The indexed entry
+struct idx_ent {
+  uint32_t name;              // offset of the name
+  uint32_t parent;            // the directory containing the entry
+  uint32_t dir;               // the directory of the entry if it's a directory, IDX_NONE otherwise
+  uint32_t type;              // filetype
+};
+
+// The indexed directory: its entries are contiguous & sorted by name
+struct idx_dir {
+  uint32_t ent;               // the entry of the directory, IDX_NONE for the indexed one
+  uint32_t first, numb;       // the entries in the directory
+  uint32_t reserved;
+  int64_t mtime_sec, mtime_nsec, ctime_sec, ctime_nsec; // the directory times at the scan
+};
+
+// The posting list of the trigram: the ascending numbers of the entries having it in the name
+struct idx_gram {
+  uint32_t gram;              // 3 bytes of the lowercase name
+  uint32_t first, numb;       // the posting list
+};
+
+// The sections of the index
+struct idx_view {
+  const struct idx_header *p_hdr;
+  const char *root;
+  const struct idx_ent *ents;
+  const struct idx_dir *dirs;
+  const struct idx_gram *grams;
+  const uint32_t *posts;
+  const char *names;
+};
+
+// The mapped index file
+struct idx_map {
+  void *base;                 // NULL if the file isn't mapped
+  size_t len;
+  dev_t dev;
+  ino_t ino;
+  struct idx_view view;
+};
+
+// The index being built by the rescan
+struct idx_build {
+  int fd_root;                // the indexed directory
+  dev_t dev_root;
+  struct idx_ent *ents;
+  size_t numb_ents, numb_ents_max;
+  struct idx_dir *dirs;
+  uint32_t *olds;             // the directory of the previous index per directory, IDX_NONE if none
+  size_t numb_dirs, numb_dirs_max, numb_olds_max;
+  char *names;
+  size_t len_names, len_names_max;
+  uint64_t *pairs;            // the trigram (high 32 bits) & the entry of each name trigram
+  size_t numb_pairs, numb_pairs_max;
+  struct idx_gram *grams;
+  size_t numb_grams, numb_grams_max;
+  uint32_t *posts;
+  unsigned long numb_read, numb_reused;
+  int full;                   // 1 if NUMB_INDEX_ENTRIES is reached
+};
+
+static char root_path[PATH_MAX];  // the indexed directory
+static char *file_idx = NULL;     // the index file, NULL if the index isn't enabled
+static int fd_lock = -1;          // the lock file, it's locked by the worker rescanning the subtree
+static int is_builder = 0;        // 1 if this process holds the lock
+
+static struct idx_map curr;       // the index used by the searches
+static pthread_rwlock_t lock_curr = PTHREAD_RWLOCK_INITIALIZER; // the searches & the replacement
+static pthread_mutex_t lock_reload = PTHREAD_MUTEX_INITIALIZER;
+static time_t tm_checked = 0;     // time of the last check of the index file by the searches
+
+// The search results, the paths are kept in `paths`
+static uint32_t found_first[LEN_SEARCH_MAX], found_rest[LEN_SEARCH_MAX];
+static found_item items[LEN_SEARCH_MAX];
+static size_t offs_paths[LEN_SEARCH_MAX];
+static char *paths = NULL;
+static size_t len_paths_max = 0;
+
+// The statistics, the rescan ones are set by the rescanning thread
+static unsigned long numb_searches, numb_rescans, numb_dirs_read, numb_dirs_reused;
+static long ms_rescan;
+
+/* Grow the array to keep the passed number of elements, its size is doubled at least */
+static int grow(void **p_arr, size_t *p_numb_max, size_t numb, size_t size_elem)
+{
+  size_t numb_new = *p_numb_max * 2 > numb ? *p_numb_max * 2 : numb;
+  void *arr;
+  if (numb <= *p_numb_max)
+    return 0;
+  if ( (arr = realloc(*p_arr, numb_new * size_elem)) == NULL )
+    return 1;
+  *p_arr = arr;
+  *p_numb_max = numb_new;
+  return 0;
+}
+
+/* Make the path of the entry in the end of the buffer: the passed prefix, then the names of
+ * the directories down to the entry. Return the path, or NULL if it doesn't fit the buffer. */
+static char *make_path(const struct idx_view *p_idx, uint32_t ent, const char *prefix,
+                       char *buf, size_t size)
+{
+  char *p = buf + size;
+  const char *name;
+  size_t len;
+
+  *--p = '\0';
+  for (; ent != IDX_NONE; ent = p_idx->dirs[p_idx->ents[ent].parent].ent) {
+    name = p_idx->names + p_idx->ents[ent].name;
+    len = strlen(name);
+    if ((size_t)(p - buf) < len + 1)
+      return NULL;
+    if (*p)
+      *--p = '/';
+    p -= len;
+    memcpy(p, name, len);
+  }
+  if (prefix) {
+    len = strlen(prefix);
+    if ((size_t)(p - buf) < len + 1)
+      return NULL;
+    if (*p && (len == 0 || prefix[len - 1] != '/'))
+      *--p = '/';
+    p -= len;
+    memcpy(p, prefix, len);
+  }
+  return p;
+}
+
+/* Set the sections of the index placed after the header, return the size of the index */
+static uint64_t set_view(struct idx_view *p_idx, const struct idx_header *p_hdr)
+{
+  const char *base = (const char *)p_hdr;
+  uint64_t offs = ALIGN8(sizeof(struct idx_header));
+
+  p_idx->p_hdr = p_hdr;
+  p_idx->root = base + offs;
+  offs += ALIGN8((uint64_t)p_hdr->len_root + 1);
+  p_idx->ents = (const struct idx_ent *)(base + offs);
+  offs += ALIGN8((uint64_t)p_hdr->numb_ents * sizeof(struct idx_ent));
+  p_idx->dirs = (const struct idx_dir *)(base + offs);
+  offs += ALIGN8((uint64_t)p_hdr->numb_dirs * sizeof(struct idx_dir));
+  p_idx->grams = (const struct idx_gram *)(base + offs);
+  offs += ALIGN8((uint64_t)p_hdr->numb_grams * sizeof(struct idx_gram));
+  p_idx->posts = (const uint32_t *)(base + offs);
+  offs += ALIGN8((uint64_t)p_hdr->numb_posts * sizeof(uint32_t));
+  p_idx->names = base + offs;
+  return offs + p_hdr->len_names;
+}
+
+/* Check the mapped index: it's of the indexed directory and its sections are consistent */
+static int is_valid(const struct idx_map *p_map)
+{
+  const struct idx_header *p_hdr = p_map->base;
+  const struct idx_view *p_idx = &p_map->view;
+  size_t i;
+
+  if (memcmp(p_hdr->magic, idx_magic, sizeof(idx_magic)) != 0 ||
+      p_hdr->numb_dirs == 0 || p_hdr->len_root != strlen(root_path) ||
+      memcmp(p_idx->root, root_path, p_hdr->len_root + 1) != 0 ||
+      (p_hdr->len_names && p_idx->names[p_hdr->len_names - 1] != '\0') ||
+      p_idx->dirs[0].ent != IDX_NONE)
+    return 0;
+  for (i = 0; i < p_hdr->numb_ents; ++i)
+    if (p_idx->ents[i].name >= p_hdr->len_names || p_idx->ents[i].parent >= p_hdr->numb_dirs ||
+        (p_idx->ents[i].dir != IDX_NONE && p_idx->ents[i].dir >= p_hdr->numb_dirs))
+      return 0;
+  for (i = 0; i < p_hdr->numb_dirs; ++i)
+    if ((uint64_t)p_idx->dirs[i].first + p_idx->dirs[i].numb > p_hdr->numb_ents ||
+        (i > 0 && p_idx->dirs[i].ent >= p_hdr->numb_ents))
+      return 0;
+  for (i = 0; i < p_hdr->numb_grams; ++i)
+    if ((uint64_t)p_idx->grams[i].first + p_idx->grams[i].numb > p_hdr->numb_posts)
+      return 0;
+  for (i = 0; i < p_hdr->numb_posts; ++i)
+    if (p_idx->posts[i] >= p_hdr->numb_ents)
+      return 0;
+  return 1;
+}
+
+/* Map the index file. Return 0 on success, 1 if there's no valid index file. */
+static int map_index(struct idx_map *p_map)
+{
+  struct stat statbuf;
+  int fd;
+
+  memset(p_map, 0, sizeof(*p_map));
+  if ( (fd = open(file_idx, O_RDONLY | O_CLOEXEC)) == -1 )
+    return 1;
+  if (fstat(fd, &statbuf) != 0 || statbuf.st_size < (off_t)ALIGN8(sizeof(struct idx_header)) ||
+      (p_map->base = mmap(NULL, (size_t)statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+    p_map->base = NULL;
+    close(fd);
+    return 1;
+  }
+  close(fd);
+  p_map->len = (size_t)statbuf.st_size;
+  p_map->dev = statbuf.st_dev;
+  p_map->ino = statbuf.st_ino;
+  if (memcmp(p_map->base, idx_magic, sizeof(idx_magic)) != 0 ||
+      set_view(&p_map->view, p_map->base) != p_map->len || !is_valid(p_map)) {
+    LOG(LOG_TYPE_NIDX, LOG_LEVEL_WARN, "the index file %s is invalid or of another directory", file_idx);
+    munmap(p_map->base, p_map->len);
+    p_map->base = NULL;
+    return 1;
+  }
+  return 0;
+}
+
+/* Map the index file for the searches if it was replaced */
+static void reload_index(void)
+{
+  struct idx_map map, prev;
+  struct stat statbuf;
+
+  pthread_mutex_lock(&lock_reload);
+  if (stat(file_idx, &statbuf) == 0 &&
+      (curr.base == NULL || statbuf.st_dev != curr.dev || statbuf.st_ino != curr.ino) &&
+      map_index(&map) == 0) {
+    pthread_rwlock_wrlock(&lock_curr);
+    prev = curr;
+    curr = map;
+    pthread_rwlock_unlock(&lock_curr);
+    if (prev.base)
+      munmap(prev.base, prev.len);
+    LOG(LOG_TYPE_NIDX, LOG_LEVEL_INFO, "the index of %u entries was mapped",
+        curr.view.p_hdr->numb_ents);
+  }
+  pthread_mutex_unlock(&lock_reload);
+}
+
+/* Compare the names of the entries for qsort_r() */
+static int cmp_ent_names(const void *p1, const void *p2, void *names)
+{
+  return strcmp((const char *)names + ((const struct idx_ent *)p1)->name,
+                (const char *)names + ((const struct idx_ent *)p2)->name);
+}
+
+/* Compare the numbers for qsort() */
+static int cmp_u32(const void *p1, const void *p2)
+{
+  uint32_t n1 = *(const uint32_t *)p1, n2 = *(const uint32_t *)p2;
+  return (n1 > n2) - (n1 < n2);
+}
+
+/* Compare the trigram & entry pairs for qsort() */
+static int cmp_u64(const void *p1, const void *p2)
+{
+  uint64_t n1 = *(const uint64_t *)p1, n2 = *(const uint64_t *)p2;
+  return (n1 > n2) - (n1 < n2);
+}
+
+/* Find the entry in the directory of the previous index by name, return IDX_NONE if there's no one */
+static uint32_t find_old_ent(const struct idx_view *p_old, uint32_t dir, const char *name)
+{
+  uint32_t lo = p_old->dirs[dir].first, hi = lo + p_old->dirs[dir].numb, mid;
+  int cmp;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if ( (cmp = strcmp(p_old->names + p_old->ents[mid].name, name)) == 0 )
+      return mid;
+    if (cmp < 0)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return IDX_NONE;
+}
+
+/* Add the entry to the directory being scanned. Return 0 on success, 1 if the index is full. */
+static int add_ent(struct idx_build *p_bld, uint32_t dir, const char *name, filetype type)
+{
+  size_t len = strlen(name) + 1;
+  if (p_bld->numb_ents >= NUMB_INDEX_ENTRIES || p_bld->len_names + len > UINT32_MAX ||
+      grow((void **)&p_bld->ents, &p_bld->numb_ents_max, p_bld->numb_ents + 1, sizeof(struct idx_ent)) ||
+      grow((void **)&p_bld->names, &p_bld->len_names_max, p_bld->len_names + len, 1)) {
+    p_bld->full = 1;
+    return 1;
+  }
+  p_bld->ents[p_bld->numb_ents].name = (uint32_t)p_bld->len_names;
+  p_bld->ents[p_bld->numb_ents].parent = dir;
+  p_bld->ents[p_bld->numb_ents].dir = IDX_NONE;
+  p_bld->ents[p_bld->numb_ents].type = type;
+  memcpy(p_bld->names + p_bld->len_names, name, len);
+  p_bld->len_names += len;
+  p_bld->numb_ents++;
+  return 0;
+}
+
+/* Add the directory of the entry to be scanned, `old` is its directory in the previous index */
+static int add_dir(struct idx_build *p_bld, uint32_t ent, uint32_t old)
+{
+  if (grow((void **)&p_bld->dirs, &p_bld->numb_dirs_max, p_bld->numb_dirs + 1, sizeof(struct idx_dir)) ||
+      grow((void **)&p_bld->olds, &p_bld->numb_olds_max, p_bld->numb_dirs + 1, sizeof(uint32_t))) {
+    p_bld->full = 1;
+    return 1;
+  }
+  memset(&p_bld->dirs[p_bld->numb_dirs], 0, sizeof(struct idx_dir));
+  p_bld->dirs[p_bld->numb_dirs].ent = ent;
+  p_bld->olds[p_bld->numb_dirs] = old;
+  if (ent != IDX_NONE)
+    p_bld->ents[ent].dir = (uint32_t)p_bld->numb_dirs;
+  p_bld->numb_dirs++;
+  return 0;
+}
+
+/* Read the entries of the directory */
+static void read_dir(struct idx_build *p_bld, uint32_t dir, const char *path)
+{
+  struct dirent *p_de;
+  struct stat statbuf;
+  filetype type;
+  DIR *p_dir;
+  int fd;
+
+  if ( (fd = openat(p_bld->fd_root, path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC)) == -1 )
+    return;
+  if ( (p_dir = fdopendir(fd)) == NULL ) {
+    close(fd);
+    return;
+  }
+  while ( (p_de = readdir(p_dir)) != NULL ) {
+    if (p_de->d_name[0] == '.' &&
+        (p_de->d_name[1] == '\0' || (p_de->d_name[1] == '.' && p_de->d_name[2] == '\0')))
+      continue;
+    if (p_de->d_type == DT_UNKNOWN &&
+        fstatat(fd, p_de->d_name, &statbuf, AT_SYMLINK_NOFOLLOW) == 0)
+      type = S_ISDIR(statbuf.st_mode) ? FTYPE_DIR : S_ISREG(statbuf.st_mode) ? FTYPE_REG : FTYPE_OTH;
+    else
+      type = p_de->d_type == DT_DIR ? FTYPE_DIR : p_de->d_type == DT_REG ? FTYPE_REG : FTYPE_OTH;
+    if (add_ent(p_bld, dir, p_de->d_name, type) != 0)
+      break;
+  }
+  closedir(p_dir);
+}
+
+/* Scan the directory: take its entries from the previous index if it's unchanged, or read them,
+ * and add its subdirectories to be scanned */
+static void scan_dir_idx(struct idx_build *p_bld, const struct idx_view *p_old, uint32_t dir)
+{
+  char buf[PATH_MAX];
+  struct stat statbuf;
+  struct idx_view view = { .ents = p_bld->ents, .dirs = p_bld->dirs, .names = p_bld->names };
+  struct idx_dir *p_dir = &p_bld->dirs[dir];
+  const struct idx_dir *p_dir_old;
+  uint32_t old = p_bld->olds[dir], first = (uint32_t)p_bld->numb_ents, ent, sub;
+  const char *path = make_path(&view, p_dir->ent, NULL, buf, sizeof(buf));
+
+  p_dir->first = first;
+  if (path == NULL ||
+      fstatat(p_bld->fd_root, *path ? path : ".", &statbuf, AT_SYMLINK_NOFOLLOW) != 0 ||
+      !S_ISDIR(statbuf.st_mode) || statbuf.st_dev != p_bld->dev_root)
+    return;
+  p_dir->mtime_sec = statbuf.st_mtim.tv_sec;
+  p_dir->mtime_nsec = statbuf.st_mtim.tv_nsec;
+  p_dir->ctime_sec = statbuf.st_ctim.tv_sec;
+  p_dir->ctime_nsec = statbuf.st_ctim.tv_nsec;
+
+  p_dir_old = old != IDX_NONE ? &p_old->dirs[old] : NULL;
+  if (p_dir_old && p_dir_old->mtime_sec == p_dir->mtime_sec &&
+      p_dir_old->mtime_nsec == p_dir->mtime_nsec && p_dir_old->ctime_sec == p_dir->ctime_sec &&
+      p_dir_old->ctime_nsec == p_dir->ctime_nsec) {
+    // The unchanged directory isn't read, its entries are in the same order
+    for (ent = p_dir_old->first; ent < p_dir_old->first + p_dir_old->numb; ++ent)
+      if (add_ent(p_bld, dir, p_old->names + p_old->ents[ent].name, p_old->ents[ent].type) != 0)
+        break;
+    p_bld->numb_reused++;
+  }
+  else {
+    read_dir(p_bld, dir, *path ? path : ".");
+    qsort_r(p_bld->ents + first, p_bld->numb_ents - first, sizeof(struct idx_ent),
+            cmp_ent_names, p_bld->names);
+    p_bld->numb_read++;
+  }
+  p_bld->dirs[dir].numb = (uint32_t)(p_bld->numb_ents - first);
+
+  // The subdirectories are matched with the previous index by name
+  for (ent = first; ent < p_bld->numb_ents; ++ent) {
+    if (p_bld->ents[ent].type != FTYPE_DIR)
+      continue;
+    sub = IDX_NONE;
+    if (p_dir_old && (sub = find_old_ent(p_old, old, p_bld->names + p_bld->ents[ent].name)) != IDX_NONE)
+      sub = p_old->ents[sub].dir;
+    if (add_dir(p_bld, ent, sub) != 0)
+      break;
+  }
+}
+
+/* Make the trigram posting lists of the names. Return 0 on success, 1 if the memory can't be allocated. */
+static int make_grams(struct idx_build *p_bld)
+{
+  uint32_t grams[NAME_MAX];
+  const unsigned char *name;
+  size_t ent, numb, i, k;
+
+  for (ent = 0; ent < p_bld->numb_ents; ++ent) {
+    name = (const unsigned char *)p_bld->names + p_bld->ents[ent].name;
+    for (numb = 0; numb < NAME_MAX && name[numb] && name[numb + 1] && name[numb + 2]; ++numb)
+      grams[numb] = (uint32_t)tolower(name[numb]) << 16 | (uint32_t)tolower(name[numb + 1]) << 8 |
+                    (uint32_t)tolower(name[numb + 2]);
+    qsort(grams, numb, sizeof(uint32_t), cmp_u32);
+    if (grow((void **)&p_bld->pairs, &p_bld->numb_pairs_max, p_bld->numb_pairs + numb, sizeof(uint64_t)))
+      return 1;
+    for (i = 0; i < numb; ++i)
+      if (i == 0 || grams[i] != grams[i - 1])
+        p_bld->pairs[p_bld->numb_pairs++] = (uint64_t)grams[i] << 32 | ent;
+  }
+  qsort(p_bld->pairs, p_bld->numb_pairs, sizeof(uint64_t), cmp_u64);
+
+  // The pairs are replaced by the entries, the trigrams are collected separately
+  p_bld->posts = (uint32_t *)p_bld->pairs;
+  for (i = 0; i < p_bld->numb_pairs; ++i) {
+    k = p_bld->numb_grams;
+    if (k == 0 || p_bld->grams[k - 1].gram != (uint32_t)(p_bld->pairs[i] >> 32)) {
+      if (grow((void **)&p_bld->grams, &p_bld->numb_grams_max, k + 1, sizeof(struct idx_gram)))
+        return 1;
+      p_bld->grams[k].gram = (uint32_t)(p_bld->pairs[i] >> 32);
+      p_bld->grams[k].first = (uint32_t)i;
+      p_bld->grams[k].numb = 0;
+      p_bld->numb_grams++;
+      k++;
+    }
+    p_bld->grams[k - 1].numb++;
+    p_bld->posts[i] = (uint32_t)p_bld->pairs[i]; // it overlaps only the pairs already read
+  }
+  return 0;
+}
+
+/* Write the section of the index file padded to 8 bytes */
+static int write_section(FILE *hfile, const void *data, uint64_t len)
+{
+  static const char pad[8];
+  return (len && fwrite(data, len, 1, hfile) != 1) ||
+         (ALIGN8(len) != len && fwrite(pad, ALIGN8(len) - len, 1, hfile) != 1);
+}
+
+/* Write the index to the temporary file and replace the index file by it */
+static int write_index(const struct idx_build *p_bld)
+{
+  char filename[PATH_MAX];
+  struct idx_header hdr;
+  FILE *hfile;
+  int rc;
+
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, idx_magic, sizeof(idx_magic));
+  hdr.numb_ents = (uint32_t)p_bld->numb_ents;
+  hdr.numb_dirs = (uint32_t)p_bld->numb_dirs;
+  hdr.numb_grams = (uint32_t)p_bld->numb_grams;
+  hdr.numb_posts = (uint32_t)p_bld->numb_pairs;
+  hdr.len_names = (uint32_t)p_bld->len_names;
+  hdr.len_root = (uint32_t)strlen(root_path);
+  hdr.built = (int64_t)time(NULL);
+
+  snprintf(filename, sizeof(filename), "%s.tmp", file_idx);
+  if ( (hfile = fopen(filename, "w")) == NULL )
+    return 1;
+  rc = write_section(hfile, &hdr, sizeof(hdr)) ||
+       write_section(hfile, root_path, hdr.len_root + 1) ||
+       write_section(hfile, p_bld->ents, p_bld->numb_ents * sizeof(struct idx_ent)) ||
+       write_section(hfile, p_bld->dirs, p_bld->numb_dirs * sizeof(struct idx_dir)) ||
+       write_section(hfile, p_bld->grams, p_bld->numb_grams * sizeof(struct idx_gram)) ||
+       write_section(hfile, p_bld->posts, p_bld->numb_pairs * sizeof(uint32_t)) ||
+       (p_bld->len_names && fwrite(p_bld->names, p_bld->len_names, 1, hfile) != 1) ||
+       fflush(hfile) != 0 || fsync(fileno(hfile)) != 0;
+  if (fclose(hfile) != 0 || rc || rename(filename, file_idx) != 0) {
+    unlink(filename);
+    return 1;
+  }
+  return 0;
+}
+
+/* Rescan the indexed subtree and replace the index file if the subtree was changed */
+static void rescan(void)
+{
+  struct idx_build bld;
+  struct idx_map old;
+  struct stat statbuf;
+  struct timespec tm_start, tm_end;
+  size_t dir;
+  int changed;
+
+  clock_gettime(CLOCK_MONOTONIC, &tm_start);
+  memset(&bld, 0, sizeof(bld));
+  if ( (bld.fd_root = open(root_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1 ||
+       fstat(bld.fd_root, &statbuf) != 0 ) {
+    LOG(LOG_TYPE_NIDX, LOG_LEVEL_ERROR, "Failed to open the indexed directory %s: %s",
+        root_path, strerror(errno));
+    if (bld.fd_root != -1)
+      close(bld.fd_root);
+    return;
+  }
+  bld.dev_root = statbuf.st_dev;
+
+  // The previous index is mapped separately, the searches can replace their one meanwhile
+  (void)map_index(&old);
+  if (add_dir(&bld, IDX_NONE, old.base ? 0 : IDX_NONE) != 0) {
+    close(bld.fd_root);
+    if (old.base)
+      munmap(old.base, old.len);
+    return;
+  }
+  for (dir = 0; dir < bld.numb_dirs; ++dir)
+    scan_dir_idx(&bld, &old.view, (uint32_t)dir);
+  close(bld.fd_root);
+  if (bld.full)
+    LOG(LOG_TYPE_NIDX, LOG_LEVEL_WARN, "only %lu entries of %s are indexed",
+        (unsigned long)bld.numb_ents, root_path);
+
+  changed = !old.base || bld.numb_read > 0 || bld.numb_dirs != old.view.p_hdr->numb_dirs ||
+            bld.numb_ents != old.view.p_hdr->numb_ents;
+  if (old.base)
+    munmap(old.base, old.len);
+  if (changed) {
+    if (make_grams(&bld) != 0 || write_index(&bld) != 0)
+      LOG(LOG_TYPE_NIDX, LOG_LEVEL_ERROR, "Failed to write the index file %s: %s",
+          file_idx, strerror(errno));
+    else
+      reload_index();
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &tm_end);
+  __atomic_store_n(&ms_rescan, (tm_end.tv_sec - tm_start.tv_sec) * 1000 +
+                   (tm_end.tv_nsec - tm_start.tv_nsec) / 1000000, __ATOMIC_RELAXED);
+  __atomic_store_n(&numb_dirs_read, bld.numb_read, __ATOMIC_RELAXED);
+  __atomic_store_n(&numb_dirs_reused, bld.numb_reused, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&numb_rescans, 1, __ATOMIC_RELAXED);
+  LOG(LOG_TYPE_NIDX, LOG_LEVEL_INFO, "%lu entries in %lu directories: %lu read, %lu reused%s",
+      (unsigned long)bld.numb_ents, (unsigned long)bld.numb_dirs, bld.numb_read, bld.numb_reused,
+      changed ? "" : ", unchanged");
+
+  free(bld.ents);
+  free(bld.dirs);
+  free(bld.olds);
+  free(bld.names);
+  free(bld.pairs);
+  free(bld.grams);
+}
+
+/* Rescan the subtree periodically while this process holds the lock of the index file,
+ * try to take the lock otherwise (its holder may exit) */
+static void *rescan_loop(void *)
+{
+  while (1) {
+    if (!is_builder && flock(fd_lock, LOCK_EX | LOCK_NB) == 0) {
+      is_builder = 1;
+      LOG(LOG_TYPE_NIDX, LOG_LEVEL_INFO, "process %d rescans %s", (int)getpid(), root_path);
+    }
+    if (is_builder)
+      rescan();
+    sleep(INDEX_RESCAN_PERIOD);
+  }
+  return NULL;
+}
+
+/* Enable the index of the file names. */
+int name_index_init(const char *root, const char *filename)
+{
+  char lockname[PATH_MAX];
+  pthread_attr_t attr;
+  pthread_t tid;
+  int rc;
+
+  if (realpath(root, root_path) == NULL) {
+    fprintf(stderr, "Error 94: Failed to resolve the indexed directory %s\n%s\n", root, strerror(errno));
+    return 94;
+  }
+  snprintf(lockname, sizeof(lockname), "%s.lock", filename);
+  if ( (file_idx = strdup(filename)) == NULL ||
+       (fd_lock = open(lockname, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1 ) {
+    fprintf(stderr, "Error 94: Failed to open the lock file of the index %s\n%s\n",
+            lockname, strerror(errno));
+    free(file_idx);
+    file_idx = NULL;
+    return 94;
+  }
+  reload_index();
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&tid, &attr, rescan_loop, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    fprintf(stderr, "Error 94: Failed to start the rescan of the indexed directory\n%s\n", strerror(rc));
+    close(fd_lock);
+    free(file_idx);
+    file_idx = NULL;
+    return 94;
+  }
+  return 0;
+}
+
+/* Find the posting list of the trigram, return NULL if no name has it */
+static const struct idx_gram *find_gram(const struct idx_view *p_idx, uint32_t gram)
+{
+  uint32_t lo = 0, hi = p_idx->p_hdr->numb_grams, mid;
+  while (lo < hi) {
+    mid = lo + (hi - lo) / 2;
+    if (p_idx->grams[mid].gram == gram)
+      return &p_idx->grams[mid];
+    if (p_idx->grams[mid].gram < gram)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return NULL;
+}
+
+/* Search the entries of the index, set the found files */
+static int search_index(const struct idx_view *p_idx, const search_req *p_req,
+                        found_list *p_found, err_inf **pp_errinf)
+{
+  char buf[PATH_MAX];
+  const char *pattern = p_req->pattern ? p_req->pattern : "";
+  const char *key = strrchr(pattern, '/') ? strrchr(pattern, '/') + 1 : pattern;
+  const unsigned char *ukey = (const unsigned char *)key;
+  const struct idx_gram *p_gram, *p_rarest = NULL;
+  const uint32_t *cands = NULL;
+  const char *name, *pos, *path;
+  size_t limit = p_req->limit < LEN_SEARCH_MAX ? p_req->limit : LEN_SEARCH_MAX;
+  size_t numb_cands = p_idx->p_hdr->numb_ents, numb_first = 0, numb_rest = 0, len_paths = 0;
+  size_t i, len;
+  uint32_t ent;
+
+  // Only the entries of the rarest trigram of the name pattern are checked
+  for (i = 0; ukey[i] && ukey[i + 1] && ukey[i + 2]; ++i) {
+    p_gram = find_gram(p_idx, (uint32_t)tolower(ukey[i]) << 16 |
+                       (uint32_t)tolower(ukey[i + 1]) << 8 | (uint32_t)tolower(ukey[i + 2]));
+    if (p_gram == NULL) {
+      numb_cands = 0;
+      break;
+    }
+    if (p_rarest == NULL || p_gram->numb < p_rarest->numb)
+      p_rarest = p_gram;
+  }
+  if (numb_cands && p_rarest) {
+    cands = p_idx->posts + p_rarest->first;
+    numb_cands = p_rarest->numb;
+  }
+
+  // The names starting with the pattern are placed first
+  for (i = 0; i < numb_cands; ++i) {
+    ent = cands ? cands[i] : (uint32_t)i;
+    name = p_idx->names + p_idx->ents[ent].name;
+    if ( (pos = strcasestr(name, key)) == NULL )
+      continue;
+    if (key != pattern &&
+        ((path = make_path(p_idx, ent, root_path, buf, sizeof(buf))) == NULL ||
+         strcasestr(path, pattern) == NULL))
+      continue;
+    p_found->total++;
+    if (pos == name && numb_first < limit)
+      found_first[numb_first++] = ent;
+    else if (pos != name && numb_rest < limit)
+      found_rest[numb_rest++] = ent;
+  }
+
+  // The paths are collected in the buffer, the items point to them when it's filled
+  for (i = 0; i < limit && i < numb_first + numb_rest; ++i) {
+    ent = i < numb_first ? found_first[i] : found_rest[i - numb_first];
+    if ( (path = make_path(p_idx, ent, root_path, buf, sizeof(buf))) == NULL )
+      path = "";
+    len = strlen(path) + 1;
+    if (grow((void **)&paths, &len_paths_max, len_paths + len, 1) != 0) {
+      (void)process_error(pattern, 93, "Failed to allocate memory for the found files", pp_errinf);
+      return 93;
+    }
+    memcpy(paths + len_paths, path, len);
+    offs_paths[i] = len_paths;
+    items[i].type = p_idx->ents[ent].type;
+    len_paths += len;
+  }
+  p_found->items.items_len = (u_int)i;
+  while (i-- > 0)
+    items[i].path = paths + offs_paths[i];
+  p_found->built = p_idx->p_hdr->built;
+  return 0;
+}
+
+/* Search the file names matching the pattern. */
+int name_index_search(const search_req *p_req, found_list *p_found, err_inf **pp_errinf)
+{
+  time_t now = time(NULL);
+  int rc;
+
+  LOG(LOG_TYPE_NIDX, LOG_LEVEL_DEBUG, "search '%s', limit %u", p_req->pattern, p_req->limit);
+  numb_searches++;
+  p_found->root = root_path;
+  p_found->items.items_len = 0;
+  p_found->items.items_val = items;
+  p_found->total = 0;
+  p_found->built = 0;
+
+  errno = 0;
+  if (file_idx == NULL) {
+    (void)process_error(p_req->pattern, 91, "The file name index isn't enabled on the Server", pp_errinf);
+    return 91;
+  }
+  // The index file is replaced by the worker rescanning the subtree
+  if (now != tm_checked) {
+    tm_checked = now;
+    reload_index();
+  }
+
+  pthread_rwlock_rdlock(&lock_curr);
+  if (curr.base == NULL) {
+    pthread_rwlock_unlock(&lock_curr);
+    errno = 0;
+    (void)process_error(root_path, 92, "The file name index isn't built yet, retry later", pp_errinf);
+    return 92;
+  }
+  rc = search_index(&curr.view, p_req, p_found, pp_errinf);
+  pthread_rwlock_unlock(&lock_curr);
+  LOG(LOG_TYPE_NIDX, LOG_LEVEL_DEBUG, "found %llu files", (unsigned long long)p_found->total);
+  return rc;
+}
+
+/* Print the statistics. */
+void name_index_print_stats(FILE *hfile)
+{
+  if (file_idx == NULL)
+    return;
+  pthread_rwlock_rdlock(&lock_curr);
+  fprintf(hfile, "File name index of %s: %u entries in %u directories, %lu bytes; searches: %lu",
+          root_path, curr.base ? curr.view.p_hdr->numb_ents : 0,
+          curr.base ? curr.view.p_hdr->numb_dirs : 0, (unsigned long)curr.len, numb_searches);
+  pthread_rwlock_unlock(&lock_curr);
+  if (is_builder)
+    fprintf(hfile, "; rescans: %lu, the last one: %lu directories read, %lu reused in %ld ms",
+            __atomic_load_n(&numb_rescans, __ATOMIC_RELAXED),
+            __atomic_load_n(&numb_dirs_read, __ATOMIC_RELAXED),
+            __atomic_load_n(&numb_dirs_reused, __ATOMIC_RELAXED),
+            __atomic_load_n(&ms_rescan, __ATOMIC_RELAXED));
+  fprintf(hfile, "\n");
+}
@@ -0,0 +1,68 @@
+#ifndef _NAME_INDEX_H_
+#define _NAME_INDEX_H_
+
+#include <stdio.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The persistent index of the file names under the indexed directory (search_names).
+ *
+ * The index file keeps the names of all the entries of the subtree, grouped by directory &
+ * sorted by name in each one, and the trigram posting lists: for each 3 bytes occurring in the
+ * lowercase names, the ascending numbers of the entries having them. A pattern of 3 bytes and
+ * longer is matched only against the entries of its rarest trigram, a shorter one against all
+ * the names. The file is mapped into memory, so a restarted Server searches at once.
+ *
+ * The subtree is rescanned by a background thread every INDEX_RESCAN_PERIOD seconds. The
+ * directories with the same modification & change time as in the previous index are not read
+ * again, their entries are taken from the index. The subtree is scanned breadth-first, so the
+ * shallower paths have lower numbers. The symbolic links aren't followed and the other file
+ * systems aren't entered.
+ *
+ * The workers of the Server share the index file: the worker holding its lock rescans the
+ * subtree and replaces the file, the others map the new file on the next search.
+ */
+
+// Period of the rescans of the indexed subtree in seconds
+enum { INDEX_RESCAN_PERIOD = 60 };
+
+// Max number of the indexed entries, the rest ones aren't indexed
+enum { NUMB_INDEX_ENTRIES = 1 << 24 };
+
+/* Enable the index of the file names: map the index file if it's of the same directory and
+ * start the background thread rescanning the directory.
+ *
+ * Parameters:
+ *  root      - the indexed directory.
+ *  filename  - the index file, its lock file has the extra suffix ".lock".
+ *
+ * Return value:
+ *  0 on success, >0 if the directory can't be resolved or the thread can't be started
+ *  (the search is answered with an error).
+ */
+int name_index_init(const char *root, const char *filename);
+
+/* Search the file names matching the pattern.
+ *
+ * The found paths are kept in the static memory of this module, they remain valid until
+ * the next call.
+ *
+ * Parameters:
+ *  p_req     - the request: the pattern & the max number of the found paths.
+ *  p_found   - a pointer to the found files to be set.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int name_index_search(const search_req *p_req, found_list *p_found, err_inf **pp_errinf);
+
+/* Print the statistics: the indexed entries, the size of the index, the searches and
+ * the directories read & reused by the last rescan.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void name_index_print_stats(FILE *hfile);
+
+#endif
@@ -0,0 +1,884 @@
+/*
+ * pack_store.c: the pack store of the small files on the Server.
+ * Errors range: 101-104 (reserve 105)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <time.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/uio.h>
+
+#include "pack_store.h"
+#include "data_dirs.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+#define PACK_NONE UINT32_MAX
+
+// The identifier & version of the index file format
+static const char pack_magic[8] = { 'F', 'L', 'T', 'R', 'P', 'A', 'K', '1' };
+
+// The identifier of the record in the pack
+static const uint32_t rec_magic = 0x4b415052;
+
+// The pack file in the index
+struct pack_info {
+  uint32_t seq;               // the number of the pack in its file name, 0 - no pack
+  uint32_t reserved;
+  uint64_t size;              // the size of the records written
+  uint64_t indexed;           //   & of the ones indexed
+  uint64_t live;              //   & of the ones the index points to
+};
+
+// The header of the index file, followed by the entries
+struct pack_header {
+  char magic[8];
+  uint32_t numb_slots;        // number of the entries
+  uint32_t numb_files;        // number of the packed files
+  uint32_t seq_next;          // the number of the next pack
+  uint32_t tail;              // the pack the records are appended to, PACK_NONE - none yet
+  int32_t compactor;          // the process compacting a pack, 0 - none
+  uint32_t reserved;
+  uint64_t numb_compacted;    // number of the packs compacted
+  uint64_t reclaimed;         //   & the bytes reclaimed
+  struct pack_info packs[PACK_FILES_MAX];
+};
+
+// The entry of the index: the packed file
+struct pack_slot {
+  uint64_t hash;              // the hash of the path, 0 - free entry
+  uint64_t offs;              // the offset of the record in the pack
+  uint32_t len;               // the length of the content
+  uint32_t hash_dir;          // the hash of the directory of the file
+  uint16_t pack;              // the pack in the header
+  uint16_t len_path;          // the length of the path
+  uint32_t reserved;
+};
+
+// The header of the record, followed by the path (without NUL) & the content
+struct pack_rec {
+  uint32_t magic;
+  uint16_t len_path;
+  uint16_t reserved;
+  uint32_t len;               // the length of the content
+  uint32_t sum;               // the hash of the path & the content
+  int64_t mtime;              // the time the file was packed
+};
+
+// The descriptors of the packs opened by a thread
+struct pack_fds {
+  int fd[PACK_FILES_MAX];     // -1 - not opened
+  uint32_t seq[PACK_FILES_MAX]; // the pack each descriptor was opened for
+};
+
+static char *prefix = NULL;   // the path prefix of the packed files, NULL - no store
+static size_t len_prefix;     //   & its length without the trailing slashes
+static const char *pack_dir;  // the directory of the packs
+static uint64_t size_max = PACK_SIZE_DEF; // the packed files are smaller
+static uint32_t files_max = PACK_INDEXED_DEF; // max number of the packed files
+static uint32_t numb_slots;   // number of the entries of the index, a power of 2
+static int full = 0;          // 1 if the index was found full, it's reported once it's filled
+
+static int fd_lock = -1;      // the lock file of the workers
+static pthread_mutex_t lock_threads = PTHREAD_MUTEX_INITIALIZER; // the lock of the threads of the worker
+static struct pack_header *hdr = NULL; // the mapped index, NULL - the store isn't opened
+static struct pack_slot *slots;
+static struct pack_fds fds_main, fds_compact; // the packs of the main thread & of the compaction
+
+// The statistics of the worker
+static unsigned long numb_puts, numb_reads, numb_fails;
+
+/* Hash the bytes (FNV-1a), 0 is never returned to mark the free entries */
+static uint64_t hash_bytes(const char *bytes, size_t len)
+{
+  uint64_t hash = 14695981039346656037ull;
+  for (; len > 0; --len, ++bytes)
+    hash = (hash ^ (unsigned char)*bytes) * 1099511628211ull;
+  return hash ? hash : 1;
+}
+
+/* Get the sum of the record: the hash of the path & the content */
+static uint32_t rec_sum(const char *path, size_t len_path, const char *data, size_t len)
+{
+  uint32_t sum = 2166136261u;
+  for (; len_path > 0; --len_path, ++path)
+    sum = (sum ^ (unsigned char)*path) * 16777619u;
+  for (; len > 0; --len, ++data)
+    sum = (sum ^ (unsigned char)*data) * 16777619u;
+  return sum;
+}
+
+/* Get the length of the directory of the path */
+static size_t len_dir(const char *path, size_t len)
+{
+  while (len > 1 && path[len - 1] != '/')
+    --len;
+  return len > 1 ? len - 1 : len;
+}
+
+/* Get the size of the record */
+static uint64_t rec_size(const struct pack_rec *p_rec)
+{
+  return sizeof(struct pack_rec) + p_rec->len_path + (uint64_t)p_rec->len;
+}
+
+/* Check whether the path is under the prefix */
+static int under_prefix(const char *name)
+{
+  return prefix && strncmp(name, prefix, len_prefix) == 0 && name[len_prefix] == '/';
+}
+
+/* Lock the store against the other workers & threads */
+static void lock_store(void)
+{
+  pthread_mutex_lock(&lock_threads);
+  while (flock(fd_lock, LOCK_EX) == -1 && errno == EINTR)
+    ;
+}
+
+/* Unlock the store */
+static void unlock_store(void)
+{
+  (void)flock(fd_lock, LOCK_UN);
+  pthread_mutex_unlock(&lock_threads);
+}
+
+/* Make the path of the pack file */
+static void pack_path_of(uint32_t seq, char *path)
+{
+  snprintf(path, LEN_PATH_MAX + 1, "%s/pack.%08x", pack_dir, seq);
+}
+
+/* Get the descriptor of the pack opened by the thread, the pack is created if `create` is set.
+ * Return -1 on failure (errno is set) */
+static int pack_fd(struct pack_fds *p_fds, uint32_t pack, int create)
+{
+  char path[LEN_PATH_MAX + 1];
+  uint32_t seq = hdr->packs[pack].seq;
+
+  if (p_fds->fd[pack] != -1 && p_fds->seq[pack] == seq)
+    return p_fds->fd[pack];
+  if (p_fds->fd[pack] != -1)
+    close(p_fds->fd[pack]); // the pack was compacted & replaced
+  pack_path_of(seq, path);
+  p_fds->fd[pack] = open(path, O_RDWR | O_CLOEXEC | (create ? O_CREAT : 0), 0644);
+  p_fds->seq[pack] = seq;
+  return p_fds->fd[pack];
+}
+
+/* Find the entry of the path in the index; it's the free entry if the path isn't indexed.
+ * Return 1 if the path is found, 0 otherwise */
+static int find_slot(struct pack_fds *p_fds, const char *name, size_t len, uint64_t hash, uint32_t *p_h)
+{
+  char path[LEN_PATH_MAX];
+  struct pack_slot *p_slot;
+  uint32_t h;
+  int fd;
+
+  for (h = hash & (numb_slots - 1); (p_slot = &slots[h])->hash != 0; h = (h + 1) & (numb_slots - 1))
+    if (p_slot->hash == hash && p_slot->len_path == len &&
+        (fd = pack_fd(p_fds, p_slot->pack, 0)) != -1 &&
+        pread(fd, path, len, (off_t)(p_slot->offs + sizeof(struct pack_rec))) == (ssize_t)len &&
+        memcmp(path, name, len) == 0)
+      break;
+  *p_h = h;
+  return p_slot->hash != 0;
+}
+
+/* Set the entry of the record */
+static void set_slot(uint32_t h, uint64_t hash, const char *name, const struct pack_rec *p_rec,
+                     uint32_t pack, uint64_t offs)
+{
+  struct pack_slot *p_slot = &slots[h];
+  p_slot->offs = offs;
+  p_slot->len = p_rec->len;
+  p_slot->hash_dir = (uint32_t)hash_bytes(name, len_dir(name, p_rec->len_path));
+  p_slot->pack = (uint16_t)pack;
+  p_slot->len_path = p_rec->len_path;
+  p_slot->hash = hash;
+}
+
+/* Remove the entry of the index, the next entries of its cluster are moved to keep them found */
+static void remove_slot(uint32_t h)
+{
+  struct pack_slot slot;
+  uint32_t i, j;
+
+  slots[h].hash = 0;
+  for (i = (h + 1) & (numb_slots - 1); slots[i].hash != 0; i = (i + 1) & (numb_slots - 1)) {
+    slot = slots[i];
+    slots[i].hash = 0;
+    for (j = slot.hash & (numb_slots - 1); slots[j].hash != 0; j = (j + 1) & (numb_slots - 1))
+      ;
+    slots[j] = slot;
+  }
+}
+
+/* Start the new pack to append to. Return 0 or -1 on failure (errno is set) */
+static int start_pack(struct pack_fds *p_fds)
+{
+  uint32_t pack;
+
+  for (pack = 0; pack < PACK_FILES_MAX && hdr->packs[pack].seq != 0; ++pack)
+    ;
+  if (pack == PACK_FILES_MAX) {
+    errno = ENOSPC;
+    return -1;
+  }
+  memset(&hdr->packs[pack], 0, sizeof(struct pack_info));
+  hdr->packs[pack].seq = hdr->seq_next;
+  if (pack_fd(p_fds, pack, 1) == -1) {
+    hdr->packs[pack].seq = 0;
+    return -1;
+  }
+  hdr->seq_next++;
+  hdr->tail = pack;
+  LOG(LOG_TYPE_PACK, LOG_LEVEL_INFO, "pack %08x was started", hdr->packs[pack].seq);
+  return 0;
+}
+
+/* Append the record to the tail pack, it's not indexed. Return 0, 102 if no pack can be
+ * started or 103 for the writing error (errno is set) */
+static int append_rec(struct pack_fds *p_fds, const struct pack_rec *p_rec, const char *name,
+                      const char *data, uint32_t *p_pack, uint64_t *p_offs)
+{
+  struct iovec iov[3] = { { (void *)p_rec, sizeof(struct pack_rec) },
+                          { (void *)name, p_rec->len_path }, { (void *)data, p_rec->len } };
+  struct pack_info *p_info;
+  uint64_t size = rec_size(p_rec);
+  ssize_t written;
+  int fd;
+
+  if ( (hdr->tail == PACK_NONE || hdr->packs[hdr->tail].size + size > PACK_FILE_MAX) &&
+       start_pack(p_fds) != 0 )
+    return 102;
+  p_info = &hdr->packs[hdr->tail];
+  if ( (fd = pack_fd(p_fds, hdr->tail, 1)) == -1 )
+    return 103;
+  if ( (written = pwritev(fd, iov, 3, (off_t)p_info->size)) != (ssize_t)size ) {
+    if (written != -1)
+      errno = ENOSPC;
+    (void)ftruncate(fd, (off_t)p_info->size); // the partial record is cut off
+    return 103;
+  }
+  *p_pack = hdr->tail;
+  *p_offs = p_info->size;
+  p_info->size += size;
+  p_info->indexed = p_info->size;
+  return 0;
+}
+
+/* Read & check the record at the offset of the pack up to `end`; the path is read into `path`,
+ * the content is read into the allocated `*p_data` if it's not NULL.
+ * Return 0 or -1 if there's no valid record */
+static int read_rec(int fd, uint64_t offs, uint64_t end, struct pack_rec *p_rec, char *path, char **p_data)
+{
+  char *data;
+
+  if (pread(fd, p_rec, sizeof(struct pack_rec), (off_t)offs) != sizeof(struct pack_rec) ||
+      p_rec->magic != rec_magic || p_rec->len_path == 0 || p_rec->len_path > LEN_PATH_MAX ||
+      offs + rec_size(p_rec) > end ||
+      pread(fd, path, p_rec->len_path, (off_t)(offs + sizeof(struct pack_rec))) != p_rec->len_path)
+    return -1;
+  path[p_rec->len_path] = '\0';
+  if ( (data = malloc(p_rec->len + 1)) == NULL )
+    return -1;
+  if (pread(fd, data, p_rec->len, (off_t)(offs + sizeof(struct pack_rec) + p_rec->len_path)) != p_rec->len ||
+      rec_sum(path, p_rec->len_path, data, p_rec->len) != p_rec->sum) {
+    free(data);
+    return -1;
+  }
+  if (p_data)
+    *p_data = data;
+  else
+    free(data);
+  return 0;
+}
+
+/* Index the records of the pack written after its last index update, the broken tail is cut off.
+ * Return 0 or -1 if the pack can't be opened */
+static int recover_pack(uint32_t pack)
+{
+  struct pack_info *p_info = &hdr->packs[pack];
+  struct pack_rec rec;
+  struct stat statbuf;
+  char path[LEN_PATH_MAX + 1];
+  uint64_t offs, hash, end, numb_unindexed = 0;
+  uint32_t h;
+  int fd;
+
+  if ( (fd = pack_fd(&fds_main, pack, 0)) == -1 || fstat(fd, &statbuf) != 0 )
+    return -1;
+
+  // The mapped index may reach the disk before the records after a crash: the entries beyond
+  // the end of the pack are removed, the records after the last entry left are indexed again
+  if ((uint64_t)statbuf.st_size < p_info->indexed) {
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_WARN, "pack %08x has %llu of %llu bytes indexed", p_info->seq,
+        (unsigned long long)statbuf.st_size, (unsigned long long)p_info->indexed);
+    p_info->indexed = 0;
+    for (h = 0; h < numb_slots; )
+      if (slots[h].hash == 0 || slots[h].pack != pack)
+        ++h;
+      else if ( (end = slots[h].offs + sizeof(struct pack_rec) + slots[h].len_path + slots[h].len) >
+                (uint64_t)statbuf.st_size ) {
+        p_info->live -= end - slots[h].offs;
+        hdr->numb_files--;
+        remove_slot(h); // the next entry may be moved here
+      }
+      else {
+        if (end > p_info->indexed)
+          p_info->indexed = end;
+        ++h;
+      }
+  }
+
+  for (offs = p_info->indexed; offs < (uint64_t)statbuf.st_size; offs += rec_size(&rec)) {
+    if (read_rec(fd, offs, (uint64_t)statbuf.st_size, &rec, path, NULL) != 0)
+      break;
+    // The second record of the same path is dead
+    hash = hash_bytes(path, rec.len_path);
+    if (find_slot(&fds_main, path, rec.len_path, hash, &h))
+      continue;
+    if (hdr->numb_files >= files_max)
+      numb_unindexed++;
+    else {
+      set_slot(h, hash, path, &rec, pack, offs);
+      hdr->numb_files++;
+      p_info->live += rec_size(&rec);
+    }
+  }
+  if (numb_unindexed)
+    fprintf(stderr, "The index of the packs is full at %u files, %llu files of pack %08x aren't indexed\n",
+            files_max, (unsigned long long)numb_unindexed, p_info->seq);
+  if (offs < (uint64_t)statbuf.st_size) {
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_WARN, "pack %08x is cut off at %llu of %llu bytes", p_info->seq,
+        (unsigned long long)offs, (unsigned long long)statbuf.st_size);
+    (void)ftruncate(fd, (off_t)offs);
+  }
+  if (offs > p_info->indexed)
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_INFO, "pack %08x: %llu bytes were indexed again", p_info->seq,
+        (unsigned long long)(offs - p_info->indexed));
+  p_info->size = p_info->indexed = offs;
+  return 0;
+}
+
+/* Add the pack files of the directory missing in the index */
+static void add_packs(void)
+{
+  struct dirent *p_de;
+  unsigned int seq;
+  uint32_t pack, free_pack;
+  char tail;
+  DIR *p_dir;
+
+  if ( (p_dir = opendir(pack_dir)) == NULL )
+    return;
+  while ( (p_de = readdir(p_dir)) != NULL ) {
+    if (sscanf(p_de->d_name, "pack.%8x%c", &seq, &tail) != 1 || seq == 0)
+      continue;
+    for (pack = 0, free_pack = PACK_NONE; pack < PACK_FILES_MAX && hdr->packs[pack].seq != seq; ++pack)
+      if (hdr->packs[pack].seq == 0 && free_pack == PACK_NONE)
+        free_pack = pack;
+    if (pack < PACK_FILES_MAX || free_pack == PACK_NONE)
+      continue;
+    memset(&hdr->packs[free_pack], 0, sizeof(struct pack_info));
+    hdr->packs[free_pack].seq = seq;
+    if (seq >= hdr->seq_next)
+      hdr->seq_next = seq + 1;
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_INFO, "pack %08x was added to the index", seq);
+  }
+  closedir(p_dir);
+}
+
+/* Open the index: check it & index the records missed, it's rebuilt if it's invalid or
+ * a pack is lost. Return 0 or -1 on failure (errno is set) */
+static int open_index(int fd_idx)
+{
+  size_t size = sizeof(struct pack_header) + (size_t)numb_slots * sizeof(struct pack_slot);
+  struct stat statbuf;
+  void *p_map;
+  uint32_t pack;
+  int fresh = 0;
+
+  if (fstat(fd_idx, &statbuf) != 0 ||
+      ( (fresh = (uint64_t)statbuf.st_size != size) && ftruncate(fd_idx, (off_t)size) != 0 ) ||
+      (p_map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_idx, 0)) == MAP_FAILED)
+    return -1;
+  hdr = p_map;
+  slots = (struct pack_slot *)(hdr + 1);
+
+  while (1) {
+    if (fresh || memcmp(hdr->magic, pack_magic, sizeof(pack_magic)) != 0 || hdr->numb_slots != numb_slots) {
+      fresh = 1;
+      LOG(LOG_TYPE_PACK, LOG_LEVEL_WARN, "the index of the packs in %s is built", pack_dir);
+      memset(p_map, 0, size);
+      memcpy(hdr->magic, pack_magic, sizeof(pack_magic));
+      hdr->numb_slots = numb_slots;
+      hdr->seq_next = 1;
+      hdr->tail = PACK_NONE;
+    }
+    add_packs();
+    for (pack = 0; pack < PACK_FILES_MAX; ++pack)
+      if (hdr->packs[pack].seq != 0 && recover_pack(pack) != 0)
+        break;
+    if (pack == PACK_FILES_MAX)
+      break;
+    // The lost pack can't be removed from the entries, they're built again without it
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_ERROR, "pack %08x is lost: %s", hdr->packs[pack].seq, strerror(errno));
+    if (fresh)
+      return -1;
+    fresh = 1;
+  }
+  if (hdr->tail != PACK_NONE && hdr->packs[hdr->tail].seq == 0)
+    hdr->tail = PACK_NONE;
+  if (hdr->compactor != 0 && kill(hdr->compactor, 0) != 0 && errno == ESRCH)
+    hdr->compactor = 0; // the compaction is resumed by another process
+  return 0;
+}
+
+/* Move the record at the offset of the compacted pack to the tail one if it's live.
+ * Return 0 or >0 on failure */
+static int move_rec(uint32_t pack, uint64_t offs, uint64_t *p_size)
+{
+  struct pack_rec rec;
+  char path[LEN_PATH_MAX + 1], *data = NULL;
+  uint64_t hash, offs_new;
+  uint32_t h, pack_new;
+  int fd, rc = 0;
+
+  if ( (fd = pack_fd(&fds_compact, pack, 0)) == -1 ||
+       read_rec(fd, offs, hdr->packs[pack].size, &rec, path, &data) != 0 ) {
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_ERROR, "the record at %llu of pack %08x can't be read",
+        (unsigned long long)offs, hdr->packs[pack].seq);
+    return 104;
+  }
+  *p_size = rec_size(&rec);
+  hash = hash_bytes(path, rec.len_path);
+  if (find_slot(&fds_compact, path, rec.len_path, hash, &h) && slots[h].pack == pack && slots[h].offs == offs) {
+    if ( (rc = append_rec(&fds_compact, &rec, path, data, &pack_new, &offs_new)) == 0 ) {
+      set_slot(h, hash, path, &rec, pack_new, offs_new);
+      hdr->packs[pack].live -= *p_size;
+      hdr->packs[pack_new].live += *p_size;
+    }
+    else
+      LOG(LOG_TYPE_PACK, LOG_LEVEL_ERROR, "%s can't be moved: %s", path, strerror(errno));
+  }
+  free(data);
+  return rc;
+}
+
+/* Compact the pack with the most dead space, if it's at least PACK_DEAD_MIN percent */
+static void compact(void)
+{
+  char path[LEN_PATH_MAX + 1];
+  struct pack_info *p_info;
+  uint64_t offs, size = 0, end, dead, dead_max = 0;
+  uint32_t pack, victim = PACK_NONE, seq;
+  int rc = 0;
+
+  // One process compacts at a time
+  lock_store();
+  if (hdr->compactor != 0 && hdr->compactor != getpid() && kill(hdr->compactor, 0) == 0) {
+    unlock_store();
+    return;
+  }
+  for (pack = 0; pack < PACK_FILES_MAX; ++pack) {
+    p_info = &hdr->packs[pack];
+    dead = p_info->size - p_info->live;
+    if (p_info->seq != 0 && pack != hdr->tail && dead * 100 >= p_info->size * PACK_DEAD_MIN &&
+        dead > dead_max) {
+      victim = pack;
+      dead_max = dead;
+    }
+  }
+  hdr->compactor = victim == PACK_NONE ? 0 : getpid();
+  if (victim == PACK_NONE) {
+    unlock_store();
+    return;
+  }
+  p_info = &hdr->packs[victim];
+  seq = p_info->seq;
+  end = p_info->size;
+  unlock_store();
+  LOG(LOG_TYPE_PACK, LOG_LEVEL_INFO, "pack %08x is compacted: %llu of %llu bytes are dead", seq,
+      (unsigned long long)dead_max, (unsigned long long)end);
+
+  // The live records are moved one by one, the requests are served in between
+  for (offs = 0; offs < end && rc == 0; offs += size) {
+    lock_store();
+    rc = p_info->seq == seq ? move_rec(victim, offs, &size) : -1;
+    unlock_store();
+  }
+
+  // The moved records are durable before the pack is removed
+  for (pack = 0; pack < PACK_FILES_MAX && rc == 0; ++pack)
+    if (pack != victim && fds_compact.fd[pack] != -1 && fdatasync(fds_compact.fd[pack]) != 0) {
+      LOG(LOG_TYPE_PACK, LOG_LEVEL_ERROR, "pack %08x can't be flushed: %s", fds_compact.seq[pack], strerror(errno));
+      rc = 103;
+    }
+
+  lock_store();
+  if (rc == 0 && p_info->seq == seq && p_info->live == 0) {
+    pack_path_of(seq, path);
+    (void)unlink(path);
+    hdr->numb_compacted++;
+    hdr->reclaimed += p_info->size;
+    memset(p_info, 0, sizeof(struct pack_info));
+    LOG(LOG_TYPE_PACK, LOG_LEVEL_INFO, "pack %08x was removed", seq);
+  }
+  hdr->compactor = 0;
+  unlock_store();
+}
+
+/* Check the dead space of the packs periodically */
+static void *compact_loop(void *)
+{
+  while (1) {
+    sleep(PACK_COMPACT_PERIOD);
+    compact();
+  }
+  return NULL;
+}
+
+/* Set the pack store. */
+int pack_store_set(char *spec)
+{
+  struct stat statbuf;
+  char *p_dir, *p_size, *p_files = NULL, *p_end;
+  unsigned long size, files;
+
+  if ( (p_dir = strchr(spec, '=')) == NULL || spec[0] != '/' ) {
+    fprintf(stderr, "!--Error 6: Invalid pack store, expected 'prefix=dir[,size[,files]]': %s\n\n", spec);
+    return -1;
+  }
+  *p_dir++ = '\0';
+  if ( (p_size = strchr(p_dir, ',')) != NULL ) {
+    *p_size++ = '\0';
+    if ( (p_files = strchr(p_size, ',')) != NULL )
+      *p_files++ = '\0';
+    errno = 0;
+    size = strtoul(p_size, &p_end, 10);
+    if (errno || *p_end != '\0' || size == 0 || size > PACK_FILE_MAX / 1024 / 16) {
+      fprintf(stderr, "!--Error 6: Invalid threshold of the packed files, KiB: %s\n\n", p_size);
+      return -1;
+    }
+    size_max = (uint64_t)size * 1024;
+  }
+  if (p_files) {
+    errno = 0;
+    files = strtoul(p_files, &p_end, 10);
+    if (errno || *p_end != '\0' || files == 0 || files > PACK_INDEXED_MAX) {
+      fprintf(stderr, "!--Error 6: Invalid max number of the packed files: %s\n\n", p_files);
+      return -1;
+    }
+    files_max = (uint32_t)files;
+  }
+  // The index is used up to 3/4 of its entries
+  for (numb_slots = 4; numb_slots / 4 * 3 < files_max; numb_slots *= 2)
+    ;
+  for (len_prefix = strlen(spec); len_prefix > 0 && spec[len_prefix - 1] == '/'; --len_prefix)
+    spec[len_prefix - 1] = '\0';
+  if (len_prefix == 0) {
+    fprintf(stderr, "!--Error 6: Invalid prefix of the pack store: /\n\n");
+    return -1;
+  }
+  if (p_dir[0] != '/' || stat(p_dir, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode)) {
+    fprintf(stderr, "!--Error 6: Invalid directory of the packs: %s\n\n", p_dir);
+    return -1;
+  }
+  prefix = spec;
+  pack_dir = p_dir;
+  return 0;
+}
+
+/* Open the pack store set by pack_store_set(). */
+int pack_store_init(void)
+{
+  char path[LEN_PATH_MAX + 1];
+  pthread_attr_t attr;
+  pthread_t tid;
+  int fd_idx, i, rc;
+
+  if (prefix == NULL)
+    return 0;
+  for (i = 0; i < PACK_FILES_MAX; ++i)
+    fds_main.fd[i] = fds_compact.fd[i] = -1;
+
+  snprintf(path, sizeof(path), "%s/pack.lock", pack_dir);
+  if ( (fd_lock = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1 ) {
+    fprintf(stderr, "Error 101: Failed to open the lock file of the packs %s\n%s\n", path, strerror(errno));
+    prefix = NULL;
+    return 101;
+  }
+  snprintf(path, sizeof(path), "%s/pack.idx", pack_dir);
+  lock_store();
+  if ( (fd_idx = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644)) == -1 || open_index(fd_idx) != 0 ) {
+    fprintf(stderr, "Error 101: Failed to open the index of the packs %s\n%s\n", path, strerror(errno));
+    unlock_store();
+    if (fd_idx != -1)
+      close(fd_idx);
+    hdr = NULL;
+    prefix = NULL;
+    return 101;
+  }
+  unlock_store();
+  close(fd_idx); // the mapping is kept
+
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&tid, &attr, compact_loop, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) // the store works without the compaction
+    fprintf(stderr, "Error 101: Failed to start the compaction of the packs\n%s\n", strerror(rc));
+  LOG(LOG_TYPE_PACK, LOG_LEVEL_INFO, "the files of %s under %llu bytes are packed into %s: %u files",
+      prefix, (unsigned long long)size_max, pack_dir, hdr->numb_files);
+  return 0;
+}
+
+/* Check whether the file is stored in the packs. */
+int pack_store_wanted(const char *name, uint64_t size)
+{
+  if (!hdr || size >= size_max || !under_prefix(name) || strlen(name) > LEN_PATH_MAX)
+    return 0;
+  // The full index is reported once, till the files are removed from it
+  if (__atomic_load_n(&hdr->numb_files, __ATOMIC_RELAXED) < files_max) {
+    full = 0;
+    return 1;
+  }
+  if (!full) {
+    full = 1;
+    fprintf(stderr, "The index of the packs is full at %u files, the files of %s are stored in the file system\n",
+            files_max, prefix);
+  }
+  return 0;
+}
+
+/* Check whether the file is in the packs. */
+int pack_store_exists(const char *name, uint64_t *p_size)
+{
+  size_t len = strlen(name);
+  uint32_t h;
+  int found;
+
+  if (!hdr || !under_prefix(name) || len > LEN_PATH_MAX)
+    return 0;
+  lock_store();
+  if ( (found = find_slot(&fds_main, name, len, hash_bytes(name, len), &h)) && p_size )
+    *p_size = slots[h].len;
+  unlock_store();
+  return found;
+}
+
+/* Append the new file to the current pack & index it. */
+int pack_store_put(const char *name, const t_flcont *p_flcont, char *pack_path, err_inf **pp_errinf)
+{
+  char path[LEN_PATH_MAX + 1];
+  struct pack_rec rec = { rec_magic, 0, 0, 0, 0, 0 };
+  size_t len = strlen(name);
+  uint64_t hash = hash_bytes(name, len), offs;
+  uint32_t h, pack;
+  int rc = 0;
+
+  // The packed file doesn't replace the one in the file system
+  if (access(data_dirs_path(name, 0, path, NULL), F_OK) == 0) {
+    errno = EEXIST;
+    (void)process_error(name, 11, "The file already exists or could not be opened in write binary mode", pp_errinf);
+    return 11;
+  }
+  rec.len_path = (uint16_t)len;
+  rec.len = p_flcont->t_flcont_len;
+  rec.sum = rec_sum(name, len, p_flcont->t_flcont_val, p_flcont->t_flcont_len);
+  rec.mtime = time(NULL);
+
+  lock_store();
+  if (find_slot(&fds_main, name, len, hash, &h)) {
+    errno = EEXIST;
+    rc = 11;
+  }
+  else if (hdr->numb_files >= files_max) {
+    errno = ENOSPC;
+    rc = 102;
+  }
+  else if ( (rc = append_rec(&fds_main, &rec, name, p_flcont->t_flcont_val, &pack, &offs)) == 0 ) {
+    set_slot(h, hash, name, &rec, pack, offs);
+    hdr->numb_files++;
+    hdr->packs[pack].live += rec_size(&rec);
+    pack_path_of(hdr->packs[pack].seq, pack_path);
+  }
+  unlock_store();
+
+  if (rc != 0) {
+    numb_fails++;
+    (void)process_error(name, rc, rc == 11 ? "The file already exists in the packs" :
+                        rc == 102 ? "No room for the file in the packs" : "Failed to write to the pack", pp_errinf);
+    return rc;
+  }
+  numb_puts++;
+  LOG(LOG_TYPE_PACK, LOG_LEVEL_DEBUG, "%s was packed into %s at %llu", name, pack_path, (unsigned long long)offs);
+  return 0;
+}
+
+/* Read the chunk of the packed file. */
+int pack_store_read(const char *name, uint64_t offs, size_t size, t_flcont *p_flcont,
+                    int *p_last, err_inf **pp_errinf)
+{
+  struct pack_slot slot;
+  struct pack_rec rec;
+  size_t len = strlen(name);
+  uint32_t h;
+  int fd = -1, found;
+  char *buf;
+
+  if (!hdr || !under_prefix(name) || len > LEN_PATH_MAX)
+    return -1;
+  lock_store();
+  if ( (found = find_slot(&fds_main, name, len, hash_bytes(name, len), &h)) ) {
+    slot = slots[h];
+    fd = pack_fd(&fds_main, slot.pack, 0);
+  }
+  unlock_store();
+  if (!found)
+    return -1;
+
+  // The pack stays readable by its descriptor even if it's compacted meanwhile
+  if (fd == -1 || offs > slot.len) {
+    if (fd != -1)
+      errno = 0;
+    (void)process_error(name, 104, fd == -1 ? "Failed to open the pack of the file" :
+                        "Invalid offset of the file chunk", pp_errinf);
+    return 104;
+  }
+  if (slot.len - offs < size)
+    size = (size_t)(slot.len - offs);
+  if ( (buf = malloc(size + 1)) == NULL ) {
+    (void)process_error(name, 13, "Failed to allocate memory for the file content", pp_errinf);
+    return 13;
+  }
+  if (pread(fd, buf, size, (off_t)(slot.offs + sizeof(struct pack_rec) + slot.len_path + offs)) != (ssize_t)size) {
+    free(buf);
+    (void)process_error(name, 104, "Failed to read the pack of the file", pp_errinf);
+    return 104;
+  }
+
+  // The whole file is checked by the sum of its record
+  if (offs == 0 && size == slot.len &&
+      (pread(fd, &rec, sizeof(rec), (off_t)slot.offs) != sizeof(rec) ||
+       rec.sum != rec_sum(name, len, buf, size))) {
+    free(buf);
+    errno = 0;
+    numb_fails++;
+    (void)process_error(name, 104, "The record of the file in the pack is corrupt", pp_errinf);
+    return 104;
+  }
+  p_flcont->t_flcont_val = buf;
+  p_flcont->t_flcont_len = size;
+  *p_last = (offs + size >= slot.len);
+  numb_reads++;
+  return 0;
+}
+
+/* Add the entry of the packed file to the scanned entries. Return 0 or 1 for the allocation failure */
+static int add_entry(struct ls_entries *p_ents, const char *name, const struct pack_rec *p_rec)
+{
+  size_t len = strlen(name) + 1, numb;
+  struct ls_entry *p_ent;
+  void *p_new;
+
+  if (p_ents->numb == p_ents->numb_max) {
+    numb = p_ents->numb_max * 2 + 16;
+    if ( (p_new = realloc(p_ents->items, numb * sizeof(struct ls_entry))) == NULL )
+      return 1;
+    p_ents->items = p_new;
+    p_ents->numb_max = numb;
+  }
+  if (p_ents->len_names + len > p_ents->len_names_max) {
+    numb = (p_ents->len_names + len) * 2;
+    if ( (p_new = realloc(p_ents->names, numb)) == NULL )
+      return 1;
+    p_ents->names = p_new;
+    p_ents->len_names_max = numb;
+  }
+  p_ent = &p_ents->items[p_ents->numb++];
+  memset(p_ent, 0, sizeof(struct ls_entry));
+  p_ent->offs_name = p_ents->len_names;
+  p_ent->mode = S_IFREG | 0644;
+  p_ent->uid = getuid();
+  p_ent->gid = getgid();
+  p_ent->size = p_rec->len;
+  p_ent->mtime = p_rec->mtime;
+  memcpy(p_ents->names + p_ents->len_names, name, len);
+  p_ents->len_names += len;
+  return 0;
+}
+
+/* Add the packed files of the directory to its scanned entries. */
+int pack_store_scan(const char *dirname, struct ls_entries *p_ents)
+{
+  char path[LEN_PATH_MAX + 1];
+  struct pack_rec rec;
+  size_t len = strlen(dirname);
+  uint32_t hash_dir, h;
+  int fd, rc = 0;
+
+  while (len > 1 && dirname[len - 1] == '/')
+    --len;
+  if (!hdr || len < len_prefix || strncmp(dirname, prefix, len_prefix) != 0 ||
+      (dirname[len_prefix] != '/' && len_prefix != len))
+    return 0;
+  hash_dir = (uint32_t)hash_bytes(dirname, len);
+
+  lock_store();
+  for (h = 0; h < numb_slots && rc == 0; ++h)
+    if (slots[h].hash != 0 && slots[h].hash_dir == hash_dir &&
+        (fd = pack_fd(&fds_main, slots[h].pack, 0)) != -1 &&
+        pread(fd, &rec, sizeof(rec), (off_t)slots[h].offs) == sizeof(rec) &&
+        pread(fd, path, slots[h].len_path, (off_t)(slots[h].offs + sizeof(rec))) == slots[h].len_path &&
+        len_dir(path, slots[h].len_path) == len && memcmp(path, dirname, len) == 0) {
+      path[slots[h].len_path] = '\0';
+      rc = add_entry(p_ents, path + len + 1, &rec);
+    }
+  unlock_store();
+  return rc;
+}
+
+/* Get the generation of the packed listings. */
+uint32_t pack_store_gen(void)
+{
+  return hdr ? __atomic_load_n(&hdr->numb_files, __ATOMIC_RELAXED) : 0;
+}
+
+/* Print the statistics. */
+void pack_store_print_stats(FILE *hfile)
+{
+  uint64_t size = 0, live = 0;
+  int pack, numb_packs = 0;
+
+  if (!hdr)
+    return;
+  lock_store();
+  for (pack = 0; pack < PACK_FILES_MAX; ++pack)
+    if (hdr->packs[pack].seq != 0) {
+      numb_packs++;
+      size += hdr->packs[pack].size;
+      live += hdr->packs[pack].live;
+    }
+  fprintf(hfile, "Pack store (%s under %llu bytes in %s): packs: %d, files: %u of %u, live bytes: %llu, "
+          "dead bytes: %llu, packs compacted: %llu, bytes reclaimed: %llu; files packed: %lu, "
+          "read: %lu, failed: %lu\n", prefix, (unsigned long long)size_max, pack_dir, numb_packs,
+          hdr->numb_files, files_max, (unsigned long long)live, (unsigned long long)(size - live),
+          (unsigned long long)hdr->numb_compacted, (unsigned long long)hdr->reclaimed,
+          numb_puts, numb_reads, numb_fails);
+  unlock_store();
+}
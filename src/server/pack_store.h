@@ -0,0 +1,153 @@
+#ifndef _PACK_STORE_H_
+#define _PACK_STORE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../rpcgen/fltr.h"
+#include "../common/fs_opers.h"
+
+/*
+ * The pack store of the small files on the Server.
+ *
+ * The files under the pack prefix smaller than the threshold are not created one by one:
+ * each of them is appended as a record (a header, the path & the content) to the current
+ * pack file of up to PACK_FILE_MAX bytes, and its path is put to the index: the hash table
+ * (path hash -> pack, offset, length) in the file mapped by all the workers, sized for the max
+ * number of the packed files set (PACK_INDEXED_DEF by default); the files beyond it are stored
+ * in the file system. So the upload of a small file costs one write instead of the creation of a file,
+ * and the download reads the content straight from the pack. The packed files are listed
+ * with the directory they are in, if it exists on the file system.
+ *
+ * The workers share the index under a lock file (flock) and their threads under a mutex.
+ * The records written after the last index update (e.g. the index pages lost by a power
+ * failure) are indexed again when the store is opened, the broken tail is truncated; the entries
+ * of the records lost by the pack while its index pages were written are removed.
+ * The whole file read from its pack is checked by the sum of its record.
+ * The files are never overwritten, as the Uploads of the file system; the space of the
+ * replaced records (found twice by the recovery) & of the failed appends is reclaimed by
+ * the background compaction: the live records of a pack with at least PACK_DEAD_MIN percent
+ * of the dead space are copied to the current pack, and the pack is removed.
+ */
+
+// Default threshold of the packed file size, bytes
+enum { PACK_SIZE_DEF = 65536 };
+
+// Max size of the pack file
+enum { PACK_FILE_MAX = 256 * 1048576 };
+
+// Max number of the pack files
+enum { PACK_FILES_MAX = 256 };
+
+// Default & max number of the packed files, the index has the power of 2 entries,
+// up to 3/4 of them are used
+enum { PACK_INDEXED_DEF = 393216, PACK_INDEXED_MAX = 3 << 24 };
+
+// Min share of the dead space of the compacted pack, percent
+enum { PACK_DEAD_MIN = 50 };
+
+// Period of the compaction check, seconds
+enum { PACK_COMPACT_PERIOD = 10 };
+
+/* Set the pack store: the path prefix of the packed files, the directory of the packs & the threshold.
+ *
+ * Parameters:
+ *  spec - the store 'prefix=dir[,size[,files]]': the files under the path prefix smaller than
+ *         `size` KiB (default: PACK_SIZE_DEF bytes) are packed into the existing directory `dir`,
+ *         up to `files` of them (default: PACK_INDEXED_DEF); the index is rebuilt from the packs
+ *         when the number is changed; it's modified by the parsing & must be kept.
+ *
+ * Return value:
+ *  0 on success, -1 if the store is invalid (the error is printed to STDERR).
+ */
+int pack_store_set(char *spec);
+
+/* Open the pack store set by pack_store_set(): map the index, index the records written
+ * after its last update, start the thread of the compaction.
+ *
+ * Return value:
+ *  0 on success (or if no store is set), >0 on failure (the files aren't packed then).
+ */
+int pack_store_init(void);
+
+/* Check whether the file is stored in the packs.
+ *
+ * Parameters:
+ *  name - the path of the file.
+ *  size - the size of the file.
+ *
+ * Return value:
+ *  1 if the file goes to the packs, 0 otherwise (it's stored in the file system).
+ */
+int pack_store_wanted(const char *name, uint64_t size);
+
+/* Check whether the file is in the packs.
+ *
+ * Parameters:
+ *  name   - the path of the file.
+ *  p_size - a pointer to the size of the packed file to be set, or NULL.
+ *
+ * Return value:
+ *  1 if it's packed, 0 otherwise.
+ */
+int pack_store_exists(const char *name, uint64_t *p_size);
+
+/* Append the new file to the current pack & index it.
+ *
+ * Parameters:
+ *  name      - the path of the file, it must be wanted by pack_store_wanted().
+ *  p_flcont  - a pointer to the file content.
+ *  pack_path - the buffer of LEN_PATH_MAX + 1 bytes for the path of the pack file,
+ *              it's flushed to make the file durable.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`), e.g. if
+ *  the file exists in the packs or in the file system.
+ */
+int pack_store_put(const char *name, const t_flcont *p_flcont, char *pack_path, err_inf **pp_errinf);
+
+/* Read the chunk of the packed file as pread_file_chunk().
+ *
+ * Parameters:
+ *  name      - the path of the file.
+ *  offs      - the offset of the chunk.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to the content to be set, it must be empty.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the file isn't packed (it's read from the file system then),
+ *  >0 on failure, e.g. the whole file doesn't match its sum (error code is stored in `(*pp_errinf)->num`).
+ */
+int pack_store_read(const char *name, uint64_t offs, size_t size, t_flcont *p_flcont,
+                    int *p_last, err_inf **pp_errinf);
+
+/* Add the packed files of the directory to its scanned entries.
+ *
+ * Parameters:
+ *  dirname - the path of the directory.
+ *  p_ents  - a pointer to the entries filled by scan_dir().
+ *
+ * Return value:
+ *  0 on success, 1 for the memory allocation failure.
+ */
+int pack_store_scan(const char *dirname, struct ls_entries *p_ents);
+
+/* Get the generation of the packed listings: the number of the packed files, as the packed
+ * files are only added while the Server runs.
+ *
+ * Return value:
+ *  The generation, 0 if there's no store.
+ */
+uint32_t pack_store_gen(void);
+
+/* Print the statistics: the packs, the files, the live & dead bytes, the compactions.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void pack_store_print_stats(FILE *hfile);
+
+#endif
@@ -3,16 +3,47 @@
  * Errors range: 1-5 (reserve 6-10)
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+#include <rpc/pmap_clnt.h>
 #include "../common/mem_opers.h" /* for the memory manipulations */
 #include "../common/fs_opers.h" /* for working with the File System */
 #include "../common/file_opers.h" /* for the files manipulations */
 #include "../common/logging.h" /* for logging */
+#include "svc_loop.h" /* for the event-driven loop */
+#include "svc_sched.h" /* for the requests scheduler */
+#include "svc_admit.h" /* for the admission control */
+#include "upld_sess.h" /* for the chunked uploads */
+#include "cont_cache.h" /* for the content cache of the downloaded files */
+#include "fd_cache.h" /* for the descriptors of the downloaded files */
+#include "read_ahead.h" /* for the read-ahead of the downloaded files */
+#include "io_ring.h" /* for the reading & writing of the files through io_uring */
+#include "direct_io.h" /* for the transfers of the large files bypassing the page cache */
+#include "durable.h" /* for the durability of the uploaded files */
+#include "data_dirs.h" /* for the storage layout over the data directories */
+#include "dev_queue.h" /* for the per-device I/O queues */
+#include "pack_store.h" /* for the pack store of the small files */
+#include "store_back.h" /* for the pluggable storage backends */
+#include "zip_store.h" /* for the compressed-at-rest storage */
+#include "dir_cache.h" /* for the cache of the directory listings */
+#include "req_flight.h" /* for the coalescing of the identical requests */
+#include "dir_page.h" /* for the paginated directory listing */
+#include "dir_delta.h" /* for the versioned directory listings */
+#include "dir_usage.h" /* for the disk usage of the directories */
+#include "name_index.h" /* for the search of the file names */
 
 extern int errno; // global system error number
 
+// The RPC dispatcher generated by rpcgen in fltr_svc.c
+extern void fltrprog_1(struct svc_req *rqstp, SVCXPRT *transp);
+
 // NOTE: it was made the same approach for all the error messages: the error messages with
 // the short info should be provided to the client through error info object, and the error
 // messages with the extended info should be printed to STDERR on the server side only.
@@ -26,12 +57,15 @@ static void print_error(const char *oper_type, const struct err_inf *p_errinf)
 
 // The main RPC function to Upload a file.
 // Note: file_inf and err_inf objects will be auto-freed by xdr_free() at function end.
-err_inf * upload_file_1_svc(file_inf *file_upld, struct svc_req *)
+err_inf * upload_file_1_svc(file_inf *file_upld, struct svc_req *rqstp)
 {
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
   static err_inf ret_err; // returned variable, must be static
   static err_inf *p_ret_err = &ret_err; // pointer to a returned static variable
   FILE *hfile;            // the file handler
+  char path[LEN_PATH_MAX + 1]; // the path in the data directory of the storage layout
+  const char *flname;     // the path of the saved file
+  int rc;
   LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO,
       "process the Upload file request, save file as: %s", file_upld->name);
 
@@ -46,30 +80,111 @@ err_inf * upload_file_1_svc(file_inf *file_upld, struct svc_req *)
   }
 
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "error info was init'ed");
+  svc_sched_charge(file_upld->cont.t_flcont_len);
+
+  // The file under a backend mount is saved by the backend, the one in the file system is
+  // checked & flushed as the native files, the memory one is limited by the backend itself
+  if ( (rc = store_back_fs_path(file_upld->name, path, &flname)) == -1 )
+    flname = data_dirs_path(file_upld->name, 1, path, NULL);
+
+  // Check the free space before the file is created, so it's not left partially written
+  if ( flname && svc_admit_check_space(flname, file_upld->cont.t_flcont_len,
+                                       upld_sess_pending(), &p_ret_err) != 0 ) {
+    print_error("Upload", p_ret_err);
+    return p_ret_err;
+  }
 
-  // Save the passed file content to a new local file
-  if ( save_file_cont(file_upld->name, &file_upld->cont, &p_ret_err) != 0 ) {
+  // Save the passed file content to a new local file, the small one is appended to a pack,
+  // the one under the zip prefix is compressed
+  if (rc != -1) {
+    if ( store_back_save(file_upld->name, &file_upld->cont, &p_ret_err) != 0 ) {
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+    }
+    if (flname == NULL)
+      return p_ret_err;
+  }
+  else if ( pack_store_wanted(file_upld->name, file_upld->cont.t_flcont_len) ) {
+    if ( pack_store_put(file_upld->name, &file_upld->cont, path, &p_ret_err) != 0 ) {
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+    }
+    flname = path; // the pack is flushed to make the file durable
+  }
+  else if ( pack_store_exists(file_upld->name, NULL) ) {
+    errno = EEXIST;
+    (void)process_error(file_upld->name, 11, "The file already exists in the packs", &p_ret_err);
+    print_error("Upload", p_ret_err);
+    return p_ret_err;
+  }
+  else if ( zip_store_wanted(file_upld->name) ) {
+    if ( zip_store_save(flname, &file_upld->cont, &p_ret_err) != 0 ) {
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+    }
+  }
+  else if ( save_file_cont(flname, &file_upld->cont, &p_ret_err) != 0 ) {
     print_error("Upload", p_ret_err);
     LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to save file contents");
     return p_ret_err;
   }
+
+  // The saved file is acknowledged when it's durable, the deferred reply is sent later
+  switch ( durable_commit(flname, rqstp, &p_ret_err) ) {
+    case 0:
+      break;
+    case -1:
+      return NULL;
+    default:
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+  }
   LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "file was saved successfully");
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
   return p_ret_err;
 }
 
+// Release the response content sent by the previous call: the cached content is unpinned,
+// the content read directly is freed
+static void release_cont(t_flcont *p_flcont, cache_pin *p_pin)
+{
+  if (*p_pin) {
+    cont_cache_put(*p_pin);
+    *p_pin = NULL;
+    p_flcont->t_flcont_val = NULL;
+    p_flcont->t_flcont_len = 0;
+  }
+  else
+    free_file_cont(p_flcont);
+}
+
 // The main RPC function to Download a file.
 // Note: file_err object will be auto-freed by xdr_free() at function end.
-file_err * download_file_1_svc(t_flname *p_flname, struct svc_req *)
+file_err * download_file_1_svc(t_flname *p_flname, struct svc_req *rqstp)
 {
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
   static file_err ret_flerr; // returned variable, must be static
   static file_inf *p_fileinf = &ret_flerr.file; // a pointer to a file info
   static err_inf *p_errinf = &ret_flerr.err; // a pointer to an error info
+  static cache_pin pin = NULL; // the pin of the cached content sent by the previous call
   FILE *hfile;  // the file handler
+  char path[LEN_PATH_MAX + 1]; // the path in the data directory of the storage layout
+  const char *flname;          // the path of the read file
+  struct stat statbuf;         // the status of the file not cached
+  int dev = -1; // the device of the file in the storage layout, -1 if it's outside
+  int last, rc;
   LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, 
       "process the Download file request, read file: %s", *p_flname);
 
+  // The identical request arrived while the previous one was processed shares its result
+  if ( req_flight_join(flight_download_file, *p_flname, 0, 0) ) {
+    svc_sched_charge(p_fileinf->cont.t_flcont_len);
+    return &ret_flerr;
+  }
+
+  // Release the content sent by the previous call: the cached one is only unpinned
+  release_cont(&p_fileinf->cont, &pin);
+
   // Reset an error info remained from the previous call of 'download' function
   if ( reset_err_inf(p_errinf) != 0 ) {
     // Return a special value if an error has occurred while initializing the error info
@@ -93,20 +208,87 @@ file_err * download_file_1_svc(t_flname *p_flname, struct svc_req *)
 
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "file name & type was init'ed");
 
-  // Set the file name to be read
-  p_fileinf->name = *p_flname;
+  // Set the file name to be read, the name memory is kept between the calls
+  strncpy(p_fileinf->name, *p_flname, LEN_PATH_MAX - 1);
+
+  // Get the file content from its backend or pack, or from the cache, or read it into the buffer if it can't be cached
+  if ( (rc = store_back_load(p_fileinf->name, &p_fileinf->cont, &p_errinf)) == -1 )
+    rc = pack_store_read(p_fileinf->name, 0, SIZE_MAX, &p_fileinf->cont, &last, &p_errinf);
+  if (rc > 0) {
+    print_error("Download", p_errinf);
+    return &ret_flerr;
+  }
+  flname = data_dirs_path(p_fileinf->name, 0, path, &dev);
+
+  // The file stored compressed is sent decompressed
+  if ( rc == -1 && (rc = zip_store_read(p_fileinf->name, flname, 0, SIZE_MAX, &p_fileinf->cont,
+                                        &last, &p_errinf)) > 0 ) {
+    print_error("Download", p_errinf);
+    return &ret_flerr;
+  }
 
-  // Read the file content into the buffer
-  if ( read_file_cont(p_fileinf->name, &p_fileinf->cont, &p_errinf) != 0 ) {
+  // The file on a device is read by the queue of the device unless it's cached, the reply is deferred
+  if (rc == -1 && dev != -1) {
+    if ( (pin = cont_cache_lookup(flname, &p_fileinf->cont, &statbuf)) != NULL )
+      rc = 0;
+    else if ( S_ISREG(statbuf.st_mode) &&
+              (rc = dev_queue_read_file(dev, p_fileinf->name, flname, &statbuf, rqstp)) != -1 ) {
+      if (rc == 1) {
+        (void)dev_queue_busy(p_fileinf->name, &p_errinf);
+        return &ret_flerr;
+      }
+      svc_sched_charge(statbuf.st_size);
+      return NULL;
+    }
+  }
+  if ( rc == -1 && (pin = cont_cache_get(flname, &p_fileinf->cont)) == NULL &&
+       read_file_cont(flname, &p_fileinf->cont, &p_errinf) != 0 ) {
     print_error("Download", p_errinf);
     LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to read file contents");
     return &ret_flerr;
   }
+  svc_sched_charge(p_fileinf->cont.t_flcont_len);
+  req_flight_done(flight_download_file, p_fileinf->name, 0, 0);
   LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "file was read successfully");
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
   return &ret_flerr;
 }
 
+// Get the status of the picked file under a backend mount, in the packs or in the storage layout
+// (on any of its devices). Return 0, 1 if there's no such file, -1 if the path is outside of them.
+static int pick_stat(const char *name, struct stat *p_stat)
+{
+  uint64_t size;
+  int rc, dev;
+
+  if ( (rc = store_back_stat(name, p_stat)) != -1 )
+    return rc;
+  if (pack_store_exists(name, &size)) {
+    memset(p_stat, 0, sizeof(struct stat));
+    p_stat->st_mode = S_IFREG | 0644;
+    p_stat->st_size = (off_t)size;
+    return 0;
+  }
+  if (!data_dirs_exported(name))
+    return -1;
+  for (dev = 0; dev < data_dirs_numb(); ++dev)
+    if (data_dirs_stat(name, dev, p_stat) == 0)
+      return 0;
+  return 1;
+}
+
+// Scan the picked directory of a backend or of the storage layout with its packed files
+static int pick_scan(const char *dirname, struct ls_entries *p_ents)
+{
+  int rc;
+  if ( (rc = store_back_list(dirname, p_ents)) == -1 )
+    rc = data_dirs_scan(dirname, p_ents);
+  return rc == 0 ? pack_store_scan(dirname, p_ents) : rc;
+}
+
+// The storage of the picked files other than the file system, for select_file()
+static const struct ls_store pick_store = { pick_stat, pick_scan };
+
 // The main RPC function for Interactive Selection (Picking) a file on the server.
 // Note: file_err object will be auto-freed by xdr_free() at function end.
 file_err * pick_file_1_svc(picked_file *p_flpkd, struct svc_req *)
@@ -114,12 +296,892 @@ file_err * pick_file_1_svc(picked_file *p_flpkd, struct svc_req *)
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
   static file_err *p_flerr_ret; // returned pointer, must be static
   LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the Pick file request: %s", p_flpkd->name);
+
+  // The identical request arrived while the previous one was processed shares its result
+  if ( req_flight_join(flight_pick_file, p_flpkd->name, p_flpkd->pftype, 0) )
+    return p_flerr_ret;
   
   p_flerr_ret = select_file(p_flpkd); // select_file() returns pointer to a static file_err object
   if (p_flerr_ret->err.num != 0)
     LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, 
-        "Failed selection: %s\n", p_flerr_ret->err.num, p_flerr_ret->err.err_inf_u.msg);
+        "Failed selection - error %d: %s\n", p_flerr_ret->err.num, p_flerr_ret->err.err_inf_u.msg);
+  else
+    req_flight_done(flight_pick_file, p_flpkd->name, p_flpkd->pftype, 0);
   
   LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
   return p_flerr_ret;
-}
\ No newline at end of file
+}
+
+// The RPC function to List a page of the directory entries.
+// Note: the page is kept by dir_page_make() until the next call, it's not freed by xdr_free().
+list_err * list_dir_1_svc(list_req *p_lsreq, struct svc_req *)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static list_err ret_lserr; // returned variable, must be static
+  static err_inf *p_errinf = &ret_lserr.err; // a pointer to an error info
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the List directory request: %s, cursor %llu",
+      p_lsreq->path, (unsigned long long)p_lsreq->cursor);
+
+  // Reset an error info remained from the previous call of 'list' function
+  if ( reset_err_inf(p_errinf) != 0 ) {
+    // Return a special value if an error has occurred while initializing the error info
+    p_errinf->num = ERRNUM_ERRINF_ERR;
+    p_errinf->err_inf_u.msg = "Failed to init the error info\n";
+    ret_lserr.list.path = "";
+    ret_lserr.list.items.items_len = 0;
+    print_error("List", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", p_errinf->err_inf_u.msg);
+    return &ret_lserr;
+  }
+
+  if ( dir_page_make(p_lsreq, &ret_lserr.list, &p_errinf) != 0 ) {
+    print_error("List", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to list the directory");
+    return &ret_lserr;
+  }
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return &ret_lserr;
+}
+
+// The RPC function to get the Changes of the directory listing since the known generation.
+// Note: the changes are kept by dir_delta_make() until the next call, they're not freed by xdr_free().
+delta_err * list_delta_1_svc(delta_req *p_dlreq, struct svc_req *)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static delta_err ret_dlerr; // returned variable, must be static
+  static err_inf *p_errinf = &ret_dlerr.err; // a pointer to an error info
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the List changes request: %s, generation %llx",
+      p_dlreq->path, (unsigned long long)p_dlreq->gen);
+
+  // Reset an error info remained from the previous call of 'list changes' function
+  if ( reset_err_inf(p_errinf) != 0 ) {
+    // Return a special value if an error has occurred while initializing the error info
+    p_errinf->num = ERRNUM_ERRINF_ERR;
+    p_errinf->err_inf_u.msg = "Failed to init the error info\n";
+    ret_dlerr.delta.path = "";
+    ret_dlerr.delta.items.items_len = 0;
+    print_error("List changes", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", p_errinf->err_inf_u.msg);
+    return &ret_dlerr;
+  }
+
+  if ( dir_delta_make(p_dlreq, &ret_dlerr.delta, &p_errinf) != 0 ) {
+    print_error("List changes", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to list the directory changes");
+    return &ret_dlerr;
+  }
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return &ret_dlerr;
+}
+
+// The RPC function to get the disk Usage of the directory subtree.
+// Note: the usage is partial if the time limit was reached, the client repeats the request then.
+// The walk is made by the thread of the usage and the reply is deferred, if it can be.
+usage_err * dir_usage_1_svc(t_flname *p_dirname, struct svc_req *rqstp)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static usage_err ret_userr; // returned variable, must be static
+  static err_inf *p_errinf = &ret_userr.err; // a pointer to an error info
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the Directory usage request: %s", *p_dirname);
+
+  // The subtree is walked by the thread of the usage, the reply is deferred
+  if (dir_usage_queue(*p_dirname, rqstp) == 0)
+    return NULL;
+
+  // Reset an error info remained from the previous call of 'usage' function
+  if ( reset_err_inf(p_errinf) != 0 ) {
+    // Return a special value if an error has occurred while initializing the error info
+    p_errinf->num = ERRNUM_ERRINF_ERR;
+    p_errinf->err_inf_u.msg = "Failed to init the error info\n";
+    ret_userr.usage.path = "";
+    print_error("Usage", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", p_errinf->err_inf_u.msg);
+    return &ret_userr;
+  }
+
+  if ( dir_usage_make(*p_dirname, &ret_userr.usage, &p_errinf) != 0 ) {
+    print_error("Usage", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to get the directory usage");
+    return &ret_userr;
+  }
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return &ret_userr;
+}
+
+// The RPC function to search the file names in the index of the Server
+search_err * search_names_1_svc(search_req *p_srreq, struct svc_req *)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static search_err ret_srerr; // returned variable, must be static
+  static err_inf *p_errinf = &ret_srerr.err; // a pointer to an error info
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the Search request: %s", p_srreq->pattern);
+
+  // Reset an error info remained from the previous call of 'search' function
+  if ( reset_err_inf(p_errinf) != 0 ) {
+    // Return a special value if an error has occurred while initializing the error info
+    p_errinf->num = ERRNUM_ERRINF_ERR;
+    p_errinf->err_inf_u.msg = "Failed to init the error info\n";
+    ret_srerr.found.root = "";
+    ret_srerr.found.items.items_len = 0;
+    print_error("Search", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", p_errinf->err_inf_u.msg);
+    return &ret_srerr;
+  }
+
+  if ( name_index_search(p_srreq, &ret_srerr.found, &p_errinf) != 0 ) {
+    print_error("Search", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to search the file names");
+    return &ret_srerr;
+  }
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return &ret_srerr;
+}
+
+// Answer the chunk request rejected by the admission control with ERRNUM_BUSY and
+// the retry-after time. Return 1 if the request is rejected, 0 otherwise.
+static int reject_busy(const char *flname, err_inf **pp_errinf)
+{
+  char msg[64];
+  int retry_after = svc_sched_retry_after();
+  if (retry_after == 0)
+    return 0;
+  snprintf(msg, sizeof(msg), "The server is busy, retry after %d ms", retry_after);
+  errno = EBUSY;
+  (void)process_error(flname, ERRNUM_BUSY, msg, pp_errinf);
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_WARN, "%s: %s", msg, flname);
+  return 1;
+}
+
+// The RPC function to Upload a chunk of file.
+// Note: chunk_inf object will be auto-freed by xdr_free() at function end.
+err_inf * upload_chunk_1_svc(chunk_inf *p_chunk, struct svc_req *rqstp)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static err_inf ret_err; // returned variable, must be static
+  static err_inf *p_ret_err = &ret_err; // pointer to a returned static variable
+  char path[LEN_PATH_MAX + 1]; // the path in the data directory of the storage layout
+  const char *flname = NULL;   // the path of the completed file, or of its pack
+  int rc;
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the Upload chunk request: %s, offset %lu, size %u",
+      p_chunk->name, p_chunk->chunk.offs, p_chunk->chunk.cont.t_flcont_len);
+
+  // Reset an error state remained after a previous call of the 'upload' function
+  if ( reset_err_inf(p_ret_err) != 0 ) {
+    ret_err.num = ERRNUM_ERRINF_ERR;
+    ret_err.err_inf_u.msg = "Failed to init the error info\n";
+    print_error("Upload", p_ret_err);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", ret_err.err_inf_u.msg);
+    return p_ret_err;
+  }
+
+  // The request rejected by the admission control is answered without processing
+  if ( reject_busy(p_chunk->name, &p_ret_err) )
+    return p_ret_err;
+  svc_sched_charge(p_chunk->chunk.cont.t_flcont_len);
+
+  // The chunk of the file under a backend mount is written by the backend, the file in the file
+  // system is checked for the free space by the first chunk & flushed as the native files
+  if ( (rc = store_back_fs_path(p_chunk->name, path, &flname)) != -1 ) {
+    if ( flname && p_chunk->chunk.offs == 0 &&
+         svc_admit_check_space(flname, p_chunk->size, upld_sess_pending(), &p_ret_err) != 0 ) {
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+    }
+    if ( store_back_write_chunk(p_chunk, svc_getrpccaller(rqstp->rq_xprt), &p_ret_err) != 0 ) {
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+    }
+    if (flname == NULL)
+      return p_ret_err;
+  }
+  // The small file uploaded by one chunk is appended to a pack, the pack is flushed to make it durable
+  else if ( p_chunk->chunk.offs == 0 && p_chunk->chunk.last && p_chunk->chunk.cont.t_flcont_len == p_chunk->size &&
+       pack_store_wanted(p_chunk->name, p_chunk->size) ) {
+    if ( pack_store_put(p_chunk->name, &p_chunk->chunk.cont, path, &p_ret_err) != 0 ) {
+      print_error("Upload", p_ret_err);
+      return p_ret_err;
+    }
+    flname = path;
+  }
+  // Write the chunk within the upload session of the file, the chunk queued on its device is replied later
+  else if ( (rc = upld_sess_write(p_chunk, rqstp, &p_ret_err)) == -1 )
+    return NULL;
+  else if (rc == ERRNUM_BUSY)
+    return p_ret_err;
+  else if (rc != 0) {
+    print_error("Upload", p_ret_err);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to write the file chunk");
+    return p_ret_err;
+  }
+  else if (p_chunk->chunk.last)
+    flname = data_dirs_path(p_chunk->name, 0, path, NULL);
+
+  // The completed upload is acknowledged when it's durable, the deferred reply is sent later
+  if (p_chunk->chunk.last) {
+    switch ( durable_commit(flname, rqstp, &p_ret_err) ) {
+      case 0:
+        break;
+      case -1:
+        return NULL;
+      default:
+        print_error("Upload", p_ret_err);
+        return p_ret_err;
+    }
+  }
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return p_ret_err;
+}
+
+// Cut the chunk of `size` bytes at the `offs` offset out of the whole file content.
+// Return 0 on success, 18 for the offset beyond the end of file.
+static int cut_chunk(const char *flname, t_flcont *p_flcont, uint64_t offs, size_t size,
+                     int *p_last, err_inf **pp_errinf)
+{
+  uint64_t len = p_flcont->t_flcont_len;
+  if (offs > len) {
+    errno = 0;
+    (void)process_error(flname, 18, "Invalid offset of the file chunk", pp_errinf);
+    return 18;
+  }
+  if (len - offs < size)
+    size = (size_t)(len - offs);
+  p_flcont->t_flcont_val += offs;
+  p_flcont->t_flcont_len = size;
+  *p_last = (offs + size >= len);
+  return 0;
+}
+
+// The RPC function to Download a chunk of file.
+// Note: the chunk content is kept until the next call, the rpcgen dispatcher doesn't free it.
+chunk_err * download_chunk_1_svc(chunk_req *p_chreq, struct svc_req *rqstp)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static chunk_err ret_cherr; // returned variable, must be static
+  static err_inf *p_errinf = &ret_cherr.err; // a pointer to an error info
+  static cache_pin pin = NULL; // the pin of the cached content sent by the previous call
+  fd_ref ref;   // the reference to the shared descriptor of the file
+  int fd;       // the file descriptor
+  int last = 0; // the end of file flag
+  int dev = -1; // the device of the file in the storage layout, -1 if it's outside
+  int rc;       // the result of the reading by the backend or from the pack, -1 if it's neither
+  char path[LEN_PATH_MAX + 1]; // the path in the data directory of the storage layout
+  const char *flname;          // the path of the read file
+  size_t size = p_chreq->size < LEN_CHUNK_MAX ? p_chreq->size : LEN_CHUNK_MAX;
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the Download chunk request: %s, offset %lu, size %u",
+      p_chreq->name, p_chreq->offs, p_chreq->size);
+
+  // The identical request arrived while the previous one was processed shares its result.
+  // It's shared even if the request is rejected by the admission control: it costs no reading.
+  if ( req_flight_join(flight_download_chunk, p_chreq->name, p_chreq->offs, size) ) {
+    svc_sched_charge(ret_cherr.chunk.cont.t_flcont_len);
+    return &ret_cherr;
+  }
+
+  // Reset an error info & the chunk remained from the previous call
+  release_cont(&ret_cherr.chunk.cont, &pin);
+  ret_cherr.chunk.offs = p_chreq->offs;
+  ret_cherr.chunk.last = FALSE;
+  if ( reset_err_inf(p_errinf) != 0 ) {
+    p_errinf->num = ERRNUM_ERRINF_ERR;
+    p_errinf->err_inf_u.msg = "Failed to init the error info\n";
+    print_error("Download", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", p_errinf->err_inf_u.msg);
+    return &ret_cherr;
+  }
+
+  // The request rejected by the admission control is answered without processing
+  if ( reject_busy(p_chreq->name, &p_errinf) )
+    return &ret_cherr;
+
+  // The chunk of the file under a backend mount is read by the backend, of the packed file - from its pack
+  if ( (rc = store_back_read_chunk(p_chreq->name, p_chreq->offs, size, &ret_cherr.chunk.cont,
+                                   &last, &p_errinf)) == -1 )
+    rc = pack_store_read(p_chreq->name, p_chreq->offs, size, &ret_cherr.chunk.cont, &last, &p_errinf);
+  if (rc > 0) {
+    print_error("Download", p_errinf);
+    return &ret_cherr;
+  }
+  flname = rc == 0 ? p_chreq->name : data_dirs_path(p_chreq->name, 0, path, &dev);
+
+  // The range of the compressed file is decompressed from the blocks covering it
+  if ( rc == -1 && (rc = zip_store_read(p_chreq->name, flname, p_chreq->offs, size, &ret_cherr.chunk.cont,
+                                        &last, &p_errinf)) > 0 ) {
+    print_error("Download", p_errinf);
+    return &ret_cherr;
+  }
+
+  // The chunk of the cached file points into the cached content
+  if ( rc == -1 && (pin = cont_cache_get(flname, &ret_cherr.chunk.cont)) != NULL ) {
+    if ( cut_chunk(p_chreq->name, &ret_cherr.chunk.cont, p_chreq->offs, size,
+                   &last, &p_errinf) != 0 ) {
+      print_error("Download", p_errinf);
+      return &ret_cherr;
+    }
+  }
+  // The chunk of a sequential download may be read ahead already
+  else if ( rc == -1 && !read_ahead_take(flname, p_chreq->offs, size, &ret_cherr.chunk.cont, &last) ) {
+    // Read the chunk from the descriptor shared by the chunk requests of the file
+    if ( (ref = fd_cache_get(flname, &fd, &p_errinf)) == NULL ) {
+      print_error("Download", p_errinf);
+      LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to open the file");
+      return &ret_cherr;
+    }
+    // The chunk of the file on a device is read by the queue of the device, the reply is deferred
+    if (dev != -1 && (rc = dev_queue_read_chunk(dev, flname, ref, fd, fd_cache_direct(ref), p_chreq->offs,
+                                                size, rqstp)) != -1) {
+      if (rc == 1) {
+        fd_cache_release(ref);
+        (void)dev_queue_busy(p_chreq->name, &p_errinf);
+        return &ret_cherr;
+      }
+      svc_sched_charge(size);
+      return NULL;
+    }
+    if ( direct_io_read_chunk(flname, fd, fd_cache_direct(ref), p_chreq->offs, size,
+                              &ret_cherr.chunk.cont, &last, &p_errinf) != 0 ) {
+      fd_cache_release(ref);
+      print_error("Download", p_errinf);
+      LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "Failed to read the file chunk");
+      return &ret_cherr;
+    }
+    fd_cache_release(ref);
+    read_ahead_note(flname, p_chreq->offs, size, last);
+  }
+  ret_cherr.chunk.last = last;
+  svc_sched_charge(ret_cherr.chunk.cont.t_flcont_len);
+  req_flight_done(flight_download_chunk, p_chreq->name, p_chreq->offs, size);
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return &ret_cherr;
+}
+
+// The RPC function to Download the blocks of a file stored compressed, as they are stored.
+// Note: the blocks are kept until the next call, the rpcgen dispatcher doesn't free them.
+block_err * download_blocks_1_svc(chunk_req *p_chreq, struct svc_req *)
+{
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Begin");
+  static block_err ret_blerr; // returned variable, must be static
+  static err_inf *p_errinf = &ret_blerr.err; // a pointer to an error info
+  char path[LEN_PATH_MAX + 1]; // the path in the data directory of the storage layout
+  const char *flname;          // the path of the read file
+  size_t size = p_chreq->size < LEN_CHUNK_MAX ? p_chreq->size : LEN_CHUNK_MAX;
+  size_t len = 0;              // the stored bytes of the blocks
+  u_int i;
+  int rc;
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "process the Download blocks request: %s, offset %lu, size %u",
+      p_chreq->name, p_chreq->offs, p_chreq->size);
+
+  // Reset an error info & the blocks remained from the previous call
+  zip_store_free_blocks(&ret_blerr.blks);
+  ret_blerr.blks.offs = p_chreq->offs;
+  ret_blerr.blks.total = 0;
+  ret_blerr.blks.last = FALSE;
+  if ( reset_err_inf(p_errinf) != 0 ) {
+    p_errinf->num = ERRNUM_ERRINF_ERR;
+    p_errinf->err_inf_u.msg = "Failed to init the error info\n";
+    print_error("Download", p_errinf);
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_ERROR, "%s", p_errinf->err_inf_u.msg);
+    return &ret_blerr;
+  }
+
+  // The request rejected by the admission control is answered without processing
+  if ( reject_busy(p_chreq->name, &p_errinf) )
+    return &ret_blerr;
+
+  // The file stored as is is downloaded by chunks
+  flname = data_dirs_path(p_chreq->name, 0, path, NULL);
+  if ( (rc = zip_store_read_blocks(p_chreq->name, flname, p_chreq->offs, size, &ret_blerr.blks,
+                                   &p_errinf)) == -1 ) {
+    errno = 0;
+    (void)process_error(p_chreq->name, ERRNUM_PLAIN, "The file isn't stored compressed", &p_errinf);
+    return &ret_blerr;
+  }
+  if (rc != 0) {
+    print_error("Download", p_errinf);
+    return &ret_blerr;
+  }
+  for (i = 0; i < ret_blerr.blks.blocks.blocks_len; ++i)
+    len += ret_blerr.blks.blocks.blocks_val[i].cont.t_flcont_len;
+  svc_sched_charge(len);
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_DEBUG, "Done.\n");
+  return &ret_blerr;
+}
+
+// The RPC function to get the path prefix of the files stored compressed, "" if there's none.
+// The clients request download_blocks only for the files under it.
+t_flname * zip_prefix_1_svc(void *, struct svc_req *)
+{
+  static t_flname ret_prefix; // returned variable, must be static
+  ret_prefix = (char *)zip_store_prefix();
+  return &ret_prefix;
+}
+
+// Server settings set through the command-line options
+static struct serv_setts {
+  unsigned short port;  // fixed TCP port shared by the workers, 0 - the ports are assigned by rpcbind
+  int numb_workers;     // number of the pre-forked worker processes on the fixed port
+  int weight_inter;     // weight of the interactive requests against the bulk ones, 0 - strict priority
+  size_t budget;        // in-flight byte budget of the bulk requests shared by the workers
+  size_t cache_size;    // memory of the content cache of each worker, 0 - no cache
+  size_t lsdir_size;    // memory of the directory listing cache of each worker, 0 - no cache
+  size_t usage_size;    // memory of the directory usage cache of each worker, 0 - no cache
+  char *index_root;     // the directory of the file name index, NULL - no index
+  const char *index_file; // the file name index, shared by the workers
+  int io_uring;         // 1 if the files are read ahead & the chunks are written through io_uring
+  uint64_t direct_size; // min size of the files transferred bypassing the page cache, 0 - never
+  enum dur_mode dur_mode; // durability of the uploaded files
+  int dur_window;       // batch window of the group commit, milliseconds
+  char *layout;         // the storage layout 'export=dir,dir,...', NULL - no layout
+  enum ddir_place place; // placement of the new files in the storage layout
+  char *pack;           // the pack store 'prefix=dir[,size]', NULL - no packs
+} serv_set = {0, 1, 8, 256 * 1048576, 64 * 1048576, 32 * 1048576, 16 * 1048576,
+              NULL, "/var/tmp/prg_serv.idx", 0, 0, dur_none, DUR_WINDOW_DEF, NULL, ddir_hash, NULL};
+
+// The pre-forked worker processes
+static pid_t *worker_pids;
+static volatile sig_atomic_t stop_master = 0; // set by SIGTERM & SIGINT in the master process
+
+// Print the help info
+static void print_help(const char *this_prg_name)
+{
+  fprintf(stderr, "Usage:\n"
+    "%s [-q weight] [-m budget] [-c cache] [-d cache] [-s cache] [-x dir[,file]]\n"
+    "        [-e engine] [-o size] [-f mode[,window]] [-v export=dir,...] [-g placement]\n"
+    "        [-k prefix=dir[,size[,files]]] [-b prefix=backend]... [-z prefix[,block]]\n"
+    "        [-l net/prefix,rate[,weight]]...\n"
+    "%s -p port [-w workers] [-q weight] [-m budget] [-c cache] [-d cache] [-s cache]\n"
+    "        [-x dir[,file]] [-e engine] [-o size] [-f mode[,window]] [-v export=dir,...]\n"
+    "        [-g placement] [-k prefix=dir[,size[,files]]] [-b prefix=backend]... [-z prefix[,block]]\n"
+    "        [-l net/prefix,rate[,weight]]...\n"
+    "%s [-h]\n\n"
+    "Options:\n"
+    "-p port     serve TCP on the fixed port without rpcbind, clients connect as 'server:port'\n"
+    "-w workers  number of the pre-forked worker processes sharing the port (SO_REUSEPORT),\n"
+    "            the kernel load-balances the connections across them; default: 1\n"
+    "-q weight   number of the interactive requests (pick_file) served per one bulk request\n"
+    "            (upload & download) when both are waiting; 0 - strict priority; default: 8\n"
+    "-m budget   in-flight byte budget of the bulk requests in MiB, shared by the workers;\n"
+    "            the requests exceeding it wait, the chunk requests waiting too long are\n"
+    "            rejected with the retry-after time; default: 256\n"
+    "-c cache    memory of the content cache of the downloaded files in MiB, per worker;\n"
+    "            the files larger than a quarter of it aren't cached; 0 - no cache; default: 64\n"
+    "-d cache    memory of the directory listing cache in MiB, per worker; the listings are\n"
+    "            invalidated by inotify on the directory changes; 0 - no cache; default: 32\n"
+    "-s cache    memory of the directory usage cache in MiB, per worker; the usage of a directory\n"
+    "            is valid while it's not changed, up to 5 minutes; 0 - no cache; default: 16\n"
+    "-x dir,file index the file names under 'dir' for the search, the index is kept in 'file'\n"
+    "            (default: /var/tmp/prg_serv.idx), shared by the workers & rescanned every %d s\n"
+    "-e engine   I/O engine of the read-ahead of the downloaded files: 'sync' - one read at a time,\n"
+    "            'uring' - many reads in flight through io_uring, the uploaded chunks are written by\n"
+    "            the device queues through io_uring too (falls back to 'sync' if it's not supported\n"
+    "            by the kernel); default: sync\n"
+    "-o size     transfer the chunks of the files of at least 'size' MiB bypassing the page cache\n"
+    "            (O_DIRECT), so they don't evict the hot files; 0 - never; default: 0\n"
+    "-f mode     durability of the uploads, they're acknowledged: 'none' - at once, 'file' - after\n"
+    "            the flush of each file to the disk, 'group' - after the flush of the files uploaded\n"
+    "            within the batch 'window' (ms, default: %d) together; default: none\n"
+    "-v layout   storage layout 'export=dir,...': the paths under 'export' are stored in the data\n"
+    "            directories (one per device, up to %d), the directories are listed as their union,\n"
+    "            the files are read & written by the I/O queue of each device, e.g. -v /export=/d1/data,/d2/data\n"
+    "-g place    placement of the new files in the storage layout: 'hash' - by the hash of the path,\n"
+    "            'load' - on the device with the fewest operations queued; default: hash\n"
+    "-k packs    pack store 'prefix=dir[,size[,files]]': the files under 'prefix' smaller than 'size' KiB\n"
+    "            (default: %d) are appended to the pack files in 'dir' & indexed there, instead\n"
+    "            of a file each, up to 'files' of them (default: %d), the next ones are stored\n"
+    "            as is; the packs with the dead space are compacted in the background\n"
+    "-b mount    storage backend of the files under 'prefix' (up to %d mounts): 'mem[,ttl[,max]]' -\n"
+    "            in the memory of the single worker, removed when not accessed for 'ttl' s (default:\n"
+    "            %d), up to 'max' MiB (default: %d); 'posix:dir' - the files of 'dir' through plain\n"
+    "            system calls, flushed as of -f, e.g. -b /scratch=mem,600,512\n"
+    "-z zip      store the files uploaded under 'prefix' compressed in the blocks of 'block' KiB\n"
+    "            (default: %d); the blocks are sent as is to the clients supporting them,\n"
+    "            decompressed for the others\n"
+    "-l class    limits of each client of the network 'net/prefix': bandwidth 'rate' in MiB/s\n"
+    "            (0 - unlimited) and weight of the client in the fair sharing; default weight: 1;\n"
+    "            the longest matching prefix is applied, up to %d classes, e.g. -l 10.0.0.0/8,50,2;\n"
+    "            '0.0.0.0/0' sets the default class, without it the clients are unlimited\n"
+    "-h          print this help\n"
+    "Without -p option the UDP & TCP services are registered with rpcbind.\n"
+    "Send SIGUSR1 to print the statistics of the server (per-class queue time, etc.).\n",
+    this_prg_name, this_prg_name, this_prg_name, INDEX_RESCAN_PERIOD, DUR_WINDOW_DEF,
+    DDIR_DEVS_MAX, PACK_SIZE_DEF / 1024, PACK_INDEXED_DEF, SB_MOUNTS_MAX, SB_MEM_TTL_DEF, SB_MEM_MAX_DEF, ZIP_BLOCK_DEF / 1024,
+    NUMB_CLIENT_CLASSES_MAX);
+}
+
+// Parse the client class 'net/prefix,rate[,weight]' and add it to the scheduler, exit if it's invalid
+static void add_client_class(const char *arg)
+{
+  char net_str[INET_ADDRSTRLEN];
+  struct in_addr net;
+  int prefix, weight = 1, nch = 0;
+  double rate;
+
+  if (sscanf(arg, "%15[0-9.]/%d,%lf%n,%d%n", net_str, &prefix, &rate, &nch, &weight, &nch) < 3 ||
+      arg[nch] != '\0' || inet_pton(AF_INET, net_str, &net) != 1 ||
+      prefix < 0 || prefix > 32 || rate < 0. || weight <= 0 || weight > 1000) {
+    fprintf(stderr, "!--Error 6: Invalid client class: %s\n\n", arg);
+    exit(6);
+  }
+  if (svc_sched_add_class(net.s_addr, prefix, rate * 1048576., weight) != 0)
+    exit(6);
+}
+
+// Parse & verify the command-line arguments, exit on invalid ones
+static void process_args(int argc, char *argv[])
+{
+  int opt;
+  long val;
+  char *endp;
+
+  while ( (opt = getopt(argc, argv, "p:w:q:m:c:d:s:x:e:o:f:v:g:k:b:z:l:h")) != -1 ) {
+    switch (opt) {
+      case 'p':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val <= 0 || val > 65535) {
+          fprintf(stderr, "!--Error 6: Invalid port: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.port = (unsigned short)val;
+        break;
+      case 'w':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val <= 0 || val > 1024) {
+          fprintf(stderr, "!--Error 6: Invalid number of workers: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.numb_workers = (int)val;
+        break;
+      case 'q':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val < 0 || val > 1000) {
+          fprintf(stderr, "!--Error 6: Invalid weight of the interactive requests: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.weight_inter = (int)val;
+        break;
+      case 'm':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val <= 0 || val > 1048576) {
+          fprintf(stderr, "!--Error 6: Invalid in-flight byte budget: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.budget = (size_t)val * 1048576;
+        break;
+      case 'c':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val < 0 || val > 1048576) {
+          fprintf(stderr, "!--Error 6: Invalid memory of the content cache: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.cache_size = (size_t)val * 1048576;
+        break;
+      case 'd':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val < 0 || val > 1048576) {
+          fprintf(stderr, "!--Error 6: Invalid memory of the directory listing cache: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.lsdir_size = (size_t)val * 1048576;
+        break;
+      case 's':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val < 0 || val > 1048576) {
+          fprintf(stderr, "!--Error 6: Invalid memory of the directory usage cache: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.usage_size = (size_t)val * 1048576;
+        break;
+      case 'x':
+        serv_set.index_root = optarg;
+        if ( (endp = strchr(optarg, ',')) != NULL ) {
+          *endp = '\0';
+          serv_set.index_file = endp + 1;
+        }
+        if (*serv_set.index_root == '\0' || *serv_set.index_file == '\0') {
+          fprintf(stderr, "!--Error 6: Invalid directory or file of the file name index\n\n");
+          exit(6);
+        }
+        break;
+      case 'e':
+        if (strcmp(optarg, "sync") == 0)
+          serv_set.io_uring = 0;
+        else if (strcmp(optarg, "uring") == 0)
+          serv_set.io_uring = 1;
+        else {
+          fprintf(stderr, "!--Error 6: Invalid I/O engine: %s\n\n", optarg);
+          exit(6);
+        }
+        break;
+      case 'o':
+        val = strtol(optarg, &endp, 10);
+        if (*endp != '\0' || val < 0 || val > 1073741824) {
+          fprintf(stderr, "!--Error 6: Invalid min size of the files transferred with O_DIRECT: %s\n\n", optarg);
+          exit(6);
+        }
+        serv_set.direct_size = (uint64_t)val * 1048576;
+        break;
+      case 'f':
+        if ( (endp = strchr(optarg, ',')) != NULL ) {
+          *endp++ = '\0';
+          val = strtol(endp, &endp, 10);
+          if (*endp != '\0' || val < 0 || val > 10000) {
+            fprintf(stderr, "!--Error 6: Invalid batch window of the group commit\n\n");
+            exit(6);
+          }
+          serv_set.dur_window = (int)val;
+        }
+        if (strcmp(optarg, "none") == 0)
+          serv_set.dur_mode = dur_none;
+        else if (strcmp(optarg, "file") == 0)
+          serv_set.dur_mode = dur_file;
+        else if (strcmp(optarg, "group") == 0)
+          serv_set.dur_mode = dur_group;
+        else {
+          fprintf(stderr, "!--Error 6: Invalid durability mode: %s\n\n", optarg);
+          exit(6);
+        }
+        break;
+      case 'v':
+        serv_set.layout = optarg;
+        break;
+      case 'g':
+        if (strcmp(optarg, "hash") == 0)
+          serv_set.place = ddir_hash;
+        else if (strcmp(optarg, "load") == 0)
+          serv_set.place = ddir_load;
+        else {
+          fprintf(stderr, "!--Error 6: Invalid placement of the new files: %s\n\n", optarg);
+          exit(6);
+        }
+        break;
+      case 'k':
+        serv_set.pack = optarg;
+        break;
+      case 'b':
+        if (store_back_mount(optarg) != 0)
+          exit(6);
+        break;
+      case 'z':
+        if (zip_store_set(optarg) != 0)
+          exit(6);
+        break;
+      case 'l':
+        add_client_class(optarg);
+        break;
+      case 'h':
+        print_help(argv[0]);
+        exit(0);
+      default:
+        print_help(argv[0]);
+        exit(6);
+    }
+  }
+
+  if (optind < argc || (serv_set.numb_workers > 1 && !serv_set.port)) {
+    fprintf(stderr, "!--Error 6: Invalid arguments, workers require the fixed port\n\n");
+    print_help(argv[0]);
+    exit(6);
+  }
+  if (serv_set.layout && data_dirs_set(serv_set.layout, serv_set.place) != 0)
+    exit(6);
+  if (serv_set.pack && pack_store_set(serv_set.pack) != 0)
+    exit(6);
+  if (serv_set.numb_workers > 1 && store_back_in_memory()) {
+    fprintf(stderr, "!--Error 6: The memory backend keeps the files in one worker, it requires one worker\n\n");
+    exit(6);
+  }
+}
+
+// Create the transport of the passed kind, register it with rpcbind and add it to the event loop
+static void create_xprt(enum xprt_kind kind)
+{
+  const char *proto_name = (kind == xprt_dgram ? "udp" : "tcp");
+  SVCXPRT *transp = (kind == xprt_dgram ? svcudp_create(RPC_ANYSOCK)
+                                        : svctcp_create(RPC_ANYSOCK, 0, 0));
+  if (transp == NULL) {
+    fprintf(stderr, "cannot create %s service.\n", proto_name);
+    exit(1);
+  }
+  if (!svc_register(transp, FLTRPROG, FLTRVERS, fltrprog_1,
+                    kind == xprt_dgram ? IPPROTO_UDP : IPPROTO_TCP)) {
+    fprintf(stderr, "unable to register (FLTRPROG, FLTRVERS, %s).\n", proto_name);
+    exit(1);
+  }
+  if (svc_loop_add_xprt(transp, kind) != 0)
+    exit(1);
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "%s service was created, port %d", proto_name, transp->xp_port);
+}
+
+// Create the TCP transport on the fixed port, it's not registered with rpcbind (protocol 0)
+static void create_xprt_fixed_port(void)
+{
+  SVCXPRT *transp = svc_loop_create_reuseport(serv_set.port);
+  if (transp == NULL)
+    exit(1);
+  if (!svc_register(transp, FLTRPROG, FLTRVERS, fltrprog_1, 0)) {
+    fprintf(stderr, "unable to register (FLTRPROG, FLTRVERS, tcp:%d).\n", (int)serv_set.port);
+    exit(1);
+  }
+  if (svc_loop_add_xprt(transp, xprt_rendezvous) != 0)
+    exit(1);
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "tcp service was created on the fixed port %d, pid %d",
+      (int)serv_set.port, (int)getpid());
+}
+
+// Run the server in the current process: create the transports and serve the requests
+static int run_worker(void)
+{
+  // The event loop must be init'ed before the creation of the transports
+  if (svc_loop_init() != 0)
+    return 1;
+  svc_sched_set_weight(serv_set.weight_inter);
+  cont_cache_init(serv_set.cache_size);
+  (void)dir_cache_init(serv_set.lsdir_size); // the Server works without the cache on failure
+  (void)dir_delta_init(); // the directories are scanned by each request on failure
+  (void)dir_usage_init(serv_set.usage_size); // the usage is made by the main thread on failure
+  direct_io_init(serv_set.direct_size);
+  (void)durable_init(serv_set.dur_mode, serv_set.dur_window); // the files are flushed each on failure
+  (void)dev_queue_init(data_dirs_numb(), serv_set.io_uring); // the chunks are read by the main thread on failure
+  (void)pack_store_init(); // the small files are stored one by one on failure
+  set_ls_store(&pick_store); // the backends, the packs & the storage layout are picked as the files
+  // The chunks are read on request on failure
+  (void)read_ahead_init(serv_set.io_uring && io_ring_init() == 0);
+  if (serv_set.index_root) // the search is answered with an error on failure
+    (void)name_index_init(serv_set.index_root, serv_set.index_file);
+
+  if (serv_set.port)
+    create_xprt_fixed_port();
+  else {
+    pmap_unset(FLTRPROG, FLTRVERS);
+    create_xprt(xprt_dgram);
+    create_xprt(xprt_rendezvous);
+  }
+
+  // Serve the requests, svc_loop_run() returns only in case of a fatal error
+  int rc = svc_loop_run();
+  fprintf(stderr, "svc_loop_run returned\n");
+  return rc;
+}
+
+// Fork a new worker process, each worker creates its own listening socket on the shared port
+static pid_t spawn_worker(int slot)
+{
+  pid_t pid = fork();
+  if (pid == 0) {
+    signal(SIGTERM, SIG_DFL);
+    signal(SIGINT, SIG_DFL);
+    signal(SIGUSR1, SIG_DFL); // the worker sets its own handler in svc_loop_init()
+    svc_admit_attach(slot);
+    exit(run_worker());
+  }
+  if (pid == -1)
+    fprintf(stderr, "!--Error 7: Cannot fork the worker process\n%s\n", strerror(errno));
+  else
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "worker process %d was started", (int)pid);
+  return pid;
+}
+
+// Stop the master process on SIGTERM or SIGINT
+static void on_stop_signal(int)
+{
+  stop_master = 1;
+}
+
+// Forward SIGUSR1 (print the statistics) from the master process to the workers
+static void on_stats_signal(int sig)
+{
+  int i;
+  for (i = 0; i < serv_set.numb_workers; ++i)
+    if (worker_pids[i] > 0)
+      kill(worker_pids[i], sig);
+}
+
+/* Run the master process that pre-forks the workers and restarts the died ones.
+ *
+ * The workers don't share any state, so no thread-safety is required from the request
+ * processing code. A worker that dies within a second of its start points out a persistent
+ * error (e.g. the port is busy), in this case all the workers are stopped.
+ *
+ * Return value:
+ *  0 on stop by signal, >0 on failure.
+ */
+static int run_master(void)
+{
+  struct sigaction sa;
+  time_t *start_times;
+  pid_t pid;
+  int status, i, rc = 0;
+
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = on_stop_signal; // no SA_RESTART - wait() should be interrupted
+  sigaction(SIGTERM, &sa, NULL);
+  sigaction(SIGINT, &sa, NULL);
+
+  worker_pids = calloc(serv_set.numb_workers, sizeof(pid_t));
+  start_times = calloc(serv_set.numb_workers, sizeof(time_t));
+  if (!worker_pids || !start_times) {
+    fprintf(stderr, "!--Error 8: Failed to allocate memory for the workers info\n");
+    return 8;
+  }
+
+  for (i = 0; i < serv_set.numb_workers; ++i) {
+    if ( (worker_pids[i] = spawn_worker(i)) == -1 ) {
+      stop_master = 1;
+      rc = 7;
+      break;
+    }
+    start_times[i] = time(NULL);
+  }
+  sa.sa_handler = on_stats_signal;
+  sigaction(SIGUSR1, &sa, NULL);
+
+  while (!stop_master) {
+    if ( (pid = wait(&status)) == -1 ) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+    for (i = 0; i < serv_set.numb_workers && worker_pids[i] != pid; ++i);
+    if (i == serv_set.numb_workers)
+      continue;
+
+    LOG(LOG_TYPE_SERV, LOG_LEVEL_WARN, "worker process %d died, status %d", (int)pid, status);
+    worker_pids[i] = 0;
+    svc_admit_reclaim(i);
+    if (time(NULL) - start_times[i] < 1) {
+      fprintf(stderr, "!--Error 9: The worker process %d died right after the start\n", (int)pid);
+      rc = 9;
+      break;
+    }
+    if ( (worker_pids[i] = spawn_worker(i)) == -1 ) {
+      rc = 7;
+      break;
+    }
+    start_times[i] = time(NULL);
+  }
+
+  // Stop all the workers
+  for (i = 0; i < serv_set.numb_workers; ++i)
+    if (worker_pids[i] > 0)
+      kill(worker_pids[i], SIGTERM);
+  while (wait(NULL) > 0);
+
+  free(worker_pids);
+  free(start_times);
+  LOG(LOG_TYPE_SERV, LOG_LEVEL_INFO, "master process stopped");
+  return rc;
+}
+
+int main(int argc, char **argv)
+{
+  // Verify the passed command-line arguments and set the server settings
+  process_args(argc, argv);
+
+  // The budget must be shared before the workers are forked
+  if (svc_admit_init(serv_set.budget, serv_set.numb_workers) != 0)
+    exit(1);
+
+  // Pre-fork the workers on the shared port or serve in this process only
+  if (serv_set.numb_workers > 1)
+    exit(run_master());
+  exit(run_worker());
+}
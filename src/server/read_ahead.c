@@ -0,0 +1,515 @@
+/*
+ * read_ahead.c: the read-ahead of the files downloaded chunk by chunk on the Server.
+ * Errors range: none (the errors are reported by the direct reading of the chunk)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "read_ahead.h"
+#include "fd_cache.h"
+#include "io_ring.h"
+#include "direct_io.h"
+#include "../common/file_opers.h"
+#include "../common/mem_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The state of the slot
+enum ra_state {
+  ra_empty,       // no chunk
+  ra_queued,      // the chunk waits for the I/O thread
+  ra_reading,     // the chunk is being read
+  ra_ready,       // the chunk is read
+  ra_failed       // the chunk can't be read, it's read directly then
+};
+
+// The slot of the chunk read ahead
+struct ra_slot {
+  enum ra_state state;
+  uint64_t offs;                // the offset of the chunk
+  t_flcont cont;                // the chunk content
+  int last;                     // 1 if the chunk reaches the end of file
+  int direct;                   // 1 if the chunk is read with O_DIRECT
+  struct ra_stream *p_stream;   // the stream of the chunk
+  struct timespec tm_start;     // time of the start of the reading
+  struct ra_slot *next_queued;  // next slot in the queue of the I/O thread
+};
+
+// The stream of the sequential chunk requests of the file
+struct ra_stream {
+  char *name;                   // the file name
+  fd_ref ref;                   // the descriptor used by the I/O thread, NULL till the read-ahead
+  int fd;
+  int fd_direct;                //   & the one opened with O_DIRECT for the large file, or -1
+  int large;                    // 1 if the file is read bypassing the page cache
+  int idx_file;                 // the index of the descriptor registered in io_uring, or -1
+  uint64_t size_file;           // the file size at the start of the read-ahead
+  size_t size_chunk;            // the chunk size of the requests
+  uint64_t next_offs;           // the offset of the next sequential request
+  int numb_seq;                 // number of the sequential requests
+  int depth;                    // number of the chunks read ahead
+  int numb_busy;                // number of the slots queued or being read
+  int dropped;                  // 1 if the stream is dropped, it's freed when nothing is read
+  time_t tm_last;               // time of the last request
+  struct timespec tm_req;       // time of the last request, monotonic
+  double sec_req, sec_read;     // the average time between the requests & of the chunk reading
+  struct ra_slot slots[RA_DEPTH_MAX];
+  struct ra_stream *next_dropped; // next stream in the list of the dropped ones
+};
+
+static struct ra_stream *streams[RA_STREAMS_MAX]; // the tracked streams
+static struct ra_stream *dropped = NULL;  // the dropped streams with the chunks being read
+static int enabled = 0;                   // 1 if the I/O thread is started
+static int use_ring = 0;                  // 1 if the chunks are read through io_uring
+
+// The slots, the queue & the statistics below are shared with the I/O thread
+static pthread_mutex_t lock_ra = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond_queued = PTHREAD_COND_INITIALIZER; // a slot is queued
+static pthread_cond_t cond_read = PTHREAD_COND_INITIALIZER;   // a slot is read
+static struct ra_slot *queue_head = NULL, *queue_tail = NULL;
+static size_t used = 0;       // number of the bytes of the queued, read & being read slots
+
+// The statistics
+static unsigned long numb_read, numb_taken, numb_waited, numb_unused;
+
+/* Get the seconds elapsed since the passed time */
+static double sec_since(const struct timespec *p_tm, struct timespec *p_now)
+{
+  clock_gettime(CLOCK_MONOTONIC, p_now);
+  return (p_now->tv_sec - p_tm->tv_sec) + (p_now->tv_nsec - p_tm->tv_nsec) / 1e9;
+}
+
+/* Free the content of the slot, the read-ahead must be locked */
+static void free_slot(struct ra_slot *p_slot)
+{
+  if (p_slot->state == ra_ready)
+    numb_unused++;
+  free_file_cont(&p_slot->cont);
+  used -= p_slot->p_stream->size_chunk;
+  p_slot->state = ra_empty;
+}
+
+/* Free the stream, nothing must be read for it */
+static void free_stream(struct ra_stream *p_stream)
+{
+  io_ring_remove_file(p_stream->idx_file);
+  fd_cache_release(p_stream->ref);
+  free(p_stream->name);
+  free(p_stream);
+}
+
+/* Drop the stream: free its chunks, the chunks being read are freed by reap_dropped() */
+static void drop_stream(int idx)
+{
+  struct ra_stream *p_stream = streams[idx];
+  int i, numb_busy;
+
+  streams[idx] = NULL;
+  pthread_mutex_lock(&lock_ra);
+  for (i = 0; i < RA_DEPTH_MAX; ++i)
+    if (p_stream->slots[i].state == ra_ready || p_stream->slots[i].state == ra_failed)
+      free_slot(&p_stream->slots[i]);
+  p_stream->dropped = 1;
+  numb_busy = p_stream->numb_busy;
+  pthread_mutex_unlock(&lock_ra);
+
+  if (numb_busy == 0)
+    free_stream(p_stream);
+  else {
+    p_stream->next_dropped = dropped;
+    dropped = p_stream;
+  }
+}
+
+/* Free the dropped streams which chunks are read by now */
+static void reap_dropped(void)
+{
+  struct ra_stream **pp_stream = &dropped, *p_stream;
+  int i;
+
+  pthread_mutex_lock(&lock_ra);
+  while ( (p_stream = *pp_stream) != NULL ) {
+    if (p_stream->numb_busy) {
+      pp_stream = &p_stream->next_dropped;
+      continue;
+    }
+    for (i = 0; i < RA_DEPTH_MAX; ++i)
+      if (p_stream->slots[i].state != ra_empty)
+        free_slot(&p_stream->slots[i]);
+    *pp_stream = p_stream->next_dropped;
+    free_stream(p_stream);
+  }
+  pthread_mutex_unlock(&lock_ra);
+}
+
+/* Find the stream continued by the request, drop the idle streams.
+ * Return the index of the stream, or -1 if there's no one. */
+static int find_stream(const char *flname, uint64_t offs, size_t size)
+{
+  time_t now = time(NULL);
+  int i, found = -1;
+
+  if (dropped)
+    reap_dropped();
+  for (i = 0; i < RA_STREAMS_MAX; ++i) {
+    if (streams[i] == NULL)
+      continue;
+    if (now - streams[i]->tm_last > RA_IDLE)
+      drop_stream(i);
+    else if (found == -1 && streams[i]->next_offs == offs && streams[i]->size_chunk == size &&
+             strcmp(streams[i]->name, flname) == 0)
+      found = i;
+  }
+  return found;
+}
+
+/* Queue the next chunks of the stream to be read ahead, the read-ahead must be locked */
+static void schedule(struct ra_stream *p_stream)
+{
+  uint64_t offs;
+  int k, i, i_free;
+
+  for (k = 0; k < p_stream->depth; ++k) {
+    offs = p_stream->next_offs + (uint64_t)k * p_stream->size_chunk;
+    if (offs >= p_stream->size_file || used + p_stream->size_chunk > RA_BUDGET)
+      break;
+    for (i = 0, i_free = -1; i < RA_DEPTH_MAX; ++i) {
+      if (p_stream->slots[i].state == ra_empty) {
+        if (i_free == -1)
+          i_free = i;
+      }
+      else if (p_stream->slots[i].offs == offs)
+        break;
+    }
+    if (i < RA_DEPTH_MAX)
+      continue; // it's read or queued already
+    if (i_free == -1)
+      break;
+
+    struct ra_slot *p_slot = &p_stream->slots[i_free];
+    p_slot->state = ra_queued;
+    p_slot->offs = offs;
+    p_slot->p_stream = p_stream;
+    p_slot->next_queued = NULL;
+    if (queue_tail) queue_tail->next_queued = p_slot;
+    else queue_head = p_slot;
+    queue_tail = p_slot;
+    p_stream->numb_busy++;
+    used += p_stream->size_chunk;
+  }
+  pthread_cond_signal(&cond_queued);
+}
+
+/* Continue the stream by the request: update the timing, free the passed chunks & read the next ones */
+static void advance(struct ra_stream *p_stream, uint64_t offs, size_t size)
+{
+  struct timespec now;
+  double sec = sec_since(&p_stream->tm_req, &now);
+  int i;
+
+  if (p_stream->numb_seq)
+    p_stream->sec_req = p_stream->numb_seq == 1 ? sec : 0.75 * p_stream->sec_req + 0.25 * sec;
+  p_stream->tm_req = now;
+  p_stream->tm_last = time(NULL);
+  p_stream->numb_seq++;
+  p_stream->next_offs = offs + size;
+  if (p_stream->numb_seq < RA_SEQ_MIN)
+    return;
+
+  pthread_mutex_lock(&lock_ra);
+  // The client making more requests while a chunk is read needs more chunks ahead
+  if (p_stream->sec_read == 0. || p_stream->sec_req <= 0.)
+    p_stream->depth = 2;
+  else if (p_stream->sec_read / p_stream->sec_req >= RA_DEPTH_MAX - 1)
+    p_stream->depth = RA_DEPTH_MAX;
+  else
+    p_stream->depth = 2 + (int)(p_stream->sec_read / p_stream->sec_req);
+  for (i = 0; i < RA_DEPTH_MAX; ++i)
+    if ((p_stream->slots[i].state == ra_ready || p_stream->slots[i].state == ra_failed) &&
+        p_stream->slots[i].offs < p_stream->next_offs)
+      free_slot(&p_stream->slots[i]);
+  schedule(p_stream);
+  pthread_mutex_unlock(&lock_ra);
+}
+
+/* Set the result of the reading of the slot, the read-ahead must be locked */
+static void read_done(struct ra_slot *p_slot, int rc)
+{
+  struct ra_stream *p_stream = p_slot->p_stream;
+  struct timespec now;
+  double sec;
+
+  p_slot->state = rc ? ra_failed : ra_ready;
+  if (rc == 0) {
+    sec = sec_since(&p_slot->tm_start, &now);
+    p_stream->sec_read = p_stream->sec_read == 0. ? sec : 0.75 * p_stream->sec_read + 0.25 * sec;
+    numb_read++;
+  }
+  p_stream->numb_busy--;
+  pthread_cond_broadcast(&cond_read);
+}
+
+/* Read the queued chunks one by one */
+static void *read_loop(void *arg)
+{
+  struct ra_slot *p_slot;
+  struct ra_stream *p_stream;
+  t_flcont cont;
+  int last = 0, rc, skip;
+
+  (void)arg;
+  pthread_mutex_lock(&lock_ra);
+  while (1) {
+    while (queue_head == NULL)
+      pthread_cond_wait(&cond_queued, &lock_ra);
+    p_slot = queue_head;
+    if ( (queue_head = p_slot->next_queued) == NULL )
+      queue_tail = NULL;
+    p_stream = p_slot->p_stream;
+    p_slot->state = ra_reading;
+    skip = p_stream->dropped;
+    pthread_mutex_unlock(&lock_ra);
+
+    // The descriptor & name of the stream are kept while its chunks are read
+    memset(&cont, 0, sizeof(cont));
+    rc = 1;
+    clock_gettime(CLOCK_MONOTONIC, &p_slot->tm_start);
+    if (!skip)
+      rc = direct_io_read_chunk(p_stream->name, p_stream->fd, p_stream->fd_direct, p_slot->offs,
+                                p_stream->size_chunk, &cont, &last, NULL);
+
+    pthread_mutex_lock(&lock_ra);
+    p_slot->cont = cont;
+    p_slot->last = last;
+    read_done(p_slot, rc);
+  }
+  return NULL;
+}
+
+/* Start the reading of the queued slot through io_uring, the read-ahead must be locked.
+ * Return 0 if the reading is started, 1 if the slot is failed. */
+static int ring_start(struct ra_slot *p_slot)
+{
+  struct ra_stream *p_stream = p_slot->p_stream;
+  struct stat statbuf;
+  size_t size = p_stream->size_chunk;
+  int rc;
+
+  // The file size is taken at each chunk as by the direct reading, the file may grow
+  if (p_stream->dropped || fstat(p_stream->fd, &statbuf) != 0 ||
+      p_slot->offs >= (uint64_t)statbuf.st_size)
+    return 1;
+  if ((uint64_t)statbuf.st_size - p_slot->offs < size)
+    size = (size_t)((uint64_t)statbuf.st_size - p_slot->offs);
+  p_slot->last = (p_slot->offs + size >= (uint64_t)statbuf.st_size);
+
+  // The aligned chunk of the large file is read with O_DIRECT into the aligned content rounded up,
+  // the other chunks are read through the registered descriptor
+  p_slot->direct = p_stream->fd_direct != -1 && p_slot->offs % DIO_ALIGN == 0;
+  if (p_slot->direct ? direct_io_alloc(&p_slot->cont, size) != 0 : alloc_file_cont(&p_slot->cont, size) == NULL)
+    return 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &p_slot->tm_start);
+  if (p_slot->direct)
+    rc = io_ring_read(p_stream->fd_direct, 0, p_slot->cont.t_flcont_val,
+                      (size + DIO_ALIGN - 1) & ~(size_t)(DIO_ALIGN - 1), p_slot->offs, p_slot);
+  else
+    rc = io_ring_read(p_stream->idx_file == -1 ? p_stream->fd : p_stream->idx_file, p_stream->idx_file != -1,
+                      p_slot->cont.t_flcont_val, size, p_slot->offs, p_slot);
+  if (rc != 0) {
+    free_file_cont(&p_slot->cont);
+    return 1;
+  }
+  p_slot->state = ra_reading;
+  return 0;
+}
+
+/* Read the queued chunks through io_uring, many at once; if the ring fails, the chunks in flight
+ * are failed and the next ones are read one by one */
+static void *read_loop_ring(void *arg)
+{
+  struct ra_slot *p_slot, *flight[IO_RING_DEPTH];
+  void *datas[IO_RING_DEPTH];
+  int results[IO_RING_DEPTH];
+  int numb_flight = 0, n, i, j;
+
+  pthread_mutex_lock(&lock_ra);
+  while (1) {
+    while (queue_head == NULL && numb_flight == 0)
+      pthread_cond_wait(&cond_queued, &lock_ra);
+
+    // The queued chunks are started while the ring has free entries, the rest wait
+    while (queue_head && numb_flight < IO_RING_DEPTH) {
+      p_slot = queue_head;
+      if ( (queue_head = p_slot->next_queued) == NULL )
+        queue_tail = NULL;
+      if (ring_start(p_slot) == 0)
+        flight[numb_flight++] = p_slot;
+      else
+        read_done(p_slot, 1);
+    }
+    pthread_mutex_unlock(&lock_ra);
+
+    // The slots in flight aren't touched by the main thread, the buffers are set already
+    if ( (n = io_ring_wait(datas, results, IO_RING_DEPTH)) == -1 )
+      break;
+
+    pthread_mutex_lock(&lock_ra);
+    for (i = 0; i < n; ++i) {
+      p_slot = datas[i];
+      // A short read is failed, the chunk is read directly then
+      read_done(p_slot, results[i] < 0 || (size_t)results[i] < p_slot->cont.t_flcont_len);
+      if (p_slot->p_stream->large && !p_slot->direct)
+        direct_io_drop(p_slot->p_stream->fd, p_slot->offs, p_slot->cont.t_flcont_len);
+      for (j = 0; flight[j] != p_slot; ++j)
+        ;
+      flight[j] = flight[--numb_flight];
+    }
+  }
+
+  // The waiting requests read the chunks in flight directly. Their buffers are left to the kernel,
+  // which may still complete the reads into them
+  LOG(LOG_TYPE_RDAH, LOG_LEVEL_ERROR, "io_uring failed, the chunks are read one by one: %s", strerror(errno));
+  pthread_mutex_lock(&lock_ra);
+  __atomic_store_n(&use_ring, 0, __ATOMIC_RELAXED);
+  for (i = 0; i < numb_flight; ++i) {
+    memset(&flight[i]->cont, 0, sizeof(t_flcont));
+    read_done(flight[i], 1);
+  }
+  pthread_mutex_unlock(&lock_ra);
+  return read_loop(arg);
+}
+
+/* Start the background I/O thread of the read-ahead. */
+int read_ahead_init(int ring)
+{
+  pthread_attr_t attr;
+  pthread_t tid;
+  int rc;
+
+  use_ring = ring; // it's reset by the thread if the ring fails
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+  rc = pthread_create(&tid, &attr, ring ? read_loop_ring : read_loop, NULL);
+  pthread_attr_destroy(&attr);
+  if (rc != 0) {
+    use_ring = 0;
+    fprintf(stderr, "Failed to start the read-ahead thread, the chunks are read on request\n%s\n",
+            strerror(rc));
+    return 1;
+  }
+  enabled = 1;
+  return 0;
+}
+
+/* Take the chunk read ahead by the stream the request continues. */
+int read_ahead_take(const char *flname, uint64_t offs, size_t size, t_flcont *p_flcont, int *p_last)
+{
+  struct ra_stream *p_stream;
+  struct ra_slot *p_slot = NULL;
+  int idx, i, taken = 0;
+
+  if (!enabled || (idx = find_stream(flname, offs, size)) == -1)
+    return 0;
+  p_stream = streams[idx];
+
+  pthread_mutex_lock(&lock_ra);
+  for (i = 0; i < RA_DEPTH_MAX && !p_slot; ++i)
+    if (p_stream->slots[i].state != ra_empty && p_stream->slots[i].offs == offs)
+      p_slot = &p_stream->slots[i];
+  if (p_slot && (p_slot->state == ra_queued || p_slot->state == ra_reading)) {
+    numb_waited++;
+    while (p_slot->state == ra_queued || p_slot->state == ra_reading)
+      pthread_cond_wait(&cond_read, &lock_ra);
+  }
+  if (p_slot && p_slot->state == ra_ready) {
+    *p_flcont = p_slot->cont;
+    *p_last = p_slot->last;
+    memset(&p_slot->cont, 0, sizeof(p_slot->cont));
+    p_slot->state = ra_empty;
+    used -= size;
+    numb_taken++;
+    taken = 1;
+  }
+  pthread_mutex_unlock(&lock_ra);
+
+  // The failed chunk is read directly, that reports the error
+  if (!taken)
+    return 0;
+  LOG(LOG_TYPE_RDAH, LOG_LEVEL_DEBUG, "taken %s, offset %lu, depth %d", flname, offs, p_stream->depth);
+  if (*p_last)
+    drop_stream(idx);
+  else
+    advance(p_stream, offs, size);
+  return 1;
+}
+
+/* Note the chunk read directly. */
+void read_ahead_note(const char *flname, uint64_t offs, size_t size, int last)
+{
+  struct ra_stream *p_stream;
+  struct stat statbuf;
+  int idx, i;
+
+  if (!enabled)
+    return;
+  if ( (idx = find_stream(flname, offs, size)) == -1 ) {
+    if (last)
+      return;
+    // A new stream replaces the least recently used one
+    for (i = 0, idx = 0; i < RA_STREAMS_MAX && streams[idx]; ++i)
+      if (streams[i] == NULL || streams[i]->tm_last < streams[idx]->tm_last)
+        idx = i;
+    if (streams[idx])
+      drop_stream(idx);
+    if ( (p_stream = calloc(1, sizeof(struct ra_stream))) == NULL ||
+         (p_stream->name = strdup(flname)) == NULL ) {
+      free(p_stream);
+      return;
+    }
+    p_stream->size_chunk = size;
+    p_stream->idx_file = p_stream->fd_direct = -1;
+    streams[idx] = p_stream;
+  }
+  if (last) {
+    drop_stream(idx);
+    return;
+  }
+  p_stream = streams[idx];
+
+  // The descriptor of the file is kept for the I/O thread as soon as the requests are sequential
+  if (p_stream->numb_seq + 1 >= RA_SEQ_MIN && p_stream->ref == NULL) {
+    if ( (p_stream->ref = fd_cache_get(flname, &p_stream->fd, NULL)) == NULL ||
+         fstat(p_stream->fd, &statbuf) != 0 ) {
+      drop_stream(idx);
+      return;
+    }
+    p_stream->size_file = (uint64_t)statbuf.st_size;
+    p_stream->large = direct_io_wanted(p_stream->size_file);
+    p_stream->fd_direct = p_stream->large ? fd_cache_direct(p_stream->ref) : -1;
+    if (__atomic_load_n(&use_ring, __ATOMIC_RELAXED))
+      p_stream->idx_file = io_ring_add_file(p_stream->fd);
+    LOG(LOG_TYPE_RDAH, LOG_LEVEL_DEBUG, "read-ahead of %s from offset %lu", flname, offs + size);
+  }
+  advance(p_stream, offs, size);
+}
+
+/* Print the statistics. */
+void read_ahead_print_stats(FILE *hfile)
+{
+  int i, numb_streams = 0;
+  for (i = 0; i < RA_STREAMS_MAX; ++i)
+    numb_streams += streams[i] != NULL;
+  pthread_mutex_lock(&lock_ra);
+  fprintf(hfile, "Read-ahead: %d streams, %lu bytes buffered; chunks read ahead: %lu, taken: %lu "
+          "(waited for: %lu), unused: %lu\n",
+          numb_streams, (unsigned long)used, numb_read, numb_taken, numb_waited, numb_unused);
+  pthread_mutex_unlock(&lock_ra);
+}
@@ -0,0 +1,82 @@
+#ifndef _READ_AHEAD_H_
+#define _READ_AHEAD_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The read-ahead of the files downloaded chunk by chunk on the Server.
+ *
+ * A stream of the file is tracked by the offset of its next chunk: the chunk request
+ * continuing the stream is sequential. After RA_SEQ_MIN sequential requests the next chunks
+ * of the stream are read ahead by the background I/O thread into the slots of the stream,
+ * from the shared descriptor of the file, so the next request takes the chunk from memory
+ * (or waits for the chunk being read). The number of the chunks read ahead follows the
+ * client: it's the number of the requests the client makes while one chunk is read from
+ * the disk, plus one, up to RA_DEPTH_MAX. The streams idle for RA_IDLE seconds are dropped.
+ * The I/O thread reads the chunks one by one, or submits the chunks of all the streams
+ * at once through io_uring (see io_ring.h), then the disk gets many reads in flight.
+ */
+
+// Number of the sequential requests to start the read-ahead
+enum { RA_SEQ_MIN = 2 };
+
+// Max number of the chunks read ahead per stream
+enum { RA_DEPTH_MAX = 8 };
+
+// Max number of the tracked streams
+enum { RA_STREAMS_MAX = 32 };
+
+// Max number of the bytes read ahead by all the streams
+enum { RA_BUDGET = 64 * 1048576 };
+
+// Max idle time of the stream, seconds
+enum { RA_IDLE = 10 };
+
+/* Start the background I/O thread of the read-ahead.
+ *
+ * Parameters:
+ *  ring - 1 if the chunks are read through io_uring, it must be set up by io_ring_init().
+ *
+ * Return value:
+ *  0 on success, >0 if the thread can't be started (the chunks aren't read ahead).
+ */
+int read_ahead_init(int ring);
+
+/* Take the chunk read ahead by the stream the request continues.
+ *
+ * If the chunk is being read, the call waits for it. The taken content is passed to the caller,
+ * it's freed as the content read directly.
+ *
+ * Parameters:
+ *  flname   - the name of the file.
+ *  offs     - the offset of the chunk.
+ *  size     - the size of the chunk.
+ *  p_flcont - a pointer to the content to be set, it must be empty.
+ *  p_last   - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *
+ * Return value:
+ *  1 if the chunk is taken, 0 if it should be read directly and passed to read_ahead_note().
+ */
+int read_ahead_take(const char *flname, uint64_t offs, size_t size, t_flcont *p_flcont, int *p_last);
+
+/* Note the chunk read directly: continue or start the stream and read its next chunks ahead.
+ *
+ * Parameters:
+ *  flname - the name of the file.
+ *  offs   - the offset of the chunk.
+ *  size   - the size of the chunk.
+ *  last   - 1 if the chunk reaches the end of file, the stream is dropped then.
+ */
+void read_ahead_note(const char *flname, uint64_t offs, size_t size, int last);
+
+/* Print the statistics: the streams, the buffered bytes, the chunks read ahead, taken & unused.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void read_ahead_print_stats(FILE *hfile);
+
+#endif
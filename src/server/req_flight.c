@@ -0,0 +1,70 @@
+/*
+ * req_flight.c: the single-flight coalescing of the concurrent identical requests.
+ * Errors range: none
+ */
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+
+#include "req_flight.h"
+#include "svc_sched.h"
+#include "../rpcgen/fltr.h"
+#include "../common/logging.h"
+
+// The last completed request of the procedure, its result is kept by the procedure
+static struct flight {
+  int valid;                // 1 if the result of the request is kept
+  char name[LEN_PATH_MAX];  // the file name
+  uint64_t arg1, arg2;      // the other arguments
+  struct timespec tm_done;  // time when the request was completed
+  unsigned long numb_done;  // number of the processed requests
+  unsigned long numb_joined; // number of the requests answered with the kept result
+} flights[NUMB_FLIGHT_PROCS];
+
+static const char *proc_names[NUMB_FLIGHT_PROCS] = {
+  "download_file", "pick_file", "download_chunk"
+};
+
+/* Join the request being dispatched to the previous identical request of the procedure. */
+int req_flight_join(enum flight_proc proc, const char *name, uint64_t arg1, uint64_t arg2)
+{
+  struct flight *p_flt = &flights[proc];
+  struct timespec tm_arrival;
+
+  if (p_flt->valid && p_flt->arg1 == arg1 && p_flt->arg2 == arg2 &&
+      svc_sched_arrival(&tm_arrival) == 0 &&
+      (tm_arrival.tv_sec < p_flt->tm_done.tv_sec ||
+       (tm_arrival.tv_sec == p_flt->tm_done.tv_sec && tm_arrival.tv_nsec <= p_flt->tm_done.tv_nsec)) &&
+      strcmp(p_flt->name, name) == 0) {
+    p_flt->numb_joined++;
+    LOG(LOG_TYPE_FLGT, LOG_LEVEL_DEBUG, "joined %s: %s", proc_names[proc], name);
+    return 1;
+  }
+  p_flt->valid = 0;
+  return 0;
+}
+
+/* Record the successful completion of the request of the procedure. */
+void req_flight_done(enum flight_proc proc, const char *name, uint64_t arg1, uint64_t arg2)
+{
+  struct flight *p_flt = &flights[proc];
+
+  strncpy(p_flt->name, name, LEN_PATH_MAX - 1);
+  p_flt->name[LEN_PATH_MAX - 1] = '\0';
+  p_flt->arg1 = arg1;
+  p_flt->arg2 = arg2;
+  clock_gettime(CLOCK_MONOTONIC, &p_flt->tm_done);
+  p_flt->valid = 1;
+  p_flt->numb_done++;
+}
+
+/* Print the statistics of the coalescing. */
+void req_flight_print_stats(FILE *hfile)
+{
+  int i;
+  fprintf(hfile, "Coalesced requests:\n");
+  for (i = 0; i < NUMB_FLIGHT_PROCS; ++i)
+    fprintf(hfile, "  %-15s processed: %lu, joined: %lu\n",
+            proc_names[i], flights[i].numb_done, flights[i].numb_joined);
+}
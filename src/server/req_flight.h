@@ -0,0 +1,56 @@
+#ifndef _REQ_FLIGHT_H_
+#define _REQ_FLIGHT_H_
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*
+ * The single-flight coalescing of the concurrent identical requests on the Server.
+ *
+ * The requests are served one by one by the event loop, and the result of an RPC procedure
+ * is kept in its static variable until the next call of the procedure. So the identical
+ * request that arrived while the previous one was being processed (e.g. the same chunk of
+ * the same file requested by many clients at once) is answered with the kept result
+ * instead of doing the work again. The request that arrived after the completion
+ * of the previous one is always processed, so no result outlives its concurrent requests.
+ */
+
+/* The procedures whose requests are coalesced */
+enum flight_proc {
+  flight_download_file,   /* download_file: the file name */
+  flight_pick_file,       /* pick_file: the file name & the pick type (listing, stat) */
+  flight_download_chunk,  /* download_chunk: the file name, the offset & size of the chunk */
+  NUMB_FLIGHT_PROCS
+};
+
+/* Join the request being dispatched to the previous identical request of the procedure.
+ *
+ * If the request can't be joined, the previous request is forgotten, because its result
+ * is going to be overwritten by the procedure.
+ *
+ * Parameters:
+ *  proc - the procedure of the request.
+ *  name - the file name of the request.
+ *  arg1 - the first argument of the request other than the name, 0 if none.
+ *  arg2 - the second argument of the request other than the name, 0 if none.
+ *
+ * Return value:
+ *  1 if the result of the previous request should be returned as is: the request has
+ *  the same arguments and it arrived before the previous one was completed; 0 otherwise.
+ */
+int req_flight_join(enum flight_proc proc, const char *name, uint64_t arg1, uint64_t arg2);
+
+/* Record the successful completion of the request of the procedure.
+ *
+ * Parameters: the same as of req_flight_join().
+ */
+void req_flight_done(enum flight_proc proc, const char *name, uint64_t arg1, uint64_t arg2);
+
+/* Print the statistics: the number of the processed and joined requests per procedure.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void req_flight_print_stats(FILE *hfile);
+
+#endif
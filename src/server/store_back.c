@@ -0,0 +1,342 @@
+/*
+ * store_back.c: the pluggable storage backends of the Server, mounted on the path prefixes.
+ * Errors range: 106-109 (reserve 110)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <errno.h>
+
+#include "store_back.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The backends to mount
+static const struct store_back *backs[] = { &store_back_posix, &store_back_mem };
+
+// The mounted backend
+struct sb_mount {
+  const char *prefix;       // the path prefix without the trailing slashes
+  size_t len_prefix;
+  const struct store_back *p_back;
+  void *ctx;                // the context of the mount made by the backend
+  unsigned long numb_written, numb_read; // the files written & the files or chunks read
+  unsigned long long bytes_written, bytes_read;
+  unsigned long numb_failed; // the failed requests
+};
+
+// The chunked upload through the backend
+struct sb_sess {
+  char *name;               // the path of the file
+  struct sb_mount *p_mnt;
+  sb_file file;             // the created file
+  struct sockaddr_storage owner; // the address of the client uploading the file
+  socklen_t len_owner;      //   & its length
+  time_t tm_last;           // time of the last chunk
+  struct sb_sess *next;
+};
+
+static struct sb_mount mounts[SB_MOUNTS_MAX];
+static int numb_mounts = 0;
+static struct sb_sess *sessions = NULL;
+
+/* Find the mount of the path: the longest matching prefix; the path relative to it is set */
+static struct sb_mount *find_mount(const char *name, const char **p_rel)
+{
+  struct sb_mount *p_mnt, *p_found = NULL;
+  for (p_mnt = mounts; p_mnt < mounts + numb_mounts; ++p_mnt)
+    if (strncmp(name, p_mnt->prefix, p_mnt->len_prefix) == 0 &&
+        (name[p_mnt->len_prefix] == '/' || name[p_mnt->len_prefix] == '\0') &&
+        (p_found == NULL || p_mnt->len_prefix > p_found->len_prefix))
+      p_found = p_mnt;
+  if (p_found)
+    *p_rel = name + p_found->len_prefix;
+  return p_found;
+}
+
+/* Record the error of the backend, return its number */
+static int back_error(struct sb_mount *p_mnt, const char *name, int errnum, const char *msg, err_inf **pp_errinf)
+{
+  p_mnt->numb_failed++;
+  (void)process_error(name, errnum, msg, pp_errinf);
+  return errnum;
+}
+
+/* Find the chunked upload of the file, of any client if `p_caller` is NULL */
+static struct sb_sess **find_sess(const char *name, const struct netbuf *p_caller)
+{
+  struct sb_sess **pp_sess;
+  for (pp_sess = &sessions; *pp_sess; pp_sess = &(*pp_sess)->next)
+    if (strcmp((*pp_sess)->name, name) == 0)
+      return p_caller == NULL || ((*pp_sess)->len_owner == p_caller->len &&
+                                  memcmp(&(*pp_sess)->owner, p_caller->buf, p_caller->len) == 0) ?
+             pp_sess : NULL;
+  return NULL;
+}
+
+/* Remove the chunked upload, its file is published if `publish` is set, or discarded.
+ * Return 0 or -1 if the file can't be published */
+static int remove_sess(struct sb_sess **pp_sess, int publish)
+{
+  struct sb_sess *p_sess = *pp_sess;
+  int rc = p_sess->p_mnt->p_back->commit(p_sess->file, publish);
+  if (!publish)
+    LOG(LOG_TYPE_SBCK, LOG_LEVEL_WARN, "upload was discarded: %s", p_sess->name);
+  *pp_sess = p_sess->next;
+  free(p_sess->name);
+  free(p_sess);
+  return rc;
+}
+
+/* Mount the backend on the path prefix. */
+int store_back_mount(char *spec)
+{
+  struct sb_mount *p_mnt = &mounts[numb_mounts];
+  const char *arg;
+  char *p_back;
+  size_t i, len;
+
+  if ( (p_back = strchr(spec, '=')) == NULL || spec[0] != '/' ) {
+    fprintf(stderr, "!--Error 6: Invalid backend mount, expected 'prefix=backend[:arg|,arg]': %s\n\n", spec);
+    return -1;
+  }
+  if (numb_mounts == SB_MOUNTS_MAX) {
+    fprintf(stderr, "!--Error 6: Too many backend mounts, max %d\n\n", SB_MOUNTS_MAX);
+    return -1;
+  }
+  *p_back++ = '\0';
+  for (p_mnt->len_prefix = strlen(spec); p_mnt->len_prefix > 0 && spec[p_mnt->len_prefix - 1] == '/';
+       --p_mnt->len_prefix)
+    spec[p_mnt->len_prefix - 1] = '\0';
+  if (p_mnt->len_prefix == 0) {
+    fprintf(stderr, "!--Error 6: Invalid prefix of the backend mount: /\n\n");
+    return -1;
+  }
+
+  for (i = 0; i < sizeof(backs) / sizeof(backs[0]); ++i) {
+    len = strlen(backs[i]->name);
+    if (strncmp(p_back, backs[i]->name, len) == 0 &&
+        (p_back[len] == '\0' || p_back[len] == ':' || p_back[len] == ','))
+      break;
+  }
+  if (i == sizeof(backs) / sizeof(backs[0])) {
+    fprintf(stderr, "!--Error 6: Unknown storage backend: %s\n\n", p_back);
+    return -1;
+  }
+  arg = p_back[len] ? p_back + len + 1 : NULL;
+  if (backs[i]->mount(arg, &p_mnt->ctx) != 0) {
+    fprintf(stderr, "!--Error 6: Invalid argument of the '%s' backend: %s\n\n", backs[i]->name,
+            arg ? arg : "");
+    return -1;
+  }
+  p_mnt->prefix = spec;
+  p_mnt->p_back = backs[i];
+  numb_mounts++;
+  return 0;
+}
+
+/* Check whether the memory backend is mounted. */
+int store_back_in_memory(void)
+{
+  int i;
+  for (i = 0; i < numb_mounts; ++i)
+    if (mounts[i].p_back == &store_back_mem)
+      return 1;
+  return 0;
+}
+
+/* Get the path in the file system of the file under a backend mount. */
+int store_back_fs_path(const char *name, char *path, const char **p_flname)
+{
+  struct sb_mount *p_mnt;
+  const char *rel;
+
+  if ( (p_mnt = find_mount(name, &rel)) == NULL )
+    return -1;
+  *p_flname = p_mnt->p_back->path(p_mnt->ctx, rel, path);
+  return 0;
+}
+
+/* Get the status of the file under a backend mount. */
+int store_back_stat(const char *name, struct stat *p_stat)
+{
+  struct sb_mount *p_mnt;
+  const char *rel;
+
+  if ( (p_mnt = find_mount(name, &rel)) == NULL )
+    return -1;
+  return p_mnt->p_back->stat(p_mnt->ctx, rel, p_stat) == 0 ? 0 : 1;
+}
+
+/* Save the uploaded file through the backend of its path. */
+int store_back_save(const char *name, const t_flcont *p_flcont, err_inf **pp_errinf)
+{
+  struct sb_mount *p_mnt;
+  const char *rel;
+  sb_file file;
+
+  if ( (p_mnt = find_mount(name, &rel)) == NULL )
+    return -1;
+  if ( (file = p_mnt->p_back->open(p_mnt->ctx, rel, 1, p_flcont->t_flcont_len)) == NULL )
+    return back_error(p_mnt, name, 106, "Failed to create the file of the backend", pp_errinf);
+  if (p_mnt->p_back->pwrite(file, p_flcont->t_flcont_val, p_flcont->t_flcont_len, 0) !=
+      (ssize_t)p_flcont->t_flcont_len) {
+    (void)p_mnt->p_back->commit(file, 0);
+    return back_error(p_mnt, name, 108, "Failed to write the file of the backend", pp_errinf);
+  }
+  if (p_mnt->p_back->commit(file, 1) != 0)
+    return back_error(p_mnt, name, 108, "Failed to commit the file of the backend", pp_errinf);
+  p_mnt->numb_written++;
+  p_mnt->bytes_written += p_flcont->t_flcont_len;
+  return 0;
+}
+
+/* Read the downloaded file through the backend of its path. */
+int store_back_load(const char *name, t_flcont *p_flcont, err_inf **pp_errinf)
+{
+  int last;
+  return store_back_read_chunk(name, 0, SIZE_MAX, p_flcont, &last, pp_errinf);
+}
+
+/* Write the uploaded chunk through the backend of its path. */
+int store_back_write_chunk(const chunk_inf *p_chunk, const struct netbuf *p_caller, err_inf **pp_errinf)
+{
+  struct sb_sess **pp_sess, *p_sess;
+  struct sb_mount *p_mnt;
+  const char *rel;
+  time_t tm_now = time(NULL);
+
+  if ( (p_mnt = find_mount(p_chunk->name, &rel)) == NULL )
+    return -1;
+
+  // The uploads idle for too long are discarded
+  for (pp_sess = &sessions; *pp_sess; )
+    if (tm_now - (*pp_sess)->tm_last > SB_SESS_TIMEOUT)
+      (void)remove_sess(pp_sess, 0);
+    else
+      pp_sess = &(*pp_sess)->next;
+
+  // The first chunk creates the file, the next ones are written to the file of the upload
+  if (p_chunk->chunk.offs == 0) {
+    if (find_sess(p_chunk->name, NULL)) {
+      errno = 0;
+      return back_error(p_mnt, p_chunk->name, 109, "The upload of the file is already in progress", pp_errinf);
+    }
+    if ( (p_sess = calloc(1, sizeof(struct sb_sess))) == NULL ||
+         (p_sess->name = strdup(p_chunk->name)) == NULL ) {
+      free(p_sess);
+      errno = 0;
+      return back_error(p_mnt, p_chunk->name, 109, "Failed to allocate memory for the upload", pp_errinf);
+    }
+    if ( (p_sess->file = p_mnt->p_back->open(p_mnt->ctx, rel, 1, p_chunk->size)) == NULL ) {
+      free(p_sess->name);
+      free(p_sess);
+      return back_error(p_mnt, p_chunk->name, 106, "Failed to create the file of the backend", pp_errinf);
+    }
+    p_sess->p_mnt = p_mnt;
+    p_sess->len_owner = p_caller->len < sizeof(p_sess->owner) ? p_caller->len : sizeof(p_sess->owner);
+    memcpy(&p_sess->owner, p_caller->buf, p_sess->len_owner);
+    p_sess->next = sessions;
+    sessions = p_sess;
+    pp_sess = &sessions;
+  }
+  else if ( (pp_sess = find_sess(p_chunk->name, p_caller)) == NULL ) {
+    errno = 0;
+    return back_error(p_mnt, p_chunk->name, 109, "No upload of the file is in progress by the client", pp_errinf);
+  }
+  p_sess = *pp_sess;
+  p_sess->tm_last = tm_now;
+
+  if (p_mnt->p_back->pwrite(p_sess->file, p_chunk->chunk.cont.t_flcont_val, p_chunk->chunk.cont.t_flcont_len,
+                            p_chunk->chunk.offs) != (ssize_t)p_chunk->chunk.cont.t_flcont_len) {
+    (void)back_error(p_mnt, p_chunk->name, 108, "Failed to write the file of the backend", pp_errinf);
+    (void)remove_sess(pp_sess, 0);
+    return 108;
+  }
+  p_mnt->bytes_written += p_chunk->chunk.cont.t_flcont_len;
+
+  // The last chunk completes the upload, the file is visible since then
+  if (p_chunk->chunk.last) {
+    if (remove_sess(pp_sess, 1) != 0)
+      return back_error(p_mnt, p_chunk->name, 108, "Failed to commit the file of the backend", pp_errinf);
+    p_mnt->numb_written++;
+  }
+  return 0;
+}
+
+/* Read the chunk of the file through the backend of its path. */
+int store_back_read_chunk(const char *name, uint64_t offs, size_t size, t_flcont *p_flcont,
+                          int *p_last, err_inf **pp_errinf)
+{
+  struct sb_mount *p_mnt;
+  struct stat statbuf;
+  const char *rel;
+  sb_file file;
+  ssize_t nrd;
+  char *buf;
+
+  if ( (p_mnt = find_mount(name, &rel)) == NULL )
+    return -1;
+  if ( (file = p_mnt->p_back->open(p_mnt->ctx, rel, 0, 0)) == NULL ||
+       p_mnt->p_back->stat(p_mnt->ctx, rel, &statbuf) != 0 ) {
+    if (file)
+      (void)p_mnt->p_back->commit(file, 0);
+    return back_error(p_mnt, name, 106, "Failed to open the file of the backend", pp_errinf);
+  }
+  if (offs > (uint64_t)statbuf.st_size) {
+    (void)p_mnt->p_back->commit(file, 0);
+    errno = 0;
+    return back_error(p_mnt, name, 107, "Invalid offset of the file chunk", pp_errinf);
+  }
+  if ((uint64_t)statbuf.st_size - offs < size)
+    size = (size_t)((uint64_t)statbuf.st_size - offs);
+  if ( (buf = malloc(size + 1)) == NULL ) {
+    (void)p_mnt->p_back->commit(file, 0);
+    errno = 0;
+    return back_error(p_mnt, name, 109, "Failed to allocate memory for the file content", pp_errinf);
+  }
+  if ( (nrd = p_mnt->p_back->pread(file, buf, size, offs)) != (ssize_t)size ) {
+    free(buf);
+    (void)p_mnt->p_back->commit(file, 0);
+    return back_error(p_mnt, name, 107, "Failed to read the file of the backend", pp_errinf);
+  }
+  (void)p_mnt->p_back->commit(file, 0);
+  p_flcont->t_flcont_val = buf;
+  p_flcont->t_flcont_len = size;
+  *p_last = (offs + size >= (uint64_t)statbuf.st_size);
+  p_mnt->numb_read++;
+  p_mnt->bytes_read += size;
+  return 0;
+}
+
+/* List the directory through the backend of its path. */
+int store_back_list(const char *dirname, struct ls_entries *p_ents)
+{
+  struct sb_mount *p_mnt;
+  const char *rel;
+  int rc;
+
+  if ( (p_mnt = find_mount(dirname, &rel)) == NULL )
+    return -1;
+  memset(p_ents, 0, sizeof(struct ls_entries));
+  if ( (rc = p_mnt->p_back->list(p_mnt->ctx, rel, p_ents)) != 0 )
+    p_mnt->numb_failed++;
+  return rc;
+}
+
+/* Print the statistics. */
+void store_back_print_stats(FILE *hfile)
+{
+  struct sb_mount *p_mnt;
+  for (p_mnt = mounts; p_mnt < mounts + numb_mounts; ++p_mnt) {
+    fprintf(hfile, "Backend %s on %s: files written: %lu (%llu bytes), files & chunks read: %lu (%llu bytes), "
+            "failed: %lu", p_mnt->p_back->name, p_mnt->prefix, p_mnt->numb_written, p_mnt->bytes_written,
+            p_mnt->numb_read, p_mnt->bytes_read, p_mnt->numb_failed);
+    p_mnt->p_back->print_stats(p_mnt->ctx, hfile);
+    fprintf(hfile, "\n");
+  }
+}
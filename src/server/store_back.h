@@ -0,0 +1,187 @@
+#ifndef _STORE_BACK_H_
+#define _STORE_BACK_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <rpc/rpc.h>
+#include "../rpcgen/fltr.h"
+#include "../common/fs_opers.h"
+
+/*
+ * The pluggable storage backends of the Server.
+ *
+ * A backend is mounted on a path prefix: the files under it are uploaded, downloaded & listed
+ * through the operations of the backend (struct store_back) with the paths relative to
+ * the prefix, instead of the file system. The backends:
+ *  - 'mem[,ttl[,max]]' - the files are kept in the memory of the worker & removed when they
+ *                   aren't accessed for `ttl` seconds (default: SB_MEM_TTL_DEF), up to `max` MiB
+ *                   of them (default: SB_MEM_MAX_DEF), the uploads beyond it are rejected; for
+ *                   the scratch areas & for the measurements of the protocol without the disk;
+ *  - 'posix:dir'  - the files are stored in the directory as is, through plain system calls.
+ * The uploads to the file system backend are checked for the free space & made durable as
+ * the native ones (see svc_admit_check_space(), durable_commit()).
+ * The paths outside the mounts are served by the file system with all the caches, the read-ahead,
+ * the storage layout & the packs, which the backends don't take part in; so the 'posix' backend
+ * is the plain baseline of the same disk.
+ */
+
+// Max number of the mounted backends
+enum { SB_MOUNTS_MAX = 8 };
+
+// Default time to live of the files of the memory backend, seconds
+enum { SB_MEM_TTL_DEF = 3600 };
+
+// Default limit of the files of the memory backend, MiB
+enum { SB_MEM_MAX_DEF = 1024 };
+
+// The chunked uploads idle for longer are discarded, seconds
+enum { SB_SESS_TIMEOUT = 600 };
+
+// The file opened by the backend
+typedef void *sb_file;
+
+// The operations of the backend, they return -1 & set errno on failure
+struct store_back {
+  const char *name;
+  /* Make the context of the mount by the argument of the backend ('ttl,max', 'dir', may be NULL) */
+  int (*mount)(const char *arg, void **p_ctx);
+  /* Open the file for reading, or create the new file of `size` bytes to be written (it fails
+   * if the file exists); the file is invisible to the readers till it's committed */
+  sb_file (*open)(void *ctx, const char *rel, int create, uint64_t size);
+  /* Read up to `size` bytes at the offset, return the number of bytes read */
+  ssize_t (*pread)(sb_file file, void *buf, size_t size, uint64_t offs);
+  /* Write the bytes at the offset of the created file, return the number of bytes written */
+  ssize_t (*pwrite)(sb_file file, const void *buf, size_t size, uint64_t offs);
+  /* Make the path of the file in the file system, return it or NULL if the backend isn't
+   * the file system one */
+  const char *(*path)(void *ctx, const char *rel, char *path);
+  /* Get the status of the file: the type, the size & the times */
+  int (*stat)(void *ctx, const char *rel, struct stat *p_stat);
+  /* List the directory as scan_dir(), return its result */
+  int (*list)(void *ctx, const char *rel, struct ls_entries *p_ents);
+  /* Close the file: the created one is published if `publish` is set, or discarded */
+  int (*commit)(sb_file file, int publish);
+  /* Print the statistics of the mount */
+  void (*print_stats)(void *ctx, FILE *hfile);
+};
+
+extern const struct store_back store_back_posix;
+extern const struct store_back store_back_mem;
+
+/* Mount the backend on the path prefix.
+ *
+ * Parameters:
+ *  spec - the mount 'prefix=backend[:arg|,arg]', e.g. '/scratch=mem,600' or '/plain=posix:/data';
+ *         it's modified by the parsing & must be kept.
+ *
+ * Return value:
+ *  0 on success, -1 if the mount is invalid (the error is printed to STDERR).
+ */
+int store_back_mount(char *spec);
+
+/* Check whether the memory backend is mounted: its files are seen only by the worker keeping them.
+ *
+ * Return value:
+ *  1 if it's mounted, 0 otherwise.
+ */
+int store_back_in_memory(void);
+
+/* Get the path in the file system of the file under a backend mount.
+ *
+ * Parameters:
+ *  name     - the path of the file.
+ *  path     - the buffer of LEN_PATH_MAX + 1 bytes for the path.
+ *  p_flname - a pointer to the path to be set: `path`, or NULL if the backend doesn't keep
+ *             the file in the file system (no free space check nor flush is needed then).
+ *
+ * Return value:
+ *  0 on success, -1 if the path isn't mounted.
+ */
+int store_back_fs_path(const char *name, char *path, const char **p_flname);
+
+/* Get the status of the file under a backend mount.
+ *
+ * Parameters:
+ *  name   - the path of the file.
+ *  p_stat - a pointer to the status to be set.
+ *
+ * Return value:
+ *  0 on success, -1 if the path isn't mounted, 1 if the backend has no such file.
+ */
+int store_back_stat(const char *name, struct stat *p_stat);
+
+/* Save the uploaded file through the backend of its path as save_file_cont().
+ *
+ * Parameters:
+ *  name      - the path of the file.
+ *  p_flcont  - a pointer to the file content.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the path isn't mounted, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int store_back_save(const char *name, const t_flcont *p_flcont, err_inf **pp_errinf);
+
+/* Read the downloaded file through the backend of its path as read_file_cont().
+ *
+ * Parameters:
+ *  name      - the path of the file.
+ *  p_flcont  - a pointer to the content to be set, it must be empty.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the path isn't mounted, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int store_back_load(const char *name, t_flcont *p_flcont, err_inf **pp_errinf);
+
+/* Write the uploaded chunk through the backend of its path as upld_sess_write(): the next
+ * chunks are accepted only from the caller that started the upload.
+ *
+ * Parameters:
+ *  p_chunk   - a pointer to the uploaded chunk of file.
+ *  p_caller  - the address of the caller (see svc_getrpccaller()).
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the path isn't mounted, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int store_back_write_chunk(const chunk_inf *p_chunk, const struct netbuf *p_caller, err_inf **pp_errinf);
+
+/* Read the chunk of the file through the backend of its path as pread_file_chunk().
+ *
+ * Parameters:
+ *  name      - the path of the file.
+ *  offs      - the offset of the chunk.
+ *  size      - the max size of the chunk.
+ *  p_flcont  - a pointer to the content to be set, it must be empty.
+ *  p_last    - a pointer to a flag set to 1 if the chunk reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the path isn't mounted, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int store_back_read_chunk(const char *name, uint64_t offs, size_t size, t_flcont *p_flcont,
+                          int *p_last, err_inf **pp_errinf);
+
+/* List the directory through the backend of its path as scan_dir().
+ *
+ * Parameters:
+ *  dirname - the path of the directory.
+ *  p_ents  - a pointer to the entries to be filled, they must be freed by free_dir_entries().
+ *
+ * Return value:
+ *  The same as of scan_dir(), -1 if the path isn't mounted.
+ */
+int store_back_list(const char *dirname, struct ls_entries *p_ents);
+
+/* Print the statistics: the requests & the bytes of each mount, the state of its backend.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void store_back_print_stats(FILE *hfile);
+
+#endif
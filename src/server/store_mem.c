@@ -0,0 +1,388 @@
+/*
+ * store_mem.c: the memory storage backend: the scratch files in the memory of the worker with
+ * the time to live.
+ * Errors range: none (the errors are reported by the callers of the backend, see store_back.c)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+#include "store_back.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The file in the memory
+struct mem_file {
+  struct mem_store *p_store;
+  char *rel;                // the path relative to the mount
+  char *data;               // the content
+  uint64_t size, alloc;     //   & its size & the allocated size
+  time_t mtime, atime;      // time the file was written & read
+  int complete;             // 0 while the file is written, it's invisible to the readers
+  struct mem_file *next;    // the next file of the hash chain
+};
+
+// The files of the mount
+struct mem_store {
+  time_t ttl;               // the files not accessed for longer are removed, seconds
+  struct mem_file **table;  // the hash table of the files by their paths
+  size_t size_table, numb_files;
+  uint64_t bytes;           // the memory of the contents
+  uint64_t max_bytes;       //   & its limit, the files beyond it aren't stored
+  unsigned long numb_full;  // the files rejected by the limit
+  unsigned long numb_expired; // the files removed by the time to live
+  time_t tm_swept;          // time the expired files were removed
+};
+
+/* Get the bucket of the path (FNV-1a) */
+static size_t bucket(const struct mem_store *p_store, const char *rel)
+{
+  uint32_t hash = 2166136261u;
+  for (; *rel; ++rel)
+    hash = (hash ^ (unsigned char)*rel) * 16777619u;
+  return hash & (p_store->size_table - 1);
+}
+
+/* Find the file of the path, the pointer to its chain link is returned */
+static struct mem_file **find_file(struct mem_store *p_store, const char *rel)
+{
+  struct mem_file **pp_file;
+  for (pp_file = &p_store->table[bucket(p_store, rel)]; *pp_file; pp_file = &(*pp_file)->next)
+    if (strcmp((*pp_file)->rel, rel) == 0)
+      return pp_file;
+  return NULL;
+}
+
+/* Remove the file from the table */
+static void remove_file(struct mem_file **pp_file)
+{
+  struct mem_file *p_file = *pp_file;
+  *pp_file = p_file->next;
+  p_file->p_store->numb_files--;
+  p_file->p_store->bytes -= p_file->alloc;
+  free(p_file->data);
+  free(p_file->rel);
+  free(p_file);
+}
+
+/* Remove the complete files not accessed within the time to live, once a second at most */
+static void sweep(struct mem_store *p_store)
+{
+  struct mem_file **pp_file;
+  time_t tm_now = time(NULL);
+  size_t i;
+
+  if (tm_now == p_store->tm_swept)
+    return;
+  p_store->tm_swept = tm_now;
+  for (i = 0; i < p_store->size_table; ++i)
+    for (pp_file = &p_store->table[i]; *pp_file; )
+      if ((*pp_file)->complete && tm_now - (*pp_file)->atime > p_store->ttl) {
+        LOG(LOG_TYPE_SBCK, LOG_LEVEL_INFO, "file expired: %s", (*pp_file)->rel);
+        p_store->numb_expired++;
+        remove_file(pp_file);
+      }
+      else
+        pp_file = &(*pp_file)->next;
+}
+
+/* Double the hash table when it's full */
+static void grow_table(struct mem_store *p_store)
+{
+  struct mem_file **table, *p_file, *p_next;
+  size_t size_old = p_store->size_table, i, h;
+
+  if (p_store->numb_files < size_old || (table = calloc(size_old * 2, sizeof(struct mem_file *))) == NULL)
+    return;
+  p_store->size_table = size_old * 2;
+  for (i = 0; i < size_old; ++i)
+    for (p_file = p_store->table[i]; p_file; p_file = p_next) {
+      p_next = p_file->next;
+      h = bucket(p_store, p_file->rel);
+      p_file->next = table[h];
+      table[h] = p_file;
+    }
+  free(p_store->table);
+  p_store->table = table;
+}
+
+/* Check whether the memory of the contents can grow by the bytes, errno is set if it can't */
+static int fits(struct mem_store *p_store, uint64_t bytes)
+{
+  if (bytes > p_store->max_bytes || p_store->bytes > p_store->max_bytes - bytes) {
+    p_store->numb_full++;
+    errno = ENOSPC;
+    return 0;
+  }
+  return 1;
+}
+
+/* The context of the mount is the table of the files, the argument is the time to live &
+ * the limit of the memory */
+static int mem_mount(const char *arg, void **p_ctx)
+{
+  struct mem_store *p_store;
+  char *endp;
+  long ttl = SB_MEM_TTL_DEF, max = SB_MEM_MAX_DEF;
+
+  if (arg) {
+    ttl = strtol(arg, &endp, 10);
+    if (*endp == ',')
+      max = strtol(endp + 1, &endp, 10);
+    if (*endp != '\0' || ttl <= 0 || max <= 0)
+      return -1;
+  }
+  if ( (p_store = calloc(1, sizeof(struct mem_store))) == NULL ||
+       (p_store->table = calloc(1024, sizeof(struct mem_file *))) == NULL ) {
+    free(p_store);
+    return -1;
+  }
+  p_store->ttl = (time_t)ttl;
+  p_store->max_bytes = (uint64_t)max << 20;
+  p_store->size_table = 1024;
+  *p_ctx = p_store;
+  return 0;
+}
+
+/* Open the complete file or create the new one */
+static sb_file mem_open(void *ctx, const char *rel, int create, uint64_t size)
+{
+  struct mem_store *p_store = ctx;
+  struct mem_file **pp_file, *p_file;
+  size_t h;
+
+  sweep(p_store);
+  if (rel[0] == '\0') {
+    errno = EISDIR; // the root of the mount
+    return NULL;
+  }
+  pp_file = find_file(p_store, rel);
+  if (!create) {
+    if (pp_file == NULL || !(*pp_file)->complete) {
+      errno = ENOENT;
+      return NULL;
+    }
+    (*pp_file)->atime = time(NULL);
+    return *pp_file;
+  }
+
+  // The file being written is invisible, but its name is taken
+  if (pp_file) {
+    errno = EEXIST;
+    return NULL;
+  }
+  if (!fits(p_store, size))
+    return NULL;
+  if ( (p_file = calloc(1, sizeof(struct mem_file))) == NULL || (p_file->rel = strdup(rel)) == NULL ||
+       (size && (p_file->data = malloc(size)) == NULL) ) {
+    if (p_file)
+      free(p_file->rel);
+    free(p_file);
+    errno = ENOMEM;
+    return NULL;
+  }
+  p_file->p_store = p_store;
+  p_file->alloc = size;
+  grow_table(p_store);
+  h = bucket(p_store, rel);
+  p_file->next = p_store->table[h];
+  p_store->table[h] = p_file;
+  p_store->numb_files++;
+  p_store->bytes += size;
+  return p_file;
+}
+
+/* The files aren't in the file system */
+static const char *mem_path(void *, const char *, char *)
+{
+  return NULL;
+}
+
+/* Read the bytes at the offset */
+static ssize_t mem_pread(sb_file file, void *buf, size_t size, uint64_t offs)
+{
+  struct mem_file *p_file = file;
+  if (offs >= p_file->size)
+    return 0;
+  if (p_file->size - offs < size)
+    size = (size_t)(p_file->size - offs);
+  memcpy(buf, p_file->data + offs, size);
+  return (ssize_t)size;
+}
+
+/* Write the bytes at the offset, the content grows to keep them */
+static ssize_t mem_pwrite(sb_file file, const void *buf, size_t size, uint64_t offs)
+{
+  struct mem_file *p_file = file;
+  uint64_t alloc;
+  char *data;
+
+  if (offs + size > p_file->alloc) {
+    alloc = p_file->alloc * 2 > offs + size ? p_file->alloc * 2 : offs + size;
+    // The doubling is capped by the limit, the exact size may fit yet
+    if (alloc - p_file->alloc > p_file->p_store->max_bytes - p_file->p_store->bytes)
+      alloc = offs + size;
+    if (!fits(p_file->p_store, alloc - p_file->alloc))
+      return -1;
+    if ( (data = realloc(p_file->data, alloc)) == NULL ) {
+      errno = ENOMEM;
+      return -1;
+    }
+    p_file->p_store->bytes += alloc - p_file->alloc;
+    p_file->data = data;
+    p_file->alloc = alloc;
+  }
+  if (offs > p_file->size)
+    memset(p_file->data + p_file->size, 0, offs - p_file->size);
+  memcpy(p_file->data + offs, buf, size);
+  if (offs + size > p_file->size)
+    p_file->size = offs + size;
+  return (ssize_t)size;
+}
+
+/* Check whether the complete file is in the directory or below it, return the length of
+ * its path within the directory or 0 */
+static size_t in_dir(const struct mem_file *p_file, const char *rel, size_t len)
+{
+  return p_file->complete && strncmp(p_file->rel, rel, len) == 0 && p_file->rel[len] == '/' ?
+         strlen(p_file->rel + len + 1) : 0;
+}
+
+/* Get the status of the file, the directory exists while it has the files */
+static int mem_stat(void *ctx, const char *rel, struct stat *p_stat)
+{
+  struct mem_store *p_store = ctx;
+  struct mem_file **pp_file, *p_file;
+  size_t len = strlen(rel), i;
+
+  memset(p_stat, 0, sizeof(struct stat));
+  p_stat->st_uid = getuid();
+  p_stat->st_gid = getgid();
+  p_stat->st_mode = S_IFDIR | 0755; // the root of the mount
+  if (len == 0)
+    return 0;
+  if ( (pp_file = find_file(p_store, rel)) != NULL && (*pp_file)->complete ) {
+    p_stat->st_mode = S_IFREG | 0644;
+    p_stat->st_size = (off_t)(*pp_file)->size;
+    p_stat->st_mtime = (*pp_file)->mtime;
+    p_stat->st_atime = (*pp_file)->atime;
+    return 0;
+  }
+  for (i = 0; i < p_store->size_table; ++i)
+    for (p_file = p_store->table[i]; p_file; p_file = p_file->next)
+      if (in_dir(p_file, rel, len))
+        return 0;
+  errno = ENOENT;
+  return -1;
+}
+
+/* Add the entry to the directory entries, return 0 or 1 for the allocation failure */
+static int add_entry(struct ls_entries *p_ents, const char *name, size_t len, mode_t mode,
+                     uint64_t size, time_t mtime)
+{
+  struct ls_entry *p_ent;
+  size_t numb;
+  void *p_new;
+
+  if (p_ents->numb == p_ents->numb_max) {
+    numb = p_ents->numb_max * 2 + 16;
+    if ( (p_new = realloc(p_ents->items, numb * sizeof(struct ls_entry))) == NULL )
+      return 1;
+    p_ents->items = p_new;
+    p_ents->numb_max = numb;
+  }
+  if (p_ents->len_names + len + 1 > p_ents->len_names_max) {
+    numb = (p_ents->len_names + len + 1) * 2;
+    if ( (p_new = realloc(p_ents->names, numb)) == NULL )
+      return 1;
+    p_ents->names = p_new;
+    p_ents->len_names_max = numb;
+  }
+  p_ent = &p_ents->items[p_ents->numb++];
+  memset(p_ent, 0, sizeof(struct ls_entry));
+  p_ent->offs_name = p_ents->len_names;
+  p_ent->mode = mode;
+  p_ent->uid = getuid();
+  p_ent->gid = getgid();
+  p_ent->size = (off_t)size;
+  p_ent->mtime = mtime;
+  memcpy(p_ents->names + p_ents->len_names, name, len);
+  p_ents->names[p_ents->len_names + len] = '\0';
+  p_ents->len_names += len + 1;
+  return 0;
+}
+
+/* List the directory: its files & the directories of the files below it */
+static int mem_list(void *ctx, const char *rel, struct ls_entries *p_ents)
+{
+  struct mem_store *p_store = ctx;
+  const struct mem_file *p_file;
+  const char *name, *p_slash;
+  size_t len = strlen(rel), len_name, i, j;
+  int rc = 0;
+
+  sweep(p_store);
+  while (len > 0 && rel[len - 1] == '/')
+    --len;
+  if (add_entry(p_ents, ".", 1, S_IFDIR | 0755, 0, 0) != 0 || add_entry(p_ents, "..", 2, S_IFDIR | 0755, 0, 0) != 0)
+    return 1;
+  for (i = 0; i < p_store->size_table && rc == 0; ++i)
+    for (p_file = p_store->table[i]; p_file && rc == 0; p_file = p_file->next) {
+      if (!in_dir(p_file, rel, len))
+        continue;
+      name = p_file->rel + len + 1;
+      if ( (p_slash = strchr(name, '/')) == NULL ) {
+        rc = add_entry(p_ents, name, strlen(name), S_IFREG | 0644, p_file->size, p_file->mtime);
+        continue;
+      }
+      // The directory is listed once
+      len_name = (size_t)(p_slash - name);
+      for (j = 2; j < p_ents->numb; ++j)
+        if (S_ISDIR(p_ents->items[j].mode) && strncmp(p_ents->names + p_ents->items[j].offs_name, name, len_name) == 0 &&
+            p_ents->names[p_ents->items[j].offs_name + len_name] == '\0')
+          break;
+      if (j == p_ents->numb)
+        rc = add_entry(p_ents, name, len_name, S_IFDIR | 0755, 0, p_file->mtime);
+    }
+  if (rc == 0 && len > 0 && p_ents->numb == 2) {
+    errno = ENOENT;
+    rc = 3;
+  }
+  return rc;
+}
+
+/* Close the file, the created one is published or removed */
+static int mem_commit(sb_file file, int publish)
+{
+  struct mem_file *p_file = file;
+  struct mem_file **pp_file;
+
+  if (p_file->complete)
+    return 0;
+  if (publish) {
+    p_file->complete = 1;
+    p_file->mtime = p_file->atime = time(NULL);
+  }
+  else if ( (pp_file = find_file(p_file->p_store, p_file->rel)) != NULL )
+    remove_file(pp_file);
+  return 0;
+}
+
+/* Print the files of the mount */
+static void mem_print_stats(void *ctx, FILE *hfile)
+{
+  struct mem_store *p_store = ctx;
+  fprintf(hfile, "; ttl: %ld s, files: %zu, memory: %llu of %llu bytes, expired: %lu, rejected as full: %lu",
+          (long)p_store->ttl, p_store->numb_files, (unsigned long long)p_store->bytes,
+          (unsigned long long)p_store->max_bytes, p_store->numb_expired, p_store->numb_full);
+}
+
+const struct store_back store_back_mem = {
+  "mem", mem_mount, mem_open, mem_pread, mem_pwrite, mem_path, mem_stat, mem_list, mem_commit, mem_print_stats
+};
@@ -0,0 +1,146 @@
+/*
+ * store_posix.c: the POSIX storage backend: the files of the directory through plain system calls.
+ * Errors range: none (the errors are reported by the callers of the backend, see store_back.c)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "store_back.h"
+#include "../common/file_opers.h"
+
+extern int errno; // global system error number
+
+// The opened file
+struct posix_file {
+  int fd;
+  int create;               // 1 if the file is created
+  int tmp;                  // 1 if the created file is anonymous (see open_new_file())
+  char path[LEN_PATH_MAX + 1];
+};
+
+/* Make the path of the file in the directory, return 0 or -1 if it's too long */
+static int make_path(void *ctx, const char *rel, char *path)
+{
+  if (snprintf(path, LEN_PATH_MAX + 1, "%s%s", (const char *)ctx, rel) > LEN_PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  return 0;
+}
+
+/* The context of the mount is the directory */
+static int posix_mount(const char *arg, void **p_ctx)
+{
+  struct stat statbuf;
+  if (arg == NULL || arg[0] != '/' || stat(arg, &statbuf) != 0 || !S_ISDIR(statbuf.st_mode))
+    return -1;
+  *p_ctx = (void *)arg;
+  return 0;
+}
+
+/* Open the file or create the new one */
+static sb_file posix_open(void *ctx, const char *rel, int create, uint64_t size)
+{
+  struct posix_file *p_file = malloc(sizeof(struct posix_file));
+
+  if (p_file == NULL || make_path(ctx, rel, p_file->path) != 0) {
+    free(p_file);
+    return NULL;
+  }
+  p_file->create = create;
+  p_file->tmp = 0;
+  if ( (p_file->fd = create ? open_new_file(p_file->path, size, &p_file->tmp, NULL)
+                            : open(p_file->path, O_RDONLY | O_CLOEXEC)) == -1 ) {
+    free(p_file);
+    return NULL;
+  }
+  return p_file;
+}
+
+/* Read the bytes at the offset */
+static ssize_t posix_pread(sb_file file, void *buf, size_t size, uint64_t offs)
+{
+  struct posix_file *p_file = file;
+  size_t done = 0;
+  ssize_t nrd;
+
+  while (done < size && (nrd = pread(p_file->fd, (char *)buf + done, size - done, (off_t)(offs + done))) != 0) {
+    if (nrd == -1) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    done += (size_t)nrd;
+  }
+  return (ssize_t)done;
+}
+
+/* Write the bytes at the offset */
+static ssize_t posix_pwrite(sb_file file, const void *buf, size_t size, uint64_t offs)
+{
+  struct posix_file *p_file = file;
+  size_t done = 0;
+  ssize_t nwr;
+
+  while (done < size) {
+    if ( (nwr = pwrite(p_file->fd, (const char *)buf + done, size - done, (off_t)(offs + done))) == -1 ) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    done += (size_t)nwr;
+  }
+  return (ssize_t)done;
+}
+
+/* Make the path of the file in the directory */
+static const char *posix_path(void *ctx, const char *rel, char *path)
+{
+  return make_path(ctx, rel, path) == 0 ? path : NULL;
+}
+
+/* Get the status of the file */
+static int posix_stat(void *ctx, const char *rel, struct stat *p_stat)
+{
+  char path[LEN_PATH_MAX + 1];
+  return make_path(ctx, rel, path) == 0 ? stat(path, p_stat) : -1;
+}
+
+/* List the directory */
+static int posix_list(void *ctx, const char *rel, struct ls_entries *p_ents)
+{
+  char path[LEN_PATH_MAX + 1];
+  return make_path(ctx, rel, path) == 0 ? scan_dir(path, p_ents) : 3;
+}
+
+/* Close the file, the created one is published or removed */
+static int posix_commit(sb_file file, int publish)
+{
+  struct posix_file *p_file = file;
+  int rc = 0;
+
+  if (p_file->create && publish)
+    rc = publish_new_file(p_file->path, p_file->fd, p_file->tmp, NULL) == 0 ? 0 : -1;
+  else if (p_file->create && !p_file->tmp)
+    (void)unlink(p_file->path);
+  if (close(p_file->fd) != 0)
+    rc = -1;
+  free(p_file);
+  return rc;
+}
+
+/* Print the directory of the mount */
+static void posix_print_stats(void *ctx, FILE *hfile)
+{
+  fprintf(hfile, "; directory: %s", (const char *)ctx);
+}
+
+const struct store_back store_back_posix = {
+  "posix", posix_mount, posix_open, posix_pread, posix_pwrite, posix_path, posix_stat, posix_list,
+  posix_commit, posix_print_stats
+};
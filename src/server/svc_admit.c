@@ -0,0 +1,256 @@
+/*
+ * svc_admit.c: the admission control of the bulk requests on the Server.
+ * Errors range: 66-68 (reserve 69-70)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <arpa/inet.h>
+
+#include "svc_admit.h"
+#include "data_dirs.h"
+#include "pack_store.h"
+#include "store_back.h"
+#include "zip_store.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Size of the buffer to peek the request: the RPC header with the max credentials
+// & verifier (400 bytes each), the max file name and the following arguments
+enum { LEN_PEEK_MAX = 8192 };
+
+// Offsets of the procedure number in the RPC call header:
+// [record mark (TCP only)] xid, message type, RPC version, program, version, procedure
+enum { OFFS_PROC_DGRAM = 20, OFFS_PROC_CONN = 24 };
+
+// The budget state shared by the worker processes
+struct admit_shm {
+  size_t in_flight;         // the reserved bytes of all the workers
+  size_t slots[];           // the reserved bytes of each worker
+};
+
+static struct admit_shm *p_shm = NULL; // the shared budget state
+static size_t budget;                  // the in-flight byte budget
+static int numb_slots;                 // number of the worker slots
+static int slot_curr = 0;              // the slot of this worker process
+static unsigned long numb_delayed = 0; // number of the failed reservations
+static unsigned long numb_rejected = 0; // number of the rejected requests
+
+/* Initialize the admission control. */
+int svc_admit_init(size_t budget_bytes, int numb_workers)
+{
+  size_t len = sizeof(struct admit_shm) + numb_workers * sizeof(size_t);
+  p_shm = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (p_shm == MAP_FAILED) {
+    p_shm = NULL;
+    fprintf(stderr, "Error 67: Cannot map the shared memory for the admission control\n%s\n",
+            strerror(errno));
+    return 67;
+  }
+  budget = budget_bytes;
+  numb_slots = numb_workers;
+  LOG(LOG_TYPE_ADMT, LOG_LEVEL_DEBUG, "budget %lu bytes, %d slots", budget, numb_slots);
+  return 0;
+}
+
+/* Attach the worker process to its slot of the budget. */
+void svc_admit_attach(int slot)
+{
+  slot_curr = slot;
+}
+
+/* Release the budget reserved by the died worker process. */
+void svc_admit_reclaim(int slot)
+{
+  if (p_shm == NULL || slot < 0 || slot >= numb_slots)
+    return;
+  size_t size = __atomic_exchange_n(&p_shm->slots[slot], 0, __ATOMIC_ACQ_REL);
+  if (size) {
+    __atomic_sub_fetch(&p_shm->in_flight, size, __ATOMIC_ACQ_REL);
+    LOG(LOG_TYPE_ADMT, LOG_LEVEL_WARN, "%lu bytes of the died worker %d were reclaimed", size, slot);
+  }
+}
+
+/* Read the next XDR unsigned int from the peeked request, return 0 if it's out of the data */
+static int peek_u32(const char *buf, size_t len, size_t *p_pos, uint32_t *p_val)
+{
+  uint32_t val;
+  if (*p_pos + sizeof(uint32_t) > len)
+    return 0;
+  memcpy(&val, buf + *p_pos, sizeof(uint32_t));
+  *p_val = ntohl(val);
+  *p_pos += sizeof(uint32_t);
+  return 1;
+}
+
+/* Skip the XDR opaque data of the passed length (it's padded to 4 bytes) */
+static int peek_skip(size_t len, size_t *p_pos, size_t nbytes)
+{
+  *p_pos += (nbytes + 3) & ~(size_t)3;
+  return *p_pos <= len;
+}
+
+/* Get the size of the file to be downloaded by download_file where download_file finds it:
+ * under a backend mount, in the packs, in the storage layout, stored compressed (its content
+ * is sent decompressed) or as is.
+ */
+static size_t file_size(const char *buf, uint32_t len_name)
+{
+  char name[LEN_PATH_MAX + 1], path[LEN_PATH_MAX + 1];
+  const char *flname;
+  struct stat statbuf;
+  uint64_t size;
+  int rc;
+
+  memcpy(name, buf, len_name);
+  name[len_name] = '\0';
+  if ( (rc = store_back_stat(name, &statbuf)) != -1 )
+    return rc == 0 && S_ISREG(statbuf.st_mode) ? (size_t)statbuf.st_size : 0;
+  if (pack_store_exists(name, &size))
+    return (size_t)size;
+  flname = data_dirs_path(name, 0, path, NULL);
+  if (zip_store_size(name, flname, &size) == 0)
+    return (size_t)size;
+  if (stat(flname, &statbuf) != 0 || !S_ISREG(statbuf.st_mode))
+    return 0;
+  return (size_t)statbuf.st_size;
+}
+
+/* Estimate the in-flight bytes of the pending bulk request. */
+size_t svc_admit_cost(int fd, int is_dgram, uint32_t proc)
+{
+  static char buf[LEN_PEEK_MAX];
+  size_t pos = (is_dgram ? OFFS_PROC_DGRAM : OFFS_PROC_CONN) + sizeof(uint32_t);
+  uint32_t val, len_name, hi, lo;
+  ssize_t nrd = recv(fd, buf, sizeof(buf), MSG_PEEK | MSG_DONTWAIT);
+  size_t len = nrd > 0 ? (size_t)nrd : 0;
+  int i;
+
+  // Only the first record fragment of the TCP request is parsed
+  if (!is_dgram && len >= sizeof(uint32_t)) {
+    memcpy(&val, buf, sizeof(uint32_t));
+    val = ntohl(val) & 0x7fffffff;
+    if (len > val + sizeof(uint32_t))
+      len = val + sizeof(uint32_t);
+  }
+
+  // Skip the credentials & the verifier: flavor, length, body
+  for (i = 0; i < 2; ++i)
+    if (!peek_u32(buf, len, &pos, &val) || !peek_u32(buf, len, &pos, &val) ||
+        !peek_skip(len, &pos, val))
+      return LEN_CHUNK_MAX;
+
+  // All the bulk procedures start with the file name
+  if (!peek_u32(buf, len, &pos, &len_name) || len_name > LEN_PATH_MAX ||
+      !peek_skip(len, &pos, len_name))
+    return LEN_CHUNK_MAX;
+
+  switch (proc) {
+    case upload_file: // file type, content length
+      if (peek_u32(buf, len, &pos, &val) && peek_u32(buf, len, &pos, &val))
+        return val;
+      break;
+    case upload_chunk: // file size, chunk offset, content length
+      if (peek_skip(len, &pos, 2 * sizeof(uint64_t)) && peek_u32(buf, len, &pos, &val))
+        return val;
+      break;
+    case download_chunk: // chunk offset, chunk size
+    case download_blocks: // uncompressed offset & size of the blocks
+      if (peek_u32(buf, len, &pos, &hi) && peek_u32(buf, len, &pos, &lo) &&
+          peek_u32(buf, len, &pos, &val))
+        return val < LEN_CHUNK_MAX ? val : LEN_CHUNK_MAX;
+      break;
+    case download_file:
+      return file_size(buf + pos - ((len_name + 3) & ~3u), len_name);
+  }
+  return LEN_CHUNK_MAX;
+}
+
+/* Check if the request fits the free budget, without reserving it. */
+int svc_admit_fits(size_t size)
+{
+  size_t in_flight;
+  if (p_shm == NULL)
+    return 1;
+  in_flight = __atomic_load_n(&p_shm->in_flight, __ATOMIC_ACQUIRE);
+  return in_flight == 0 || in_flight + size <= budget;
+}
+
+/* Reserve the request bytes in the budget. */
+int svc_admit_reserve(size_t size)
+{
+  size_t in_flight;
+  if (p_shm == NULL)
+    return 1;
+
+  in_flight = __atomic_load_n(&p_shm->in_flight, __ATOMIC_ACQUIRE);
+  do {
+    if (in_flight && in_flight + size > budget) {
+      numb_delayed++;
+      return 0;
+    }
+  } while (!__atomic_compare_exchange_n(&p_shm->in_flight, &in_flight, in_flight + size,
+                                        0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+  __atomic_add_fetch(&p_shm->slots[slot_curr], size, __ATOMIC_ACQ_REL);
+  return 1;
+}
+
+/* Release the bytes reserved by svc_admit_reserve(). */
+void svc_admit_release(size_t size)
+{
+  if (p_shm == NULL || size == 0)
+    return;
+  __atomic_sub_fetch(&p_shm->slots[slot_curr], size, __ATOMIC_ACQ_REL);
+  __atomic_sub_fetch(&p_shm->in_flight, size, __ATOMIC_ACQ_REL);
+}
+
+/* Count the request rejected because it waited for the budget too long. */
+void svc_admit_count_reject(void)
+{
+  numb_rejected++;
+}
+
+/* Check the free space of the file system where the file is to be created. */
+int svc_admit_check_space(const char *flname, uint64_t size, uint64_t pending,
+                          err_inf **pp_errinf)
+{
+  char dirpath[LEN_PATH_MAX + 1];
+  struct statvfs vfsbuf;
+  uint64_t avail;
+
+  strncpy(dirpath, flname, LEN_PATH_MAX);
+  dirpath[LEN_PATH_MAX] = '\0';
+  if (statvfs(dirname(dirpath), &vfsbuf) != 0) {
+    LOG(LOG_TYPE_ADMT, LOG_LEVEL_WARN, "statvfs() failed for %s: %s", flname, strerror(errno));
+    return 0; // the file creation will report the actual error
+  }
+
+  avail = (uint64_t)vfsbuf.f_bavail * vfsbuf.f_frsize;
+  avail = avail > pending ? avail - pending : 0;
+  if (size > avail) {
+    errno = ENOSPC;
+    (void)process_error(flname, 68, "Not enough free space on the file system for the file",
+                        pp_errinf);
+    LOG(LOG_TYPE_ADMT, LOG_LEVEL_WARN, "upload of %lu bytes is rejected, available %lu",
+        size, avail);
+    return 68;
+  }
+  return 0;
+}
+
+/* Print the admission control statistics. */
+void svc_admit_print_stats(FILE *hfile)
+{
+  fprintf(hfile, "Admission (budget: %lu bytes): in flight: %lu bytes (this worker: %lu), "
+          "delayed: %lu, rejected: %lu\n", budget,
+          p_shm ? __atomic_load_n(&p_shm->in_flight, __ATOMIC_ACQUIRE) : 0,
+          p_shm ? p_shm->slots[slot_curr] : 0, numb_delayed, numb_rejected);
+}
@@ -0,0 +1,128 @@
+#ifndef _SVC_ADMIT_H_
+#define _SVC_ADMIT_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The admission control of the bulk requests on the Server.
+ *
+ * The file data of the bulk request is held in memory as a whole while it's processed:
+ * the whole file of upload_file is decoded before the procedure is called, and the whole
+ * file of download_file is read before it's sent. So the size of the request data is
+ * estimated (peeked from the pending request) before the request is dispatched, and it's
+ * reserved in the in-flight byte budget shared by all the worker processes. The request
+ * which reply is deferred (see svc_loop_defer()) holds its bytes till the reply is sent.
+ * The requests which don't fit the budget wait in the scheduler queues, the chunk requests
+ * waiting too long are rejected with ERRNUM_BUSY and the retry-after time.
+ * Also the free space of the target file system is checked before an upload is accepted.
+ */
+
+/* Initialize the admission control.
+ *
+ * The budget is shared by the processes forked after this call, so it must be called
+ * by the master process before the workers are forked.
+ *
+ * Parameters:
+ *  budget_bytes - the in-flight byte budget.
+ *  numb_workers - the number of the worker processes, each one reserves in its own slot.
+ *
+ * Return value:
+ *  0 on success, >0 on failure.
+ */
+int svc_admit_init(size_t budget_bytes, int numb_workers);
+
+/* Attach the worker process to its slot of the budget.
+ *
+ * Parameters:
+ *  slot - the index of the worker process, 0 for the single process server.
+ */
+void svc_admit_attach(int slot);
+
+/* Release the budget reserved by the died worker process.
+ *
+ * Parameters:
+ *  slot - the index of the died worker process.
+ */
+void svc_admit_reclaim(int slot);
+
+/* Estimate the in-flight bytes of the pending bulk request.
+ *
+ * The request is peeked (not read) from the socket, the size of the file data is taken from
+ * the request arguments: the content length for the uploads, the requested chunk size for
+ * download_chunk & download_blocks and the file size for download_file: the size of the file
+ * where it's stored (a backend, the packs, the storage layout), the uncompressed one of the file
+ * stored compressed. If the arguments are not received yet, LEN_CHUNK_MAX is returned.
+ *
+ * Parameters:
+ *  fd       - the socket of the pending request.
+ *  is_dgram - 1 for the UDP socket, 0 for the TCP connection.
+ *  proc     - the procedure number of the request.
+ *
+ * Return value:
+ *  The estimated number of bytes.
+ */
+size_t svc_admit_cost(int fd, int is_dgram, uint32_t proc);
+
+/* Check if the request fits the free budget, without reserving it.
+ *
+ * Parameters:
+ *  size - the estimated bytes of the request.
+ *
+ * Return value:
+ *  1 if it fits, 0 otherwise.
+ */
+int svc_admit_fits(size_t size);
+
+/* Reserve the request bytes in the budget.
+ *
+ * The request larger than the whole budget is admitted only when nothing is in flight,
+ * so it's delayed but not starved.
+ *
+ * Parameters:
+ *  size - the estimated bytes of the request.
+ *
+ * Return value:
+ *  1 if the bytes are reserved, 0 if the request doesn't fit the budget.
+ */
+int svc_admit_reserve(size_t size);
+
+/* Release the bytes reserved by svc_admit_reserve().
+ *
+ * Parameters:
+ *  size - the reserved bytes.
+ */
+void svc_admit_release(size_t size);
+
+/* Count the request rejected because it waited for the budget too long. */
+void svc_admit_count_reject(void);
+
+/* Check the free space of the file system where the file is to be created.
+ *
+ * Parameters:
+ *  flname    - the name of the file to be uploaded.
+ *  size      - the size of the file.
+ *  pending   - the bytes already promised to the other uploads in progress.
+ *  pp_errinf - a double pointer to an `err_inf` structure for storing error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 if there is enough space (or it cannot be determined),
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int svc_admit_check_space(const char *flname, uint64_t size, uint64_t pending,
+                          err_inf **pp_errinf);
+
+/* Print the admission control statistics: the budget, the bytes in flight, the number of
+ * the delayed and rejected requests.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void svc_admit_print_stats(FILE *hfile);
+
+#endif
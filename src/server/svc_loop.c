@@ -0,0 +1,370 @@
+/*
+ * svc_loop.c: the event-driven (epoll based) loop of the Server that replaces svc_run().
+ * Errors range: 46-51 (reserve 52-55)
+ */
+#define _GNU_SOURCE /* for accept4() */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+
+#include "svc_loop.h"
+#include "svc_sched.h"
+#include "svc_admit.h"
+#include "cont_cache.h"
+#include "fd_cache.h"
+#include "read_ahead.h"
+#include "io_ring.h"
+#include "direct_io.h"
+#include "durable.h"
+#include "data_dirs.h"
+#include "dev_queue.h"
+#include "pack_store.h"
+#include "store_back.h"
+#include "zip_store.h"
+#include "dir_cache.h"
+#include "req_flight.h"
+#include "dir_delta.h"
+#include "dir_page.h"
+#include "dir_usage.h"
+#include "name_index.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The max number of events processed per one epoll_wait() call
+enum { NUMB_EVENTS_MAX = 256 };
+
+static int hepoll = -1;    // the epoll instance
+static int fd_spare = -1;  // a spare descriptor to get out of the open files limit
+static unsigned char *socks_kind; // transport kind indexed by the socket descriptor
+static volatile sig_atomic_t stats_req = 0; // set by SIGUSR1 to print the statistics
+static int fd_dispatched = -1;  // the socket which request is being dispatched
+static int deferred = 0;        // 1 if the reply to the dispatched request is deferred
+
+// The notification descriptors of the background threads
+static struct {
+  int fd;
+  void (*pf_notify)(void);
+} notifies[NUMB_NOTIFY_MAX];
+static int numb_notifies = 0;
+
+/* Pack the socket descriptor and the transport kind into the epoll user data */
+static uint64_t ev_data_pack(int fd, enum xprt_kind kind)
+{
+  return ((uint64_t)kind << 32) | (uint32_t)fd;
+}
+
+/* Raise the soft limit of open file descriptors up to the hard limit.
+ * Return the resulting soft limit.
+ */
+static int raise_nofile_limit(void)
+{
+  struct rlimit rlim;
+  if (getrlimit(RLIMIT_NOFILE, &rlim) != 0)
+    return FD_SETSIZE;
+  if (rlim.rlim_cur != rlim.rlim_max) {
+    rlim_t lim_prev = rlim.rlim_cur;
+    rlim.rlim_cur = rlim.rlim_max;
+    if (setrlimit(RLIMIT_NOFILE, &rlim) != 0) {
+      LOG(LOG_TYPE_LOOP, LOG_LEVEL_WARN, "Cannot raise the open files limit: %s", strerror(errno));
+      rlim.rlim_cur = lim_prev;
+    }
+    else
+      LOG(LOG_TYPE_LOOP, LOG_LEVEL_INFO, "open files limit raised to %ld", (long)rlim.rlim_cur);
+  }
+  return rlim.rlim_cur > INT32_MAX ? INT32_MAX : (int)rlim.rlim_cur;
+}
+
+/* Request the statistics printing on SIGUSR1 */
+static void on_stats_signal(int)
+{
+  stats_req = 1;
+}
+
+/* Print the statistics of the Server to STDERR */
+static void print_stats(void)
+{
+  fprintf(stderr, "---------- Server statistics, pid %d:\n", (int)getpid());
+  svc_sched_print_stats(stderr);
+  svc_admit_print_stats(stderr);
+  cont_cache_print_stats(stderr);
+  fd_cache_print_stats(stderr);
+  read_ahead_print_stats(stderr);
+  io_ring_print_stats(stderr);
+  direct_io_print_stats(stderr);
+  durable_print_stats(stderr);
+  data_dirs_print_stats(stderr);
+  dev_queue_print_stats(stderr);
+  pack_store_print_stats(stderr);
+  store_back_print_stats(stderr);
+  zip_store_print_stats(stderr);
+  dir_cache_print_stats(stderr);
+  req_flight_print_stats(stderr);
+  dir_page_print_stats(stderr);
+  dir_delta_print_stats(stderr);
+  dir_usage_print_stats(stderr);
+  name_index_print_stats(stderr);
+}
+
+/* Initialize the event loop. */
+int svc_loop_init(void)
+{
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "Begin");
+  int rc, numb_fds = raise_nofile_limit();
+
+  if ( (rc = svc_sched_init(numb_fds)) != 0 )
+    return rc;
+  if ( (socks_kind = calloc(numb_fds, sizeof(unsigned char))) == NULL ) {
+    fprintf(stderr, "Error 51: Failed to allocate memory for the event loop\n");
+    return 51;
+  }
+  signal(SIGUSR1, on_stats_signal);
+
+  if ( (hepoll = epoll_create1(EPOLL_CLOEXEC)) == -1 ) {
+    fprintf(stderr, "Error 46: Cannot create the epoll instance\n%s\n", strerror(errno));
+    return 46;
+  }
+
+  // Reserve a descriptor that is released when accept() fails with EMFILE
+  fd_spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "Done.");
+  return 0;
+}
+
+/* Add the RPC transport to the event loop. */
+int svc_loop_add_xprt(SVCXPRT *xprt, enum xprt_kind kind)
+{
+  struct epoll_event ev;
+  // The served sockets are reported once, until their request is dispatched and they are
+  // re-armed, so the requests waiting in the scheduler queues don't wake the loop again
+  ev.events = (kind == xprt_rendezvous ? EPOLLIN : EPOLLIN | EPOLLONESHOT);
+  ev.data.u64 = ev_data_pack(xprt->xp_fd, kind);
+
+  // Accept on the listening socket until it's drained, so it should not block
+  if (kind == xprt_rendezvous)
+    (void)fcntl(xprt->xp_fd, F_SETFL, fcntl(xprt->xp_fd, F_GETFL) | O_NONBLOCK);
+
+  if (epoll_ctl(hepoll, EPOLL_CTL_ADD, xprt->xp_fd, &ev) == -1) {
+    fprintf(stderr, "Error 47: Cannot add the socket %d to the epoll instance\n%s\n",
+            xprt->xp_fd, strerror(errno));
+    return 47;
+  }
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "socket %d (kind %d) was added", xprt->xp_fd, (int)kind);
+  return 0;
+}
+
+/* Add the notification descriptor of a background thread to the event loop. */
+int svc_loop_add_notify(int fd, void (*pf_notify)(void))
+{
+  struct epoll_event ev;
+
+  if (numb_notifies == NUMB_NOTIFY_MAX) {
+    fprintf(stderr, "Error 47: Too many notification descriptors\n");
+    return 47;
+  }
+  ev.events = EPOLLIN;
+  ev.data.u64 = ev_data_pack(fd, xprt_notify);
+  if (epoll_ctl(hepoll, EPOLL_CTL_ADD, fd, &ev) == -1) {
+    fprintf(stderr, "Error 47: Cannot add the descriptor %d to the epoll instance\n%s\n",
+            fd, strerror(errno));
+    return 47;
+  }
+  notifies[numb_notifies].fd = fd;
+  notifies[numb_notifies++].pf_notify = pf_notify;
+  return 0;
+}
+
+/* Call the handler of the notification descriptor ready to be read */
+static void notify(int fd)
+{
+  int n;
+  for (n = 0; n < numb_notifies; ++n)
+    if (notifies[n].fd == fd)
+      notifies[n].pf_notify();
+}
+
+/* Defer the reply to the request being dispatched. */
+int svc_loop_defer(void)
+{
+  if (fd_dispatched == -1 || socks_kind[fd_dispatched] != xprt_conn)
+    return -1;
+  deferred = 1;
+  return 0;
+}
+
+/* Resume the serving of the connection after the deferred reply is sent. */
+void svc_loop_resume(SVCXPRT *xprt)
+{
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.u64 = ev_data_pack(xprt->xp_fd, xprt_conn);
+  svc_sched_resume(xprt->xp_fd);
+  if (epoll_ctl(hepoll, EPOLL_CTL_MOD, xprt->xp_fd, &ev) == -1)
+    LOG(LOG_TYPE_LOOP, LOG_LEVEL_ERROR, "socket %d can't be re-armed: %s", xprt->xp_fd, strerror(errno));
+}
+
+/* Create the TCP transport listening on the fixed port shared with other processes. */
+SVCXPRT *svc_loop_create_reuseport(unsigned short port)
+{
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "Begin, port: %d", (int)port);
+  struct sockaddr_in addr;
+  SVCXPRT *xprt;
+  int opt = 1;
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+
+  if (fd == -1 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) == -1 ||
+      setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) == -1) {
+    fprintf(stderr, "Error 49: Cannot create the socket with SO_REUSEPORT option\n%s\n",
+            strerror(errno));
+    if (fd != -1) close(fd);
+    return NULL;
+  }
+
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(fd, SOMAXCONN) == -1) {
+    fprintf(stderr, "Error 50: Cannot listen on the port %d\n%s\n", (int)port, strerror(errno));
+    close(fd);
+    return NULL;
+  }
+
+  // svc_vc_create() takes over the bound & listening socket
+  if ( (xprt = svc_vc_create(fd, 0, 0)) == NULL )
+    close(fd);
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "Done.");
+  return xprt;
+}
+
+/* Reject a pending connection when the open files limit is reached.
+ *
+ * The level-triggered listening socket would be reported as ready again and again,
+ * so the pending connection is accepted on the released spare descriptor and closed.
+ */
+static void reject_conn(int fd_lsn)
+{
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_WARN, "open files limit is reached, the connection is rejected");
+  if (fd_spare == -1)
+    return;
+  close(fd_spare);
+  int fd = accept(fd_lsn, NULL, NULL);
+  if (fd != -1)
+    close(fd);
+  fd_spare = open("/dev/null", O_RDONLY | O_CLOEXEC);
+}
+
+/* Accept all the pending connections on the listening socket and add them to the loop */
+static void accept_conns(int fd_lsn)
+{
+  int fd;
+  SVCXPRT *xprt;
+
+  while (1) {
+    if ( (fd = accept4(fd_lsn, NULL, NULL, SOCK_CLOEXEC)) == -1 ) {
+      if (errno == EMFILE || errno == ENFILE)
+        reject_conn(fd_lsn);
+      else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        LOG(LOG_TYPE_LOOP, LOG_LEVEL_ERROR, "accept() failed: %s", strerror(errno));
+      return;
+    }
+
+    // Create the RPC transport for the connection, it's registered in TI-RPC internally
+    if ( (xprt = svc_fd_create(fd, 0, 0)) == NULL ) {
+      LOG(LOG_TYPE_LOOP, LOG_LEVEL_ERROR, "svc_fd_create() failed for socket %d", fd);
+      close(fd);
+      continue;
+    }
+
+    if (svc_loop_add_xprt(xprt, xprt_conn) != 0)
+      svc_destroy(xprt);
+    else
+      LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "connection accepted, socket %d", fd);
+  }
+}
+
+/* Dispatch the request of the socket and re-arm the socket in the epoll instance.
+ *
+ * If the connection is closed or broken, TI-RPC destroys the transport and closes
+ * the socket, that removes it from epoll, so the re-arming fails and the scheduler
+ * is informed about the closed connection. The socket of the deferred reply is re-armed
+ * by svc_loop_resume(), the budget of its request is held till then.
+ */
+static void dispatch(int fd)
+{
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLONESHOT;
+  ev.data.u64 = ev_data_pack(fd, socks_kind[fd]);
+
+  fd_dispatched = fd;
+  deferred = 0;
+  svc_getreq_common(fd);
+  fd_dispatched = -1;
+  if (deferred)
+    svc_sched_defer(fd);
+  else if (epoll_ctl(hepoll, EPOLL_CTL_MOD, fd, &ev) == -1) {
+    LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "socket %d was closed", fd);
+    svc_sched_done(fd, 1);
+  }
+  else
+    svc_sched_done(fd, 0);
+}
+
+/* Run the event-driven loop serving the added transports.
+ *
+ * The ready sockets are not served in the order they are reported, they are put into
+ * the scheduler queues, and one request is dispatched per loop iteration. While there
+ * are queued requests, epoll is polled without waiting, so the newly arrived interactive
+ * requests can be served ahead of the already queued bulk ones. If only the throttled
+ * clients are waiting, epoll waits until the first of them gets its bandwidth back.
+ */
+int svc_loop_run(void)
+{
+  LOG(LOG_TYPE_LOOP, LOG_LEVEL_DEBUG, "Begin");
+  struct epoll_event events[NUMB_EVENTS_MAX];
+  enum xprt_kind kind;
+  int nev, i, fd;
+
+  while (1) {
+    nev = epoll_wait(hepoll, events, NUMB_EVENTS_MAX, svc_sched_timeout());
+    if (stats_req) {
+      stats_req = 0;
+      print_stats();
+    }
+    if (nev == -1) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "Error 48: epoll_wait() failed\n%s\n", strerror(errno));
+      return 48;
+    }
+
+    for (i = 0; i < nev; ++i) {
+      fd = (int)(uint32_t)events[i].data.u64;
+      kind = (enum xprt_kind)(events[i].data.u64 >> 32);
+      if (kind == xprt_rendezvous)
+        accept_conns(fd);
+      else if (kind == xprt_notify)
+        notify(fd);
+      else {
+        socks_kind[fd] = kind;
+        svc_sched_push(fd, kind == xprt_dgram);
+      }
+    }
+
+    // Receive & dispatch the request
+    if ( (fd = svc_sched_pop()) != -1 )
+      dispatch(fd);
+  }
+  /* NOTREACHED */
+  return 0;
+}
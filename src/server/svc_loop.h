@@ -0,0 +1,105 @@
+#ifndef _SVC_LOOP_H_
+#define _SVC_LOOP_H_
+
+#include <rpc/rpc.h>
+
+/* The kinds of transports served by the event loop */
+enum xprt_kind {
+  xprt_rendezvous,  /* listening TCP socket - new connections are accepted on it */
+  xprt_dgram,       /* UDP socket - each datagram is a complete request */
+  xprt_conn,        /* accepted TCP connection */
+  xprt_notify       /* not a transport: the notification descriptor of a background thread */
+};
+
+/* Initialize the event loop.
+ *
+ * This function creates the epoll instance and raises the soft limit of open file
+ * descriptors up to the hard one, so that thousands of client connections can be served.
+ * It must be called before the creation of any RPC transport, because TI-RPC sizes
+ * its transports table by the open files limit at the first transport registration.
+ *
+ * Return value:
+ *  0 on success, >0 on failure.
+ */
+int svc_loop_init(void);
+
+/* Add the RPC transport to the event loop.
+ *
+ * Parameters:
+ *  xprt - the transport created by svctcp_create(), svcudp_create() or svc_fd_create().
+ *  kind - the transport kind, see `enum xprt_kind`.
+ *
+ * Return value:
+ *  0 on success, >0 on failure.
+ */
+int svc_loop_add_xprt(SVCXPRT *xprt, enum xprt_kind kind);
+
+/* Create the TCP transport listening on the fixed port shared with other processes.
+ *
+ * The listening socket is created with SO_REUSEPORT, so several server processes can
+ * bind the same port and the kernel load-balances the incoming connections across them.
+ * Such transport is not registered with rpcbind, clients connect to it directly by port.
+ *
+ * Parameters:
+ *  port - the TCP port to listen on.
+ *
+ * Return value:
+ *  A pointer to the created transport on success, or NULL on failure.
+ */
+SVCXPRT *svc_loop_create_reuseport(unsigned short port);
+
+/* Add the notification descriptor of a background thread to the event loop.
+ *
+ * The descriptor (e.g. eventfd) becomes readable when the thread has results for the main
+ * thread; the callback is called by the loop then, it must drain the descriptor.
+ * Up to NUMB_NOTIFY_MAX descriptors can be added.
+ *
+ * Parameters:
+ *  fd        - the descriptor, it's polled for reading.
+ *  pf_notify - the callback called in the main thread.
+ *
+ * Return value:
+ *  0 on success, >0 on failure.
+ */
+enum { NUMB_NOTIFY_MAX = 4 };
+int svc_loop_add_notify(int fd, void (*pf_notify)(void));
+
+/* Defer the reply to the request being dispatched.
+ *
+ * It's called by the RPC function that returns NULL to send its reply later: the connection
+ * isn't served (nor destroyed when it's closed by the client) till svc_loop_resume(), so
+ * the transport stays valid for svc_sendreply(). The datagram requests can't be deferred,
+ * the transport is shared by the clients.
+ *
+ * Return value:
+ *  0 if the reply is deferred, -1 if it must be sent at once.
+ */
+int svc_loop_defer(void);
+
+/* Resume the serving of the connection after the deferred reply is sent.
+ *
+ * The bytes of the request reserved in the in-flight byte budget are released then.
+ *
+ * Parameters:
+ *  xprt - the transport of the request deferred by svc_loop_defer().
+ */
+void svc_loop_resume(SVCXPRT *xprt);
+
+/* Run the event-driven loop serving the added transports.
+ *
+ * This function is a replacement of svc_run(). It waits on the epoll instance and hands
+ * only the ready sockets to the RPC dispatcher, so the idle connections cost nothing
+ * and the number of connections is not limited by FD_SETSIZE.
+ * New connections are accepted by this loop itself and registered with svc_fd_create().
+ * The closed connections are destroyed by TI-RPC, which also closes their sockets and
+ * thereby removes them from the epoll instance.
+ * The ready requests are dispatched in the order defined by the scheduler (svc_sched.h),
+ * the sockets are re-armed in epoll (EPOLLONESHOT) only after their request is dispatched.
+ * The statistics of the Server are printed to STDERR on SIGUSR1.
+ *
+ * Return value:
+ *  It returns only in case of a fatal error with a value >0.
+ */
+int svc_loop_run(void);
+
+#endif
@@ -0,0 +1,642 @@
+/*
+ * svc_sched.c: the scheduler of the ready requests on the Server.
+ * Errors range: 56-58 (reserve 59-60)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "svc_sched.h"
+#include "svc_admit.h"
+#include "../rpcgen/fltr.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Offsets of the procedure number in the RPC call header:
+// [record mark (TCP only)] xid, message type, RPC version, program, version, procedure
+enum { OFFS_PROC_DGRAM = 20, OFFS_PROC_CONN = 24 };
+
+// The deficit round-robin quantum of the client flow with weight 1, bytes
+enum { DRR_QUANTUM = 1048576 };
+
+// The lowest deficit of the flow, it bounds the number of rounds the flow skips
+// after a huge request (e.g. the whole-file upload_file)
+enum { DRR_DEFICIT_MIN = -LEN_CHUNK_MAX };
+
+// Number of buckets in the hash table of the client flows, power of 2
+enum { NUMB_FLOW_BUCKETS = 256 };
+
+// Admission control timings, milliseconds: the max time the chunk request waits for
+// the budget before it's rejected, the retry-after time of the rejected request, and
+// the polling period of the budget released by other worker processes
+enum { ADMIT_WAIT_MAX = 2000, ADMIT_RETRY_AFTER = 1000, ADMIT_POLL = 10 };
+
+// Queue of sockets linked through `struct sock_sched.next`
+struct sock_fifo {
+  int head, tail;           // first & last socket in the queue, -1 if the queue is empty
+  int length;               // number of the queued sockets
+};
+
+// The flow of the bulk requests of one client (source address)
+struct client_flow {
+  in_addr_t addr;           // the client address, host byte order; 0 if it's unknown
+  int cls;                  // index of the client class
+  struct sock_fifo fifo;    // the queued bulk requests of the client
+  int nsocks;               // number of sockets attached to the flow
+  int active;               // 1 if the flow is in the active ring
+  int new_round;            // 1 if the quantum has to be added at the next visit
+  int throttled;            // 1 if the flow is out of the tokens
+  long deficit;             // DRR deficit, bytes
+  double tokens;            // token bucket level, bytes, goes negative on overdraft
+  double tm_refill;         // time of the last bucket refill, seconds
+  struct client_flow *next_active; // next flow in the active ring
+  struct client_flow *next_hash;   // next flow in the hash bucket
+};
+
+// State of the socket in the scheduler
+struct sock_sched {
+  int queued;               // 1 if the socket is in a queue
+  int next;                 // next socket in the same queue, -1 for the queue tail
+  int is_dgram;             // 1 for the UDP socket, the flow is attached per request
+  uint32_t proc;            // the procedure of the queued bulk request
+  size_t cost;              // the estimated in-flight bytes of the queued bulk request
+  size_t reserved;          // the bytes reserved in the budget for the dispatched request
+  int rejected;             // 1 if the dispatched request is rejected by the admission control
+  struct client_flow *flow; // the client flow the socket is attached to, NULL if none
+  struct timespec tm_push;  // time when the socket was queued
+};
+
+// Statistics of the request class
+static struct class_stats {
+  const char *name;         // class name for the statistics
+  int length;               // number of the queued sockets
+  unsigned long numb_srv;   // number of the served requests
+  double tm_wait_sum;       // total queue time of the served requests, microseconds
+  double tm_wait_max;       // max queue time, microseconds
+} stats[NUMB_RQ_CLASSES] = {
+  { "interactive", 0, 0, 0., 0. },
+  { "bulk",        0, 0, 0., 0. }
+};
+
+// The client class: the limits of the clients from the network and their statistics
+static struct client_class {
+  in_addr_t net, mask;      // the network of the class, host byte order
+  int prefix;               // the network prefix length
+  double rate;              // bandwidth limit per client, bytes per second; 0 - unlimited
+  int weight;               // DRR weight of the client flow
+  unsigned long numb_srv;   // number of the served bulk requests
+  unsigned long long bytes; // number of the transferred bytes
+  unsigned long numb_thrt;  // number of times the clients were throttled
+} classes[NUMB_CLIENT_CLASSES_MAX] = {
+  { 0, 0, 0, 0., 1, 0, 0, 0 }  // the default class: all the clients, unlimited
+};
+static int numb_classes = 1;
+
+static struct sock_sched *socks;  // scheduler state indexed by the socket descriptor
+static int numb_socks;            // size of the socks array
+static int weight_inter = 8;      // weight of the interactive requests, 0 - strict priority
+static int credit_inter = 0;      // interactive requests dispatched since the last bulk one
+static int fd_curr = -1;          // the socket which request is being dispatched
+
+static struct sock_fifo fifo_inter = { -1, -1, 0 };      // the queued interactive requests
+static struct client_flow *flows[NUMB_FLOW_BUCKETS];      // the client flows by address
+static struct client_flow *ring_tail = NULL;              // the tail of the active flows ring
+static int numb_active = 0;                               // number of the active flows
+static struct client_flow flow_fallback = { .fifo = { -1, -1, 0 } }; // used if no memory
+
+/* Get the monotonic time in seconds */
+static double time_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* Initialize the scheduler. */
+int svc_sched_init(int numb_fds)
+{
+  if ( (socks = calloc(numb_fds, sizeof(struct sock_sched))) == NULL ) {
+    fprintf(stderr, "Error 56: Failed to allocate memory for the scheduler\n");
+    return 56;
+  }
+  numb_socks = numb_fds;
+  flow_fallback.tokens = 0.;
+  flow_fallback.tm_refill = time_now();
+  LOG(LOG_TYPE_SCHD, LOG_LEVEL_DEBUG, "scheduler init'ed for %d sockets", numb_socks);
+  return 0;
+}
+
+/* Set the weight of the interactive requests against the bulk ones. */
+void svc_sched_set_weight(int weight)
+{
+  weight_inter = weight;
+}
+
+/* Add the client class with its bandwidth limit and weight. */
+int svc_sched_add_class(in_addr_t net, int prefix, double rate, int weight)
+{
+  struct client_class *p_cls;
+  in_addr_t mask = prefix ? htonl(~0u << (32 - prefix)) : 0;
+
+  // The network 0.0.0.0/0 overrides the default class
+  if (prefix == 0)
+    p_cls = &classes[0];
+  else if (numb_classes < NUMB_CLIENT_CLASSES_MAX)
+    p_cls = &classes[numb_classes++];
+  else {
+    fprintf(stderr, "Error 57: Too many client classes, max %d\n", NUMB_CLIENT_CLASSES_MAX);
+    return 57;
+  }
+  p_cls->mask = ntohl(mask);
+  p_cls->net = ntohl(net) & p_cls->mask;
+  p_cls->prefix = prefix;
+  p_cls->rate = rate;
+  p_cls->weight = weight;
+  return 0;
+}
+
+/* Find the class of the client address by the longest prefix match */
+static int find_class(in_addr_t addr)
+{
+  int i, cls = 0;
+  for (i = 1; i < numb_classes; ++i)
+    if ((addr & classes[i].mask) == classes[i].net && classes[i].prefix > classes[cls].prefix)
+      cls = i;
+  return cls;
+}
+
+/* Refill the token bucket of the flow.
+ * The bucket depth is one second of the class rate, but at least one max chunk.
+ */
+static void refill(struct client_flow *p_flow, double tm_now)
+{
+  double rate = classes[p_flow->cls].rate;
+  double depth = rate > LEN_CHUNK_MAX ? rate : LEN_CHUNK_MAX;
+  if (rate == 0.)
+    p_flow->tokens = depth;
+  else {
+    p_flow->tokens += rate * (tm_now - p_flow->tm_refill);
+    if (p_flow->tokens > depth)
+      p_flow->tokens = depth;
+  }
+  p_flow->tm_refill = tm_now;
+}
+
+/* Check if the flow can be freed: no attached sockets, no queued requests and no debt */
+static int flow_idle(struct client_flow *p_flow, double tm_now)
+{
+  if (p_flow->nsocks || p_flow->fifo.length || p_flow->active)
+    return 0;
+  refill(p_flow, tm_now);
+  return p_flow->tokens >= 0.;
+}
+
+/* Find the flow of the client address or create a new one.
+ * The idle flows met in the hash bucket are freed on the way.
+ */
+static struct client_flow *get_flow(in_addr_t addr)
+{
+  struct client_flow **pp_flow = &flows[(addr * 2654435761u) & (NUMB_FLOW_BUCKETS - 1)];
+  struct client_flow *p_flow, *p_found = NULL;
+  double tm_now = time_now();
+
+  while ( (p_flow = *pp_flow) ) {
+    if (p_flow->addr == addr)
+      p_found = p_flow;
+    else if (flow_idle(p_flow, tm_now)) {
+      *pp_flow = p_flow->next_hash;
+      free(p_flow);
+      continue;
+    }
+    pp_flow = &p_flow->next_hash;
+  }
+  if (p_found)
+    return p_found;
+
+  if ( (p_flow = calloc(1, sizeof(struct client_flow))) == NULL ) {
+    LOG(LOG_TYPE_SCHD, LOG_LEVEL_ERROR, "Failed to allocate memory for the client flow");
+    return &flow_fallback;
+  }
+  p_flow->addr = addr;
+  p_flow->cls = find_class(addr);
+  p_flow->fifo.head = p_flow->fifo.tail = -1;
+  p_flow->tm_refill = tm_now;
+  refill(p_flow, tm_now);
+  p_flow->next_hash = *pp_flow;
+  *pp_flow = p_flow;
+  LOG(LOG_TYPE_SCHD, LOG_LEVEL_DEBUG, "flow created for client %08x, class %d", addr, p_flow->cls);
+  return p_flow;
+}
+
+/* Detach the socket from its flow, the flow is freed if it becomes idle */
+static void detach_flow(int fd)
+{
+  struct client_flow *p_flow = socks[fd].flow, **pp_flow;
+  if (p_flow == NULL)
+    return;
+  socks[fd].flow = NULL;
+  p_flow->nsocks--;
+  if (p_flow == &flow_fallback || !flow_idle(p_flow, time_now()))
+    return;
+
+  pp_flow = &flows[(p_flow->addr * 2654435761u) & (NUMB_FLOW_BUCKETS - 1)];
+  while (*pp_flow != p_flow)
+    pp_flow = &(*pp_flow)->next_hash;
+  *pp_flow = p_flow->next_hash;
+  free(p_flow);
+}
+
+/* Classify the pending request of the socket by its procedure number.
+ *
+ * The request header is peeked, so it remains in the socket for the RPC transport.
+ * Incomplete headers, closed connections and errors are classified as interactive:
+ * they are cheap to process and it releases the socket as soon as possible.
+ * The source address of the datagram is returned in `p_addr`, the procedure - in `p_proc`.
+ */
+static enum req_class classify(int fd, int is_dgram, in_addr_t *p_addr, uint32_t *p_proc)
+{
+  uint32_t hdr[7];
+  struct sockaddr_in addr;
+  socklen_t len_addr = sizeof(addr);
+  size_t offs = is_dgram ? OFFS_PROC_DGRAM : OFFS_PROC_CONN;
+  ssize_t nrd;
+
+  memset(&addr, 0, sizeof(addr));
+  nrd = recvfrom(fd, hdr, offs + sizeof(uint32_t), MSG_PEEK | MSG_DONTWAIT,
+                 is_dgram ? (struct sockaddr *)&addr : NULL, is_dgram ? &len_addr : NULL);
+  *p_addr = addr.sin_family == AF_INET ? ntohl(addr.sin_addr.s_addr) : 0;
+  *p_proc = NULLPROC;
+
+  if (nrd < (ssize_t)(offs + sizeof(uint32_t)))
+    return rq_class_inter;
+
+  switch ( (*p_proc = ntohl(hdr[offs / sizeof(uint32_t)])) ) {
+    case upload_file:
+    case download_file:
+    case upload_chunk:
+    case download_chunk:
+    case download_blocks:
+      return rq_class_bulk;
+    default:
+      return rq_class_inter;
+  }
+}
+
+/* Get the client address of the TCP connection, 0 if it's not IPv4 */
+static in_addr_t peer_addr(int fd)
+{
+  struct sockaddr_in addr;
+  socklen_t len_addr = sizeof(addr);
+  if (getpeername(fd, (struct sockaddr *)&addr, &len_addr) != 0 || addr.sin_family != AF_INET)
+    return 0;
+  return ntohl(addr.sin_addr.s_addr);
+}
+
+/* Append the socket to the queue */
+static void fifo_push(struct sock_fifo *p_fifo, int fd)
+{
+  socks[fd].next = -1;
+  if (p_fifo->tail == -1)
+    p_fifo->head = fd;
+  else
+    socks[p_fifo->tail].next = fd;
+  p_fifo->tail = fd;
+  p_fifo->length++;
+}
+
+/* Put the flow at the tail of the active ring */
+static void ring_append(struct client_flow *p_flow)
+{
+  if (ring_tail == NULL)
+    p_flow->next_active = p_flow;
+  else {
+    p_flow->next_active = ring_tail->next_active;
+    ring_tail->next_active = p_flow;
+  }
+  ring_tail = p_flow;
+  p_flow->active = 1;
+  p_flow->new_round = 1;
+  numb_active++;
+}
+
+/* Remove the head flow from the active ring */
+static void ring_remove_head(void)
+{
+  struct client_flow *p_head = ring_tail->next_active;
+  if (p_head == ring_tail)
+    ring_tail = NULL;
+  else
+    ring_tail->next_active = p_head->next_active;
+  p_head->active = 0;
+  numb_active--;
+}
+
+/* Put the ready socket into the queue of its request class. */
+void svc_sched_push(int fd, int is_dgram)
+{
+  in_addr_t addr;
+  uint32_t proc;
+  enum req_class cls;
+  struct client_flow *p_flow;
+
+  if (fd < 0 || fd >= numb_socks || socks[fd].queued)
+    return;
+
+  cls = classify(fd, is_dgram, &addr, &proc);
+  socks[fd].queued = 1;
+  socks[fd].is_dgram = is_dgram;
+  clock_gettime(CLOCK_MONOTONIC, &socks[fd].tm_push);
+  stats[cls].length++;
+
+  if (cls == rq_class_inter) {
+    fifo_push(&fifo_inter, fd);
+    LOG(LOG_TYPE_SCHD, LOG_LEVEL_DEBUG, "socket %d queued as interactive, queue length %d",
+        fd, fifo_inter.length);
+    return;
+  }
+
+  // The bulk request is queued into the flow of its client, the connection stays attached
+  // to the flow until it's closed, the UDP socket - until the request is dispatched
+  if (socks[fd].flow == NULL) {
+    socks[fd].flow = get_flow(is_dgram ? addr : peer_addr(fd));
+    socks[fd].flow->nsocks++;
+  }
+  p_flow = socks[fd].flow;
+  socks[fd].proc = proc;
+  socks[fd].cost = svc_admit_cost(fd, is_dgram, proc);
+  fifo_push(&p_flow->fifo, fd);
+  if (!p_flow->active) {
+    // The debt of the previous requests is kept, the credit is not accumulated while idle
+    if (p_flow->deficit > 0)
+      p_flow->deficit = 0;
+    ring_append(p_flow);
+  }
+  LOG(LOG_TYPE_SCHD, LOG_LEVEL_DEBUG, "socket %d queued as bulk of client %08x, cost %lu, flow length %d",
+      fd, p_flow->addr, socks[fd].cost, p_flow->fifo.length);
+}
+
+/* Check if the flow is out of the tokens, count the throttling events */
+static int flow_throttled(struct client_flow *p_flow, double tm_now)
+{
+  refill(p_flow, tm_now);
+  if (p_flow->tokens >= 0.) {
+    p_flow->throttled = 0;
+    return 0;
+  }
+  if (!p_flow->throttled) {
+    p_flow->throttled = 1;
+    classes[p_flow->cls].numb_thrt++;
+    LOG(LOG_TYPE_SCHD, LOG_LEVEL_DEBUG, "client %08x is throttled", p_flow->addr);
+  }
+  return 1;
+}
+
+/* Check if the queued chunk request has waited for the budget too long, so it should be
+ * rejected. The whole-file requests are never rejected, they wait for the budget.
+ */
+static int admit_expired(int fd, double tm_now)
+{
+  double tm_push = socks[fd].tm_push.tv_sec + socks[fd].tm_push.tv_nsec / 1e9;
+  return (socks[fd].proc == upload_chunk || socks[fd].proc == download_chunk ||
+          socks[fd].proc == download_blocks) &&
+         (tm_now - tm_push) * 1000. > ADMIT_WAIT_MAX;
+}
+
+/* Get the time until the head request of the flow can be dispatched, milliseconds:
+ * until the throttled flow gets its tokens back, or until the budget is polled again.
+ */
+static int flow_wait(struct client_flow *p_flow, double tm_now)
+{
+  int fd = p_flow->fifo.head;
+  if (flow_throttled(p_flow, tm_now))
+    return (int)(-p_flow->tokens / classes[p_flow->cls].rate * 1000.) + 1;
+  if (svc_admit_fits(socks[fd].cost) || admit_expired(fd, tm_now))
+    return 0;
+  return ADMIT_POLL;
+}
+
+/* Get the min time until a flow can be served, milliseconds.
+ * Return 0 if any active flow can be served, -1 if there are no active flows.
+ */
+static int bulk_timeout(void)
+{
+  struct client_flow *p_flow;
+  double tm_now = time_now();
+  int i, tm_wait, tm_min = -1;
+
+  for (i = 0, p_flow = ring_tail; i < numb_active; ++i) {
+    p_flow = p_flow->next_active;
+    if ( (tm_wait = flow_wait(p_flow, tm_now)) == 0 )
+      return 0;
+    if (tm_min < 0 || tm_wait < tm_min)
+      tm_min = tm_wait;
+  }
+  return tm_min;
+}
+
+/* Get the timeout of the event loop waiting. */
+int svc_sched_timeout(void)
+{
+  if (fifo_inter.length)
+    return 0;
+  return bulk_timeout();
+}
+
+/* Take the first socket from the queue and update the class statistics */
+static int dequeue(struct sock_fifo *p_fifo, enum req_class cls)
+{
+  struct class_stats *p_stats = &stats[cls];
+  struct timespec tm_now;
+  double tm_wait;
+  int fd = p_fifo->head;
+
+  p_fifo->head = socks[fd].next;
+  if (p_fifo->head == -1)
+    p_fifo->tail = -1;
+  p_fifo->length--;
+  p_stats->length--;
+  socks[fd].queued = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &tm_now);
+  tm_wait = (tm_now.tv_sec - socks[fd].tm_push.tv_sec) * 1e6 +
+            (tm_now.tv_nsec - socks[fd].tm_push.tv_nsec) / 1e3;
+  p_stats->numb_srv++;
+  p_stats->tm_wait_sum += tm_wait;
+  if (tm_wait > p_stats->tm_wait_max)
+    p_stats->tm_wait_max = tm_wait;
+  return fd;
+}
+
+/* Take the next bulk request with deficit round-robin over the client flows.
+ *
+ * The head flow of the active ring gets its quantum once per round and is served while
+ * its deficit is positive. The served requests are charged after their processing
+ * (svc_sched_charge()), so the deficit may become negative, and the debt is repaid
+ * in the next rounds. The throttled flows are skipped, as well as the flows which head
+ * request doesn't fit the in-flight byte budget (svc_admit.h). The chunk request waiting
+ * for the budget too long is dispatched as rejected, it's answered with ERRNUM_BUSY.
+ * Return -1 if all the active flows are throttled or wait for the budget.
+ */
+static int pop_bulk(void)
+{
+  struct client_flow *p_flow;
+  double tm_now = time_now();
+  int numb_skipped = 0, fd;
+
+  while (numb_active && numb_skipped < numb_active) {
+    p_flow = ring_tail->next_active;
+    if (flow_throttled(p_flow, tm_now)) {
+      ring_tail = p_flow;
+      numb_skipped++;
+      continue;
+    }
+    if (p_flow->new_round) {
+      p_flow->deficit += (long)DRR_QUANTUM * classes[p_flow->cls].weight;
+      p_flow->new_round = 0;
+    }
+    if (p_flow->deficit <= 0) {
+      // The round of the flow is over, the next flow takes the head
+      p_flow->new_round = 1;
+      ring_tail = p_flow;
+      numb_skipped = 0;
+      continue;
+    }
+
+    // Reserve the request bytes in the budget, or reject the request waiting too long
+    fd = p_flow->fifo.head;
+    if (svc_admit_reserve(socks[fd].cost))
+      socks[fd].reserved = socks[fd].cost;
+    else if (admit_expired(fd, tm_now)) {
+      socks[fd].rejected = 1;
+      svc_admit_count_reject();
+      LOG(LOG_TYPE_SCHD, LOG_LEVEL_WARN, "request of socket %d is rejected, no budget", fd);
+    }
+    else {
+      ring_tail = p_flow;
+      numb_skipped++;
+      continue;
+    }
+
+    dequeue(&p_flow->fifo, rq_class_bulk);
+    classes[p_flow->cls].numb_srv++;
+    if (p_flow->fifo.length == 0)
+      ring_remove_head();
+    return fd;
+  }
+  return -1;
+}
+
+/* Take the next socket to be served from the queues. */
+int svc_sched_pop(void)
+{
+  int fd;
+
+  // The bulk request is served if there are no interactive ones, or if the interactive
+  // requests have used up their weight while the bulk ones were waiting
+  if (stats[rq_class_bulk].length &&
+      (!fifo_inter.length || (weight_inter && credit_inter >= weight_inter)) &&
+      (fd = pop_bulk()) != -1) {
+    credit_inter = 0;
+    return (fd_curr = fd);
+  }
+  if (fifo_inter.length) {
+    if (stats[rq_class_bulk].length) credit_inter++;
+    return (fd_curr = dequeue(&fifo_inter, rq_class_inter));
+  }
+  return -1;
+}
+
+/* Charge the client of the request being dispatched for the transferred bytes. */
+void svc_sched_charge(size_t nbytes)
+{
+  struct client_flow *p_flow;
+  if (fd_curr == -1 || (p_flow = socks[fd_curr].flow) == NULL)
+    return;
+
+  p_flow->tokens -= (double)nbytes;
+  p_flow->deficit -= (long)(nbytes > LEN_CHUNK_MAX ? LEN_CHUNK_MAX : nbytes);
+  if (p_flow->deficit < DRR_DEFICIT_MIN)
+    p_flow->deficit = DRR_DEFICIT_MIN;
+  classes[p_flow->cls].bytes += nbytes;
+}
+
+/* Get the retry-after time of the request being dispatched. */
+int svc_sched_retry_after(void)
+{
+  return (fd_curr != -1 && socks[fd_curr].rejected) ? ADMIT_RETRY_AFTER : 0;
+}
+
+/* Get the time when the request being dispatched has arrived. */
+int svc_sched_arrival(struct timespec *p_tm)
+{
+  if (fd_curr == -1)
+    return -1;
+  *p_tm = socks[fd_curr].tm_push;
+  return 0;
+}
+
+/* Complete the dispatching of the socket request. */
+void svc_sched_done(int fd, int closed)
+{
+  fd_curr = -1;
+  if (fd < 0 || fd >= numb_socks)
+    return;
+  svc_admit_release(socks[fd].reserved);
+  socks[fd].reserved = 0;
+  socks[fd].rejected = 0;
+  if (closed || socks[fd].is_dgram)
+    detach_flow(fd);
+  if (closed)
+    memset(&socks[fd], 0, sizeof(struct sock_sched));
+}
+
+/* Complete the dispatching of the socket request which reply is deferred. */
+void svc_sched_defer(int fd)
+{
+  fd_curr = -1;
+  if (fd < 0 || fd >= numb_socks)
+    return;
+  socks[fd].rejected = 0;
+}
+
+/* Release the budget of the deferred request when its reply is sent. */
+void svc_sched_resume(int fd)
+{
+  if (fd < 0 || fd >= numb_socks)
+    return;
+  svc_admit_release(socks[fd].reserved);
+  socks[fd].reserved = 0;
+}
+
+/* Print the per-class scheduler statistics. */
+void svc_sched_print_stats(FILE *hfile)
+{
+  struct in_addr net;
+  int i;
+  fprintf(hfile, "Scheduler (interactive weight: %d%s):\n",
+          weight_inter, weight_inter ? "" : " - strict priority");
+  for (i = 0; i < NUMB_RQ_CLASSES; ++i)
+    fprintf(hfile, "  %-11s served: %lu, queue time avg: %.0f us, max: %.0f us, queued: %d\n",
+            stats[i].name, stats[i].numb_srv,
+            stats[i].numb_srv ? stats[i].tm_wait_sum / stats[i].numb_srv : 0.,
+            stats[i].tm_wait_max, stats[i].length);
+
+  fprintf(hfile, "Client classes (active flows: %d):\n", numb_active);
+  for (i = 0; i < numb_classes; ++i) {
+    net.s_addr = htonl(classes[i].net);
+    fprintf(hfile, "  %s/%d rate: ", inet_ntoa(net), classes[i].prefix);
+    if (classes[i].rate == 0.)
+      fprintf(hfile, "unlimited");
+    else
+      fprintf(hfile, "%.1f MiB/s", classes[i].rate / 1048576.);
+    fprintf(hfile, ", weight: %d, served: %lu, bytes: %llu, throttled: %lu\n",
+            classes[i].weight, classes[i].numb_srv, classes[i].bytes, classes[i].numb_thrt);
+  }
+}
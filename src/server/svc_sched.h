@@ -0,0 +1,170 @@
+#ifndef _SVC_SCHED_H_
+#define _SVC_SCHED_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <time.h>
+#include <netinet/in.h>
+
+/*
+ * The scheduler of the ready requests on the Server.
+ *
+ * The sockets reported as ready by the event loop are classified by the RPC procedure
+ * of their pending request and put into the queue of the request class. The requests
+ * are dispatched from the queues with weighted round-robin, so the interactive requests
+ * (like pick_file) are not stuck behind the bulk data transfers.
+ *
+ * The bulk requests are queued per client (source address) and dispatched with deficit
+ * round-robin over the clients, so a client with many connections or big files gets
+ * the same share of the Server as a client with a single one. Each client has a token
+ * bucket limiting its bandwidth, the limits & weights are set per client class (network).
+ * The bulk requests are admitted by the in-flight byte budget (svc_admit.h).
+ */
+
+/* The max number of the client classes */
+#define NUMB_CLIENT_CLASSES_MAX 16
+
+/* The request classes */
+enum req_class {
+  rq_class_inter,   /* interactive & metadata requests: NULLPROC, pick_file, list_dir, list_delta,
+                       dir_usage, search_names */
+  rq_class_bulk,    /* bulk data transfers: upload_file, download_file, upload_chunk, download_chunk,
+                       download_blocks */
+  NUMB_RQ_CLASSES
+};
+
+/* Initialize the scheduler.
+ *
+ * Parameters:
+ *  numb_fds - the max number of file descriptors, the sockets are indexed by their descriptors.
+ *
+ * Return value:
+ *  0 on success, >0 on failure.
+ */
+int svc_sched_init(int numb_fds);
+
+/* Set the weight of the interactive requests against the bulk ones.
+ *
+ * Up to `weight` interactive requests are dispatched per one bulk request while both
+ * queues are not empty. Weight 0 means the strict priority of the interactive requests.
+ *
+ * Parameters:
+ *  weight - the weight of the interactive requests.
+ */
+void svc_sched_set_weight(int weight);
+
+/* Add the client class with its bandwidth limit and weight.
+ *
+ * The client belongs to the class with the longest matching network prefix. The clients
+ * which match no class belong to the default one: unlimited bandwidth, weight 1.
+ * The class with prefix 0 replaces the default class.
+ *
+ * Parameters:
+ *  net    - the network address of the class, network byte order.
+ *  prefix - the network prefix length, 0-32.
+ *  rate   - the bandwidth limit of each client of the class, bytes per second; 0 - unlimited.
+ *  weight - the weight of the client in the deficit round-robin, >0.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (too many classes).
+ */
+int svc_sched_add_class(in_addr_t net, int prefix, double rate, int weight);
+
+/* Put the ready socket into the queue of its request class.
+ *
+ * The class is determined by the procedure number peeked (not read) from the RPC call
+ * header of the pending request. A socket that is already queued is not queued twice.
+ * The bulk request is queued into the flow of its client.
+ *
+ * Parameters:
+ *  fd       - the ready socket.
+ *  is_dgram - 1 for the UDP socket, 0 for the TCP connection.
+ */
+void svc_sched_push(int fd, int is_dgram);
+
+/* Get the timeout of the event loop waiting.
+ *
+ * Return value:
+ *  0 if there is a request ready to be dispatched,
+ *  the time in milliseconds until a throttled client can be served, if all the queued
+ *  requests belong to the throttled clients,
+ *  -1 if all the queues are empty.
+ */
+int svc_sched_timeout(void);
+
+/* Take the next socket to be served from the queues.
+ *
+ * The socket becomes the current one until svc_sched_done() is called for it.
+ *
+ * Return value:
+ *  The socket descriptor, or -1 if all the queues are empty or the clients are throttled.
+ */
+int svc_sched_pop(void);
+
+/* Charge the client of the request being dispatched for the transferred bytes.
+ *
+ * It's called by the RPC procedures with the size of the transferred file data. The bytes
+ * are taken from the token bucket and the round-robin deficit of the client.
+ *
+ * Parameters:
+ *  nbytes - the number of the transferred bytes.
+ */
+void svc_sched_charge(size_t nbytes);
+
+/* Get the retry-after time of the request being dispatched.
+ *
+ * The bulk requests are dispatched when their estimated bytes fit the in-flight byte budget
+ * (svc_admit.h). The chunk request that waits for the budget too long is dispatched
+ * as rejected: the RPC procedure should answer it with ERRNUM_BUSY without processing.
+ *
+ * Return value:
+ *  The time in milliseconds after which the rejected request should be retried,
+ *  0 if the request is not rejected.
+ */
+int svc_sched_retry_after(void);
+
+/* Get the time when the request being dispatched has arrived (its socket was queued).
+ *
+ * Parameters:
+ *  p_tm - a pointer to the time to be set, CLOCK_MONOTONIC.
+ *
+ * Return value:
+ *  0 on success, -1 if no request is being dispatched.
+ */
+int svc_sched_arrival(struct timespec *p_tm);
+
+/* Complete the dispatching of the socket request.
+ *
+ * Parameters:
+ *  fd     - the socket returned by svc_sched_pop().
+ *  closed - 1 if the connection was closed by the request processing, 0 otherwise.
+ */
+void svc_sched_done(int fd, int closed);
+
+/* Complete the dispatching of the socket request which reply is deferred (see svc_loop_defer()).
+ *
+ * The bytes reserved for the request in the in-flight byte budget are kept: its data is held
+ * by the operation doing it till the reply is sent, they are released by svc_sched_resume().
+ *
+ * Parameters:
+ *  fd - the socket returned by svc_sched_pop().
+ */
+void svc_sched_defer(int fd);
+
+/* Release the bytes reserved for the deferred request when its reply is sent.
+ *
+ * Parameters:
+ *  fd - the socket of the deferred request.
+ */
+void svc_sched_resume(int fd);
+
+/* Print the per-class scheduler statistics: the number of the served requests, the average
+ * and max queue time and the current queue length; and the statistics of the client classes:
+ * the number of the served bulk requests, transferred bytes and throttling events.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void svc_sched_print_stats(FILE *hfile);
+
+#endif
@@ -0,0 +1,306 @@
+/*
+ * upld_sess.c: the sessions of the chunked Upload of files on the Server.
+ * Errors range: 61-64 (reserve 65)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <errno.h>
+#include <netinet/in.h>
+
+#include "upld_sess.h"
+#include "svc_admit.h"
+#include "fd_cache.h"
+#include "direct_io.h"
+#include "data_dirs.h"
+#include "dev_queue.h"
+#include "pack_store.h"
+#include "zip_store.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// Max idle time of the upload session, seconds
+enum { UPLD_SESS_TIMEOUT = 600 };
+
+// The upload session
+struct upld_sess {
+  char *name;               // the uploaded file name
+  char *path;               //   & its path in the data directory of its device
+  int fd;                   // the uploaded file descriptor
+  int tmp;                  // 1 if the file is anonymous till the upload is completed
+  int fd_direct;            //   & the one opened with O_DIRECT for the large file, or -1
+  int large;                // 1 if the file is written bypassing the page cache
+  int dev;                  // the device of the file in the storage layout, -1 if it's outside
+  int numb_writing;         // number of the chunks being written by the queue of the device
+  int failed;               // 1 if a queued chunk failed, the upload is discarded when none is written
+  zip_file zip;             // the compressed file, NULL if the file is stored as is
+  struct sockaddr_storage owner; // the address of the client host uploading the file
+  socklen_t len_owner;      //   & its length
+  uint64_t size;            // the file size declared by the client
+  uint64_t written;         // the end of the written data
+  time_t tm_last;           // time of the last written chunk
+  struct upld_sess *next;   // next session in the list
+};
+
+static struct upld_sess *sessions = NULL; // the list of the upload sessions in progress
+
+/* Check whether the caller is on the host of the owner. */
+int upld_sess_same_host(const struct sockaddr_storage *p_owner, socklen_t len_owner,
+                        const struct netbuf *p_caller)
+{
+  const struct sockaddr_storage *p_addr = (const struct sockaddr_storage *)p_caller->buf;
+
+  if (p_caller->len < sizeof(sa_family_t) || p_addr->ss_family != p_owner->ss_family)
+    return 0;
+  if (p_owner->ss_family == AF_INET && p_caller->len >= sizeof(struct sockaddr_in))
+    return ((const struct sockaddr_in *)p_owner)->sin_addr.s_addr ==
+           ((const struct sockaddr_in *)p_addr)->sin_addr.s_addr;
+  if (p_owner->ss_family == AF_INET6 && p_caller->len >= sizeof(struct sockaddr_in6))
+    return memcmp(&((const struct sockaddr_in6 *)p_owner)->sin6_addr,
+                  &((const struct sockaddr_in6 *)p_addr)->sin6_addr, sizeof(struct in6_addr)) == 0;
+  // The address of another family has no port, it's compared as is
+  return len_owner == p_caller->len && memcmp(p_owner, p_addr, len_owner) == 0;
+}
+
+/* Find the upload session of the file, of any client if `p_caller` is NULL.
+ * Return a pointer to the link that points to the found session, or NULL if it's not found.
+ */
+static struct upld_sess **find_sess(const char *name, const struct netbuf *p_caller)
+{
+  struct upld_sess **pp_sess;
+  for (pp_sess = &sessions; *pp_sess; pp_sess = &(*pp_sess)->next)
+    if (strcmp((*pp_sess)->name, name) == 0)
+      return p_caller == NULL || upld_sess_same_host(&(*pp_sess)->owner, (*pp_sess)->len_owner, p_caller) ?
+             pp_sess : NULL;
+  return NULL;
+}
+
+/* Remove the session from the list, the incomplete file is removed if `discard` is set
+ * (the anonymous file is removed by the closing).
+ * Return 0 on success, or -1 if the file closing fails.
+ */
+static int remove_sess(struct upld_sess **pp_sess, int discard)
+{
+  struct upld_sess *p_sess = *pp_sess;
+  int rc = close(p_sess->fd);
+  if (p_sess->fd_direct != -1)
+    close(p_sess->fd_direct);
+  if (discard && !p_sess->tmp) {
+    unlink(p_sess->path);
+    fd_cache_forget(p_sess->path);
+  }
+  if (discard) {
+    LOG(LOG_TYPE_UPLD, LOG_LEVEL_WARN, "upload was discarded: %s", p_sess->name);
+  }
+  *pp_sess = p_sess->next;
+  zip_store_close(p_sess->zip);
+  free(p_sess->name);
+  free(p_sess->path);
+  free(p_sess);
+  return rc;
+}
+
+/* Discard the sessions idle for more than UPLD_SESS_TIMEOUT seconds */
+static void discard_stale_sess(void)
+{
+  struct upld_sess **pp_sess = &sessions;
+  time_t tm_now = time(NULL);
+  while (*pp_sess) {
+    if (tm_now - (*pp_sess)->tm_last > UPLD_SESS_TIMEOUT && (*pp_sess)->numb_writing == 0)
+      (void)remove_sess(pp_sess, 1);
+    else
+      pp_sess = &(*pp_sess)->next;
+  }
+}
+
+/* Get the bytes promised to the uploads in progress. */
+uint64_t upld_sess_pending(void)
+{
+  struct upld_sess *p_sess;
+  uint64_t pending = 0;
+  for (p_sess = sessions; p_sess; p_sess = p_sess->next)
+    if (p_sess->size > p_sess->written)
+      pending += p_sess->size - p_sess->written;
+  return pending;
+}
+
+/* Create the upload session with a new file, if the file system has space for it */
+static struct upld_sess *create_sess(const char *name, uint64_t size, const struct netbuf *p_caller,
+                                     err_inf **pp_errinf)
+{
+  char path[LEN_PATH_MAX + 1];
+  const char *flname;
+  struct upld_sess *p_sess;
+  int dev;
+
+  if (find_sess(name, NULL)) {
+    errno = 0;
+    (void)process_error(name, 61, "The upload of the file is already in progress", pp_errinf);
+    return NULL;
+  }
+
+  // The packed file isn't replaced by the one in the file system
+  if (pack_store_exists(name, NULL)) {
+    errno = EEXIST;
+    (void)process_error(name, 11, "The file already exists or could not be opened in write binary mode", pp_errinf);
+    return NULL;
+  }
+
+  // The new file is placed on a device of the storage layout
+  flname = data_dirs_path(name, 1, path, &dev);
+  if (svc_admit_check_space(flname, size, upld_sess_pending(), pp_errinf) != 0)
+    return NULL;
+
+  if ( (p_sess = calloc(1, sizeof(struct upld_sess))) == NULL ||
+       (p_sess->name = strdup(name)) == NULL || (p_sess->path = strdup(flname)) == NULL ) {
+    errno = 0;
+    (void)process_error(name, 62, "Failed to allocate memory for the upload session", pp_errinf);
+    if (p_sess)
+      free(p_sess->name);
+    free(p_sess);
+    return NULL;
+  }
+
+  // The file under the zip prefix is compressed by the blocks, its compressed size is unknown
+  if ( zip_store_wanted(name) && (p_sess->zip = zip_store_open()) == NULL ) {
+    errno = 0;
+    (void)process_error(name, 62, "Failed to allocate memory for the upload session", pp_errinf);
+    free(p_sess->name);
+    free(p_sess->path);
+    free(p_sess);
+    return NULL;
+  }
+
+  // The file is preallocated and stays anonymous till the last chunk
+  if ( (p_sess->fd = open_new_file(flname, p_sess->zip ? 0 : size, &p_sess->tmp, pp_errinf)) == -1 ) {
+    zip_store_close(p_sess->zip);
+    free(p_sess->name);
+    free(p_sess->path);
+    free(p_sess);
+    return NULL;
+  }
+
+  if (!p_sess->tmp)
+    fd_cache_forget(flname); // the descriptor of a removed file of the same name
+  p_sess->len_owner = p_caller->len < sizeof(p_sess->owner) ? p_caller->len : sizeof(p_sess->owner);
+  memcpy(&p_sess->owner, p_caller->buf, p_sess->len_owner);
+  p_sess->size = size;
+  p_sess->dev = dev;
+  p_sess->large = !p_sess->zip && direct_io_wanted(size);
+  p_sess->fd_direct = p_sess->large ? direct_io_open(p_sess->fd, O_WRONLY) : -1;
+  p_sess->next = sessions;
+  sessions = p_sess;
+  LOG(LOG_TYPE_UPLD, LOG_LEVEL_INFO, "upload session was created: %s", name);
+  return p_sess;
+}
+
+/* Complete the chunk written by the queue of the device, the failed upload is discarded
+ * when none of its chunks is written */
+static void on_written(void *arg, int rc)
+{
+  struct upld_sess **pp_sess;
+  for (pp_sess = &sessions; *pp_sess && *pp_sess != arg; pp_sess = &(*pp_sess)->next)
+    ;
+  if (*pp_sess == NULL)
+    return;
+  (*pp_sess)->numb_writing--;
+  (*pp_sess)->tm_last = time(NULL);
+  if (rc != 0)
+    (*pp_sess)->failed = 1;
+  if ((*pp_sess)->failed && (*pp_sess)->numb_writing == 0)
+    (void)remove_sess(pp_sess, 1);
+}
+
+/* Write the uploaded chunk of file. */
+int upld_sess_write(chunk_inf *p_chunk, struct svc_req *rqstp, err_inf **pp_errinf)
+{
+  LOG(LOG_TYPE_UPLD, LOG_LEVEL_DEBUG, "Begin, file: %s, offset: %lu, size: %u",
+      p_chunk->name, p_chunk->chunk.offs, p_chunk->chunk.cont.t_flcont_len);
+  const struct netbuf *p_caller = svc_getrpccaller(rqstp->rq_xprt);
+  uint64_t end = p_chunk->chunk.offs + p_chunk->chunk.cont.t_flcont_len; // the end of the chunk
+  struct upld_sess **pp_sess;
+  struct upld_sess *p_sess;
+  int queued;
+
+  discard_stale_sess();
+
+  // The first chunk creates a new session, the next ones continue the existing session
+  if (p_chunk->chunk.offs == 0) {
+    if ( (p_sess = create_sess(p_chunk->name, p_chunk->size, p_caller, pp_errinf)) == NULL )
+      return (*pp_errinf)->num;
+    pp_sess = &sessions;
+  }
+  else if ( (pp_sess = find_sess(p_chunk->name, p_caller)) == NULL ) {
+    errno = 0;
+    (void)process_error(p_chunk->name, 63, "No upload of the file is in progress by the client", pp_errinf);
+    return (*pp_errinf)->num;
+  }
+  p_sess = *pp_sess;
+
+  // The upload with a failed chunk is discarded when its other chunks are written
+  if (p_sess->failed) {
+    errno = 0;
+    (void)process_error(p_chunk->name, 64, "The upload of the file failed, it's being discarded", pp_errinf);
+    return (*pp_errinf)->num;
+  }
+  // The file is published when all its chunks are written, the last one is retried till then
+  if (p_chunk->chunk.last && p_sess->numb_writing > 0) {
+    errno = EBUSY;
+    (void)process_error(p_chunk->name, ERRNUM_BUSY, "The chunks of the upload are being written, "
+                        "retry after 100 ms", pp_errinf);
+    return (*pp_errinf)->num;
+  }
+
+  // The chunk of the compressed file completes its blocks, the last one writes its index
+  if (p_sess->zip) {
+    if (zip_store_write(p_sess->zip, p_sess->fd, p_chunk->name, &p_chunk->chunk.cont, p_chunk->chunk.offs,
+                        p_chunk->chunk.last, pp_errinf) != 0) {
+      (void)remove_sess(pp_sess, 1);
+      return (*pp_errinf)->num;
+    }
+  }
+  // The chunk in the middle of the file is written by the queue of its device, the reply is deferred;
+  // the chunk to the full queue is retried by the client
+  else if (!p_chunk->chunk.last && p_chunk->chunk.offs != 0 &&
+           (queued = dev_queue_write_chunk(p_sess->dev, p_chunk->name, p_sess->fd, p_sess->fd_direct,
+                                           p_sess->large, &p_chunk->chunk.cont, p_chunk->chunk.offs,
+                                           on_written, p_sess, rqstp)) != -1) {
+    if (queued == 1)
+      return dev_queue_busy(p_chunk->name, pp_errinf);
+    p_sess->numb_writing++;
+    p_sess->tm_last = time(NULL);
+    if (end > p_sess->written)
+      p_sess->written = end;
+    return -1;
+  }
+  else if (direct_io_write(NULL, p_sess->fd, p_sess->fd_direct, p_chunk->chunk.cont.t_flcont_val,
+                           p_chunk->chunk.cont.t_flcont_len, p_chunk->chunk.offs, p_sess->large) != 0) {
+    (void)process_error(p_chunk->name, 16, "Failed to write to the file", pp_errinf);
+    (void)remove_sess(pp_sess, 1);
+    return (*pp_errinf)->num;
+  }
+  p_sess->tm_last = time(NULL);
+  if (end > p_sess->written)
+    p_sess->written = end;
+
+  // The last chunk completes the upload, the file appears under its name
+  if (p_chunk->chunk.last) {
+    if (publish_new_file(p_sess->path, p_sess->fd, p_sess->tmp, pp_errinf) != 0) {
+      (void)remove_sess(pp_sess, 1);
+      return (*pp_errinf)->num;
+    }
+    fd_cache_forget(p_sess->path); // the descriptor of a removed file of the same name
+    if (remove_sess(pp_sess, 0) != 0) {
+      (void)process_error(p_chunk->name, 12, "Failed to close the file", pp_errinf);
+      return (*pp_errinf)->num;
+    }
+    LOG(LOG_TYPE_UPLD, LOG_LEVEL_INFO, "upload was completed: %s", p_chunk->name);
+  }
+  LOG(LOG_TYPE_UPLD, LOG_LEVEL_DEBUG, "Done.");
+  return 0;
+}
@@ -0,0 +1,69 @@
+#ifndef _UPLD_SESS_H_
+#define _UPLD_SESS_H_
+
+#include <stdint.h>
+#include <sys/socket.h>
+#include <rpc/rpc.h>
+#include "../rpcgen/fltr.h"
+
+/* Write the uploaded chunk of file.
+ *
+ * The chunked Upload of a file is an upload session on the Server. The first chunk
+ * (offset 0) creates a new anonymous file preallocated to the declared size (see open_new_file())
+ * on the device the file is placed on by the storage layout (see data_dirs.h), it fails if
+ * the file already exists or another upload of the same file is in progress. The next chunks
+ * are accepted only for the files which uploads are in progress and only from the host that
+ * started the upload (the client address without the port), so neither an existing file nor
+ * the upload of another host can be modified through this function, while the connections
+ * of the host may write the chunks of the file concurrently.
+ * The first chunk is rejected if the file system has no free space for the declared file
+ * size together with the remaining data of the other uploads in progress.
+ * The chunks may be written at any offsets, except the ones of the file stored compressed
+ * (see zip_store.h): they are written in order. The chunk marked as the last one completes
+ * the upload session: the file is linked under its name, so the readers never see it incomplete.
+ * The chunks between the first & the last one of the file on a device of the storage layout
+ * are written by the queue of the device (see dev_queue.h): the reply is deferred then and
+ * any number of them may be written at once. The last chunk is answered with ERRNUM_BUSY while
+ * the chunks of its file are being written, so the file is published only when all of them are
+ * complete; the failed writing discards the upload when its other chunks are written.
+ * The chunk to the full queue of its device is answered with ERRNUM_BUSY too, it's retried.
+ * The sessions idle for more than UPLD_SESS_TIMEOUT seconds are discarded together with
+ * their incomplete files.
+ *
+ * Parameters:
+ *  p_chunk   - a pointer to the uploaded chunk of file, its data is taken if it's queued.
+ *  rqstp     - the request of the chunk, its caller is the owner of the upload.
+ *  pp_errinf - a double pointer to an `err_inf` structure for storing error information.
+ *              If an error occurs, this structure is validated and allocated if necessary,
+ *              and the error information (number and message) is saved in it.
+ *              If pp_errinf is NULL, no error info is provided.
+ *
+ * Return value:
+ *  0 on success, -1 if the chunk is queued (the RPC function returns NULL),
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int upld_sess_write(chunk_inf *p_chunk, struct svc_req *rqstp, err_inf **pp_errinf);
+
+/* Check whether the caller is on the host of the owner of the upload: the addresses are
+ * compared without the ports.
+ *
+ * Parameters:
+ *  p_owner   - a pointer to the address of the owner.
+ *  len_owner - the length of the address.
+ *  p_caller  - a pointer to the address of the caller.
+ *
+ * Return value:
+ *  1 if it's the same host, 0 otherwise.
+ */
+int upld_sess_same_host(const struct sockaddr_storage *p_owner, socklen_t len_owner,
+                        const struct netbuf *p_caller);
+
+/* Get the bytes promised to the uploads in progress: the declared file sizes minus
+ * the data already written.
+ *
+ * Return value:
+ *  The number of bytes.
+ */
+uint64_t upld_sess_pending(void);
+
+#endif
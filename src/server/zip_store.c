@@ -0,0 +1,537 @@
+/*
+ * zip_store.c: the compressed-at-rest storage of the files on the Server.
+ * Errors range: 111-114 (reserve 115)
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <zlib.h>
+
+#include "zip_store.h"
+#include "../common/file_opers.h"
+#include "../common/logging.h"
+
+extern int errno; // global system error number
+
+// The identifier & version of the compressed file format
+static const char zip_magic[8] = { 'F', 'L', 'T', 'R', 'Z', 'I', 'P', '1' };
+
+// The header of the compressed file
+struct zip_head {
+  char magic[8];
+  uint32_t block;           // uncompressed size of the blocks, the last one may be shorter
+  uint32_t numb;            // number of the blocks
+  uint64_t size;            // uncompressed size of the file
+  uint64_t offs_idx;        // offset of the index: the offsets of the blocks & the end of the last one
+};
+
+// The compressed file being written
+struct zip_writer {
+  uint32_t block;           // uncompressed size of the blocks
+  uint64_t size;            // uncompressed bytes passed
+  uint64_t end;             // end of the written blocks in the file
+  uint64_t *idx;            // the offsets of the written blocks
+  uint32_t numb, numb_max;  //   & their number, allocated number
+  char *buf;                // the incomplete block
+  size_t fill;              //   & its size
+  char *zbuf;               // the compressed block
+  uLong zlen_max;           //   & its max size
+};
+
+static const char *prefix = NULL; // the path prefix of the compressed files, NULL - none
+static size_t len_prefix;
+static uint32_t block_size = ZIP_BLOCK_DEF;
+
+// The statistics of the worker
+static unsigned long numb_files, numb_sent, numb_decomp, numb_fails;
+static unsigned long long bytes_raw, bytes_zip, bytes_sent, bytes_decomp;
+
+/* Set the compressed storage. */
+int zip_store_set(char *spec)
+{
+  char *p_block, *p_end;
+  unsigned long block;
+
+  if ( (p_block = strchr(spec, ',')) != NULL ) {
+    *p_block++ = '\0';
+    errno = 0;
+    block = strtoul(p_block, &p_end, 10);
+    if (errno || *p_end != '\0' || block < ZIP_BLOCK_MIN / 1024 || block > ZIP_BLOCK_MAX / 1024) {
+      fprintf(stderr, "!--Error 6: Invalid block size of the compressed files, KiB: %s\n\n", p_block);
+      return -1;
+    }
+    block_size = (uint32_t)block * 1024;
+  }
+  for (len_prefix = strlen(spec); len_prefix > 0 && spec[len_prefix - 1] == '/'; --len_prefix)
+    spec[len_prefix - 1] = '\0';
+  if (spec[0] != '/' || len_prefix == 0) {
+    fprintf(stderr, "!--Error 6: Invalid prefix of the compressed files, expected 'prefix[,block]': %s\n\n",
+            spec);
+    return -1;
+  }
+  prefix = spec;
+  return 0;
+}
+
+/* Check whether the uploaded file is to be stored compressed. */
+int zip_store_wanted(const char *name)
+{
+  return prefix && strncmp(name, prefix, len_prefix) == 0 && name[len_prefix] == '/';
+}
+
+/* Get the path prefix of the compressed files. */
+const char * zip_store_prefix(void)
+{
+  return prefix ? prefix : "";
+}
+
+/* Count the failure & set the error info. Return the error number */
+static int zip_error(const char *name, int num, const char *msg, err_inf **pp_errinf)
+{
+  numb_fails++;
+  (void)process_error(name, num, msg, pp_errinf);
+  LOG(LOG_TYPE_ZIP, LOG_LEVEL_ERROR, "%s: %s", msg, name);
+  return num;
+}
+
+/* Write all the bytes at the offset. Return 0 or -1 on failure */
+static int write_all(int fd, const void *buf, size_t size, uint64_t offs)
+{
+  size_t done = 0;
+  ssize_t nwr;
+
+  while (done < size) {
+    if ( (nwr = pwrite(fd, (const char *)buf + done, size - done, (off_t)(offs + done))) == -1 ) {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+    done += (size_t)nwr;
+  }
+  return 0;
+}
+
+/* Start the writing of the compressed file. */
+zip_file zip_store_open(void)
+{
+  struct zip_writer *zf = calloc(1, sizeof(struct zip_writer));
+
+  if (zf == NULL)
+    return NULL;
+  zf->block = block_size;
+  zf->end = sizeof(struct zip_head);
+  zf->zlen_max = compressBound(zf->block);
+  if ( (zf->buf = malloc(zf->block)) == NULL || (zf->zbuf = malloc(zf->zlen_max)) == NULL ) {
+    zip_store_close(zf);
+    return NULL;
+  }
+  return zf;
+}
+
+/* Free the compressed file. */
+void zip_store_close(zip_file zf)
+{
+  if (zf == NULL)
+    return;
+  free(zf->idx);
+  free(zf->buf);
+  free(zf->zbuf);
+  free(zf);
+}
+
+/* Put the offset to the index. Return 0 or -1 if the memory can't be allocated */
+static int add_offset(struct zip_writer *zf, uint64_t offs)
+{
+  uint64_t *p_new;
+  uint32_t numb;
+
+  if (zf->numb == zf->numb_max) {
+    numb = zf->numb_max ? zf->numb_max * 2 : 64;
+    if (numb <= zf->numb_max || (p_new = realloc(zf->idx, numb * sizeof(uint64_t))) == NULL)
+      return -1;
+    zf->idx = p_new;
+    zf->numb_max = numb;
+  }
+  zf->idx[zf->numb++] = offs;
+  return 0;
+}
+
+/* Compress the block & append it to the file, the block not shrunk is stored as is.
+ * Return 0 on success, >0 on failure.
+ */
+static int put_block(struct zip_writer *zf, int fd, const char *name, const char *data, size_t size,
+                     err_inf **pp_errinf)
+{
+  uLong zlen = zf->zlen_max;
+  const char *p_out = zf->zbuf;
+
+  if (compress2((Bytef *)zf->zbuf, &zlen, (const Bytef *)data, size, ZIP_LEVEL) != Z_OK || zlen >= size) {
+    p_out = data;
+    zlen = size;
+  }
+  if (add_offset(zf, zf->end) != 0) {
+    errno = 0;
+    return zip_error(name, 111, "Failed to allocate memory for the index of the compressed file", pp_errinf);
+  }
+  if (write_all(fd, p_out, zlen, zf->end) != 0)
+    return zip_error(name, 16, "Failed to write to the file", pp_errinf);
+  zf->end += zlen;
+  return 0;
+}
+
+/* Compress the uploaded data & write it to the file. */
+int zip_store_write(zip_file zf, int fd, const char *name, const t_flcont *p_flcont, uint64_t offs,
+                    int last, err_inf **pp_errinf)
+{
+  LOG(LOG_TYPE_ZIP, LOG_LEVEL_DEBUG, "Begin, file: %s, offset: %lu, size: %u",
+      name, offs, p_flcont->t_flcont_len);
+  const char *data = p_flcont->t_flcont_val;
+  size_t len = p_flcont->t_flcont_len, n;
+  struct zip_head head;
+  int rc;
+
+  if (offs != zf->size) {
+    errno = 0;
+    return zip_error(name, 114, "The chunks of the compressed file must be uploaded in order", pp_errinf);
+  }
+  zf->size += len;
+
+  // The whole blocks of the data are compressed in place, the rest is kept till the next data
+  while (len > 0) {
+    if (zf->fill == 0 && len >= zf->block) {
+      if ( (rc = put_block(zf, fd, name, data, zf->block, pp_errinf)) != 0 )
+        return rc;
+      n = zf->block;
+    }
+    else {
+      n = zf->block - zf->fill < len ? zf->block - zf->fill : len;
+      memcpy(zf->buf + zf->fill, data, n);
+      zf->fill += n;
+      if (zf->fill == zf->block) {
+        if ( (rc = put_block(zf, fd, name, zf->buf, zf->fill, pp_errinf)) != 0 )
+          return rc;
+        zf->fill = 0;
+      }
+    }
+    data += n;
+    len -= n;
+  }
+  if (!last)
+    return 0;
+
+  // The last block, the index & the header complete the file
+  if (zf->fill > 0 && (rc = put_block(zf, fd, name, zf->buf, zf->fill, pp_errinf)) != 0)
+    return rc;
+  zf->fill = 0;
+  if (add_offset(zf, zf->end) != 0) {
+    errno = 0;
+    return zip_error(name, 111, "Failed to allocate memory for the index of the compressed file", pp_errinf);
+  }
+  memcpy(head.magic, zip_magic, sizeof(head.magic));
+  head.block = zf->block;
+  head.numb = zf->numb - 1;
+  head.size = zf->size;
+  head.offs_idx = zf->end;
+  if (write_all(fd, zf->idx, zf->numb * sizeof(uint64_t), zf->end) != 0 ||
+      write_all(fd, &head, sizeof(head), 0) != 0)
+    return zip_error(name, 16, "Failed to write to the file", pp_errinf);
+  numb_files++;
+  bytes_raw += zf->size;
+  bytes_zip += zf->end + zf->numb * sizeof(uint64_t);
+  LOG(LOG_TYPE_ZIP, LOG_LEVEL_INFO, "file was compressed: %s, %lu -> %lu bytes",
+      name, zf->size, zf->end + zf->numb * sizeof(uint64_t));
+  return 0;
+}
+
+/* Save the uploaded file compressed. */
+int zip_store_save(const char *flname, const t_flcont *p_flcont, err_inf **pp_errinf)
+{
+  zip_file zf;
+  int fd, tmp, rc;
+
+  if ( (zf = zip_store_open()) == NULL ) {
+    errno = 0;
+    return zip_error(flname, 111, "Failed to allocate memory for the compressed file", pp_errinf);
+  }
+  // The compressed size is unknown, nothing is preallocated
+  if ( (fd = open_new_file(flname, 0, &tmp, pp_errinf)) == -1 ) {
+    zip_store_close(zf);
+    return (*pp_errinf)->num;
+  }
+  if ( (rc = zip_store_write(zf, fd, flname, p_flcont, 0, 1, pp_errinf)) == 0 )
+    rc = publish_new_file(flname, fd, tmp, pp_errinf);
+  if (rc != 0 && !tmp)
+    unlink(flname);
+  if (close(fd) != 0 && rc == 0)
+    rc = zip_error(flname, 12, "Failed to close the file", pp_errinf);
+  zip_store_close(zf);
+  return rc;
+}
+
+/* Open the file & read its header.
+ * Return the descriptor, -1 if the file isn't stored compressed, -2 if its header is invalid.
+ */
+static int open_zip(const char *name, const char *flname, struct zip_head *p_head)
+{
+  int fd;
+
+  if ( !zip_store_wanted(name) || (fd = open(flname, O_RDONLY | O_CLOEXEC)) == -1 )
+    return -1;
+  if (pread(fd, p_head, sizeof(struct zip_head), 0) != sizeof(struct zip_head) ||
+      memcmp(p_head->magic, zip_magic, sizeof(zip_magic)) != 0) {
+    close(fd);
+    return -1;
+  }
+  if (p_head->block < ZIP_BLOCK_MIN || p_head->block > ZIP_BLOCK_MAX || p_head->offs_idx < sizeof(struct zip_head) ||
+      p_head->numb != (p_head->size + p_head->block - 1) / p_head->block) {
+    close(fd);
+    return -2;
+  }
+  return fd;
+}
+
+/* Get the uncompressed size of the file stored compressed from its header. */
+int zip_store_size(const char *name, const char *flname, uint64_t *p_size)
+{
+  struct zip_head head;
+  int fd;
+
+  if ( (fd = open_zip(name, flname, &head)) < 0 )
+    return -1;
+  close(fd);
+  *p_size = head.size;
+  return 0;
+}
+
+/* Get the uncompressed size of the block */
+static size_t block_len(const struct zip_head *p_head, uint64_t blk)
+{
+  uint64_t offs = blk * p_head->block;
+  return p_head->size - offs < p_head->block ? (size_t)(p_head->size - offs) : p_head->block;
+}
+
+/* Read the offsets of `numb` blocks from the first one & the end of the last one, check them.
+ * Return the offsets to be freed, or NULL on failure (the error info is set).
+ */
+static uint64_t *read_index(int fd, const struct zip_head *p_head, uint64_t first, uint64_t numb,
+                            const char *name, err_inf **pp_errinf)
+{
+  size_t len = (size_t)(numb + 1) * sizeof(uint64_t);
+  uint64_t *idx = malloc(len), i;
+
+  if (idx == NULL) {
+    (void)zip_error(name, 13, "Failed to allocate memory for the file content", pp_errinf);
+    return NULL;
+  }
+  errno = 0; // the short read sets no error
+  if (pread(fd, idx, len, (off_t)(p_head->offs_idx + first * sizeof(uint64_t))) != (ssize_t)len) {
+    free(idx);
+    (void)zip_error(name, 113, "Failed to read the index of the compressed file", pp_errinf);
+    return NULL;
+  }
+  // The block is stored as is unless it shrinks, so it's never longer than uncompressed
+  for (i = 0; i < numb; ++i)
+    if (idx[i] < sizeof(struct zip_head) || idx[i + 1] <= idx[i] || idx[i + 1] > p_head->offs_idx ||
+        idx[i + 1] - idx[i] > block_len(p_head, first + i)) {
+      free(idx);
+      errno = 0;
+      (void)zip_error(name, 113, "The index of the compressed file is corrupted", pp_errinf);
+      return NULL;
+    }
+  return idx;
+}
+
+/* Read the stored blocks between the offsets into a new buffer. Return it or NULL on failure */
+static char *read_blocks(int fd, const uint64_t *idx, uint64_t numb, const char *name, err_inf **pp_errinf)
+{
+  size_t len = (size_t)(idx[numb] - idx[0]);
+  char *buf = malloc(len);
+
+  if (buf == NULL) {
+    (void)zip_error(name, 13, "Failed to allocate memory for the file content", pp_errinf);
+    return NULL;
+  }
+  errno = 0;
+  if (pread(fd, buf, len, (off_t)idx[0]) != (ssize_t)len) {
+    free(buf);
+    (void)zip_error(name, 113, "Failed to read the blocks of the compressed file", pp_errinf);
+    return NULL;
+  }
+  return buf;
+}
+
+/* Check the header read by open_zip() & the offset. Return 0 on success, >0 on failure */
+static int check_zip(int fd, const struct zip_head *p_head, uint64_t offs, const char *name, err_inf **pp_errinf)
+{
+  if (fd == -2) {
+    errno = 0;
+    return zip_error(name, 113, "The header of the compressed file is corrupted", pp_errinf);
+  }
+  if (offs > p_head->size) {
+    errno = 0;
+    return zip_error(name, 112, "Invalid offset of the file chunk", pp_errinf);
+  }
+  return 0;
+}
+
+/* Read the range of the compressed file decompressed. */
+int zip_store_read(const char *name, const char *flname, uint64_t offs, size_t size,
+                   t_flcont *p_flcont, int *p_last, err_inf **pp_errinf)
+{
+  struct zip_head head;
+  uint64_t *idx = NULL, first = 0, numb = 0, i, blk_offs;
+  char *zdata = NULL, *buf = NULL, *scratch = NULL, *dst;
+  const char *src;
+  size_t lo, hi, len_blk, len_zip;
+  uLongf len_out;
+  int fd, rc;
+
+  if ( (fd = open_zip(name, flname, &head)) == -1 )
+    return -1;
+  if ( (rc = check_zip(fd, &head, offs, name, pp_errinf)) != 0 ) {
+    if (fd >= 0)
+      close(fd);
+    return rc;
+  }
+  if (head.size - offs < size)
+    size = (size_t)(head.size - offs);
+  if ( (buf = malloc(size + 1)) == NULL ) {
+    close(fd);
+    return zip_error(name, 13, "Failed to allocate memory for the file content", pp_errinf);
+  }
+
+  // The blocks covering the range are read at once & decompressed into the content,
+  // the partly covered ones through the scratch block
+  if (size > 0) {
+    first = offs / head.block;
+    numb = (offs + size - 1) / head.block - first + 1;
+    if ( (idx = read_index(fd, &head, first, numb, name, pp_errinf)) == NULL ||
+         (zdata = read_blocks(fd, idx, numb, name, pp_errinf)) == NULL ) {
+      rc = (*pp_errinf)->num;
+      goto done;
+    }
+  }
+  for (i = 0; i < numb; ++i) {
+    blk_offs = (first + i) * head.block;
+    len_blk = block_len(&head, first + i);
+    len_zip = (size_t)(idx[i + 1] - idx[i]);
+    src = zdata + (idx[i] - idx[0]);
+    lo = offs > blk_offs ? (size_t)(offs - blk_offs) : 0;
+    hi = offs + size < blk_offs + len_blk ? (size_t)(offs + size - blk_offs) : len_blk;
+    dst = buf + (blk_offs + lo - offs);
+    if (len_zip == len_blk) {
+      memcpy(dst, src + lo, hi - lo);
+      continue;
+    }
+    if ( (lo != 0 || hi != len_blk) && scratch == NULL && (scratch = malloc(head.block)) == NULL ) {
+      rc = zip_error(name, 13, "Failed to allocate memory for the file content", pp_errinf);
+      goto done;
+    }
+    len_out = len_blk;
+    if (uncompress((Bytef *)(lo == 0 && hi == len_blk ? dst : scratch), &len_out, (const Bytef *)src,
+                   len_zip) != Z_OK || len_out != len_blk) {
+      errno = 0;
+      rc = zip_error(name, 113, "The block of the compressed file is corrupted", pp_errinf);
+      goto done;
+    }
+    if (lo != 0 || hi != len_blk)
+      memcpy(dst, scratch + lo, hi - lo);
+    numb_decomp++;
+  }
+  p_flcont->t_flcont_val = buf;
+  p_flcont->t_flcont_len = size;
+  *p_last = (offs + size >= head.size);
+  bytes_decomp += size;
+  buf = NULL;
+done:
+  free(buf);
+  free(scratch);
+  free(zdata);
+  free(idx);
+  close(fd);
+  return rc;
+}
+
+/* Read the blocks of the compressed file as they are stored. */
+int zip_store_read_blocks(const char *name, const char *flname, uint64_t offs, size_t size,
+                          block_cont *p_blks, err_inf **pp_errinf)
+{
+  struct zip_head head;
+  uint64_t *idx = NULL, first, numb, i;
+  char *zdata;
+  int fd, rc;
+
+  if ( (fd = open_zip(name, flname, &head)) == -1 )
+    return -1;
+  if ( (rc = check_zip(fd, &head, offs, name, pp_errinf)) != 0 ) {
+    if (fd >= 0)
+      close(fd);
+    return rc;
+  }
+
+  // The blocks fitting the uncompressed size, at least one, are cut to the stored size of the chunk
+  first = offs / head.block;
+  numb = size / head.block ? size / head.block : 1;
+  if (numb > head.numb - first)
+    numb = head.numb - first;
+  p_blks->offs = first * head.block;
+  p_blks->total = head.size;
+  p_blks->last = TRUE;
+  if (numb == 0) {
+    close(fd);
+    return 0;
+  }
+  if ( (idx = read_index(fd, &head, first, numb, name, pp_errinf)) == NULL ) {
+    close(fd);
+    return (*pp_errinf)->num;
+  }
+  while (numb > 1 && idx[numb] - idx[0] > LEN_CHUNK_MAX)
+    numb--;
+  if ( (zdata = read_blocks(fd, idx, numb, name, pp_errinf)) == NULL ||
+       (p_blks->blocks.blocks_val = calloc(numb, sizeof(zip_block))) == NULL ) {
+    rc = zdata ? zip_error(name, 13, "Failed to allocate memory for the file content", pp_errinf)
+               : (*pp_errinf)->num;
+    free(zdata);
+    free(idx);
+    close(fd);
+    return rc;
+  }
+  // The blocks point into the one buffer, it's freed with the first block
+  for (i = 0; i < numb; ++i) {
+    p_blks->blocks.blocks_val[i].size = (u_int)block_len(&head, first + i);
+    p_blks->blocks.blocks_val[i].cont.t_flcont_val = zdata + (idx[i] - idx[0]);
+    p_blks->blocks.blocks_val[i].cont.t_flcont_len = (u_int)(idx[i + 1] - idx[i]);
+  }
+  p_blks->blocks.blocks_len = (u_int)numb;
+  p_blks->last = (first + numb == head.numb);
+  numb_sent += numb;
+  bytes_sent += idx[numb] - idx[0];
+  free(idx);
+  close(fd);
+  return 0;
+}
+
+/* Free the blocks read by zip_store_read_blocks(). */
+void zip_store_free_blocks(block_cont *p_blks)
+{
+  if (p_blks->blocks.blocks_len > 0)
+    free(p_blks->blocks.blocks_val[0].cont.t_flcont_val);
+  free(p_blks->blocks.blocks_val);
+  p_blks->blocks.blocks_val = NULL;
+  p_blks->blocks.blocks_len = 0;
+}
+
+/* Print the statistics. */
+void zip_store_print_stats(FILE *hfile)
+{
+  if (prefix == NULL)
+    return;
+  fprintf(hfile, "Compressed storage (%s in blocks of %u bytes): files written: %lu (%llu -> %llu bytes), "
+          "blocks sent as is: %lu (%llu bytes), blocks decompressed: %lu (%llu bytes delivered), failed: %lu\n",
+          prefix, block_size, numb_files, bytes_raw, bytes_zip, numb_sent, bytes_sent, numb_decomp,
+          bytes_decomp, numb_fails);
+}
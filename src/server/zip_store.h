@@ -0,0 +1,178 @@
+#ifndef _ZIP_STORE_H_
+#define _ZIP_STORE_H_
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include "../rpcgen/fltr.h"
+
+/*
+ * The compressed-at-rest storage of the files on the Server.
+ *
+ * The files uploaded under the zip prefix are stored compressed by zlib in the blocks of
+ * the same uncompressed size, each of them is decoded independently. The file is:
+ *   the header - the magic, the block size, the number of the blocks, the uncompressed size
+ *                & the offset of the index;
+ *   the blocks - compressed, or as is if they don't shrink;
+ *   the index  - the offsets of the blocks in the file & the end of the last one,
+ * so any range of the file is read by the blocks covering it. The index follows the blocks,
+ * so the file is written in one pass without knowing its size, the header is written last.
+ *
+ * The clients supporting the compression download the blocks as they are stored (see
+ * download_blocks), the Server neither decompresses nor compresses them again; the whole-file
+ * & the chunk Downloads get the decompressed content. The files uploaded before the prefix
+ * was set, the packed ones & the ones of the backends are stored & downloaded as usual.
+ * The listings show the stored sizes of the files.
+ */
+
+// Default uncompressed size of the block, bytes
+enum { ZIP_BLOCK_DEF = 262144 };
+
+// Min & max uncompressed size of the block, bytes
+enum { ZIP_BLOCK_MIN = 4096, ZIP_BLOCK_MAX = LEN_CHUNK_MAX };
+
+// The zlib compression level of the blocks
+enum { ZIP_LEVEL = 6 };
+
+// The compressed file being written
+typedef struct zip_writer *zip_file;
+
+/* Set the compressed storage: the path prefix of the compressed files & the block size.
+ *
+ * Parameters:
+ *  spec - the storage 'prefix[,block]': the files uploaded under the path prefix are stored
+ *         compressed in the blocks of `block` KiB (default: ZIP_BLOCK_DEF bytes);
+ *         it's modified by the parsing & must be kept.
+ *
+ * Return value:
+ *  0 on success, -1 if the storage is invalid (the error is printed to STDERR).
+ */
+int zip_store_set(char *spec);
+
+/* Check whether the uploaded file is to be stored compressed.
+ *
+ * Parameters:
+ *  name - the path of the file.
+ *
+ * Return value:
+ *  1 if the file is under the zip prefix, 0 otherwise.
+ */
+int zip_store_wanted(const char *name);
+
+/* Get the path prefix of the compressed files, advertised to the clients by zip_prefix.
+ *
+ * Return value:
+ *  The prefix without the trailing '/', "" if the compressed storage isn't set.
+ */
+const char * zip_store_prefix(void);
+
+/* Start the writing of the compressed file.
+ *
+ * Return value:
+ *  The compressed file, NULL if the memory can't be allocated.
+ */
+zip_file zip_store_open(void);
+
+/* Compress the uploaded data & write it to the file created by open_new_file().
+ * The data is passed sequentially: the incomplete block is kept till the next data.
+ * The last data completes the file: the index & the header are written.
+ *
+ * Parameters:
+ *  zf        - the compressed file.
+ *  fd        - the descriptor of the file being written.
+ *  name      - the name of the file, for the errors.
+ *  p_flcont  - a pointer to the uploaded data.
+ *  offs      - the uncompressed offset of the data, it must follow the previous data.
+ *  last      - 1 if it's the last data of the file.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int zip_store_write(zip_file zf, int fd, const char *name, const t_flcont *p_flcont, uint64_t offs,
+                    int last, err_inf **pp_errinf);
+
+/* Free the compressed file, the descriptor isn't closed.
+ *
+ * Parameters:
+ *  zf - the compressed file, may be NULL.
+ */
+void zip_store_close(zip_file zf);
+
+/* Save the uploaded file compressed as save_file_cont().
+ *
+ * Parameters:
+ *  flname    - the path of the new file.
+ *  p_flcont  - a pointer to the file content.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int zip_store_save(const char *flname, const t_flcont *p_flcont, err_inf **pp_errinf);
+
+/* Read the range of the compressed file decompressed, as pread_file_chunk().
+ *
+ * Parameters:
+ *  name      - the name of the file.
+ *  flname    - the path of the file.
+ *  offs      - the uncompressed offset of the range.
+ *  size      - the max size of the range.
+ *  p_flcont  - a pointer to the content to be set, it must be empty.
+ *  p_last    - a pointer to a flag set to 1 if the range reaches the end of file, 0 otherwise.
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the file isn't stored compressed,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int zip_store_read(const char *name, const char *flname, uint64_t offs, size_t size,
+                   t_flcont *p_flcont, int *p_last, err_inf **pp_errinf);
+
+/* Get the uncompressed size of the file stored compressed from its header.
+ *
+ * Parameters:
+ *  name   - the name of the file.
+ *  flname - the path of the file.
+ *  p_size - a pointer to the size to be set.
+ *
+ * Return value:
+ *  0 on success, -1 if the file isn't stored compressed or its header is invalid.
+ */
+int zip_store_size(const char *name, const char *flname, uint64_t *p_size);
+
+/* Read the blocks of the compressed file as they are stored.
+ * The blocks from the one containing the offset are read while their uncompressed size
+ * fits the passed size and their stored size fits LEN_CHUNK_MAX, at least one block is read.
+ *
+ * Parameters:
+ *  name      - the name of the file.
+ *  flname    - the path of the file.
+ *  offs      - the uncompressed offset in the first block.
+ *  size      - the max uncompressed size of the blocks.
+ *  p_blks    - a pointer to the blocks to be set, they must be freed by zip_store_free_blocks().
+ *  pp_errinf - a double pointer to an error info structure to store error information.
+ *
+ * Return value:
+ *  0 on success, -1 if the file isn't stored compressed,
+ *  >0 on failure (error code is stored in `(*pp_errinf)->num`).
+ */
+int zip_store_read_blocks(const char *name, const char *flname, uint64_t offs, size_t size,
+                          block_cont *p_blks, err_inf **pp_errinf);
+
+/* Free the blocks read by zip_store_read_blocks().
+ *
+ * Parameters:
+ *  p_blks - a pointer to the blocks.
+ */
+void zip_store_free_blocks(block_cont *p_blks);
+
+/* Print the statistics: the compressed & uncompressed bytes written, the blocks sent as is
+ * & the decompressed ones.
+ *
+ * Parameters:
+ *  hfile - the stream to print to.
+ */
+void zip_store_print_stats(FILE *hfile);
+
+#endif
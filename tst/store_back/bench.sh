@@ -0,0 +1,70 @@
+#!/bin/bash
+# Compare the Upload & Download of the files through the storage backends & the native path:
+#   mem    - the server with -b /x=mem,ttl,max, the files are kept in its memory;
+#   posix  - the server with -b /x=posix:dir, the files of the directory through plain system calls;
+#   native - the server without the mounts, the files of the same directory's file system with
+#            the caches, the read-ahead & the rest of the native path.
+# Each mode runs its own server on the port, the files are transferred by the client one by one.
+#
+# Usage: bench.sh [bin_dir [numb_files [size_KiB [port]]]]
+#   bin_dir    - the directory of prg_serv & prg_clnt (default: ../../bin/release)
+#   numb_files - the number of the files of each mode (default: 20)
+#   size_KiB   - the size of each file (default: 4096)
+#   port       - the port of the server (default: 20090)
+
+BIN=${1:-../../bin/release}
+NUMB=${2:-20}
+SIZE=${3:-4096}
+PORT=${4:-20090}
+
+for prg in prg_serv prg_clnt; do
+  if [ ! -x "$BIN/$prg" ]; then
+    echo "!--Error: $BIN/$prg is not built" >&2
+    exit 1
+  fi
+done
+
+DIR=$(mktemp -d /tmp/store_back_bench.XXXXXX) || exit 1
+trap 'kill $PID 2>/dev/null; wait $PID 2>/dev/null; rm -rf "$DIR"' EXIT
+mkdir -p "$DIR/src" "$DIR/dst" "$DIR/posix" "$DIR/native"
+for ((i = 0; i < NUMB; ++i)); do
+  head -c $((SIZE * 1024)) /dev/urandom > "$DIR/src/f$i"
+done
+MEM_MAX=$(( (NUMB * SIZE / 1024 + 1) * 2 ))
+
+# Time of the command in microseconds
+now() { date +%s%6N; }
+
+# Run the mode: its name, the remote directory of the files & the options of the server
+run_mode() {
+  local mode=$1 rdir=$2 beg mid end i
+  shift 2
+  "$BIN/prg_serv" -p $PORT "$@" >"$DIR/serv_$mode.log" 2>&1 &
+  PID=$!
+  sleep 0.5
+
+  beg=$(now)
+  for ((i = 0; i < NUMB; ++i)); do
+    "$BIN/prg_clnt" -u localhost:$PORT "$DIR/src/f$i" "$rdir/f$i" >/dev/null || echo "$mode: upload f$i failed" >&2
+  done
+  mid=$(now)
+  for ((i = 0; i < NUMB; ++i)); do
+    rm -f "$DIR/dst/f$i"
+    "$BIN/prg_clnt" -d localhost:$PORT "$rdir/f$i" "$DIR/dst/f$i" >/dev/null || echo "$mode: download f$i failed" >&2
+  done
+  end=$(now)
+  for ((i = 0; i < NUMB; ++i)); do
+    cmp -s "$DIR/src/f$i" "$DIR/dst/f$i" || echo "$mode: f$i differs" >&2
+  done
+
+  kill $PID; wait $PID 2>/dev/null
+  awk -v m=$mode -v n=$NUMB -v s=$SIZE -v u=$((mid - beg)) -v d=$((end - mid)) 'BEGIN {
+    mib = n * s / 1024;
+    printf "%-7s upload: %8.1f ms %8.1f MiB/s   download: %8.1f ms %8.1f MiB/s\n",
+           m, u / 1000, mib / (u / 1e6), d / 1000, mib / (d / 1e6) }'
+}
+
+echo "$NUMB files of $SIZE KiB each"
+run_mode mem /x -b /x=mem,3600,$MEM_MAX
+run_mode posix /x -b /x=posix:"$DIR/posix"
+run_mode native "$DIR/native"
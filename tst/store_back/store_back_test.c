@@ -0,0 +1,297 @@
+/*
+ * store_back_test.c: the test of the storage backends of the Server (see src/server/store_back.h).
+ *
+ * The operations of both backends are run directly: open, pwrite, pread, stat, list & commit,
+ * with the publishing & the discarding of the created files; the memory backend is also checked
+ * for the expiry by the time to live & for its memory limit. Then the backends are mounted &
+ * the files are saved, loaded & uploaded by the chunks as the Server does.
+ * The files of the 'posix' backend are made in a temporary directory, it's removed at the end.
+ *
+ * Usage: store_back_test
+ * The exit status is the number of the failed checks.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+
+#include "store_back.h"
+#include "../common/mem_opers.h"
+
+static int numb_checks = 0, numb_failed = 0;
+
+// Check the condition, print the failed one
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static void check(int ok, const char *text, int line)
+{
+  numb_checks++;
+  if (!ok) {
+    numb_failed++;
+    fprintf(stderr, "FAILED (line %d): %s\n", line, text);
+  }
+}
+
+/* Find the entry of the listing by its name, return its index or -1 */
+static int find_entry(const struct ls_entries *p_ents, const char *name)
+{
+  size_t i;
+  for (i = 0; i < p_ents->numb; ++i)
+    if (strcmp(p_ents->names + p_ents->items[i].offs_name, name) == 0)
+      return (int)i;
+  return -1;
+}
+
+/* Run the operations of the backend on the mount: the files are created in the directory 'd' */
+static void test_operations(const struct store_back *p_back, void *ctx)
+{
+  struct ls_entries ents;
+  struct stat statbuf;
+  char buf[32];
+  sb_file file;
+  int i;
+
+  printf("%s: open, pwrite, pread, stat, list, commit\n", p_back->name);
+
+  // The created file is written out of order & published
+  CHECK( (file = p_back->open(ctx, "/d/f1", 1, 10)) != NULL );
+  if (file == NULL)
+    return;
+  CHECK( p_back->pwrite(file, "world", 5, 5) == 5 );
+  CHECK( p_back->pwrite(file, "hello", 5, 0) == 5 );
+  CHECK( p_back->commit(file, 1) == 0 );
+
+  // The name of the published file is taken
+  errno = 0;
+  CHECK( p_back->open(ctx, "/d/f1", 1, 0) == NULL && errno == EEXIST );
+
+  // The published file is read: the whole, the tail, past the end
+  CHECK( (file = p_back->open(ctx, "/d/f1", 0, 0)) != NULL );
+  if (file) {
+    memset(buf, 0, sizeof(buf));
+    CHECK( p_back->pread(file, buf, sizeof(buf), 0) == 10 && memcmp(buf, "helloworld", 10) == 0 );
+    CHECK( p_back->pread(file, buf, sizeof(buf), 7) == 3 && memcmp(buf, "rld", 3) == 0 );
+    CHECK( p_back->pread(file, buf, sizeof(buf), 10) == 0 );
+    CHECK( p_back->commit(file, 0) == 0 ); // the opened file is only closed
+  }
+  CHECK( p_back->stat(ctx, "/d/f1", &statbuf) == 0 && S_ISREG(statbuf.st_mode) && statbuf.st_size == 10 );
+  CHECK( p_back->stat(ctx, "/d", &statbuf) == 0 && S_ISDIR(statbuf.st_mode) );
+
+  // The discarded file is neither seen nor kept, its name is free again
+  CHECK( (file = p_back->open(ctx, "/d/f2", 1, 4)) != NULL );
+  if (file) {
+    CHECK( p_back->pwrite(file, "lost", 4, 0) == 4 );
+    CHECK( p_back->commit(file, 0) == 0 );
+  }
+  errno = 0;
+  CHECK( p_back->stat(ctx, "/d/f2", &statbuf) == -1 && errno == ENOENT );
+  CHECK( p_back->open(ctx, "/d/f2", 0, 0) == NULL );
+  CHECK( (file = p_back->open(ctx, "/d/f2", 1, 0)) != NULL );
+  if (file)
+    CHECK( p_back->commit(file, 0) == 0 );
+
+  // The directory lists the published file only, the root lists the directory
+  memset(&ents, 0, sizeof(ents));
+  CHECK( p_back->list(ctx, "/d", &ents) == 0 );
+  CHECK( (i = find_entry(&ents, "f1")) >= 0 && S_ISREG(ents.items[i].mode) && ents.items[i].size == 10 );
+  CHECK( find_entry(&ents, "f2") == -1 );
+  free_dir_entries(&ents);
+  memset(&ents, 0, sizeof(ents));
+  CHECK( p_back->list(ctx, "", &ents) == 0 );
+  CHECK( (i = find_entry(&ents, "d")) >= 0 && S_ISDIR(ents.items[i].mode) );
+  free_dir_entries(&ents);
+  memset(&ents, 0, sizeof(ents));
+  CHECK( p_back->list(ctx, "/none", &ents) != 0 );
+  free_dir_entries(&ents);
+}
+
+/* Check the files of the memory backend being written are invisible & expire only when complete */
+static void test_mem_ttl(void)
+{
+  struct stat statbuf;
+  sb_file file, file_open;
+  void *ctx;
+  char arg[] = "1";
+
+  printf("mem: time to live\n");
+  CHECK( store_back_mem.mount(arg, &ctx) == 0 );
+  CHECK( (file = store_back_mem.open(ctx, "/old", 1, 3)) != NULL );
+  if (file == NULL)
+    return;
+  CHECK( store_back_mem.pwrite(file, "old", 3, 0) == 3 );
+  CHECK( store_back_mem.commit(file, 1) == 0 );
+  CHECK( (file_open = store_back_mem.open(ctx, "/open", 1, 0)) != NULL );
+  CHECK( store_back_mem.stat(ctx, "/open", &statbuf) == -1 ); // invisible till it's committed
+
+  // The expired files are removed by the next operation (once a second at most)
+  sleep(3);
+  errno = 0;
+  CHECK( store_back_mem.open(ctx, "/old", 0, 0) == NULL && errno == ENOENT );
+  CHECK( store_back_mem.stat(ctx, "/old", &statbuf) == -1 );
+
+  // The file being written isn't expired
+  if (file_open) {
+    CHECK( store_back_mem.pwrite(file_open, "new", 3, 0) == 3 );
+    CHECK( store_back_mem.commit(file_open, 1) == 0 );
+    CHECK( store_back_mem.stat(ctx, "/open", &statbuf) == 0 && statbuf.st_size == 3 );
+  }
+}
+
+/* Check the limit of the memory backend: the files beyond it are rejected, the discarded ones
+ * free their memory */
+static void test_mem_max(void)
+{
+  static char data[700 * 1024];
+  sb_file file, file2;
+  void *ctx;
+  char arg[] = "60,1"; // 1 MiB
+
+  printf("mem: memory limit\n");
+  CHECK( store_back_mem.mount(arg, &ctx) == 0 );
+  CHECK( (file = store_back_mem.open(ctx, "/a", 1, sizeof(data))) != NULL );
+  if (file == NULL)
+    return;
+  CHECK( store_back_mem.pwrite(file, data, sizeof(data), 0) == (ssize_t)sizeof(data) );
+
+  // The declared size doesn't fit
+  errno = 0;
+  CHECK( store_back_mem.open(ctx, "/b", 1, sizeof(data)) == NULL && errno == ENOSPC );
+
+  // The file growing beyond the limit is rejected
+  CHECK( (file2 = store_back_mem.open(ctx, "/c", 1, 0)) != NULL );
+  if (file2) {
+    errno = 0;
+    CHECK( store_back_mem.pwrite(file2, data, sizeof(data), 0) == -1 && errno == ENOSPC );
+    CHECK( store_back_mem.commit(file2, 0) == 0 );
+  }
+
+  // The memory of the discarded file is free again
+  CHECK( store_back_mem.commit(file, 0) == 0 );
+  CHECK( (file = store_back_mem.open(ctx, "/b", 1, sizeof(data))) != NULL );
+  if (file)
+    CHECK( store_back_mem.commit(file, 1) == 0 );
+
+  // The invalid arguments aren't mounted
+  strcpy(arg, "0");
+  CHECK( store_back_mem.mount(arg, &ctx) != 0 );
+  strcpy(arg, "1,x");
+  CHECK( store_back_mem.mount(arg, &ctx) != 0 );
+}
+
+/* Save, load & upload by the chunks the file of the mount as the Server does */
+static void test_mount(const char *prefix)
+{
+  static err_inf err;
+  static char data[3000];
+  err_inf *p_err = &err;
+  struct ls_entries ents;
+  char path[LEN_PATH_MAX + 1], name[64];
+  const char *flname;
+  t_flcont cont = { sizeof(data), data }, cont_read;
+  chunk_inf chunk;
+  struct sockaddr_in addr1 = { .sin_family = AF_INET, .sin_port = 1000 }, addr2 = addr1;
+  struct netbuf caller1 = { sizeof(addr1), sizeof(addr1), &addr1 }, caller2 = { sizeof(addr2), sizeof(addr2), &addr2 };
+  int last;
+  size_t i;
+
+  printf("mount %s: save, load, chunks, list\n", prefix);
+  for (i = 0; i < sizeof(data); ++i)
+    data[i] = (char)i;
+  addr2.sin_port = 1001; // another connection of the same host
+  CHECK( reset_err_inf(&err) == 0 );
+
+  // The whole file
+  snprintf(name, sizeof(name), "%s/d/whole", prefix);
+  CHECK( store_back_fs_path(name, path, &flname) == 0 );
+  CHECK( store_back_save(name, &cont, &p_err) == 0 );
+  CHECK( store_back_save(name, &cont, &p_err) == 106 ); // it exists
+  memset(&cont_read, 0, sizeof(cont_read));
+  CHECK( store_back_load(name, &cont_read, &p_err) == 0 && cont_read.t_flcont_len == sizeof(data) &&
+         memcmp(cont_read.t_flcont_val, data, sizeof(data)) == 0 );
+  free(cont_read.t_flcont_val);
+
+  // The chunks: the first one creates the file, the last one publishes it, the upload is
+  // continued only by its client
+  snprintf(name, sizeof(name), "%s/d/chunked", prefix);
+  memset(&chunk, 0, sizeof(chunk));
+  chunk.name = name;
+  chunk.size = sizeof(data);
+  chunk.chunk.offs = 1000;
+  chunk.chunk.cont.t_flcont_val = data + 1000;
+  chunk.chunk.cont.t_flcont_len = 1000;
+  CHECK( store_back_write_chunk(&chunk, &caller1, &p_err) == 109 ); // no upload is in progress
+  chunk.chunk.offs = 0;
+  chunk.chunk.cont.t_flcont_val = data;
+  CHECK( store_back_write_chunk(&chunk, &caller1, &p_err) == 0 );
+  CHECK( store_back_write_chunk(&chunk, &caller1, &p_err) == 109 ); // the upload is in progress
+  CHECK( store_back_write_chunk(&chunk, &caller2, &p_err) == 109 );
+  memset(&cont_read, 0, sizeof(cont_read));
+  CHECK( store_back_load(name, &cont_read, &p_err) == 106 ); // it's invisible yet
+  chunk.chunk.offs = 1000;
+  chunk.chunk.cont.t_flcont_val = data + 1000;
+  chunk.chunk.cont.t_flcont_len = 2000;
+  chunk.chunk.last = 1;
+  CHECK( store_back_write_chunk(&chunk, &caller2, &p_err) == 109 ); // the upload of another client
+  CHECK( store_back_write_chunk(&chunk, &caller1, &p_err) == 0 );
+  memset(&cont_read, 0, sizeof(cont_read));
+  CHECK( store_back_read_chunk(name, 2500, 1000, &cont_read, &last, &p_err) == 0 &&
+         cont_read.t_flcont_len == 500 && last && memcmp(cont_read.t_flcont_val, data + 2500, 500) == 0 );
+  free(cont_read.t_flcont_val);
+  memset(&cont_read, 0, sizeof(cont_read));
+  CHECK( store_back_read_chunk(name, 4000, 1000, &cont_read, &last, &p_err) == 107 );
+
+  snprintf(name, sizeof(name), "%s/d", prefix);
+  CHECK( store_back_list(name, &ents) == 0 && find_entry(&ents, "whole") >= 0 && find_entry(&ents, "chunked") >= 0 );
+  free_dir_entries(&ents);
+
+  // The paths outside the mounts aren't served
+  CHECK( store_back_fs_path("/unmounted/f", path, &flname) == -1 );
+  CHECK( store_back_save("/unmounted/f", &cont, &p_err) == -1 );
+  free_err_inf(&err);
+}
+
+int main(void)
+{
+  char dir[] = "/tmp/store_back_test.XXXXXX", sub[sizeof(dir) + 8], spec_posix[sizeof(dir) + 32],
+       spec_mem[] = "/m=mem", path[LEN_PATH_MAX + 1], cmd[sizeof(dir) + 16];
+  const char *flname;
+  void *ctx;
+
+  if (mkdtemp(dir) == NULL) {
+    perror("mkdtemp");
+    return 1;
+  }
+  snprintf(sub, sizeof(sub), "%s/d", dir);
+  CHECK( mkdir(sub, 0755) == 0 );
+
+  // The operations of the backends
+  CHECK( store_back_posix.mount(dir, &ctx) == 0 );
+  test_operations(&store_back_posix, ctx);
+  CHECK( store_back_posix.mount("/nonexistent/dir", &ctx) != 0 );
+  CHECK( store_back_mem.mount(NULL, &ctx) == 0 );
+  test_operations(&store_back_mem, ctx);
+  test_mem_ttl();
+  test_mem_max();
+
+  // The mounts: the posix one is in the file system, the memory one isn't
+  snprintf(spec_posix, sizeof(spec_posix), "/x/=posix:%s", dir);
+  CHECK( store_back_mount(spec_posix) == 0 );
+  CHECK( store_back_mount(spec_mem) == 0 );
+  CHECK( store_back_in_memory() == 1 );
+  CHECK( store_back_fs_path("/x/d/f1", path, &flname) == 0 && flname != NULL &&
+         strcmp(flname, sub) > 0 && strncmp(flname, sub, strlen(sub)) == 0 );
+  CHECK( store_back_fs_path("/m/f1", path, &flname) == 0 && flname == NULL );
+  test_mount("/x");
+  test_mount("/m");
+
+  store_back_print_stats(stdout);
+  snprintf(cmd, sizeof(cmd), "rm -rf %s", dir);
+  if (system(cmd) != 0)
+    fprintf(stderr, "The directory isn't removed: %s\n", dir);
+  printf("%d checks, %d failed\n", numb_checks, numb_failed);
+  return numb_failed;
+}